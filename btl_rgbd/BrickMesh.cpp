@@ -0,0 +1,225 @@
+//boost
+#include <boost/shared_ptr.hpp>
+//stl
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <math.h>
+//opencv
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/internal.hpp>
+//eigen
+#include <Eigen/Core>
+//self
+#include "OtherUtil.hpp"
+#include "CpuLib.h"
+#include "BrickMesh.h"
+
+//the marching cubes tables of MarchingCubs.cpp
+extern const int edgeTable[256];
+extern const int triTable[256][16];
+extern const int numVertsTable[256];
+
+namespace btl{ namespace geometry
+{
+
+//the corners and edges of pcl::device::TrianglesGenerator
+static const int _anCorner[8][3] = { {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0}, {0,0,1}, {1,0,1}, {1,1,1}, {0,1,1} };
+static const int _anEdge[12][2] = { {0,1}, {1,2}, {2,3}, {3,0}, {4,5}, {5,6}, {6,7}, {7,4}, {0,4}, {1,5}, {2,6}, {3,7} };
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//meshes each listed brick from scratch: a vertex on every edge from an observed voxel of the brick to its observed
+//upper neighbour along x, y or z where the tsdf changes sign, then the triangles of the cells whose first corner is in
+//the brick, skipping the cells with an unobserved corner as CMarchingCubesBlocks. bricks whose min/max show no sign
+//change are emptied without visiting their voxels
+class CMeshBricks : public cv::ParallelLoopBody
+{
+public:
+	CMeshBricks(const cv::Mat& cvmVolume_, const int* pnOrigin_, const float fVoxelSizeM_, const cv::Mat& cvmMinMax_, const std::vector<int>& vnBricks_,
+		const int nBrick_, const int nSide_, std::vector<CBrickMesh::SBrick>* pvBricks_)
+	:_cvmVolume(cvmVolume_),_fVoxelSizeM(fVoxelSizeM_),_cvmMinMax(cvmMinMax_),_vnBricks(vnBricks_),_nBrick(nBrick_),_nSide(nSide_),_pvBricks(pvBricks_){
+		_nRes = cvmVolume_.cols;
+		for (int i = 0; i < 3; i++) { _anOrigin[i] = pnOrigin_[i]; _anShift[i] = ( pnOrigin_[i] % _nRes + _nRes ) % _nRes; }
+	}
+	virtual void operator()(const cv::Range& sRange_) const{
+		const int B = _nBrick;
+		const float fS = _fVoxelSizeM;
+		for (int i = sRange_.start; i < sRange_.end; i++){
+			const int n = _vnBricks[i];
+			const int b[3] = { n % _nSide, n / _nSide % _nSide, n / (_nSide*_nSide) };
+			CBrickMesh::SBrick& sBrick = (*_pvBricks)[n];
+			sBrick._vVertices.clear();
+			sBrick._vusEdges.clear();
+			sBrick._vuCorners.clear();
+			const float* pMinMax = _cvmMinMax.ptr<float>( b[2]*_nSide + b[1] ) + 2*b[0];
+			if (!(pMinMax[0] < 0.f && pMinMax[1] >= 0.f)) continue;
+			const int anEnd[3] = { std::min( _nRes, (b[0]+1)*B ), std::min( _nRes, (b[1]+1)*B ), std::min( _nRes, (b[2]+1)*B ) };
+			//the vertices of the brick
+			for (int z = b[2]*B; z < anEnd[2]; z++)
+			for (int y = b[1]*B; y < anEnd[1]; y++)
+			for (int x = b[0]*B; x < anEnd[0]; x++){
+				const short* pV = voxel(x,y,z);
+				if (0 == pV[1]) continue;
+				const float f0 = pV[0]/32767.f;
+				for (int a = 0; a < 3; a++){
+					const int v[3] = { x + int(0 == a), y + int(1 == a), z + int(2 == a) };
+					if (v[a] >= _nRes) continue;
+					const short* pW = voxel(v[0],v[1],v[2]);
+					if (0 == pW[1]) continue;
+					const float f1 = pW[0]/32767.f;
+					if ((f0 < 0.f) == (f1 < 0.f)) continue;
+					const float t = -f0/(f1 - f0 + 1e-15f);
+					float af[3] = { x + .5f, y + .5f, z + .5f };
+					af[a] += t;
+					sBrick._vVertices.push_back( Eigen::Vector3f( (_anOrigin[0] + af[0])*fS, (_anOrigin[1] + af[1])*fS, (_anOrigin[2] + af[2])*fS ) );
+					sBrick._vusEdges.push_back( (unsigned short)( ( ( (z - b[2]*B)*B + (y - b[1]*B) )*B + (x - b[0]*B) )*3 + a ) );
+				}
+			}//for each voxel
+			//the triangles of the cells
+			for (int z = b[2]*B; z < std::min( anEnd[2], _nRes-1 ); z++)
+			for (int y = b[1]*B; y < std::min( anEnd[1], _nRes-1 ); y++)
+			for (int x = b[0]*B; x < std::min( anEnd[0], _nRes-1 ); x++){
+				int nCube = 0, c = 0;
+				for (; c < 8; c++){
+					const short* pV = voxel( x + _anCorner[c][0], y + _anCorner[c][1], z + _anCorner[c][2] );
+					if (0 == pV[1]) break;
+					nCube |= int(pV[0] < 0) << c;
+				}
+				if (c < 8 || 0 == edgeTable[nCube]) continue;
+				for (int k = 0; k < numVertsTable[nCube]; k++){
+					//the edge by its lower corner and its axis, in the brick that holds the lower corner
+					const int* p0 = _anCorner[ _anEdge[ triTable[nCube][k] ][0] ];
+					const int* p1 = _anCorner[ _anEdge[ triTable[nCube][k] ][1] ];
+					const int a = p0[0] != p1[0] ? 0 : p0[1] != p1[1] ? 1 : 2;
+					const int u[3] = { x + std::min( p0[0], p1[0] ), y + std::min( p0[1], p1[1] ), z + std::min( p0[2], p1[2] ) };
+					const int d[3] = { u[0]/B - b[0], u[1]/B - b[1], u[2]/B - b[2] };
+					const unsigned int uEdge = ( ( (u[2] - (b[2]+d[2])*B)*B + (u[1] - (b[1]+d[1])*B) )*B + (u[0] - (b[0]+d[0])*B) )*3 + a;
+					sBrick._vuCorners.push_back( (unsigned int)( d[0] | d[1] << 1 | d[2] << 2 ) << 16 | uEdge );
+				}
+			}//for each cell
+		}//for each brick
+	}
+private:
+	//voxel n of the volume, n in [0,_nRes)
+	inline const short* voxel(const int nX_, const int nY_, const int nZ_) const{
+		const int x = nX_ + _anShift[0], y = nY_ + _anShift[1], z = nZ_ + _anShift[2];
+		return _cvmVolume.ptr<short>( (z - (z >= _nRes ? _nRes : 0))*_nRes + y - (y >= _nRes ? _nRes : 0) ) + 2*(x - (x >= _nRes ? _nRes : 0));
+	}
+	const cv::Mat& _cvmVolume;
+	float _fVoxelSizeM;
+	const cv::Mat& _cvmMinMax;
+	const std::vector<int>& _vnBricks;
+	int _nBrick, _nSide, _nRes;
+	int _anOrigin[3], _anShift[3];
+	std::vector<CBrickMesh::SBrick>* _pvBricks;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//gathers the vertices of each brick at its offset and turns the corners into indices, looking the edges up among the
+//vertices of the brick they belong to
+class CIndexBricks : public cv::ParallelLoopBody
+{
+public:
+	CIndexBricks(const std::vector<CBrickMesh::SBrick>& vBricks_, const int nSide_, const std::vector<unsigned int>& vuVertexOffsets_,
+		const std::vector<unsigned int>& vuCornerOffsets_, std::vector<Eigen::Vector3f>* pvVertices_, std::vector<unsigned int>* pvIndices_)
+	:_vBricks(vBricks_),_nSide(nSide_),_vuVertexOffsets(vuVertexOffsets_),_vuCornerOffsets(vuCornerOffsets_),_pvVertices(pvVertices_),_pvIndices(pvIndices_){}
+	virtual void operator()(const cv::Range& sBricks_) const{
+		for (int n = sBricks_.start; n < sBricks_.end; n++){
+			const CBrickMesh::SBrick& sBrick = _vBricks[n];
+			std::copy( sBrick._vVertices.begin(), sBrick._vVertices.end(), _pvVertices->begin() + _vuVertexOffsets[n] );
+			unsigned int* pIndex = &(*_pvIndices)[0] + _vuCornerOffsets[n];
+			for (size_t t = 0; t < sBrick._vuCorners.size(); t += 3, pIndex += 3){
+				bool abFound[3] = { false, false, false };
+				int nFound = -1;
+				for (int k = 0; k < 3; k++){
+					const unsigned int uCorner = sBrick._vuCorners[t+k], uSlot = uCorner >> 16;
+					const int m = n + int(uSlot & 1) + int(uSlot >> 1 & 1)*_nSide + int(uSlot >> 2)*_nSide*_nSide;
+					const std::vector<unsigned short>& vusEdges = _vBricks[m]._vusEdges;
+					const std::vector<unsigned short>::const_iterator it = std::lower_bound( vusEdges.begin(), vusEdges.end(), (unsigned short)(uCorner & 0xffff) );
+					if (it == vusEdges.end() || *it != (uCorner & 0xffff)) continue;
+					pIndex[k] = _vuVertexOffsets[m] + unsigned(it - vusEdges.begin());
+					abFound[k] = true;
+					nFound = k;
+				}
+				//cannot happen as the bricks around a changed voxel are re-meshed together, a degenerate triangle keeps the
+				//indices valid nonetheless
+				for (int k = 0; k < 3; k++)
+					if (!abFound[k]) pIndex[k] = nFound >= 0 ? pIndex[nFound] : 0;
+			}//for each triangle
+		}//for each brick
+	}
+private:
+	const std::vector<CBrickMesh::SBrick>& _vBricks;
+	int _nSide;
+	const std::vector<unsigned int>& _vuVertexOffsets;
+	const std::vector<unsigned int>& _vuCornerOffsets;
+	std::vector<Eigen::Vector3f>* _pvVertices;
+	std::vector<unsigned int>* _pvIndices;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+CBrickMesh::CBrickMesh(int nBrick_)
+:_nBrick(nBrick_)
+{
+	reset();
+}
+void CBrickMesh::reset(){
+	_vBricks.clear();
+	_nSide = 0;
+	_anOrigin[0] = _anOrigin[1] = _anOrigin[2] = 0;
+	_fVoxelSizeM = 0.f;
+}
+unsigned int CBrickMesh::vertices() const{
+	size_t uTotal = 0;
+	for (size_t n = 0; n < _vBricks.size(); n++) uTotal += _vBricks[n]._vVertices.size();
+	return (unsigned int)uTotal;
+}
+
+void CBrickMesh::update(const cv::Mat& cvmVolume_, const int* pnOrigin_, float fVoxelSizeM_, const cv::Mat& cvmMinMax_, cv::Mat* pcvmDirty_){
+	const int nSide = pcvmDirty_->cols;
+	BTL_ASSERT( CV_8UC1 == pcvmDirty_->type() && pcvmDirty_->rows == nSide*nSide && nSide == (cvmVolume_.cols + _nBrick - 1)/_nBrick, "CBrickMesh::update() the flags must be a y*z x x CV_8UC1 cube of the bricks" );
+	BTL_ASSERT( CV_32FC2 == cvmMinMax_.type() && cvmMinMax_.cols == nSide, "CBrickMesh::update() the min/max must be level 0 of the same bricks" );
+	//the cached vertices are in world and the edges are counted from the origin
+	const bool bAll = nSide != _nSide || fVoxelSizeM_ != _fVoxelSizeM || pnOrigin_[0] != _anOrigin[0] || pnOrigin_[1] != _anOrigin[1] || pnOrigin_[2] != _anOrigin[2];
+	if (bAll){
+		_vBricks.assign( nSide*nSide*nSide, SBrick() );
+		_nSide = nSide;
+		_fVoxelSizeM = fVoxelSizeM_;
+		for (int i = 0; i < 3; i++) _anOrigin[i] = pnOrigin_[i];
+	}
+	//a brick is re-meshed when it or one of its neighbours on the upper side is flagged
+	std::vector<int> vnBricks;
+	for (int z = 0; z < nSide; z++)
+	for (int y = 0; y < nSide; y++)
+	for (int x = 0; x < nSide; x++){
+		bool bDirty = bAll;
+		for (int d = 0; d < 8 && !bDirty; d++){
+			const int nX = x + (d & 1), nY = y + (d >> 1 & 1), nZ = z + (d >> 2);
+			if (nX < nSide && nY < nSide && nZ < nSide) bDirty = 0 != (pcvmDirty_->ptr<uchar>(nZ*nSide + nY)[nX] & btl::cpu::DIRTY_MESH);
+		}
+		if (bDirty) vnBricks.push_back( (z*nSide + y)*nSide + x );
+	}
+	cv::parallel_for_( cv::Range(0,int(vnBricks.size())), CMeshBricks(cvmVolume_,pnOrigin_,fVoxelSizeM_,cvmMinMax_,vnBricks,_nBrick,_nSide,&_vBricks) );
+	for (int r = 0; r < pcvmDirty_->rows; r++){
+		uchar* pDirty = pcvmDirty_->ptr<uchar>(r);
+		for (int x = 0; x < nSide; x++) pDirty[x] &= uchar(~btl::cpu::DIRTY_MESH);
+	}
+	return;
+}
+
+unsigned int CBrickMesh::mesh(std::vector<Eigen::Vector3f>* pvVertices_, std::vector<unsigned int>* pvIndices_) const{
+	//the first vertex and the first corner of each brick
+	std::vector<unsigned int> vuVertexOffsets(_vBricks.size()+1,0), vuCornerOffsets(_vBricks.size()+1,0);
+	for (size_t n = 0; n < _vBricks.size(); n++){
+		vuVertexOffsets[n+1] = vuVertexOffsets[n] + (unsigned int)_vBricks[n]._vVertices.size();
+		vuCornerOffsets[n+1] = vuCornerOffsets[n] + (unsigned int)_vBricks[n]._vuCorners.size();
+	}
+	pvVertices_->resize( vuVertexOffsets.back() );
+	pvIndices_->resize( vuCornerOffsets.back() );
+	if (pvIndices_->empty()) return 0;
+	cv::parallel_for_( cv::Range(0,int(_vBricks.size())), CIndexBricks(_vBricks,_nSide,vuVertexOffsets,vuCornerOffsets,pvVertices_,pvIndices_) );
+	return vuCornerOffsets.back()/3;
+}
+
+}//geometry
+}//btl
@@ -0,0 +1,47 @@
+#ifndef BTL_GEOMETRY_BRICK_MESH
+#define BTL_GEOMETRY_BRICK_MESH
+
+namespace btl{ namespace geometry
+{
+
+// Incremental marching cubes over the host volume of CCubicGrids. The volume is cut into bricks of _nBrick^3 voxels and
+// the mesh of each brick is cached, so that update() only re-meshes, in parallel, the bricks whose voxels integration
+// changed as flagged by btl::cpu::integrateTsdfVolume(), and skips those the min/max pyramid of
+// btl::cpu::buildTsdfMinMaxPyramid() shows to hold no surface. A vertex sits on the edge between two neighbouring
+// voxels and belongs to the brick of the lower one; the triangles of a brick refer to the vertices of the brick and of
+// its 7 neighbours on the upper side by their edges, so that mesh() can share every vertex between the triangles
+// around it, across bricks as well, without any search beyond those neighbours.
+class CBrickMesh
+{
+public:
+	typedef boost::shared_ptr<CBrickMesh> tp_shared_ptr;
+
+	CBrickMesh(int nBrick_);
+	void reset();
+	//re-meshes the bricks flagged DIRTY_MESH in *pcvmDirty_, a (y*z) x x CV_8UC1 over the bricks counted from pnOrigin_ of the cyclic
+	//volume, and the bricks whose cells reach into them, then clears the bit. a new origin or voxel size re-meshes all
+	void update(const cv::Mat& cvmVolume_, const int* pnOrigin_, float fVoxelSizeM_, const cv::Mat& cvmMinMax_/*level 0*/, cv::Mat* pcvmDirty_);
+	//indexed triangles in world, 3 indices per triangle into *pvVertices_. returns the triangles
+	unsigned int mesh(std::vector<Eigen::Vector3f>* pvVertices_, std::vector<unsigned int>* pvIndices_) const;
+	unsigned int vertices() const;
+
+	int _nBrick;
+
+protected:
+	friend class CMeshBricks;
+	friend class CIndexBricks;
+	struct SBrick{
+		std::vector<Eigen::Vector3f> _vVertices; //in world
+		std::vector<unsigned short> _vusEdges; //edge of each vertex, (voxel in the brick)*3 + axis, ascending
+		std::vector<unsigned int> _vuCorners; //3 per triangle, (neighbour << 16) | edge, neighbour bits x, y and z
+	};
+	std::vector<SBrick> _vBricks; //(z*_nSide + y)*_nSide + x
+	int _nSide; //bricks a side
+	int _anOrigin[3];
+	float _fVoxelSizeM;
+};
+
+}//geometry
+}//btl
+
+#endif
@@ -8,6 +8,7 @@
 #define CV_SSE2 1
 #include <opencv/highgui.h>
 #include <opencv/cv.h>
+#include "CpuLib.h"
 
 namespace btl
 {
@@ -530,6 +531,13 @@ void bilateralFilterInDisparity(cv::Mat* pcvDepth_, double dSigmaDisparity_, dou
 {
 	BTL_ASSERT(pcvDepth_->channels()==1,"CVUtil::bilateralFilterInDisparity(): the input must be 1 channel depth map")
 	cv::Mat& cvDepth_ = *pcvDepth_;
+	if( CV_32FC1 == cvDepth_.type() ){
+		//single pass, multithreaded
+		cv::Mat cvmFiltered;
+		btl::cpu::bilateralFilteringInDisparity( cvDepth_, float(dSigmaSpace_), float(dSigmaDisparity_), &cvmFiltered );
+		cvmFiltered.copyTo( cvDepth_ );
+		return;
+	}
 	cv::Mat cvDisparity, cvFilteredDisparity;
 	
 	btl::utility::convert2DisparityDomain< T >( cvDepth_, &cvDisparity );
@@ -542,6 +550,11 @@ template< class T >
 void filterDepth ( const double& dThreshould_, const cv::Mat_ < T >& cvmDepth_, cv::Mat_< T >* pcvmDepthNew_ )
 {
 	//PRINT( dThreshould_ );
+	if( cv::DataType<T>::depth == CV_32F ){
+		//vectorised and multithreaded
+		btl::cpu::filterDepth( cvmDepth_, float(dThreshould_), pcvmDepthNew_ );
+		return;
+	}
 	pcvmDepthNew_->create ( cvmDepth_.size() );
 
 	for ( int y = 0; y < cvmDepth_.rows; y++ )
@@ -23,9 +23,9 @@ void btl::image::SCamera::generateMapXY4Undistort()
 	cvmK.at<float>(0,2) = _u;cvmK.at<float>(1,2) = _v;
 
 	cv::Mat_<float> cvmInvK = cvmK.inv(cv::DECOMP_SVD);
-	cv::Mat          _cvmMapX; //for undistortion
-	cv::Mat			 _cvmMapY; //useless just for calling cv::remap
 	btl::utility::map4UndistortImage<float> ( _sHeight, _sWidth, cvmK, cvmInvK, _cvmDistCoeffs, &_cvmMapX, &_cvmMapY );
+	//no device is needed with CKeyFrame::CPU_BACKEND
+	if (cv::gpu::getCudaEnabledDeviceCount() <= 0) return;
 	_cvgmMapX.upload(_cvmMapX);
 	_cvgmMapY.upload(_cvmMapY);
 }
@@ -48,8 +48,8 @@ struct SCamera
 	cv::Mat _cvmDistCoeffs;
 	//rendering
 	//GLuint _uTexture;
-	//cv::Mat        _cvmMapX; //for undistortion
-	//cv::Mat		 _cvmMapY; //useless just for calling cv::remap
+	cv::Mat          _cvmMapX; //for undistortion, host copy for CKeyFrame::CPU_BACKEND
+	cv::Mat			 _cvmMapY;
 	cv::gpu::GpuMat  _cvgmMapX;
 	cv::gpu::GpuMat  _cvgmMapY;
 	//type
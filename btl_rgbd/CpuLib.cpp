@@ -0,0 +1,1624 @@
+//host mirrors of the pyramid kernels in cuda/CudaLib.cu
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/internal.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <Eigen/Dense>
+#include "OtherUtil.hpp"
+#include "EigenUtil.hpp"
+#include "CpuLib.h"
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace btl{ namespace cpu
+{
+static const float _fNaN = std::numeric_limits<float>::quiet_NaN();
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//out = 1/in if |in| > 0, NaN otherwise; the same operation converts depth to disparity and back
+class CInverse : public cv::ParallelLoopBody
+{
+public:
+	CInverse(const cv::Mat& cvmIn_, cv::Mat* pcvmOut_):_cvmIn(cvmIn_),_pcvmOut(pcvmOut_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			const float* pIn = _cvmIn.ptr<float>(r);
+			float* pOut = _pcvmOut->ptr<float>(r);
+			int c = 0;
+#if CV_SSE2
+			const __m128 m128One = _mm_set1_ps(1.f), m128Zero = _mm_setzero_ps(), m128NaN = _mm_set1_ps(_fNaN);
+			const __m128 m128AbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			for (; c <= _cvmIn.cols - 4; c += 4){
+				__m128 m128In = _mm_loadu_ps(pIn + c);
+				__m128 m128Valid = _mm_cmpgt_ps( _mm_and_ps(m128In,m128AbsMask), m128Zero );
+				__m128 m128Inv = _mm_div_ps( m128One, m128In );
+				_mm_storeu_ps( pOut + c, _mm_or_ps( _mm_and_ps(m128Valid,m128Inv), _mm_andnot_ps(m128Valid,m128NaN) ) );
+			}
+#endif
+			for (; c < _cvmIn.cols; c++)
+				pOut[c] = fabsf(pIn[c]) > 0.f ? 1.f/pIn[c] : _fNaN;
+		}//for each row
+	}
+private:
+	const cv::Mat& _cvmIn;
+	cv::Mat* _pcvmOut;
+};
+void depth2Disparity( const cv::Mat& cvmDepth_, cv::Mat* pcvmDisparity_ ){
+	pcvmDisparity_->create(cvmDepth_.size(),CV_32FC1);
+	cv::parallel_for_( cv::Range(0,cvmDepth_.rows), CInverse(cvmDepth_,pcvmDisparity_) );
+}
+void disparity2Depth( const cv::Mat& cvmDisparity_, cv::Mat* pcvmDepth_ ){
+	pcvmDepth_->create(cvmDisparity_.size(),CV_32FC1);
+	cv::parallel_for_( cv::Range(0,cvmDisparity_.rows), CInverse(cvmDisparity_,pcvmDepth_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//bilateral filter in disparity with pre-computed spatial and range weights.
+//the range weight exp(-d^2/2sigma^2) is looked up from a table covering |d| < 4 sigma, beyond that it is taken as 0.
+//when the input is depth, the rows needed by a band are converted to disparity on the fly and the result is
+//converted back, so no full size disparity image is created.
+//the device window is the 5x5 square of kernelBilateral(); otherwise it is the disc of radius round(1.5 sigma) of
+//cv::bilateralFilter(), which the depth mode replaces.
+class CBilateral : public cv::ParallelLoopBody
+{
+public:
+	enum { LUT_SIZE = 1024 };
+	//bDepth_: input and output are depth, invalid depth (NaN or <= 0) is left untouched
+	//bDeviceWindow_: use the same window as kernelBilateral(), which ends one short of x+R+1 and skips the last row/col
+	CBilateral(const cv::Mat& cvmSrc_, float fSigmaSpace_, float fSigmaColor_, bool bDepth_, bool bDeviceWindow_, cv::Mat* pcvmDst_)
+	:_cvmSrc(cvmSrc_),_bDepth(bDepth_),_nBorder(bDeviceWindow_?1:0),_pcvmDst(pcvmDst_){
+		_nR = bDeviceWindow_ ? 2 : std::max( cvRound(fSigmaSpace_*1.5f), 1 );
+		_nD = _nR * 2 + 1;
+		_vSpace.resize(_nD*_nD);
+		const float fSigmaSpace2InvHalf = .5f/(fSigmaSpace_*fSigmaSpace_);
+		for (int dy = -_nR; dy <= _nR; dy++)
+		for (int dx = -_nR; dx <= _nR; dx++){
+			const bool bIn = bDeviceWindow_ || dx*dx + dy*dy <= _nR*_nR;
+			_vSpace[(dy+_nR)*_nD+dx+_nR] = bIn ? expf( -float(dx*dx + dy*dy) * fSigmaSpace2InvHalf ) : 0.f;
+		}
+		const float fSigmaColor2InvHalf = .5f/(fSigmaColor_*fSigmaColor_);
+		_fLUTScale = LUT_SIZE / (4.f*fSigmaColor_);
+		for (int i = 0; i < LUT_SIZE; i++){
+			const float fDiff = (i + .5f)/_fLUTScale;
+			_afRange[i] = expf( -fDiff*fDiff*fSigmaColor2InvHalf );
+		}
+	}
+	virtual void operator()(const cv::Range& sRows_) const{
+		const int nRows = _cvmSrc.rows, nCols = _cvmSrc.cols;
+		//rows read by this band
+		const int R = _nR;
+		const int nFirst = std::max(sRows_.start - R, 0);
+		const int nLast  = std::min(sRows_.end + R, nRows);
+		std::vector<float> vDisparity;
+		std::vector<const float*> vRows(nLast - nFirst);
+		if (_bDepth){
+			vDisparity.resize( (nLast - nFirst)*nCols );
+			for (int r = nFirst; r < nLast; r++){
+				const float* pDepth = _cvmSrc.ptr<float>(r);
+				float* pDisp = &vDisparity[(r - nFirst)*nCols];
+				for (int c = 0; c < nCols; c++)
+					pDisp[c] = pDepth[c] > 0.f ? 1.f/pDepth[c] : _fNaN; //NaN fails the test too
+				vRows[r - nFirst] = pDisp;
+			}
+		}
+		else{
+			for (int r = nFirst; r < nLast; r++) vRows[r - nFirst] = _cvmSrc.ptr<float>(r);
+		}
+		for (int y = sRows_.start; y < sRows_.end; y++){
+			const float* pSrc = vRows[y - nFirst];
+			float* pDst = _pcvmDst->ptr<float>(y);
+			const int ty = std::min(y + R + 1, nRows - _nBorder);
+			for (int x = 0; x < nCols; x++){
+				const float fCentre = pSrc[x];
+				if (fCentre != fCentre) { pDst[x] = _bDepth ? _cvmSrc.ptr<float>(y)[x] : _fNaN; continue; }
+				const int tx = std::min(x + R + 1, nCols - _nBorder);
+				const int cx0 = std::max(x - R, 0);
+				float fSum1 = 0.f, fSum2 = 0.f;
+				for (int cy = std::max(y - R, 0); cy < ty; ++cy){
+					const float* pNb = vRows[cy - nFirst];
+					const float* pSpace = &_vSpace[0] + (cy - y + R)*_nD + R - x;
+					for (int cx = cx0; cx < tx; ++cx){
+						const float fNb = pNb[cx];
+						//int(NaN) is undefined, so test it before the table look-up
+						if (fNb != fNb) continue;
+						const int nIdx = int( fabsf(fCentre - fNb)*_fLUTScale );
+						if (nIdx >= LUT_SIZE) continue;
+						const float fW = pSpace[cx] * _afRange[nIdx];
+						fSum1 += fNb * fW;
+						fSum2 += fW;
+					}
+				}//for each pixel in neighbourhood
+				pDst[x] = _bDepth ? fSum2/fSum1 : fSum1/fSum2;
+			}//for each col
+		}//for each row
+	}
+private:
+	const cv::Mat& _cvmSrc;
+	bool _bDepth;
+	int _nBorder;
+	cv::Mat* _pcvmDst;
+	int _nR, _nD; //radius and diameter of the window
+	std::vector<float> _vSpace;
+	float _afRange[LUT_SIZE];
+	float _fLUTScale;
+};
+void bilateralFiltering(const cv::Mat& cvmSrc_, const float& fSigmaSpace_, const float& fSigmaColor_, cv::Mat* pcvmDst_ ){
+	BTL_ASSERT( CV_32FC1 == cvmSrc_.type(), "btl::cpu::bilateralFiltering() input must be CV_32FC1" );
+	pcvmDst_->create(cvmSrc_.size(),CV_32FC1);
+	cv::parallel_for_( cv::Range(0,cvmSrc_.rows), CBilateral(cvmSrc_,fSigmaSpace_,fSigmaColor_,false,true,pcvmDst_) );
+}
+void bilateralFilteringInDisparity(const cv::Mat& cvmDepth_, const float& fSigmaSpace_, const float& fSigmaDisparity_, cv::Mat* pcvmDepth_ ){
+	BTL_ASSERT( CV_32FC1 == cvmDepth_.type(), "btl::cpu::bilateralFilteringInDisparity() input must be CV_32FC1" );
+	BTL_ASSERT( cvmDepth_.data != pcvmDepth_->data, "btl::cpu::bilateralFilteringInDisparity() can not filter in place" );
+	pcvmDepth_->create(cvmDepth_.size(),CV_32FC1);
+	cv::parallel_for_( cv::Range(0,cvmDepth_.rows), CBilateral(cvmDepth_,fSigmaSpace_,fSigmaDisparity_,true,false,pcvmDepth_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//keeps a depth only if all 8 neighbours are within fThreshold_ of it, 0 otherwise (border included).
+//the 3x3 max/min is separable: a vertical pass over 3 rows into a row buffer, then a horizontal 3-tap pass.
+//including the centre does not change the test since |c-c| = 0. a NaN anywhere in the window invalidates it.
+class CFilterDepth : public cv::ParallelLoopBody
+{
+public:
+	CFilterDepth(const cv::Mat& cvmDepth_, float fThreshold_, cv::Mat* pcvmDepthNew_):_cvmDepth(cvmDepth_),_fThreshold(fThreshold_),_pcvmDepthNew(pcvmDepthNew_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		const int nCols = _cvmDepth.cols;
+		std::vector<float> vMax(nCols), vMin(nCols), vSum(nCols);
+		for (int y = sRows_.start; y < sRows_.end; y++){
+			float* pOut = _pcvmDepthNew->ptr<float>(y);
+			if (0 == y || _cvmDepth.rows - 1 == y || nCols < 3) { for (int x = 0; x < nCols; x++) pOut[x] = 0.f; continue; }
+			const float* pU = _cvmDepth.ptr<float>(y-1);
+			const float* pC = _cvmDepth.ptr<float>(y);
+			const float* pD = _cvmDepth.ptr<float>(y+1);
+			float* pMax = &vMax[0]; float* pMin = &vMin[0]; float* pSum = &vSum[0];
+			//vertical pass
+			int x = 0;
+#if CV_SSE2
+			for (; x <= nCols - 4; x += 4){
+				__m128 m128U = _mm_loadu_ps(pU + x), m128C = _mm_loadu_ps(pC + x), m128D = _mm_loadu_ps(pD + x);
+				_mm_storeu_ps( pMax + x, _mm_max_ps( _mm_max_ps(m128U,m128C), m128D ) );
+				_mm_storeu_ps( pMin + x, _mm_min_ps( _mm_min_ps(m128U,m128C), m128D ) );
+				_mm_storeu_ps( pSum + x, _mm_add_ps( _mm_add_ps(m128U,m128C), m128D ) );
+			}
+#endif
+			for (; x < nCols; x++){
+				pMax[x] = std::max( std::max(pU[x],pC[x]), pD[x] );
+				pMin[x] = std::min( std::min(pU[x],pC[x]), pD[x] );
+				pSum[x] = pU[x] + pC[x] + pD[x];
+			}
+			//horizontal pass
+			pOut[0] = pOut[nCols-1] = 0.f;
+			x = 1;
+#if CV_SSE2
+			const __m128 m128Threshold = _mm_set1_ps(_fThreshold);
+			for (; x <= nCols - 5; x += 4){
+				__m128 m128Max = _mm_max_ps( _mm_max_ps( _mm_loadu_ps(pMax+x-1), _mm_loadu_ps(pMax+x) ), _mm_loadu_ps(pMax+x+1) );
+				__m128 m128Min = _mm_min_ps( _mm_min_ps( _mm_loadu_ps(pMin+x-1), _mm_loadu_ps(pMin+x) ), _mm_loadu_ps(pMin+x+1) );
+				__m128 m128Sum = _mm_add_ps( _mm_add_ps( _mm_loadu_ps(pSum+x-1), _mm_loadu_ps(pSum+x) ), _mm_loadu_ps(pSum+x+1) );
+				__m128 m128C = _mm_loadu_ps(pC + x);
+				__m128 m128Keep = _mm_and_ps( _mm_cmplt_ps( _mm_sub_ps(m128Max,m128C), m128Threshold ), _mm_cmplt_ps( _mm_sub_ps(m128C,m128Min), m128Threshold ) );
+				m128Keep = _mm_and_ps( m128Keep, _mm_cmpord_ps(m128Sum,m128Sum) );
+				_mm_storeu_ps( pOut + x, _mm_and_ps( m128Keep, m128C ) );
+			}
+#endif
+			for (; x < nCols - 1; x++){
+				const float fMax = std::max( std::max(pMax[x-1],pMax[x]), pMax[x+1] );
+				const float fMin = std::min( std::min(pMin[x-1],pMin[x]), pMin[x+1] );
+				const float fSum = pSum[x-1] + pSum[x] + pSum[x+1];
+				const bool bKeep = (fMax - pC[x] < _fThreshold) & (pC[x] - fMin < _fThreshold) & (fSum == fSum);
+				pOut[x] = bKeep ? pC[x] : 0.f;
+			}
+		}//for each row
+	}
+private:
+	const cv::Mat& _cvmDepth;
+	float _fThreshold;
+	cv::Mat* _pcvmDepthNew;
+};
+void filterDepth(const cv::Mat& cvmDepth_, const float& fThreshold_, cv::Mat* pcvmDepthNew_){
+	BTL_ASSERT( CV_32FC1 == cvmDepth_.type(), "btl::cpu::filterDepth() input must be CV_32FC1" );
+	BTL_ASSERT( cvmDepth_.data != pcvmDepthNew_->data, "btl::cpu::filterDepth() can not filter in place" );
+	pcvmDepthNew_->create(cvmDepth_.size(),CV_32FC1);
+	cv::parallel_for_( cv::Range(0,cvmDepth_.rows), CFilterDepth(cvmDepth_,fThreshold_,pcvmDepthNew_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//same as kernelPyrDown(): mean of the 5x5 neighbours within 3 sigma of the centre
+class CPyrDown : public cv::ParallelLoopBody
+{
+public:
+	CPyrDown(const cv::Mat& cvmSrc_, float fSigmaColor_, cv::Mat* pcvmDst_):_cvmSrc(cvmSrc_),_fSigmaColor(fSigmaColor_),_pcvmDst(pcvmDst_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		const int D = 5;
+		const float fThreshold = 3*_fSigmaColor;
+		for (int y = sRows_.start; y < sRows_.end; y++){
+			float* pDst = _pcvmDst->ptr<float>(y);
+			const int ty = std::min(2*y - D/2 + D, _cvmSrc.rows - 1);
+			for (int x = 0; x < _pcvmDst->cols; x++){
+				const float fCentre = _cvmSrc.ptr<float>(2*y)[2*x];
+				if (fCentre != fCentre) { pDst[x] = _fNaN; continue; }
+				const int tx = std::min(2*x - D/2 + D, _cvmSrc.cols - 1);
+				float fSum = 0.f; int nCount = 0;
+				for (int cy = std::max(0, 2*y - D/2); cy < ty; ++cy){
+					const float* pSrc = _cvmSrc.ptr<float>(cy);
+					for (int cx = std::max(0, 2*x - D/2); cx < tx; ++cx){
+						if (fabsf(pSrc[cx] - fCentre) < fThreshold){
+							fSum += pSrc[cx];
+							++nCount;
+						}
+					}
+				}//for each pixel in the neighbourhood 5x5
+				pDst[x] = fSum / nCount;
+			}//for each col
+		}//for each row
+	}
+private:
+	const cv::Mat& _cvmSrc;
+	float _fSigmaColor;
+	cv::Mat* _pcvmDst;
+};
+void pyrDown (const cv::Mat& cvmSrc_, const float& fSigmaColor_, cv::Mat* pcvmDst_){
+	pcvmDst_->create(cvmSrc_.rows/2,cvmSrc_.cols/2,CV_32FC1);
+	cv::parallel_for_( cv::Range(0,pcvmDst_->rows), CPyrDown(cvmSrc_,fSigmaColor_,pcvmDst_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+class CUnprojectRGB : public cv::ParallelLoopBody
+{
+public:
+	CUnprojectRGB(const cv::Mat& cvmDepths_, float fFx_, float fFy_, float u_, float v_, unsigned short uScale_, cv::Mat* pcvmPts_)
+	:_cvmDepths(cvmDepths_),_fInvFx(1.f/fFx_),_fInvFy(1.f/fFy_),_u(u_),_v(v_),_uScale(uScale_),_pcvmPts(pcvmPts_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			const float* pDepth = _cvmDepths.ptr<float>(r);
+			float* pPt = _pcvmPts->ptr<float>(r);
+			const float fY = ( r*_uScale - _v ) * _fInvFy;
+			for (int c = 0; c < _cvmDepths.cols; c++, pPt += 3){
+				const float fD = pDepth[c];
+				if( 0.4f < fD && fD < 10.f ){
+					pPt[0] = ( c*_uScale - _u ) * _fInvFx * fD;
+					pPt[1] = fY * fD;
+					pPt[2] = fD;
+				}
+				else{
+					pPt[0] = pPt[1] = pPt[2] = _fNaN;
+				}
+			}//for each col
+		}//for each row
+	}
+private:
+	const cv::Mat& _cvmDepths;
+	float _fInvFx, _fInvFy, _u, _v;
+	unsigned short _uScale;
+	cv::Mat* _pcvmPts;
+};
+void unprojectRGBCVm ( const cv::Mat& cvmDepths_, 
+	const float& fFxRGB_,const float& fFyRGB_,const float& uRGB_, const float& vRGB_, unsigned int uLevel_, 
+	cv::Mat* pcvmPts_ ){
+	pcvmPts_->create(cvmDepths_.size(),CV_32FC3);
+	cv::parallel_for_( cv::Range(0,cvmDepths_.rows), CUnprojectRGB(cvmDepths_,fFxRGB_,fFyRGB_,uRGB_,vRGB_,1<<uLevel_,pcvmPts_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//depth *= sqrt(tanx^2 + tany^2 + 1), NaN stays NaN
+class CScaleDepth : public cv::ParallelLoopBody
+{
+public:
+	CScaleDepth(float fFx_, float fFy_, float u_, float v_, cv::Mat* pcvmDepth_)
+	:_fInvFx(1.f/fFx_),_fInvFy(1.f/fFy_),_u(u_),_v(v_),_pcvmDepth(pcvmDepth_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			float* pDepth = _pcvmDepth->ptr<float>(r);
+			const float fTanY = ( r - _v ) * _fInvFy;
+			for (int c = 0; c < _pcvmDepth->cols; c++){
+				const float fTanX = ( c - _u ) * _fInvFx;
+				pDepth[c] *= sqrtf( fTanX*fTanX + fTanY*fTanY + 1.f );
+			}
+		}//for each row
+	}
+private:
+	float _fInvFx, _fInvFy, _u, _v;
+	cv::Mat* _pcvmDepth;
+};
+void scaleDepthCVmCVm(unsigned short usPyrLevel_, const float fFx_, const float fFy_, const float u_, const float v_, cv::Mat* pcvmDepth_){
+	//the intrinsics of the level as pcl::device::Intr::operator()
+	const int nDiv = 1 << usPyrLevel_;
+	cv::parallel_for_( cv::Range(0,pcvmDepth_->rows), CScaleDepth(fFx_/nDiv,fFy_/nDiv,u_/nDiv,v_/nDiv,pcvmDepth_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//same as kernelFastNormalEstimation(): cross product of the right and down neighbours, facing the camera
+class CFastNormalEstimation : public cv::ParallelLoopBody
+{
+public:
+	CFastNormalEstimation(const cv::Mat& cvmPts_, cv::Mat* pcvmNls_):_cvmPts(cvmPts_),_pcvmNls(pcvmNls_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			float* pNl = _pcvmNls->ptr<float>(r);
+			if( r >= _cvmPts.rows - 1 ){
+				for (int c = 0; c < _cvmPts.cols*3; c++) pNl[c] = _fNaN;
+				continue;
+			}
+			const float* pPt = _cvmPts.ptr<float>(r);
+			const float* pDown = _cvmPts.ptr<float>(r+1);
+			for (int c = 0; c < _cvmPts.cols; c++, pPt += 3, pDown += 3, pNl += 3){
+				pNl[0] = pNl[1] = pNl[2] = _fNaN;
+				if( c == _cvmPts.cols - 1 ) continue;
+				const float* pRight = pPt + 3;
+				if( pPt[2] != pPt[2] || pRight[2] != pRight[2] || pDown[2] != pDown[2] ) continue;
+				const float v1x = pRight[0]-pPt[0], v1y = pRight[1]-pPt[1], v1z = pRight[2]-pPt[2];
+				const float v2x = pDown[0] -pPt[0], v2y = pDown[1] -pPt[1], v2z = pDown[2] -pPt[2];
+				float nx = v1y*v2z - v1z*v2y;
+				float ny = v1z*v2x - v1x*v2z;
+				float nz = v1x*v2y - v1y*v2x;
+				const float fNorm = sqrtf(nx*nx + ny*ny + nz*nz);
+				if( fNorm < 1.0e-10 ) continue;
+				nx /= fNorm; ny /= fNorm; nz /= fNorm;
+				//flip if facing away from the camera
+				const float fSign = ( -nx*pPt[0] - ny*pPt[1] - nz*pPt[2] < 0 ) ? -1.f : 1.f;
+				pNl[0] = fSign*nx; pNl[1] = fSign*ny; pNl[2] = fSign*nz;
+			}//for each col
+		}//for each row
+	}
+private:
+	const cv::Mat& _cvmPts;
+	cv::Mat* _pcvmNls;
+};
+void fastNormalEstimation(const cv::Mat& cvmPts_, cv::Mat* pcvmNls_ ){
+	pcvmNls_->create(cvmPts_.size(),CV_32FC3);
+	cv::parallel_for_( cv::Range(0,cvmPts_.rows), CFastNormalEstimation(cvmPts_,pcvmNls_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Pt_w = Rw^T ( Pt_c - Tw ), Nl_w = Rw^T Nl_c
+class CTransformLocalToWorld : public cv::ParallelLoopBody
+{
+public:
+	CTransformLocalToWorld(const float* pRw_, const float* pTw_, cv::Mat* pcvmPts_, cv::Mat* pcvmNls_)
+	:_pcvmPts(pcvmPts_),_pcvmNls(pcvmNls_){
+		//pRw_ is column major, read row by row it gives Rw^T
+		for (int i = 0; i < 9; i++) _aRwTrans[i] = pRw_[i];
+		for (int i = 0; i < 3; i++) _aTw[i] = pTw_[i];
+	}
+	virtual void operator()(const cv::Range& sRows_) const{
+		const float* R = _aRwTrans;
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			float* pPt = _pcvmPts->ptr<float>(r);
+			float* pNl = _pcvmNls->ptr<float>(r);
+			for (int c = 0; c < _pcvmPts->cols; c++, pPt += 3, pNl += 3){
+				const float x = pPt[0] - _aTw[0], y = pPt[1] - _aTw[1], z = pPt[2] - _aTw[2];
+				pPt[0] = R[0]*x + R[1]*y + R[2]*z;
+				pPt[1] = R[3]*x + R[4]*y + R[5]*z;
+				pPt[2] = R[6]*x + R[7]*y + R[8]*z;
+				const float nx = pNl[0], ny = pNl[1], nz = pNl[2];
+				pNl[0] = R[0]*nx + R[1]*ny + R[2]*nz;
+				pNl[1] = R[3]*nx + R[4]*ny + R[5]*nz;
+				pNl[2] = R[6]*nx + R[7]*ny + R[8]*nz;
+			}//for each col
+		}//for each row
+	}
+private:
+	cv::Mat* _pcvmPts;
+	cv::Mat* _pcvmNls;
+	float _aRwTrans[9];
+	float _aTw[3];
+};
+void transformLocalToWorldCVCV(const float* pRw_/*col major*/, const float* pTw_, cv::Mat* pcvmPts_, cv::Mat* pcvmNls_){
+	cv::parallel_for_( cv::Range(0,pcvmPts_->rows), CTransformLocalToWorld(pRw_,pTw_,pcvmPts_,pcvmNls_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//average of each 2x2 block, NaN if one of them is
+class CResizeMap : public cv::ParallelLoopBody
+{
+public:
+	CResizeMap(bool bNormalize_, const cv::Mat& cvmSrc_, cv::Mat* pcvmDst_)
+	:_bNormalize(bNormalize_),_cvmSrc(cvmSrc_),_pcvmDst(pcvmDst_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			const float* p0 = _cvmSrc.ptr<float>(2*r);
+			const float* p1 = _cvmSrc.ptr<float>(2*r+1);
+			float* pDst = _pcvmDst->ptr<float>(r);
+			for (int c = 0; c < _pcvmDst->cols; c++, p0 += 6, p1 += 6, pDst += 3){
+				if (p0[0] != p0[0] || p0[3] != p0[3] || p1[0] != p1[0] || p1[3] != p1[3]){
+					pDst[0] = pDst[1] = pDst[2] = _fNaN;
+					continue;
+				}
+				float a[3];
+				for (int i = 0; i < 3; i++) a[i] = (p0[i] + p0[i+3] + p1[i] + p1[i+3])*.25f;
+				if (_bNormalize){
+					const float fInvNorm = 1.f/sqrtf( a[0]*a[0] + a[1]*a[1] + a[2]*a[2] );
+					for (int i = 0; i < 3; i++) a[i] *= fInvNorm;
+				}
+				pDst[0] = a[0]; pDst[1] = a[1]; pDst[2] = a[2];
+			}//for each col
+		}//for each row
+	}
+private:
+	bool _bNormalize;
+	const cv::Mat& _cvmSrc;
+	cv::Mat* _pcvmDst;
+};
+void resizeMap(bool bNormalize_, const cv::Mat& cvmSrc_, cv::Mat* pcvmDst_){
+	pcvmDst_->create(cvmSrc_.rows/2,cvmSrc_.cols/2,CV_32FC3);
+	cv::parallel_for_( cv::Range(0,pcvmDst_->rows), CResizeMap(bNormalize_,cvmSrc_,pcvmDst_) );
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+class CSplitC3 : public cv::ParallelLoopBody
+{
+public:
+	CSplitC3(const cv::Mat& cvmC3_, cv::Mat* pcvmPlanes_):_cvmC3(cvmC3_),_pcvmPlanes(pcvmPlanes_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			const float* pIn = _cvmC3.ptr<float>(r);
+			float* pX = _pcvmPlanes[0].ptr<float>(r);
+			float* pY = _pcvmPlanes[1].ptr<float>(r);
+			float* pZ = _pcvmPlanes[2].ptr<float>(r);
+			int c = 0;
+#if CV_SSE2
+			//x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 -> x0 x1 x2 x3 | y0 y1 y2 y3 | z0 z1 z2 z3
+			for (; c <= _cvmC3.cols - 4; c += 4, pIn += 12){
+				__m128 m128A = _mm_loadu_ps(pIn), m128B = _mm_loadu_ps(pIn+4), m128C = _mm_loadu_ps(pIn+8);
+				__m128 m128X = _mm_shuffle_ps( _mm_shuffle_ps(m128A,m128A,_MM_SHUFFLE(3,3,0,0)), _mm_shuffle_ps(m128B,m128C,_MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,2,0) );
+				__m128 m128Y = _mm_shuffle_ps( _mm_shuffle_ps(m128A,m128B,_MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps(m128B,m128C,_MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0) );
+				__m128 m128Z = _mm_shuffle_ps( _mm_shuffle_ps(m128A,m128B,_MM_SHUFFLE(1,1,2,2)), _mm_shuffle_ps(m128C,m128C,_MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0) );
+				_mm_storeu_ps(pX + c, m128X);
+				_mm_storeu_ps(pY + c, m128Y);
+				_mm_storeu_ps(pZ + c, m128Z);
+			}
+#endif
+			for (; c < _cvmC3.cols; c++, pIn += 3){
+				pX[c] = pIn[0]; pY[c] = pIn[1]; pZ[c] = pIn[2];
+			}
+		}//for each row
+	}
+private:
+	const cv::Mat& _cvmC3;
+	cv::Mat* _pcvmPlanes;
+};
+void splitC3(const cv::Mat& cvmC3_, cv::Mat* pcvmPlanes_){
+	BTL_ASSERT( CV_32FC3 == cvmC3_.type(), "btl::cpu::splitC3() input must be CV_32FC3" );
+	for (int i = 0; i < 3; i++) pcvmPlanes_[i].create(cvmC3_.size(),CV_32FC1);
+	cv::parallel_for_( cv::Range(0,cvmC3_.rows), CSplitC3(cvmC3_,pcvmPlanes_) );
+}
+class CMergeC3 : public cv::ParallelLoopBody
+{
+public:
+	CMergeC3(const cv::Mat* pcvmPlanes_, cv::Mat* pcvmC3_):_pcvmPlanes(pcvmPlanes_),_pcvmC3(pcvmC3_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			const float* pX = _pcvmPlanes[0].ptr<float>(r);
+			const float* pY = _pcvmPlanes[1].ptr<float>(r);
+			const float* pZ = _pcvmPlanes[2].ptr<float>(r);
+			float* pOut = _pcvmC3->ptr<float>(r);
+			for (int c = 0; c < _pcvmC3->cols; c++, pOut += 3){
+				pOut[0] = pX[c]; pOut[1] = pY[c]; pOut[2] = pZ[c];
+			}
+		}//for each row
+	}
+private:
+	const cv::Mat* _pcvmPlanes;
+	cv::Mat* _pcvmC3;
+};
+void mergeC3(const cv::Mat* pcvmPlanes_, cv::Mat* pcvmC3_){
+	pcvmC3_->create(pcvmPlanes_[0].size(),CV_32FC3);
+	cv::parallel_for_( cv::Range(0,pcvmC3_->rows), CMergeC3(pcvmPlanes_,pcvmC3_) );
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//each stripe of rows accumulates its own partial sums, the stripes are added up in a fixed order afterwards
+//so that the result does not depend on the number of threads. with pcvmPtPlanesCur_/pcvmNlPlanesCur_ the current
+//vertices are read from X,Y,Z planes instead and transformed 4 at a time, the gates and the sums are shared.
+class CRegistrationICP : public cv::ParallelLoopBody
+{
+public:
+	enum { STRIPE = 16, SUMS = 27 };
+	CRegistrationICP(const float fFx_, const float fFy_, const float fU_, const float fV_, const float fDistThres_, const float fSinAngleThres_,
+		const float* pRwCur_, const float* pTwCur_, const float* pRwPrev_, const float* pTwPrev_,
+		const cv::Mat& cvmPtsWorldPrev_, const cv::Mat& cvmNlsWorldPrev_, const cv::Mat& cvmPtsLocalCur_, const cv::Mat& cvmNlsLocalCur_,
+		double* pdStripeSums_, int* pnStripeCounts_, const cv::Mat* pcvmPtPlanesCur_ = NULL, const cv::Mat* pcvmNlPlanesCur_ = NULL)
+	:_fFx(fFx_),_fFy(fFy_),_fU(fU_),_fV(fV_),_fDistThres(fDistThres_),_fSinAngleThres(fSinAngleThres_),
+	_cvmPtsWorldPrev(cvmPtsWorldPrev_),_cvmNlsWorldPrev(cvmNlsWorldPrev_),_cvmPtsLocalCur(cvmPtsLocalCur_),_cvmNlsLocalCur(cvmNlsLocalCur_),
+	_pcvmPtPlanesCur(pcvmPtPlanesCur_),_pcvmNlPlanesCur(pcvmNlPlanesCur_),
+	_pdStripeSums(pdStripeSums_),_pnStripeCounts(pnStripeCounts_){
+		for (int i = 0; i < 3; i++) for (int j = 0; j < 3; j++){
+			_aRwCurTrans[i*3+j] = pRwCur_[i*3+j];//col major read row by row is Rw^T
+			_aRwPrev[i*3+j]     = pRwPrev_[j*3+i];
+		}
+		for (int i = 0; i < 3; i++) { _aTwCur[i] = pTwCur_[i]; _aTwPrev[i] = pTwPrev_[i]; }
+	}
+	virtual void operator()(const cv::Range& sStripes_) const{
+		const float* Rc = _aRwCurTrans;
+		const float* Rp = _aRwPrev;
+		for (int s = sStripes_.start; s < sStripes_.end; s++){
+			double adSum[SUMS] = {0};
+			int nCount = 0;
+			const int nEnd = std::min(_cvmPtsLocalCur.rows, (s+1)*STRIPE);
+			for (int r = s*STRIPE; r < nEnd; r++){
+				int c = 0;
+				if (_pcvmPtPlanesCur){
+					const float* pX  = _pcvmPtPlanesCur[0].ptr<float>(r), *pY  = _pcvmPtPlanesCur[1].ptr<float>(r), *pZ  = _pcvmPtPlanesCur[2].ptr<float>(r);
+					const float* pNx = _pcvmNlPlanesCur[0].ptr<float>(r), *pNy = _pcvmNlPlanesCur[1].ptr<float>(r), *pNz = _pcvmNlPlanesCur[2].ptr<float>(r);
+#if CV_SSE2
+					//same operations in the same order as the scalar transform below, so both give the same sums
+					float aafW[3][4], aafP[3][4];
+					for (; c <= _cvmPtsLocalCur.cols - 4; c += 4){
+						const __m128 x = _mm_sub_ps(_mm_loadu_ps(pX+c),_mm_set1_ps(_aTwCur[0]));
+						const __m128 y = _mm_sub_ps(_mm_loadu_ps(pY+c),_mm_set1_ps(_aTwCur[1]));
+						const __m128 z = _mm_sub_ps(_mm_loadu_ps(pZ+c),_mm_set1_ps(_aTwCur[2]));
+						__m128 m128W[3];
+						for (int i = 0; i < 3; i++){
+							m128W[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(Rc[i*3]),x),_mm_mul_ps(_mm_set1_ps(Rc[i*3+1]),y)),_mm_mul_ps(_mm_set1_ps(Rc[i*3+2]),z));
+							_mm_storeu_ps(aafW[i],m128W[i]);
+						}
+						for (int i = 0; i < 3; i++)
+							_mm_storeu_ps(aafP[i],_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(Rp[i*3]),m128W[0]),_mm_mul_ps(_mm_set1_ps(Rp[i*3+1]),m128W[1])),_mm_mul_ps(_mm_set1_ps(Rp[i*3+2]),m128W[2])),_mm_set1_ps(_aTwPrev[i])));
+						for (int k = 0; k < 4; k++){
+							if (pNx[c+k] != pNx[c+k] || pX[c+k] != pX[c+k]) continue;
+							const float aPtW[3] = { aafW[0][k], aafW[1][k], aafW[2][k] };
+							const float aNlCur[3] = { pNx[c+k], pNy[c+k], pNz[c+k] };
+							accumulate(aPtW,aafP[0][k],aafP[1][k],aafP[2][k],aNlCur,adSum,&nCount);
+						}
+					}
+#endif
+					for (; c < _cvmPtsLocalCur.cols; c++){
+						const float aPtCur[3] = { pX[c], pY[c], pZ[c] }, aNlCur[3] = { pNx[c], pNy[c], pNz[c] };
+						associate(aPtCur,aNlCur,adSum,&nCount);
+					}
+				}
+				else{
+					const float* pPtCur = _cvmPtsLocalCur.ptr<float>(r);
+					const float* pNlCur = _cvmNlsLocalCur.ptr<float>(r);
+					for (; c < _cvmPtsLocalCur.cols; c++, pPtCur += 3, pNlCur += 3) associate(pPtCur,pNlCur,adSum,&nCount);
+				}
+			}//for each row
+			for (int i = 0; i < SUMS; i++) _pdStripeSums[s*SUMS+i] = adSum[i];
+			_pnStripeCounts[s] = nCount;
+		}//for each stripe
+	}
+private:
+	inline void associate(const float* pPtCur, const float* pNlCur, double* adSum, int* pnCount) const{
+		if (pNlCur[0] != pNlCur[0] || pPtCur[0] != pPtCur[0]) return;
+		const float* Rc = _aRwCurTrans;
+		const float* Rp = _aRwPrev;
+		//transform the current vertex into world and then into the previous camera
+		const float x = pPtCur[0] - _aTwCur[0], y = pPtCur[1] - _aTwCur[1], z = pPtCur[2] - _aTwCur[2];
+		const float aPtW[3] = { Rc[0]*x + Rc[1]*y + Rc[2]*z, Rc[3]*x + Rc[4]*y + Rc[5]*z, Rc[6]*x + Rc[7]*y + Rc[8]*z };
+		const float fXp = Rp[0]*aPtW[0] + Rp[1]*aPtW[1] + Rp[2]*aPtW[2] + _aTwPrev[0];
+		const float fYp = Rp[3]*aPtW[0] + Rp[4]*aPtW[1] + Rp[5]*aPtW[2] + _aTwPrev[1];
+		const float fZp = Rp[6]*aPtW[0] + Rp[7]*aPtW[1] + Rp[8]*aPtW[2] + _aTwPrev[2];
+		accumulate(aPtW,fXp,fYp,fZp,pNlCur,adSum,pnCount);
+	}
+	inline void accumulate(const float* aPtW, const float fXp, const float fYp, const float fZp, const float* pNlCur, double* adSum, int* pnCount) const{
+		const float* Rc = _aRwCurTrans;
+		//projection onto the previous image
+		const int nX = cvRound(fXp * _fFx / fZp + _fU);
+		const int nY = cvRound(fYp * _fFy / fZp + _fV);
+		if (nX < 0 || nY < 0 || nX >= _cvmPtsWorldPrev.cols || nY >= _cvmPtsWorldPrev.rows || fZp < 0) return;
+		const float* pNlRef = _cvmNlsWorldPrev.ptr<float>(nY) + 3*nX; if (pNlRef[0] != pNlRef[0]) return;
+		const float* pPtRef = _cvmPtsWorldPrev.ptr<float>(nY) + 3*nX; if (pPtRef[0] != pPtRef[0]) return;
+		//distance gate
+		const float dx = pPtRef[0] - aPtW[0], dy = pPtRef[1] - aPtW[1], dz = pPtRef[2] - aPtW[2];
+		if (sqrt(dx*dx + dy*dy + dz*dz) > _fDistThres) return;
+		//angle gate
+		const float aNlW[3] = { Rc[0]*pNlCur[0] + Rc[1]*pNlCur[1] + Rc[2]*pNlCur[2], Rc[3]*pNlCur[0] + Rc[4]*pNlCur[1] + Rc[5]*pNlCur[2], Rc[6]*pNlCur[0] + Rc[7]*pNlCur[1] + Rc[8]*pNlCur[2] };
+		const float cx = aNlW[1]*pNlRef[2] - aNlW[2]*pNlRef[1], cy = aNlW[2]*pNlRef[0] - aNlW[0]*pNlRef[2], cz = aNlW[0]*pNlRef[1] - aNlW[1]*pNlRef[0];
+		if (sqrt(cx*cx + cy*cy + cz*cz) >= _fSinAngleThres) return;
+		//row of the point-to-plane system: [ p x n, n | n.(q - p) ]
+		float row[7];
+		row[0] = aPtW[1]*pNlRef[2] - aPtW[2]*pNlRef[1];
+		row[1] = aPtW[2]*pNlRef[0] - aPtW[0]*pNlRef[2];
+		row[2] = aPtW[0]*pNlRef[1] - aPtW[1]*pNlRef[0];
+		row[3] = pNlRef[0]; row[4] = pNlRef[1]; row[5] = pNlRef[2];
+		row[6] = pNlRef[0]*dx + pNlRef[1]*dy + pNlRef[2]*dz;
+		int nShift = 0;
+		for (int i = 0; i < 6; ++i) for (int j = i; j < 7; ++j) adSum[nShift++] += double(row[i]*row[j]);
+		(*pnCount)++;
+	}
+	float _fFx, _fFy, _fU, _fV;
+	float _fDistThres, _fSinAngleThres;
+	float _aRwCurTrans[9], _aTwCur[3];
+	float _aRwPrev[9], _aTwPrev[3];
+	const cv::Mat& _cvmPtsWorldPrev;
+	const cv::Mat& _cvmNlsWorldPrev;
+	const cv::Mat& _cvmPtsLocalCur;
+	const cv::Mat& _cvmNlsLocalCur;
+	const cv::Mat* _pcvmPtPlanesCur;
+	const cv::Mat* _pcvmNlPlanesCur;
+	double* _pdStripeSums;
+	int* _pnStripeCounts;
+};
+static int sumStripesICP(const int nStripes_, const std::vector<double>& vStripeSums_, const std::vector<int>& vStripeCounts_, double* pdSum_){
+	int nCount = 0;
+	for (int i = 0; i < CRegistrationICP::SUMS; i++) pdSum_[i] = 0.;
+	for (int s = 0; s < nStripes_; s++){
+		for (int i = 0; i < CRegistrationICP::SUMS; i++) pdSum_[i] += vStripeSums_[s*CRegistrationICP::SUMS+i];
+		nCount += vStripeCounts_[s];
+	}
+	return nCount;
+}
+int registrationICP( const float& fFx_, const float& fFy_, const float& u_, const float& v_, unsigned int uLevel_,
+	const float fDistThres_, const float fSinAngleThres_,
+	const float* pRwCur_, const float* pTwCur_, const float* pRwPrev_, const float* pTwPrev_,
+	const cv::Mat& cvmPtsWorldPrev_, const cv::Mat& cvmNlsWorldPrev_, const cv::Mat& cvmPtsLocalCur_, const cv::Mat& cvmNlsLocalCur_,
+	double* pdSum_ ){
+	BTL_ASSERT( CV_32FC3 == cvmPtsLocalCur_.type() && CV_32FC3 == cvmPtsWorldPrev_.type() && cvmNlsLocalCur_.size() == cvmPtsLocalCur_.size() && cvmNlsWorldPrev_.size() == cvmPtsWorldPrev_.size(), "btl::cpu::registrationICP() pts and nls must be CV_32FC3 of the same size" );
+	const float fScale = float(1<<uLevel_);
+	const int nStripes = (cvmPtsLocalCur_.rows + CRegistrationICP::STRIPE - 1)/CRegistrationICP::STRIPE;
+	std::vector<double> vStripeSums(nStripes*CRegistrationICP::SUMS);
+	std::vector<int> vStripeCounts(nStripes);
+	cv::parallel_for_( cv::Range(0,nStripes), CRegistrationICP(fFx_/fScale,fFy_/fScale,u_/fScale,v_/fScale,fDistThres_,fSinAngleThres_,
+		pRwCur_,pTwCur_,pRwPrev_,pTwPrev_,cvmPtsWorldPrev_,cvmNlsWorldPrev_,cvmPtsLocalCur_,cvmNlsLocalCur_,&vStripeSums[0],&vStripeCounts[0]) );
+	return sumStripesICP(nStripes,vStripeSums,vStripeCounts,pdSum_);
+}
+int registrationICP( const float& fFx_, const float& fFy_, const float& u_, const float& v_, unsigned int uLevel_,
+	const float fDistThres_, const float fSinAngleThres_,
+	const float* pRwCur_, const float* pTwCur_, const float* pRwPrev_, const float* pTwPrev_,
+	const cv::Mat& cvmPtsWorldPrev_, const cv::Mat& cvmNlsWorldPrev_, const cv::Mat* pcvmPtPlanesCur_, const cv::Mat* pcvmNlPlanesCur_,
+	double* pdSum_ ){
+	BTL_ASSERT( CV_32FC3 == cvmPtsWorldPrev_.type() && cvmNlsWorldPrev_.size() == cvmPtsWorldPrev_.size(), "btl::cpu::registrationICP() the previous pts and nls must be CV_32FC3 of the same size" );
+	for (int i = 0; i < 3; i++)
+		BTL_ASSERT( CV_32FC1 == pcvmPtPlanesCur_[i].type() && CV_32FC1 == pcvmNlPlanesCur_[i].type() && pcvmPtPlanesCur_[i].size() == pcvmPtPlanesCur_[0].size() && pcvmNlPlanesCur_[i].size() == pcvmPtPlanesCur_[0].size(), "btl::cpu::registrationICP() the current planes must be CV_32FC1 of the same size" );
+	const float fScale = float(1<<uLevel_);
+	const int nStripes = (pcvmPtPlanesCur_[0].rows + CRegistrationICP::STRIPE - 1)/CRegistrationICP::STRIPE;
+	std::vector<double> vStripeSums(nStripes*CRegistrationICP::SUMS);
+	std::vector<int> vStripeCounts(nStripes);
+	//the first planes only give the size of the current frame to the interleaved members
+	cv::parallel_for_( cv::Range(0,nStripes), CRegistrationICP(fFx_/fScale,fFy_/fScale,u_/fScale,v_/fScale,fDistThres_,fSinAngleThres_,
+		pRwCur_,pTwCur_,pRwPrev_,pTwPrev_,cvmPtsWorldPrev_,cvmNlsWorldPrev_,pcvmPtPlanesCur_[0],pcvmNlPlanesCur_[0],&vStripeSums[0],&vStripeCounts[0],
+		pcvmPtPlanesCur_,pcvmNlPlanesCur_) );
+	return sumStripesICP(nStripes,vStripeSums,vStripeCounts,pdSum_);
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+class CImageGradient : public cv::ParallelLoopBody
+{
+public:
+	CImageGradient(const cv::Mat& cvmBW_, cv::Mat* pcvmGx_, cv::Mat* pcvmGy_):_cvmBW(cvmBW_),_pcvmGx(pcvmGx_),_pcvmGy(pcvmGy_){}
+	virtual void operator()(const cv::Range& sRows_) const{
+		const int nCols = _cvmBW.cols;
+		const float fScale = .5f/255.f;
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			float* pGx = _pcvmGx->ptr<float>(r);
+			float* pGy = _pcvmGy->ptr<float>(r);
+			if (r == 0 || r == _cvmBW.rows-1){
+				for (int c = 0; c < nCols; c++) pGx[c] = pGy[c] = 0.f;
+				continue;
+			}
+			const uchar* pUp = _cvmBW.ptr<uchar>(r-1);
+			const uchar* pI = _cvmBW.ptr<uchar>(r);
+			const uchar* pDown = _cvmBW.ptr<uchar>(r+1);
+			pGx[0] = pGy[0] = pGx[nCols-1] = pGy[nCols-1] = 0.f;
+			for (int c = 1; c < nCols-1; c++){
+				pGx[c] = (int(pI[c+1]) - int(pI[c-1]))*fScale;
+				pGy[c] = (int(pDown[c]) - int(pUp[c]))*fScale;
+			}
+		}//for each row
+	}
+private:
+	const cv::Mat& _cvmBW;
+	cv::Mat* _pcvmGx;
+	cv::Mat* _pcvmGy;
+};
+void imageGradient(const cv::Mat& cvmBW_, cv::Mat* pcvmGx_, cv::Mat* pcvmGy_){
+	BTL_ASSERT( CV_8UC1 == cvmBW_.type(), "btl::cpu::imageGradient() input must be CV_8UC1" );
+	pcvmGx_->create(cvmBW_.size(),CV_32FC1);
+	pcvmGy_->create(cvmBW_.size(),CV_32FC1);
+	cv::parallel_for_( cv::Range(0,cvmBW_.rows), CImageGradient(cvmBW_,pcvmGx_,pcvmGy_) );
+}
+static inline float bilinear(const cv::Mat& cvmImg_, const int nX_, const int nY_, const float fA_, const float fB_){
+	const float* p0 = cvmImg_.ptr<float>(nY_) + nX_;
+	const float* p1 = cvmImg_.ptr<float>(nY_+1) + nX_;
+	return (1.f-fB_)*((1.f-fA_)*p0[0] + fA_*p0[1]) + fB_*((1.f-fA_)*p1[0] + fA_*p1[1]);
+}
+//same stripes and sum layout as CRegistrationICP. the rows of J'J are accumulated 4 columns at a time in float
+//and flushed into double after each image row.
+class CRegistrationPhotometric : public cv::ParallelLoopBody
+{
+public:
+	enum { STRIPE = 16, SUMS = 27 };
+	CRegistrationPhotometric(const float fFx_, const float fFy_, const float fU_, const float fV_, const float fDistThres_, const float fHuber_,
+		const float* pRwCur_, const float* pTwCur_, const float* pRwPrev_, const float* pTwPrev_,
+		const cv::Mat& cvmPtsWorldPrev_, const cv::Mat& cvmBWPrev_, const cv::Mat& cvmGxPrev_, const cv::Mat& cvmGyPrev_,
+		const cv::Mat& cvmPtsLocalCur_, const cv::Mat& cvmBWCur_, double* pdStripeSums_, int* pnStripeCounts_)
+	:_fFx(fFx_),_fFy(fFy_),_fU(fU_),_fV(fV_),_fDistThres(fDistThres_),_fHuber(fHuber_),
+	_cvmPtsWorldPrev(cvmPtsWorldPrev_),_cvmBWPrev(cvmBWPrev_),_cvmGxPrev(cvmGxPrev_),_cvmGyPrev(cvmGyPrev_),
+	_cvmPtsLocalCur(cvmPtsLocalCur_),_cvmBWCur(cvmBWCur_),_pdStripeSums(pdStripeSums_),_pnStripeCounts(pnStripeCounts_){
+		for (int i = 0; i < 3; i++) for (int j = 0; j < 3; j++){
+			_aRwCurTrans[i*3+j] = pRwCur_[i*3+j];//col major read row by row is Rw^T
+			_aRwPrev[i*3+j]     = pRwPrev_[j*3+i];
+		}
+		for (int i = 0; i < 3; i++) { _aTwCur[i] = pTwCur_[i]; _aTwPrev[i] = pTwPrev_[i]; }
+	}
+	virtual void operator()(const cv::Range& sStripes_) const{
+		const float* Rc = _aRwCurTrans;
+		const float* Rp = _aRwPrev;
+		const float fScale = 1.f/255.f;
+		for (int s = sStripes_.start; s < sStripes_.end; s++){
+			double adFull[48] = {0}; //6 rows of J'[J|b], 8 columns with a zero pad
+			int nCount = 0;
+			const int nEnd = std::min(_cvmPtsLocalCur.rows, (s+1)*STRIPE);
+			for (int r = s*STRIPE; r < nEnd; r++){
+				const float* pPtCur = _cvmPtsLocalCur.ptr<float>(r);
+				const uchar* pICur = _cvmBWCur.ptr<uchar>(r);
+#if CV_SSE2
+				__m128 aAcc[12];
+				for (int i = 0; i < 12; i++) aAcc[i] = _mm_setzero_ps();
+#else
+				float afAcc[48] = {0};
+#endif
+				for (int c = 0; c < _cvmPtsLocalCur.cols; c++, pPtCur += 3){
+					if (pPtCur[0] != pPtCur[0]) continue;
+					//transform the current vertex into world and then into the previous camera
+					const float x = pPtCur[0] - _aTwCur[0], y = pPtCur[1] - _aTwCur[1], z = pPtCur[2] - _aTwCur[2];
+					const float aPtW[3] = { Rc[0]*x + Rc[1]*y + Rc[2]*z, Rc[3]*x + Rc[4]*y + Rc[5]*z, Rc[6]*x + Rc[7]*y + Rc[8]*z };
+					const float fXp = Rp[0]*aPtW[0] + Rp[1]*aPtW[1] + Rp[2]*aPtW[2] + _aTwPrev[0];
+					const float fYp = Rp[3]*aPtW[0] + Rp[4]*aPtW[1] + Rp[5]*aPtW[2] + _aTwPrev[1];
+					const float fZp = Rp[6]*aPtW[0] + Rp[7]*aPtW[1] + Rp[8]*aPtW[2] + _aTwPrev[2];
+					if (fZp <= 0) continue;
+					//sub-pixel projection onto the previous image
+					const float fX = fXp * _fFx / fZp + _fU;
+					const float fY = fYp * _fFy / fZp + _fV;
+					if (!(fX >= 0 && fY >= 0 && fX < _cvmBWPrev.cols-1 && fY < _cvmBWPrev.rows-1)) continue;
+					const int nX = int(fX), nY = int(fY);
+					const float fA = fX - nX, fB = fY - nY;
+					//occlusion: the previous vertex seen there must be at about the same depth
+					const float* pPtRef = _cvmPtsWorldPrev.ptr<float>(nY + (fB > .5f)) + 3*(nX + (fA > .5f));
+					if (pPtRef[0] != pPtRef[0]) continue;
+					const float fZRef = Rp[6]*pPtRef[0] + Rp[7]*pPtRef[1] + Rp[8]*pPtRef[2] + _aTwPrev[2];
+					if (fabs(fZRef - fZp) > _fDistThres) continue;
+					//residual and huber weight
+					const uchar* pI0 = _cvmBWPrev.ptr<uchar>(nY) + nX;
+					const uchar* pI1 = _cvmBWPrev.ptr<uchar>(nY+1) + nX;
+					const float fIp = ((1.f-fB)*((1.f-fA)*pI0[0] + fA*pI0[1]) + fB*((1.f-fA)*pI1[0] + fA*pI1[1]))*fScale;
+					const float fRes = fIp - pICur[c]*fScale;
+					const float fW = fabs(fRes) <= _fHuber ? 1.f : sqrt(_fHuber/fabs(fRes));
+					//dI/dP in the previous camera, then rotated into world
+					const float fGx = bilinear(_cvmGxPrev,nX,nY,fA,fB)*_fFx/fZp, fGy = bilinear(_cvmGyPrev,nX,nY,fA,fB)*_fFy/fZp;
+					const float aG[3] = { fGx, fGy, -(fGx*fXp + fGy*fYp)/fZp };
+					const float aH[3] = { aG[0]*Rp[0] + aG[1]*Rp[3] + aG[2]*Rp[6], aG[0]*Rp[1] + aG[1]*Rp[4] + aG[2]*Rp[7], aG[0]*Rp[2] + aG[1]*Rp[5] + aG[2]*Rp[8] };
+					//row of the system: [ p x h, h | -r ], as the point-to-plane one with h for n
+					float row[8];
+					row[0] = fW*(aPtW[1]*aH[2] - aPtW[2]*aH[1]);
+					row[1] = fW*(aPtW[2]*aH[0] - aPtW[0]*aH[2]);
+					row[2] = fW*(aPtW[0]*aH[1] - aPtW[1]*aH[0]);
+					row[3] = fW*aH[0]; row[4] = fW*aH[1]; row[5] = fW*aH[2];
+					row[6] = -fW*fRes; row[7] = 0.f;
+#if CV_SSE2
+					const __m128 m128Lo = _mm_loadu_ps(row), m128Hi = _mm_loadu_ps(row+4);
+					for (int i = 0; i < 6; i++){
+						const __m128 m128S = _mm_set1_ps(row[i]);
+						aAcc[2*i]   = _mm_add_ps(aAcc[2*i],   _mm_mul_ps(m128S,m128Lo));
+						aAcc[2*i+1] = _mm_add_ps(aAcc[2*i+1], _mm_mul_ps(m128S,m128Hi));
+					}
+#else
+					for (int i = 0; i < 6; i++) for (int j = i; j < 7; j++) afAcc[i*8+j] += row[i]*row[j];
+#endif
+					nCount++;
+				}//for each col
+#if CV_SSE2
+				float CV_DECL_ALIGNED(16) afAcc[48];
+				for (int i = 0; i < 12; i++) _mm_store_ps(afAcc+4*i, aAcc[i]);
+#endif
+				for (int i = 0; i < 48; i++) adFull[i] += afAcc[i];
+			}//for each row
+			int nShift = 0;
+			for (int i = 0; i < 6; ++i) for (int j = i; j < 7; ++j) _pdStripeSums[s*SUMS + nShift++] = adFull[i*8+j];
+			_pnStripeCounts[s] = nCount;
+		}//for each stripe
+	}
+private:
+	float _fFx, _fFy, _fU, _fV;
+	float _fDistThres, _fHuber;
+	float _aRwCurTrans[9], _aTwCur[3];
+	float _aRwPrev[9], _aTwPrev[3];
+	const cv::Mat& _cvmPtsWorldPrev;
+	const cv::Mat& _cvmBWPrev;
+	const cv::Mat& _cvmGxPrev;
+	const cv::Mat& _cvmGyPrev;
+	const cv::Mat& _cvmPtsLocalCur;
+	const cv::Mat& _cvmBWCur;
+	double* _pdStripeSums;
+	int* _pnStripeCounts;
+};
+int registrationPhotometric( const float& fFx_, const float& fFy_, const float& u_, const float& v_, unsigned int uLevel_,
+	const float fDistThres_, const float fHuber_,
+	const float* pRwCur_, const float* pTwCur_, const float* pRwPrev_, const float* pTwPrev_,
+	const cv::Mat& cvmPtsWorldPrev_, const cv::Mat& cvmBWPrev_, const cv::Mat& cvmGxPrev_, const cv::Mat& cvmGyPrev_,
+	const cv::Mat& cvmPtsLocalCur_, const cv::Mat& cvmBWCur_,
+	double* pdSum_ ){
+	BTL_ASSERT( CV_32FC3 == cvmPtsLocalCur_.type() && CV_32FC3 == cvmPtsWorldPrev_.type() && CV_8UC1 == cvmBWCur_.type() && CV_8UC1 == cvmBWPrev_.type() &&
+		cvmBWCur_.size() == cvmPtsLocalCur_.size() && cvmBWPrev_.size() == cvmPtsWorldPrev_.size() && cvmGxPrev_.size() == cvmBWPrev_.size(), 
+		"btl::cpu::registrationPhotometric() pts must be CV_32FC3 and images CV_8UC1 of the same size" );
+	const float fScale = float(1<<uLevel_);
+	const int nStripes = (cvmPtsLocalCur_.rows + CRegistrationPhotometric::STRIPE - 1)/CRegistrationPhotometric::STRIPE;
+	std::vector<double> vStripeSums(nStripes*CRegistrationPhotometric::SUMS);
+	std::vector<int> vStripeCounts(nStripes);
+	cv::parallel_for_( cv::Range(0,nStripes), CRegistrationPhotometric(fFx_/fScale,fFy_/fScale,u_/fScale,v_/fScale,fDistThres_,fHuber_,
+		pRwCur_,pTwCur_,pRwPrev_,pTwPrev_,cvmPtsWorldPrev_,cvmBWPrev_,cvmGxPrev_,cvmGyPrev_,cvmPtsLocalCur_,cvmBWCur_,&vStripeSums[0],&vStripeCounts[0]) );
+	int nCount = 0;
+	for (int i = 0; i < CRegistrationPhotometric::SUMS; i++) pdSum_[i] = 0.;
+	for (int s = 0; s < nStripes; s++){
+		for (int i = 0; i < CRegistrationPhotometric::SUMS; i++) pdSum_[i] += vStripeSums[s*CRegistrationPhotometric::SUMS+i];
+		nCount += vStripeCounts[s];
+	}
+	return nCount;
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//each hypothesis draws its own sample from a generator seeded by its index, so the set does not depend on threads.
+//the minimal problems of a range are then solved together by btl::utility::absoluteOrientationBatch().
+class CRansacHypotheses : public cv::ParallelLoopBody
+{
+public:
+	enum { PARAMS = 12 };//9 of R col major then 3 of T
+	CRansacHypotheses(const Eigen::MatrixXf& eimRef_, const Eigen::MatrixXf& eimCur_, int* pIdx_, float* pHypotheses_, uchar* pValid_)
+	:_eimRef(eimRef_),_eimCur(eimCur_),_pIdx(pIdx_),_pHypotheses(pHypotheses_),_pValid(pValid_){}
+	virtual void operator()(const cv::Range& sHypo_) const{
+		const int N = (int)_eimRef.cols();
+		for (int h = sHypo_.start; h < sHypo_.end; h++){
+			cv::RNG cRng( 0x9E3779B9u + unsigned(h) );
+			int* pIdx = _pIdx + h*3;
+			pIdx[0] = 0; pIdx[1] = 1; pIdx[2] = 2;
+			_pValid[h] = 0;
+			//a few draws to get past degenerate samples
+			for (int nTry = 0; nTry < 8 && !_pValid[h]; nTry++){
+				int a = cRng.uniform(0,N), b = cRng.uniform(0,N), c = cRng.uniform(0,N);
+				if (a == b || b == c || a == c) continue;
+				//reject collinear samples, twice the area of the reference triangle must not vanish
+				const Eigen::Vector3f eivU = _eimRef.col(b) - _eimRef.col(a), eivV = _eimRef.col(c) - _eimRef.col(a);
+				if (eivU.cross(eivV).squaredNorm() < 1e-6f) continue;
+				pIdx[0] = a; pIdx[1] = b; pIdx[2] = c;
+				_pValid[h] = 1;
+			}
+		}//for each hypothesis
+		const int nHypo = sHypo_.end - sHypo_.start;
+		if (nHypo <= 0) return;
+		std::vector< Eigen::Matrix3f > vR(nHypo);
+		std::vector< Eigen::Vector3f > vT(nHypo);
+		btl::utility::absoluteOrientationBatch<float>( _eimRef, _eimCur, _pIdx + sHypo_.start*3, 3, nHypo, &vR[0], &vT[0] );
+		for (int i = 0; i < nHypo; i++){
+			float* pH = _pHypotheses + (sHypo_.start + i)*PARAMS;
+			for (int j = 0; j < 9; j++) pH[j] = vR[i].data()[j];
+			for (int j = 0; j < 3; j++) pH[9+j] = vT[i](j);
+		}
+	}
+private:
+	const Eigen::MatrixXf& _eimRef;
+	const Eigen::MatrixXf& _eimCur;
+	int* _pIdx;
+	float* _pHypotheses;
+	uchar* _pValid;
+};
+//counts the pairs in [nBegin,nEnd) with |R ref + T - cur| < thres for every surviving hypothesis, 4 pairs per step.
+//the SoA rows are padded with NaN up to a multiple of 4, NaN never passes the test.
+class CRansacScore : public cv::ParallelLoopBody
+{
+public:
+	CRansacScore(const cv::Mat& cvmRef_, const cv::Mat& cvmCur_, const float* pHypotheses_, const int* pSurvivors_, 
+		int nBegin_, int nEnd_, float fThres_, int* pScores_)
+	:_cvmRef(cvmRef_),_cvmCur(cvmCur_),_pHypotheses(pHypotheses_),_pSurvivors(pSurvivors_),
+	_nBegin(nBegin_),_nEnd(nEnd_),_fThres2(fThres_*fThres_),_pScores(pScores_){}
+	virtual void operator()(const cv::Range& sSurvivors_) const{
+		const float* pRx = _cvmRef.ptr<float>(0); const float* pRy = _cvmRef.ptr<float>(1); const float* pRz = _cvmRef.ptr<float>(2);
+		const float* pCx = _cvmCur.ptr<float>(0); const float* pCy = _cvmCur.ptr<float>(1); const float* pCz = _cvmCur.ptr<float>(2);
+		for (int s = sSurvivors_.start; s < sSurvivors_.end; s++){
+			const int h = _pSurvivors[s];
+			const float* R = _pHypotheses + h*CRansacHypotheses::PARAMS;
+			const float* T = R + 9;
+			int nScore = 0;
+			int i = _nBegin;
+#if CV_SSE2
+			const __m128 r0 = _mm_set1_ps(R[0]), r1 = _mm_set1_ps(R[1]), r2 = _mm_set1_ps(R[2]);
+			const __m128 r3 = _mm_set1_ps(R[3]), r4 = _mm_set1_ps(R[4]), r5 = _mm_set1_ps(R[5]);
+			const __m128 r6 = _mm_set1_ps(R[6]), r7 = _mm_set1_ps(R[7]), r8 = _mm_set1_ps(R[8]);
+			const __m128 t0 = _mm_set1_ps(T[0]), t1 = _mm_set1_ps(T[1]), t2 = _mm_set1_ps(T[2]);
+			const __m128 m128Thres2 = _mm_set1_ps(_fThres2);
+			for (; i + 4 <= _nEnd; i += 4){
+				const __m128 x = _mm_loadu_ps(pRx+i), y = _mm_loadu_ps(pRy+i), z = _mm_loadu_ps(pRz+i);
+				const __m128 dx = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(r0,x), _mm_mul_ps(r3,y) ), _mm_add_ps( _mm_mul_ps(r6,z), t0 ) ), _mm_loadu_ps(pCx+i) );
+				const __m128 dy = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(r1,x), _mm_mul_ps(r4,y) ), _mm_add_ps( _mm_mul_ps(r7,z), t1 ) ), _mm_loadu_ps(pCy+i) );
+				const __m128 dz = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(r2,x), _mm_mul_ps(r5,y) ), _mm_add_ps( _mm_mul_ps(r8,z), t2 ) ), _mm_loadu_ps(pCz+i) );
+				const __m128 d2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps(dx,dx), _mm_mul_ps(dy,dy) ), _mm_mul_ps(dz,dz) );
+				const int nMask = _mm_movemask_ps( _mm_cmplt_ps(d2,m128Thres2) );
+				nScore += (nMask&1) + ((nMask>>1)&1) + ((nMask>>2)&1) + ((nMask>>3)&1);
+			}
+#endif
+			for (; i < _nEnd; i++){
+				const float dx = R[0]*pRx[i] + R[3]*pRy[i] + R[6]*pRz[i] + T[0] - pCx[i];
+				const float dy = R[1]*pRx[i] + R[4]*pRy[i] + R[7]*pRz[i] + T[1] - pCy[i];
+				const float dz = R[2]*pRx[i] + R[5]*pRy[i] + R[8]*pRz[i] + T[2] - pCz[i];
+				if (dx*dx + dy*dy + dz*dz < _fThres2) nScore++;
+			}
+			_pScores[h] += nScore;
+		}//for each surviving hypothesis
+	}
+private:
+	const cv::Mat& _cvmRef;
+	const cv::Mat& _cvmCur;
+	const float* _pHypotheses;
+	const int* _pSurvivors;
+	int _nBegin, _nEnd;
+	float _fThres2;
+	int* _pScores;
+};
+//orders the survivors by score, ties by index so that the outcome is reproducible
+struct SRansacRank{
+	SRansacRank(const int* pScores_):_pScores(pScores_){}
+	bool operator()(int a_, int b_) const { return _pScores[a_] != _pScores[b_] ? _pScores[a_] > _pScores[b_] : a_ < b_; }
+	const int* _pScores;
+};
+int ransacAbsoluteOrientation( const cv::Mat& cvmRef_, const cv::Mat& cvmCur_, const float fInlierThres_, const int nHypotheses_, const int nBlock_,
+	float* pRw_, float* pTw_, std::vector<uchar>* pvInliers_ ){
+	BTL_ASSERT( CV_32FC1 == cvmRef_.type() && CV_32FC1 == cvmCur_.type() && 3 == cvmRef_.rows && cvmRef_.size() == cvmCur_.size(), "btl::cpu::ransacAbsoluteOrientation() ref and cur must be 3 x N CV_32FC1" );
+	BTL_ASSERT( nHypotheses_ > 0 && nBlock_ > 0, "btl::cpu::ransacAbsoluteOrientation() nHypotheses_ and nBlock_ must be positive" );
+	const int N = cvmRef_.cols;
+	pvInliers_->assign(N,0);
+	if (N < 3) return 0;
+	//the pairs are scored in a random order so that every block is an unbiased subset, padded with NaN to a multiple of 4
+	std::vector<int> vOrder(N);
+	for (int i = 0; i < N; i++) vOrder[i] = i;
+	cv::RNG cRng(0x5bd1e995u);
+	for (int i = N-1; i > 0; i--) std::swap( vOrder[i], vOrder[cRng.uniform(0,i+1)] );
+	const int nPadded = (N + 3) & ~3;
+	cv::Mat cvmRef(3,nPadded,CV_32FC1), cvmCur(3,nPadded,CV_32FC1);
+	cvmRef.setTo(_fNaN); cvmCur.setTo(_fNaN);
+	for (int k = 0; k < 3; k++) for (int i = 0; i < N; i++){
+		cvmRef.ptr<float>(k)[i] = cvmRef_.ptr<float>(k)[vOrder[i]];
+		cvmCur.ptr<float>(k)[i] = cvmCur_.ptr<float>(k)[vOrder[i]];
+	}
+	//hypotheses
+	Eigen::MatrixXf eimRef(3,N), eimCur(3,N);
+	for (int k = 0; k < 3; k++) for (int i = 0; i < N; i++){
+		eimRef(k,i) = cvmRef_.ptr<float>(k)[i];
+		eimCur(k,i) = cvmCur_.ptr<float>(k)[i];
+	}
+	std::vector<float> vHypotheses(nHypotheses_*CRansacHypotheses::PARAMS);
+	std::vector<int> vIdx(nHypotheses_*3);
+	std::vector<uchar> vValid(nHypotheses_);
+	cv::parallel_for_( cv::Range(0,nHypotheses_), CRansacHypotheses(eimRef,eimCur,&vIdx[0],&vHypotheses[0],&vValid[0]) );
+	std::vector<int> vSurvivors;
+	for (int h = 0; h < nHypotheses_; h++) if (vValid[h]) vSurvivors.push_back(h);
+	if (vSurvivors.empty()) return 0;
+	//preemption: after i scored pairs keep the best M * 2^-floor(i/B) hypotheses, stop when one is left
+	std::vector<int> vScores(nHypotheses_,0);
+	int nScored = 0;
+	while (vSurvivors.size() > 1 && nScored < N){
+		const int nEnd = std::min(N, nScored + nBlock_);
+		cv::parallel_for_( cv::Range(0,(int)vSurvivors.size()), CRansacScore(cvmRef,cvmCur,&vHypotheses[0],&vSurvivors[0],nScored,nEnd,fInlierThres_,&vScores[0]) );
+		nScored = nEnd;
+		const int nHalvings = nScored / nBlock_;
+		const size_t nKeep = std::max<size_t>( 1, nHalvings < 31 ? size_t(nHypotheses_ >> nHalvings) : 0 );
+		std::sort( vSurvivors.begin(), vSurvivors.end(), SRansacRank(&vScores[0]) );
+		if (nKeep < vSurvivors.size()) vSurvivors.resize(nKeep);
+	}
+	//the winner votes over all pairs
+	const int h = vSurvivors.front();
+	const float* R = &vHypotheses[h*CRansacHypotheses::PARAMS];
+	const float* T = R + 9;
+	const float fThres2 = fInlierThres_*fInlierThres_;
+	int nInliers = 0;
+	for (int i = 0; i < N; i++){
+		float d2 = 0.f;
+		for (int k = 0; k < 3; k++){
+			const float d = R[k]*cvmRef_.ptr<float>(0)[i] + R[3+k]*cvmRef_.ptr<float>(1)[i] + R[6+k]*cvmRef_.ptr<float>(2)[i] + T[k] - cvmCur_.ptr<float>(k)[i];
+			d2 += d*d;
+		}
+		if (d2 < fThres2) { (*pvInliers_)[i] = 1; nInliers++; }
+	}
+	for (int i = 0; i < 9; i++) pRw_[i] = R[i];
+	for (int i = 0; i < 3; i++) pTw_[i] = T[i];
+	return nInliers;
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline int popCount64(uint64 u_){
+	u_ = u_ - ((u_ >> 1) & 0x5555555555555555ULL);
+	u_ = (u_ & 0x3333333333333333ULL) + ((u_ >> 2) & 0x3333333333333333ULL);
+	u_ = (u_ + (u_ >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return int((u_ * 0x0101010101010101ULL) >> 56);
+}
+static inline int hamming(const uchar* pA_, const uchar* pB_, const int nBytes_){
+	int nDist = 0, i = 0;
+	for (; i <= nBytes_ - 8; i += 8){
+		uint64 uA, uB;
+		memcpy(&uA,pA_+i,8); memcpy(&uB,pB_+i,8);
+		nDist += popCount64(uA^uB);
+	}
+	for (; i < nBytes_; i++) nDist += popCount64(uint64(pA_[i]^pB_[i]));
+	return nDist;
+}
+//each reference feature looks for its nearest descriptor among the current keypoints of the grid cells its search
+//circle overlaps, the cells are fRadius_ wide so at most 3x3 of them are visited
+class CGuidedMatch : public cv::ParallelLoopBody
+{
+public:
+	CGuidedMatch(const std::vector<cv::Point2f>& vRefProjected_, const cv::Mat& cvmRefDescriptors_,
+		const std::vector<cv::Point2f>& vCur_, const cv::Mat& cvmCurDescriptors_,
+		const std::vector<int>& vCellStart_, const std::vector<int>& vCellIdx_, const int nCellsX_, const int nCellsY_,
+		const float fRadius_, const int nMaxDistance_, int* pBestCur_, int* pBestDist_)
+		:_vRefProjected(vRefProjected_),_cvmRefDescriptors(cvmRefDescriptors_),_vCur(vCur_),_cvmCurDescriptors(cvmCurDescriptors_),
+		_vCellStart(vCellStart_),_vCellIdx(vCellIdx_),_nCellsX(nCellsX_),_nCellsY(nCellsY_),
+		_fRadius(fRadius_),_nMaxDistance(nMaxDistance_),_pBestCur(pBestCur_),_pBestDist(pBestDist_){}
+	virtual void operator()(const cv::Range& sRange_) const{
+		const float fRadius2 = _fRadius*_fRadius;
+		const int nBytes = _cvmRefDescriptors.cols;
+		for (int r = sRange_.start; r < sRange_.end; r++){
+			_pBestCur[r] = -1;
+			_pBestDist[r] = _nMaxDistance+1;
+			const cv::Point2f& sRef = _vRefProjected[r];
+			if (sRef.x != sRef.x) continue; //not projected
+			const int nX0 = std::max(0, int((sRef.x-_fRadius)/_fRadius)), nX1 = std::min(_nCellsX-1, int((sRef.x+_fRadius)/_fRadius));
+			const int nY0 = std::max(0, int((sRef.y-_fRadius)/_fRadius)), nY1 = std::min(_nCellsY-1, int((sRef.y+_fRadius)/_fRadius));
+			const uchar* pRef = _cvmRefDescriptors.ptr<uchar>(r);
+			for (int y = nY0; y <= nY1; y++) for (int x = nX0; x <= nX1; x++){
+				const int nCell = y*_nCellsX + x;
+				for (int k = _vCellStart[nCell]; k < _vCellStart[nCell+1]; k++){
+					const int c = _vCellIdx[k];
+					const float dx = _vCur[c].x - sRef.x, dy = _vCur[c].y - sRef.y;
+					if (dx*dx + dy*dy > fRadius2) continue;
+					const int nDist = hamming(pRef,_cvmCurDescriptors.ptr<uchar>(c),nBytes);
+					if (nDist < _pBestDist[r]) { _pBestDist[r] = nDist; _pBestCur[r] = c; }
+				}
+			}
+		}
+	}
+private:
+	const std::vector<cv::Point2f>& _vRefProjected;
+	const cv::Mat& _cvmRefDescriptors;
+	const std::vector<cv::Point2f>& _vCur;
+	const cv::Mat& _cvmCurDescriptors;
+	const std::vector<int>& _vCellStart;
+	const std::vector<int>& _vCellIdx;
+	const int _nCellsX, _nCellsY;
+	const float _fRadius;
+	const int _nMaxDistance;
+	int* _pBestCur;
+	int* _pBestDist;
+};
+int guidedMatch( const std::vector<cv::Point2f>& vRefProjected_, const cv::Mat& cvmRefDescriptors_,
+	const std::vector<cv::Point2f>& vCur_, const cv::Mat& cvmCurDescriptors_, const cv::Size& sImage_,
+	const float fRadius_, const int nMaxDistance_, std::vector<cv::DMatch>* pvMatches_ ){
+	BTL_ASSERT( CV_8UC1 == cvmRefDescriptors_.type() && CV_8UC1 == cvmCurDescriptors_.type() && cvmRefDescriptors_.cols == cvmCurDescriptors_.cols, "btl::cpu::guidedMatch() descriptors must be CV_8UC1 of the same length" );
+	BTL_ASSERT( int(vRefProjected_.size()) == cvmRefDescriptors_.rows && int(vCur_.size()) == cvmCurDescriptors_.rows, "btl::cpu::guidedMatch() one descriptor row per feature" );
+	BTL_ASSERT( fRadius_ >= 1.f, "btl::cpu::guidedMatch() fRadius_ must be at least a pixel" );
+	pvMatches_->clear();
+	const int nRef = int(vRefProjected_.size()), nCur = int(vCur_.size());
+	if (0 == nRef || 0 == nCur) return 0;
+	//bucket the current keypoints, counting sort by cell
+	const int nCellsX = int(sImage_.width/fRadius_) + 1, nCellsY = int(sImage_.height/fRadius_) + 1;
+	std::vector<int> vCellOf(nCur), vCellStart(nCellsX*nCellsY+1,0), vCellIdx(nCur);
+	for (int c = 0; c < nCur; c++){
+		const int x = std::min(nCellsX-1, std::max(0, int(vCur_[c].x/fRadius_)));
+		const int y = std::min(nCellsY-1, std::max(0, int(vCur_[c].y/fRadius_)));
+		vCellOf[c] = y*nCellsX + x;
+		vCellStart[vCellOf[c]+1]++;
+	}
+	for (size_t i = 1; i < vCellStart.size(); i++) vCellStart[i] += vCellStart[i-1];
+	std::vector<int> vFill(vCellStart.begin(), vCellStart.end()-1);
+	for (int c = 0; c < nCur; c++) vCellIdx[vFill[vCellOf[c]]++] = c;
+	//nearest descriptor in the window of every reference feature
+	std::vector<int> vBestCur(nRef), vBestDist(nRef);
+	cv::parallel_for_( cv::Range(0,nRef), CGuidedMatch(vRefProjected_,cvmRefDescriptors_,vCur_,cvmCurDescriptors_,vCellStart,vCellIdx,nCellsX,nCellsY,fRadius_,nMaxDistance_,&vBestCur[0],&vBestDist[0]) );
+	//a current keypoint claimed by several references keeps the closest one
+	std::vector<int> vClaim(nCur,-1);
+	for (int r = 0; r < nRef; r++){
+		const int c = vBestCur[r];
+		if (c < 0) continue;
+		if (vClaim[c] < 0 || vBestDist[r] < vBestDist[vClaim[c]]) vClaim[c] = r;
+	}
+	for (int c = 0; c < nCur; c++)
+		if (vClaim[c] >= 0) pvMatches_->push_back( cv::DMatch(c,vClaim[c],float(vBestDist[vClaim[c]])) );
+	return int(pvMatches_->size());
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//n_ mod nRes_ in [0,nRes_) for negative n_ as well
+static inline int wrap(const int n_, const int nRes_){
+	const int m = n_ % nRes_;
+	return m < 0 ? m + nRes_ : m;
+}
+//floor() without the libm call, for |fX_| well within the int range
+static inline int floorInt(const float fX_){
+	const int n = int(fX_);
+	return n - int(fX_ < float(n));
+}
+//narrows [*pfLo_,*pfHi_] to the x where c0_ + c1_*x >= 0
+static inline void clipLinear(const float c0_, const float c1_, float* pfLo_, float* pfHi_){
+	if (fabsf(c1_) < 1e-12f) { if (c0_ < 0.f) *pfHi_ = -1.f; return; }
+	const float fX = -c0_/c1_;
+	if (c1_ > 0.f) *pfLo_ = std::max(*pfLo_,fX);
+	else           *pfHi_ = std::min(*pfHi_,fX);
+}
+//the update of pcl::device::tsdf23 on the same short2 layout, one row of x-contiguous voxels (a fixed y and z) per
+//step: the voxel centre is projected into the depth map rounding to nearest, sdf = depth - |voxel - camera|, the
+//tsdf is capped at 1 and averaged with weight 1 up to MAX_WEIGHT. every row is first clipped as a line against the
+//view frustum and the farthest depth plus the truncation, so rows out of view are skipped as a whole and the rest
+//only visit their span in view, 8 voxels at a time. the rows are either those of the dense volume or those of the
+//sparse blocks, nBlockSide_^2 rows of nBlockSide_ voxels per block. the dense volume is cyclic: world voxel g is kept
+//at g mod _nRes, so that a buffer row holds up to two runs of world voxels. with _pcvmDirty the bricks of _nBrick^3
+//voxels, counted from _anOrigin, in which a tsdf changed or a voxel was first observed are flagged.
+class CIntegrateTsdf : public cv::ParallelLoopBody
+{
+public:
+	enum { MAX_WEIGHT = 1 << 7, DIVISOR = 32767 };
+	CIntegrateTsdf(const cv::Mat& cvmDepth_, const float fVoxelSize_, const float fTrunc_, const float* pRw_, const float* pCw_,
+		const float fFx_, const float fFy_, const float fU_, const float fV_, const float fMaxDepth_, const int* pnOrigin_, cv::Mat* pcvmVolume_,
+		cv::Mat* pcvmDirty_, const int nBrick_)
+	:_cvmDepth(cvmDepth_),_fVoxelSize(fVoxelSize_),_fTrunc(fTrunc_),_fFx(fFx_),_fFy(fFy_),_fU(fU_),_fV(fV_),_fMaxDepth(fMaxDepth_),
+	_pcvmVolume(pcvmVolume_),_nRes(pcvmVolume_->cols),_pvpBlocks(NULL),_pvBlockOrigins(NULL),_pcvmDirty(pcvmDirty_),_nBrick(nBrick_){
+		setPose(pRw_,pCw_);
+		for (int i = 0; i < 3; i++) _anOrigin[i] = pnOrigin_ ? pnOrigin_[i] : 0;
+	}
+	CIntegrateTsdf(const cv::Mat& cvmDepth_, const float fVoxelSize_, const float fTrunc_, const float* pRw_, const float* pCw_,
+		const float fFx_, const float fFy_, const float fU_, const float fV_, const float fMaxDepth_,
+		const std::vector<short*>& vpBlocks_, const std::vector<cv::Point3i>& vBlockOrigins_, const int nBlockSide_)
+	:_cvmDepth(cvmDepth_),_fVoxelSize(fVoxelSize_),_fTrunc(fTrunc_),_fFx(fFx_),_fFy(fFy_),_fU(fU_),_fV(fV_),_fMaxDepth(fMaxDepth_),
+	_pcvmVolume(NULL),_nRes(nBlockSide_),_pvpBlocks(&vpBlocks_),_pvBlockOrigins(&vBlockOrigins_),_pcvmDirty(NULL),_nBrick(nBlockSide_){
+		setPose(pRw_,pCw_);
+		_anOrigin[0] = _anOrigin[1] = _anOrigin[2] = 0;
+	}
+	virtual void operator()(const cv::Range& sRows_) const{
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			if (_pcvmVolume){
+				//world y and z of the buffer row, and the buffer x of the first world voxel of the row
+				const int y = _anOrigin[1] + wrap( r % _nRes - _anOrigin[1], _nRes );
+				const int z = _anOrigin[2] + wrap( r / _nRes - _anOrigin[2], _nRes );
+				const int m = wrap( _anOrigin[0], _nRes );
+				short* pRow = _pcvmVolume->ptr<short>(r);
+				integrateRow( _anOrigin[0], y, z, _nRes - m, pRow + 2*m );
+				if (m > 0) integrateRow( _anOrigin[0] + _nRes - m, y, z, m, pRow );
+				continue;
+			}
+			const int nBlock = r / (_nRes*_nRes), nRow = r % (_nRes*_nRes);
+			const cv::Point3i& sO = (*_pvBlockOrigins)[nBlock];
+			integrateRow( sO.x, sO.y + nRow % _nRes, sO.z + nRow / _nRes, _nRes, (*_pvpBlocks)[nBlock] + 2*nRow*_nRes );
+		}
+	}
+private:
+	void setPose(const float* pRw_, const float* pCw_){
+		for (int i = 0; i < 3; i++) for (int j = 0; j < 3; j++) _aRw[i*3+j] = pRw_[j*3+i];//row major
+		for (int i = 0; i < 3; i++) _aCw[i] = pCw_[i];
+	}
+	//the nLen_ voxels (x0_+x, y_, z_), x in [0,nLen_), stored from pVoxel_ on
+	void integrateRow(const int x0_, const int y_, const int z_, const int nLen_, short* pVoxel_) const{
+		const float* R = _aRw;
+		const float fS = _fVoxelSize;
+		const float fW = float(_cvmDepth.cols), fH = float(_cvmDepth.rows);
+		//voxel x of the row at a + x*b in camera coordinates
+		const float gx = (x0_ + .5f)*fS - _aCw[0], gy = (y_ + .5f)*fS - _aCw[1], gz = (z_ + .5f)*fS - _aCw[2];
+		const float a[3] = { R[0]*gx + R[1]*gy + R[2]*gz, R[3]*gx + R[4]*gy + R[5]*gz, R[6]*gx + R[7]*gy + R[8]*gz };
+		const float b[3] = { R[0]*fS, R[3]*fS, R[6]*fS };
+		//in front of the camera, not behind the farthest surface, and within a pixel of the image
+		float fLo = 0.f, fHi = float(nLen_-1);
+		clipLinear( a[2], b[2], &fLo, &fHi );
+		clipLinear( _fMaxDepth + _fTrunc - a[2], -b[2], &fLo, &fHi );
+		clipLinear( _fFx*a[0] + (_fU+1.f)*a[2], _fFx*b[0] + (_fU+1.f)*b[2], &fLo, &fHi );
+		clipLinear( (fW-_fU)*a[2] - _fFx*a[0], (fW-_fU)*b[2] - _fFx*b[0], &fLo, &fHi );
+		clipLinear( _fFy*a[1] + (_fV+1.f)*a[2], _fFy*b[1] + (_fV+1.f)*b[2], &fLo, &fHi );
+		clipLinear( (fH-_fV)*a[2] - _fFy*a[1], (fH-_fV)*b[2] - _fFy*b[1], &fLo, &fHi );
+		if (fLo > fHi) return;
+		const int x1 = std::min( nLen_-1, int(ceil(fHi)) );
+		int x = std::max( 0, int(floor(fLo)) );
+		const float fYZ2 = gy*gy + gz*gz;
+		//the flags of the row of bricks the voxels fall in
+		uchar* pDirty = _pcvmDirty ? _pcvmDirty->ptr<uchar>( (z_ - _anOrigin[2])/_nBrick*_pcvmDirty->cols + (y_ - _anOrigin[1])/_nBrick ) : NULL;
+		const int nLocal = x0_ - _anOrigin[0];
+#if CV_SSE2
+		for (; x + 8 <= x1 + 1; x += 8){
+			const bool bChanged = update4( a, b, x,   x0_, fYZ2, pVoxel_ ) | update4( a, b, x+4, x0_, fYZ2, pVoxel_ );
+			if (bChanged && pDirty) pDirty[(nLocal + x)/_nBrick] = pDirty[(nLocal + x + 7)/_nBrick] = DIRTY_MESH | DIRTY_MIN_MAX;
+		}
+#endif
+		for (; x <= x1; x++){
+			const float X = a[0] + x*b[0], Y = a[1] + x*b[1], Z = a[2] + x*b[2];
+			if (!(Z > 0.f)) continue;
+			const float fInvZ = 1.f/Z;
+			const int nU = cvRound( X*_fFx*fInvZ + _fU ), nV = cvRound( Y*_fFy*fInvZ + _fV );
+			if (nU < 0 || nV < 0 || nU >= _cvmDepth.cols || nV >= _cvmDepth.rows) continue;
+			const float fD = _cvmDepth.ptr<float>(nV)[nU];
+			const float fGx = (x0_ + x + .5f)*fS - _aCw[0];
+			const float fSdf = fD - sqrtf( fGx*fGx + fYZ2 );
+			if (!(fD != 0.f && fSdf >= -_fTrunc)) continue;
+			const float fTsdf = std::min( 1.f, fSdf/_fTrunc );
+			short* pV = pVoxel_ + 2*x;
+			const float fWeight = pV[1];
+			const float fNew = ( float(pV[0])/DIVISOR*fWeight + fTsdf )/( fWeight + 1.f );
+			const short sPrev = pV[0];
+			pV[0] = short( std::max( -float(DIVISOR), std::min( float(DIVISOR), fNew*DIVISOR ) ) );
+			pV[1] = short( std::min( fWeight + 1.f, float(MAX_WEIGHT) ) );
+			if (pDirty && (sPrev != pV[0] || 0.f == fWeight)) pDirty[(nLocal + x)/_nBrick] = DIRTY_MESH | DIRTY_MIN_MAX;
+		}
+	}
+#if CV_SSE2
+	//returns whether a tsdf changed or a voxel was first observed
+	inline bool update4(const float* a, const float* b, const int x, const int x0_, const float fYZ2_, short* pVoxel_) const{
+		const __m128 m128X = _mm_add_ps( _mm_set1_ps(float(x)), _mm_set_ps(3.f,2.f,1.f,0.f) );
+		const __m128 m128Z = _mm_add_ps( _mm_set1_ps(a[2]), _mm_mul_ps(m128X,_mm_set1_ps(b[2])) );
+		const __m128 m128InvZ = _mm_div_ps( _mm_set1_ps(1.f), m128Z );
+		const __m128 m128Cx = _mm_add_ps( _mm_set1_ps(a[0]), _mm_mul_ps(m128X,_mm_set1_ps(b[0])) );
+		const __m128 m128Cy = _mm_add_ps( _mm_set1_ps(a[1]), _mm_mul_ps(m128X,_mm_set1_ps(b[1])) );
+		//_mm_cvtps_epi32() rounds to nearest like __float2int_rn(), NaN and inf become INT_MIN
+		const __m128i m128iU = _mm_cvtps_epi32( _mm_add_ps( _mm_mul_ps( _mm_mul_ps(m128Cx,_mm_set1_ps(_fFx)), m128InvZ ), _mm_set1_ps(_fU) ) );
+		const __m128i m128iV = _mm_cvtps_epi32( _mm_add_ps( _mm_mul_ps( _mm_mul_ps(m128Cy,_mm_set1_ps(_fFy)), m128InvZ ), _mm_set1_ps(_fV) ) );
+		const __m128i m128iMinus1 = _mm_set1_epi32(-1);
+		__m128i m128iIn = _mm_and_si128( _mm_cmpgt_epi32(m128iU,m128iMinus1), _mm_cmplt_epi32(m128iU,_mm_set1_epi32(_cvmDepth.cols)) );
+		m128iIn = _mm_and_si128( m128iIn, _mm_and_si128( _mm_cmpgt_epi32(m128iV,m128iMinus1), _mm_cmplt_epi32(m128iV,_mm_set1_epi32(_cvmDepth.rows)) ) );
+		m128iIn = _mm_and_si128( m128iIn, _mm_castps_si128( _mm_cmpgt_ps(m128Z,_mm_setzero_ps()) ) );
+		const int nIn = _mm_movemask_ps( _mm_castsi128_ps(m128iIn) );
+		if (0 == nIn) return false;
+		//there is no gather in SSE2
+		CV_DECL_ALIGNED(16) int anU[4], anV[4];
+		CV_DECL_ALIGNED(16) float afD[4];
+		_mm_store_si128( (__m128i*)anU, m128iU );
+		_mm_store_si128( (__m128i*)anV, m128iV );
+		for (int k = 0; k < 4; k++) afD[k] = (nIn >> k & 1) ? _cvmDepth.ptr<float>(anV[k])[anU[k]] : _fNaN;
+		const __m128 m128D = _mm_load_ps(afD);
+		const __m128 m128Gx = _mm_sub_ps( _mm_mul_ps( _mm_add_ps( _mm_add_ps(m128X,_mm_set1_ps(float(x0_))), _mm_set1_ps(.5f) ), _mm_set1_ps(_fVoxelSize) ), _mm_set1_ps(_aCw[0]) );
+		const __m128 m128Sdf = _mm_sub_ps( m128D, _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps(m128Gx,m128Gx), _mm_set1_ps(fYZ2_) ) ) );
+		//NaN depth fails the second test
+		const __m128 m128Upd = _mm_and_ps( _mm_cmpneq_ps(m128D,_mm_setzero_ps()), _mm_cmpge_ps(m128Sdf,_mm_set1_ps(-_fTrunc)) );
+		if (0 == _mm_movemask_ps(m128Upd)) return false;
+		const __m128 m128Tsdf = _mm_min_ps( _mm_set1_ps(1.f), _mm_div_ps(m128Sdf,_mm_set1_ps(_fTrunc)) );
+		//unpack the short2 (tsdf, weight) pairs
+		__m128i* pV = (__m128i*)(pVoxel_ + 2*x);
+		const __m128i m128iVox = _mm_loadu_si128(pV);
+		const __m128 m128Prev = _mm_div_ps( _mm_cvtepi32_ps( _mm_srai_epi32( _mm_slli_epi32(m128iVox,16), 16 ) ), _mm_set1_ps(float(DIVISOR)) );
+		const __m128 m128W = _mm_cvtepi32_ps( _mm_srai_epi32(m128iVox,16) );
+		const __m128 m128W1 = _mm_add_ps( m128W, _mm_set1_ps(1.f) );
+		const __m128 m128New = _mm_div_ps( _mm_add_ps( _mm_mul_ps(m128Prev,m128W), m128Tsdf ), m128W1 );
+		//clamped in float, then truncated like __float2int_rz()
+		const __m128 m128Div = _mm_set1_ps(float(DIVISOR));
+		const __m128i m128iNew = _mm_cvttps_epi32( _mm_max_ps( _mm_sub_ps(_mm_setzero_ps(),m128Div), _mm_min_ps( m128Div, _mm_mul_ps(m128New,m128Div) ) ) );
+		const __m128i m128iW = _mm_cvttps_epi32( _mm_min_ps( m128W1, _mm_set1_ps(float(MAX_WEIGHT)) ) );
+		const __m128i m128iPacked = _mm_or_si128( _mm_and_si128(m128iNew,_mm_set1_epi32(0xffff)), _mm_slli_epi32(m128iW,16) );
+		const __m128i m128iUpd = _mm_castps_si128(m128Upd);
+		_mm_storeu_si128( pV, _mm_or_si128( _mm_and_si128(m128iUpd,m128iPacked), _mm_andnot_si128(m128iUpd,m128iVox) ) );
+		//the tsdf halves differ or the weight was 0
+		const __m128i m128iSame = _mm_and_si128( _mm_cmpeq_epi32( _mm_slli_epi32(m128iVox,16), _mm_slli_epi32(m128iPacked,16) ), _mm_cmpgt_epi32( _mm_srai_epi32(m128iVox,16), _mm_setzero_si128() ) );
+		return 0 != _mm_movemask_ps( _mm_castsi128_ps( _mm_andnot_si128(m128iSame,m128iUpd) ) );
+	}
+#endif
+	const cv::Mat& _cvmDepth;
+	float _fVoxelSize, _fTrunc;
+	float _aRw[9], _aCw[3];
+	float _fFx, _fFy, _fU, _fV;
+	float _fMaxDepth;
+	cv::Mat* _pcvmVolume;
+	int _nRes;
+	int _anOrigin[3];
+	const std::vector<short*>* _pvpBlocks;
+	const std::vector<cv::Point3i>* _pvBlockOrigins;
+	cv::Mat* _pcvmDirty;
+	int _nBrick;
+};
+//no voxel beyond the farthest depth plus the truncation can change
+static float maxDepth(const cv::Mat& cvmDepth_){
+	float fMaxDepth = 0.f;
+	for (int r = 0; r < cvmDepth_.rows; r++){
+		const float* pDepth = cvmDepth_.ptr<float>(r);
+		for (int c = 0; c < cvmDepth_.cols; c++) if (pDepth[c] > fMaxDepth) fMaxDepth = pDepth[c]; //NaN compares false
+	}
+	return fMaxDepth;
+}
+void integrateTsdfVolume( const cv::Mat& cvmDepth_, unsigned int uLevel_, const float fVoxelSize_, const float fTruncDistanceM_,
+	const float* pRw_, const float* pCw_, const float& fFx_, const float& fFy_, const float& u_, const float& v_, cv::Mat* pcvmVolume_, const int* pnOrigin_,
+	cv::Mat* pcvmDirty_, const int nBrick_ ){
+	BTL_ASSERT( CV_32FC1 == cvmDepth_.type(), "btl::cpu::integrateTsdfVolume() depth must be CV_32FC1" );
+	BTL_ASSERT( CV_16SC2 == pcvmVolume_->type() && pcvmVolume_->rows == pcvmVolume_->cols*pcvmVolume_->cols, "btl::cpu::integrateTsdfVolume() volume must be a y*z x x CV_16SC2 cube" );
+	BTL_ASSERT( !pcvmDirty_ || ( CV_8UC1 == pcvmDirty_->type() && pcvmDirty_->cols == (pcvmVolume_->cols + nBrick_ - 1)/nBrick_ && pcvmDirty_->rows == pcvmDirty_->cols*pcvmDirty_->cols ),
+		"btl::cpu::integrateTsdfVolume() the brick flags must be a y*z x x CV_8UC1 cube of the bricks" );
+	const float fMaxDepth = maxDepth(cvmDepth_);
+	if (fMaxDepth <= 0.f) return;
+	const float fScale = 1.f/(1 << uLevel_);
+	cv::parallel_for_( cv::Range(0,pcvmVolume_->rows), CIntegrateTsdf(cvmDepth_,fVoxelSize_,fTruncDistanceM_,pRw_,pCw_,fFx_*fScale,fFy_*fScale,u_*fScale,v_*fScale,fMaxDepth,pnOrigin_,pcvmVolume_,pcvmDirty_,nBrick_) );
+}
+void integrateTsdfBlocks( const cv::Mat& cvmDepth_, unsigned int uLevel_, const float fVoxelSize_, const float fTruncDistanceM_,
+	const float* pRw_, const float* pCw_, const float& fFx_, const float& fFy_, const float& u_, const float& v_,
+	const std::vector<short*>& vpBlocks_, const std::vector<cv::Point3i>& vBlockOrigins_, const int nBlockSide_ ){
+	BTL_ASSERT( CV_32FC1 == cvmDepth_.type(), "btl::cpu::integrateTsdfBlocks() depth must be CV_32FC1" );
+	BTL_ASSERT( vpBlocks_.size() == vBlockOrigins_.size(), "btl::cpu::integrateTsdfBlocks() one origin per block" );
+	if (vpBlocks_.empty()) return;
+	const float fMaxDepth = maxDepth(cvmDepth_);
+	if (fMaxDepth <= 0.f) return;
+	const float fScale = 1.f/(1 << uLevel_);
+	cv::parallel_for_( cv::Range(0,int(vpBlocks_.size())*nBlockSide_*nBlockSide_),
+		CIntegrateTsdf(cvmDepth_,fVoxelSize_,fTruncDistanceM_,pRw_,pCw_,fFx_*fScale,fFy_*fScale,u_*fScale,v_*fScale,fMaxDepth,vpBlocks_,vBlockOrigins_,nBlockSide_) );
+}
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//min and max tsdf of the observed voxels of each brick of nBrick_^3 voxels, counted from the origin of a cyclic volume
+//and widened by one voxel on each side, so that a ray which finds a brick free of negative tsdf also finds free every
+//voxel it steps into on leaving it and every trilinear cell it crosses. (FLT_MAX,-FLT_MAX) without an observed voxel.
+//with pcvmRebuild_ only the listed brick rows are visited, and in them only the flagged bricks and their aprons
+class CBrickMinMax : public cv::ParallelLoopBody
+{
+public:
+	CBrickMinMax(const cv::Mat& cvmVolume_, const int* pnOrigin_, const int nBrick_, cv::Mat* pcvmMinMax_,
+		const cv::Mat* pcvmRebuild_ = NULL, const std::vector<int>* pvnRows_ = NULL)
+	:_cvmVolume(cvmVolume_),_nBrick(nBrick_),_pcvmMinMax(pcvmMinMax_),_pcvmRebuild(pcvmRebuild_),_pvnRows(pvnRows_){
+		for (int i = 0; i < 3; i++) _anOrigin[i] = pnOrigin_ ? pnOrigin_[i] : 0;
+	}
+	virtual void operator()(const cv::Range& sRows_) const{
+		const int nRes = _cvmVolume.cols, nBricks = _pcvmMinMax->cols, B = _nBrick;
+		const int mx = wrap(_anOrigin[0],nRes), my = wrap(_anOrigin[1],nRes), mz = wrap(_anOrigin[2],nRes);
+		for (int i = sRows_.start; i < sRows_.end; i++){
+			const int r = _pvnRows ? (*_pvnRows)[i] : i;
+			const int nBY = r % nBricks, nBZ = r / nBricks;
+			float* pMinMax = _pcvmMinMax->ptr<float>(r);
+			const uchar* pRebuild = _pcvmRebuild ? _pcvmRebuild->ptr<uchar>(r) : NULL;
+			for (int b = 0; b < nBricks; b++) if (!pRebuild || pRebuild[b]) { pMinMax[2*b] = std::numeric_limits<float>::max(); pMinMax[2*b+1] = -std::numeric_limits<float>::max(); }
+			const int z1 = std::min( nRes, (nBZ+1)*B + 1 ), y1 = std::min( nRes, (nBY+1)*B + 1 );
+			for (int z = std::max( 0, nBZ*B - 1 ); z < z1; z++)
+			for (int y = std::max( 0, nBY*B - 1 ); y < y1; y++){
+				//local to buffer voxels
+				const short* pRow = _cvmVolume.ptr<short>( (z + mz - (z + mz >= nRes ? nRes : 0))*nRes + y + my - (y + my >= nRes ? nRes : 0) );
+				if (pRebuild){
+					for (int b = 0; b < nBricks; b++){
+						if (!pRebuild[b]) continue;
+						const int x1 = std::min( nRes, (b+1)*B + 1 );
+						for (int x = std::max( 0, b*B - 1 ); x < x1; x++){
+							const short* pV = pRow + 2*(x + mx - (x + mx >= nRes ? nRes : 0));
+							if (0 != pV[1]) update( pV[0]/32767.f, pMinMax + 2*b );
+						}
+					}//for each flagged brick
+					continue;
+				}
+				for (int x = 0; x < nRes; x++){
+					const short* pV = pRow + 2*(x + mx - (x + mx >= nRes ? nRes : 0));
+					if (0 == pV[1]) continue;
+					const float f = pV[0]/32767.f;
+					const int b = x / B, m = x % B;
+					update( f, pMinMax + 2*b );
+					if (B-1 == m && b+1 < nBricks) update( f, pMinMax + 2*(b+1) );
+					else if (0 == m && b > 0) update( f, pMinMax + 2*(b-1) );
+				}//for each x
+			}//for each y
+		}//for each brick row
+	}
+private:
+	static inline void update(const float f_, float* pMinMax_){
+		if (f_ < pMinMax_[0]) pMinMax_[0] = f_;
+		if (f_ > pMinMax_[1]) pMinMax_[1] = f_;
+	}
+	const cv::Mat& _cvmVolume;
+	int _anOrigin[3];
+	int _nBrick;
+	cv::Mat* _pcvmMinMax;
+	const cv::Mat* _pcvmRebuild;
+	const std::vector<int>* _pvnRows;
+};
+//the cell (x_,y_,z_) of a coarser level holds the 2x2x2 cells below it
+static void minMaxOfChildren(const cv::Mat& cvmFine_, const int x_, const int y_, const int z_, float* pCoarse_){
+	const int nFine = cvmFine_.cols;
+	float fMin = std::numeric_limits<float>::max(), fMax = -std::numeric_limits<float>::max();
+	for (int k = 2*z_; k < std::min( 2*z_+2, nFine ); k++)
+	for (int j = 2*y_; j < std::min( 2*y_+2, nFine ); j++)
+	for (int i = 2*x_; i < std::min( 2*x_+2, nFine ); i++){
+		const float* pFine = cvmFine_.ptr<float>(k*nFine + j) + 2*i;
+		fMin = std::min( fMin, pFine[0] );
+		fMax = std::max( fMax, pFine[1] );
+	}
+	pCoarse_[0] = fMin;
+	pCoarse_[1] = fMax;
+}
+void buildTsdfMinMaxPyramid( const cv::Mat& cvmVolume_, const int* pnOrigin_, const int nBrick_, std::vector<cv::Mat>* pvcvmPyramid_, cv::Mat* pcvmDirty_ ){
+	BTL_ASSERT( CV_16SC2 == cvmVolume_.type() && cvmVolume_.rows == cvmVolume_.cols*cvmVolume_.cols, "btl::cpu::buildTsdfMinMaxPyramid() the volume must be (y*z) x x CV_16SC2" );
+	int nSide = (cvmVolume_.cols + nBrick_ - 1)/nBrick_;
+	BTL_ASSERT( !pcvmDirty_ || ( CV_8UC1 == pcvmDirty_->type() && pcvmDirty_->cols == nSide && pcvmDirty_->rows == nSide*nSide ),
+		"btl::cpu::buildTsdfMinMaxPyramid() the flags must be a (y*z) x x CV_8UC1 cube of the bricks" );
+	if (pcvmDirty_ && !pvcvmPyramid_->empty() && (*pvcvmPyramid_)[0].cols == nSide && (*pvcvmPyramid_)[0].rows == nSide*nSide){
+		//a brick holds the voxels of its neighbours next to it, so it is rebuilt when it or one of its 26 neighbours is flagged
+		cv::Mat cvmRebuild(nSide*nSide,nSide,CV_8UC1,cv::Scalar::all(0));
+		std::vector<uchar> vRows(nSide*nSide,0);
+		for (int z = 0; z < nSide; z++)
+		for (int y = 0; y < nSide; y++){
+			uchar* pDirty = pcvmDirty_->ptr<uchar>(z*nSide + y);
+			for (int x = 0; x < nSide; x++){
+				if (!(pDirty[x] & DIRTY_MIN_MAX)) continue;
+				pDirty[x] &= uchar(~DIRTY_MIN_MAX);
+				for (int k = std::max( 0, z-1 ); k < std::min( nSide, z+2 ); k++)
+				for (int j = std::max( 0, y-1 ); j < std::min( nSide, y+2 ); j++){
+					vRows[k*nSide + j] = 1;
+					uchar* pRebuild = cvmRebuild.ptr<uchar>(k*nSide + j);
+					for (int i = std::max( 0, x-1 ); i < std::min( nSide, x+2 ); i++) pRebuild[i] = 1;
+				}
+			}
+		}
+		std::vector<int> vnRows;
+		for (int r = 0; r < nSide*nSide; r++) if (vRows[r]) vnRows.push_back(r);
+		if (vnRows.empty()) return;
+		cv::parallel_for_( cv::Range(0,int(vnRows.size())), CBrickMinMax(cvmVolume_,pnOrigin_,nBrick_,&(*pvcvmPyramid_)[0],&cvmRebuild,&vnRows) );
+		//only the cells above a rebuilt brick change
+		for (size_t l = 1; l < pvcvmPyramid_->size(); l++){
+			const cv::Mat& cvmFine = (*pvcvmPyramid_)[l-1];
+			cv::Mat& cvmCoarse = (*pvcvmPyramid_)[l];
+			const int nFine = cvmFine.cols, nCoarse = cvmCoarse.cols;
+			cv::Mat cvmCoarseRebuild(nCoarse*nCoarse,nCoarse,CV_8UC1,cv::Scalar::all(0));
+			for (int z = 0; z < nFine; z++)
+			for (int y = 0; y < nFine; y++){
+				const uchar* pRebuild = cvmRebuild.ptr<uchar>(z*nFine + y);
+				uchar* pCoarseRebuild = cvmCoarseRebuild.ptr<uchar>(z/2*nCoarse + y/2);
+				for (int x = 0; x < nFine; x++){
+					if (!pRebuild[x] || pCoarseRebuild[x/2]) continue;
+					pCoarseRebuild[x/2] = 1;
+					minMaxOfChildren( cvmFine, x/2, y/2, z/2, cvmCoarse.ptr<float>(z/2*nCoarse + y/2) + 2*(x/2) );
+				}
+			}
+			cvmRebuild = cvmCoarseRebuild;
+		}
+		return;
+	}
+	pvcvmPyramid_->resize(1);
+	(*pvcvmPyramid_)[0].create(nSide*nSide,nSide,CV_32FC2);
+	cv::parallel_for_( cv::Range(0,nSide*nSide), CBrickMinMax(cvmVolume_,pnOrigin_,nBrick_,&(*pvcvmPyramid_)[0]) );
+	if (pcvmDirty_) for (int r = 0; r < pcvmDirty_->rows; r++){
+		uchar* pDirty = pcvmDirty_->ptr<uchar>(r);
+		for (int x = 0; x < nSide; x++) pDirty[x] &= uchar(~DIRTY_MIN_MAX);
+	}
+	//each coarser cell holds the 2x2x2 cells below it, the last level is a single cell
+	while (nSide > 1){
+		nSide = (nSide + 1)/2;
+		pvcvmPyramid_->push_back( cv::Mat(nSide*nSide,nSide,CV_32FC2) );
+		const cv::Mat& cvmFine = (*pvcvmPyramid_)[pvcvmPyramid_->size()-2];
+		cv::Mat& cvmCoarse = pvcvmPyramid_->back();
+		for (int z = 0; z < nSide; z++)
+		for (int y = 0; y < nSide; y++){
+			float* pCoarse = cvmCoarse.ptr<float>(z*nSide + y);
+			for (int x = 0; x < nSide; x++) minMaxOfChildren( cvmFine, x, y, z, pCoarse + 2*x );
+		}
+	}
+	return;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//marches each ray of the level through a cyclic volume, clipped to the volume. wherever the cell of the min/max pyramid
+//at the ray holds no negative tsdf the ray leaves at once the coarsest such cell, elsewhere the step is the distance
+//the tsdf allows but at least a voxel. the first + to - crossing is refined on the trilinear tsdf and the normal is the
+//normalised tsdf gradient, NaN where a neighbour is unobserved as in pcl::device::raycast()
+class CRaycastTsdf : public cv::ParallelLoopBody
+{
+public:
+	CRaycastTsdf(const cv::Mat& cvmVolume_, const int* pnOrigin_, const std::vector<cv::Mat>& vcvmPyramid_, const int nBrick_, const float fVoxelSize_, const float fTrunc_,
+		const float* pRw_, const float* pCw_, const float fFx_, const float fFy_, const float fU_, const float fV_, cv::Mat* pcvmPts_, cv::Mat* pcvmNls_)
+	:_cvmVolume(cvmVolume_),_vcvmPyramid(vcvmPyramid_),_nBrick(nBrick_),_fVoxelSize(fVoxelSize_),_fTrunc(fTrunc_),
+	_fFx(fFx_),_fFy(fFy_),_fU(fU_),_fV(fV_),_pcvmPts(pcvmPts_),_pcvmNls(pcvmNls_){
+		//pRw_ is column major, read row by row it gives Rw^T
+		for (int i = 0; i < 9; i++) _aRwTrans[i] = pRw_[i];
+		for (int i = 0; i < 3; i++) _aCw[i] = pCw_[i];
+		_nRes = cvmVolume_.cols;
+		for (int i = 0; i < 3; i++) _anOrigin[i] = pnOrigin_ ? pnOrigin_[i] : 0;
+		for (int i = 0; i < 3; i++) _anShift[i] = wrap(_anOrigin[i],_nRes);
+	}
+	virtual void operator()(const cv::Range& sRows_) const{
+		const float* R = _aRwTrans;
+		const float fS = _fVoxelSize, fInvS = 1.f/fS;
+		//the camera centre in voxels of the volume, voxel n spans [n,n+1)
+		const float o[3] = { _aCw[0]*fInvS - _anOrigin[0], _aCw[1]*fInvS - _anOrigin[1], _aCw[2]*fInvS - _anOrigin[2] };
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			float* pPt = _pcvmPts->ptr<float>(r);
+			float* pNl = _pcvmNls->ptr<float>(r);
+			for (int c = 0; c < _pcvmPts->cols; c++, pPt += 3, pNl += 3){
+				pPt[0] = pPt[1] = pPt[2] = pNl[0] = pNl[1] = pNl[2] = _fNaN;
+				const float x = (c - _fU)/_fFx, y = (r - _fV)/_fFy;
+				const float fInvNorm = 1.f/sqrtf( x*x + y*y + 1.f );
+				const float d[3] = { (R[0]*x + R[1]*y + R[2])*fInvNorm, (R[3]*x + R[4]*y + R[5])*fInvNorm, (R[6]*x + R[7]*y + R[8])*fInvNorm };
+				//clip to the volume, t in m
+				float fT = 0.f, fTEnd = std::numeric_limits<float>::max();
+				for (int i = 0; i < 3; i++){
+					if (d[i] != 0.f){
+						const float fA = -o[i]*fS/d[i], fB = (_nRes - o[i])*fS/d[i];
+						fT = std::max( fT, std::min( fA, fB ) );
+						fTEnd = std::min( fTEnd, std::max( fA, fB ) );
+					}
+					else if (o[i] < 0.f || o[i] >= _nRes) fTEnd = -1.f;
+				}
+				fT += 1e-3f*fS;
+				float fTPrev = 0.f, fPrev = 0.f;
+				bool bPrev = false;
+				while (fT < fTEnd){
+					int n[3];
+					for (int i = 0; i < 3; i++) n[i] = floorInt( o[i] + fT*fInvS*d[i] );
+					if (n[0] < 0 || n[1] < 0 || n[2] < 0 || n[0] >= _nRes || n[1] >= _nRes || n[2] >= _nRes) break;
+					const int nLevel = freeLevel(n);
+					if (nLevel >= 0){
+						//leave the cell
+						const int nCell = _nBrick << nLevel;
+						float fExit = std::numeric_limits<float>::max();
+						for (int i = 0; i < 3; i++){
+							const int k = n[i]/nCell;
+							if (d[i] > 0.f) fExit = std::min( fExit, ( (k+1)*nCell - o[i] )*fS/d[i] );
+							else if (d[i] < 0.f) fExit = std::min( fExit, ( k*nCell - o[i] )*fS/d[i] );
+						}
+						fT = std::max( fT, fExit ) + 1e-3f*fS;
+						bPrev = false;
+						continue;
+					}
+					const short* pV = voxel(n[0],n[1],n[2]);
+					if (0 == pV[1]){
+						fT += fS;
+						bPrev = false;
+						continue;
+					}
+					const float f = pV[0]/32767.f;
+					if (f < 0.f){
+						if (bPrev) surface( d, fTPrev, fPrev, fT, f, pPt, pNl );
+						break;
+					}
+					bPrev = true;
+					fPrev = f;
+					fTPrev = fT;
+					fT += std::max( fS, .8f*f*_fTrunc );
+				}//along the ray
+			}//for each col
+		}//for each row
+	}
+private:
+	//the coarsest level whose cell at voxel n_ holds no negative tsdf, -1 if the brick does
+	int freeLevel(const int* n_) const{
+		int l = -1;
+		for (; l+1 < int(_vcvmPyramid.size()); l++){
+			const int nSide = _vcvmPyramid[l+1].cols, nCell = _nBrick << (l+1);
+			if ( !(_vcvmPyramid[l+1].ptr<float>( n_[2]/nCell*nSide + n_[1]/nCell )[ 2*(n_[0]/nCell) ] > 0.f) ) break;
+		}
+		return l;
+	}
+	//voxel n of the volume, n in [0,_nRes)
+	inline const short* voxel(const int nX_, const int nY_, const int nZ_) const{
+		const int x = nX_ + _anShift[0], y = nY_ + _anShift[1], z = nZ_ + _anShift[2];
+		return _cvmVolume.ptr<short>( (z - (z >= _nRes ? _nRes : 0))*_nRes + y - (y >= _nRes ? _nRes : 0) ) + 2*(x - (x >= _nRes ? _nRes : 0));
+	}
+	//trilinear interpolation at (fX_,fY_,fZ_) in voxels, the voxel centres being at integers. false if a corner is
+	//outside of the volume or unobserved
+	bool interpolate(const float fX_, const float fY_, const float fZ_, float* pfTsdf_) const{
+		const int nX = int(floor(fX_)), nY = int(floor(fY_)), nZ = int(floor(fZ_));
+		if (nX < 0 || nY < 0 || nZ < 0 || nX+1 >= _nRes || nY+1 >= _nRes || nZ+1 >= _nRes) return false;
+		const float a = fX_ - nX, b = fY_ - nY, c = fZ_ - nZ;
+		float f[8];
+		for (int i = 0; i < 8; i++){
+			const short* pV = voxel( nX + (i&1), nY + (i>>1&1), nZ + (i>>2) );
+			if (0 == pV[1]) return false;
+			f[i] = pV[0]/32767.f;
+		}
+		*pfTsdf_ = (1-c)*( (1-b)*( (1-a)*f[0] + a*f[1] ) + b*( (1-a)*f[2] + a*f[3] ) )
+			+ c*( (1-b)*( (1-a)*f[4] + a*f[5] ) + b*( (1-a)*f[6] + a*f[7] ) );
+		return true;
+	}
+	void surface(const float* d, const float fT0_, const float fF0_, const float fT1_, const float fF1_, float* pPt_, float* pNl_) const{
+		const float fInvS = 1.f/_fVoxelSize;
+		const float o[3] = { _aCw[0]*fInvS - _anOrigin[0] - .5f, _aCw[1]*fInvS - _anOrigin[1] - .5f, _aCw[2]*fInvS - _anOrigin[2] - .5f };
+		float fT = fT0_ + (fT1_ - fT0_)*fF0_/(fF0_ - fF1_);
+		float fA, fB;
+		if (interpolate( o[0] + fT0_*fInvS*d[0], o[1] + fT0_*fInvS*d[1], o[2] + fT0_*fInvS*d[2], &fA ) &&
+			interpolate( o[0] + fT1_*fInvS*d[0], o[1] + fT1_*fInvS*d[1], o[2] + fT1_*fInvS*d[2], &fB ) &&
+			fA > 0.f && fB < 0.f)
+			fT = fT0_ + (fT1_ - fT0_)*fA/(fA - fB);
+		for (int i = 0; i < 3; i++) pPt_[i] = _aCw[i] + fT*d[i];
+		//central differences one voxel apart
+		const float g[3] = { o[0] + fT*fInvS*d[0], o[1] + fT*fInvS*d[1], o[2] + fT*fInvS*d[2] };
+		float afN[3];
+		for (int i = 0; i < 3; i++){
+			float gp[3] = { g[0], g[1], g[2] }, gm[3] = { g[0], g[1], g[2] };
+			gp[i] += 1.f; gm[i] -= 1.f;
+			if (!interpolate( gp[0], gp[1], gp[2], &fA ) || !interpolate( gm[0], gm[1], gm[2], &fB )) return;
+			afN[i] = fA - fB;
+		}
+		const float fNorm = sqrtf( afN[0]*afN[0] + afN[1]*afN[1] + afN[2]*afN[2] );
+		if (!(fNorm > 0.f)) return;
+		for (int i = 0; i < 3; i++) pNl_[i] = afN[i]/fNorm;
+	}
+	const cv::Mat& _cvmVolume;
+	const std::vector<cv::Mat>& _vcvmPyramid;
+	int _nBrick, _nRes;
+	int _anOrigin[3], _anShift[3];
+	float _fVoxelSize, _fTrunc;
+	float _aRwTrans[9], _aCw[3];
+	float _fFx, _fFy, _fU, _fV;
+	cv::Mat* _pcvmPts;
+	cv::Mat* _pcvmNls;
+};
+void raycastTsdfVolume( const cv::Mat& cvmVolume_, const int* pnOrigin_, const std::vector<cv::Mat>& vcvmPyramid_, const int nBrick_,
+	const float fVoxelSize_, const float fTruncDistanceM_, const float* pRw_, const float* pCw_,
+	const float& fFx_, const float& fFy_, const float& u_, const float& v_, unsigned int uLevel_, cv::Mat* pcvmPts_, cv::Mat* pcvmNls_ ){
+	BTL_ASSERT( CV_16SC2 == cvmVolume_.type() && cvmVolume_.rows == cvmVolume_.cols*cvmVolume_.cols, "btl::cpu::raycastTsdfVolume() the volume must be (y*z) x x CV_16SC2" );
+	BTL_ASSERT( CV_32FC3 == pcvmPts_->type() && CV_32FC3 == pcvmNls_->type(), "btl::cpu::raycastTsdfVolume() the maps must be allocated CV_32FC3" );
+	const float fScale = 1.f/(1 << uLevel_);
+	cv::parallel_for_( cv::Range(0,pcvmPts_->rows), CRaycastTsdf(cvmVolume_,pnOrigin_,vcvmPyramid_,nBrick_,fVoxelSize_,fTruncDistanceM_,
+		pRw_,pCw_,fFx_*fScale,fFy_*fScale,u_*fScale,v_*fScale,pcvmPts_,pcvmNls_) );
+	return;
+}
+}//cpu
+}//btl
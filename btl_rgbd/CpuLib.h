@@ -0,0 +1,103 @@
+#ifndef BTL_CPU_HEADER
+#define BTL_CPU_HEADER
+//host mirrors of the kernels in cuda/CudaLib.h used to build the keyframe pyramid.
+//the outputs follow the device versions: CV_32FC1 depth/disparity, CV_32FC3 points and normals,
+//invalid entries are NaN. all functions run in parallel over rows with cv::parallel_for_.
+
+namespace btl { namespace cpu
+{
+//bits of the brick flags of integrateTsdfVolume()
+enum { DIRTY_MESH = 1, DIRTY_MIN_MAX = 2 };
+void depth2Disparity( const cv::Mat& cvmDepth_, cv::Mat* pcvmDisparity_ );
+void disparity2Depth( const cv::Mat& cvmDisparity_, cv::Mat* pcvmDepth_ );
+void bilateralFiltering(const cv::Mat& cvmSrc_, const float& fSigmaSpace_, const float& fSigmaColor_, cv::Mat* pcvmDst_ );
+//depth in, depth out; the disparity conversion is done inside the filter. NaN or 0 depth is invalid and kept as it is
+void bilateralFilteringInDisparity(const cv::Mat& cvmDepth_, const float& fSigmaSpace_, const float& fSigmaDisparity_, cv::Mat* pcvmDepth_ );
+//zero the depth whose 8 neighbours are not all within fThreshold_, same as btl::utility::filterDepth()
+void filterDepth(const cv::Mat& cvmDepth_, const float& fThreshold_, cv::Mat* pcvmDepthNew_);
+void pyrDown (const cv::Mat& cvmSrc_, const float& fSigmaColor_, cv::Mat* pcvmDst_);
+void unprojectRGBCVm ( const cv::Mat& cvmDepths_, 
+	const float& fFxRGB_,const float& fFyRGB_,const float& uRGB_, const float& vRGB_, unsigned int uLevel_, 
+	cv::Mat* pcvmPts_ );
+//raw depth (m) of level usPyrLevel_ to the distance from the camera centre, same as btl::device::scaleDepthCVmCVm()
+void scaleDepthCVmCVm(unsigned short usPyrLevel_, const float fFx_, const float fFy_, const float u_, const float v_, cv::Mat* pcvmDepth_);
+void fastNormalEstimation(const cv::Mat& cvmPts_, cv::Mat* pcvmNls_ );
+void transformLocalToWorldCVCV(const float* pRw_/*col major*/, const float* pTw_, cv::Mat* pcvmPts_, cv::Mat* pcvmNls_);
+//half size CV_32FC3 map, same as btl::device::resizeMap()
+void resizeMap(bool bNormalize_, const cv::Mat& cvmSrc_, cv::Mat* pcvmDst_);
+//one ICP step, same projective association and gates as btl::device::registrationICP(). pRwCur_/pRwPrev_ are the
+//column major Rw of the frames, the intrinsics are those of level 0. pdSum_ receives 27 doubles laid out as the
+//device sum buffer: the upper triangle of A row by row, each row followed by its entry of b.
+//returns the number of correspondences.
+int registrationICP( const float& fFx_, const float& fFy_, const float& u_, const float& v_, unsigned int uLevel_,
+	const float fDistThres_, const float fSinAngleThres_,
+	const float* pRwCur_, const float* pTwCur_, const float* pRwPrev_, const float* pTwPrev_,
+	const cv::Mat& cvmPtsWorldPrev_, const cv::Mat& cvmNlsWorldPrev_, const cv::Mat& cvmPtsLocalCur_, const cv::Mat& cvmNlsLocalCur_,
+	double* pdSum_ );
+//same as above with the current pts and nls given as X,Y,Z planes (CV_32FC1, see CKeyFrame::splitSoA()),
+//4 vertices are transformed at a time. gives the same sums as the interleaved version.
+int registrationICP( const float& fFx_, const float& fFy_, const float& u_, const float& v_, unsigned int uLevel_,
+	const float fDistThres_, const float fSinAngleThres_,
+	const float* pRwCur_, const float* pTwCur_, const float* pRwPrev_, const float* pTwPrev_,
+	const cv::Mat& cvmPtsWorldPrev_, const cv::Mat& cvmNlsWorldPrev_, const cv::Mat* pcvmPtPlanesCur_/*[3]*/, const cv::Mat* pcvmNlPlanesCur_/*[3]*/,
+	double* pdSum_ );
+//central differences of a CV_8UC1 image in intensity/255 per pixel, CV_32FC1 with zero borders
+void imageGradient(const cv::Mat& cvmBW_, cv::Mat* pcvmGx_, cv::Mat* pcvmGy_);
+//one gauss-newton step of direct photometric alignment: the current vertices are projected into the previous image
+//and compared by bilinear interpolation, with the gradients of the previous image from imageGradient(). vertices whose
+//depth differs from the previous one by more than fDistThres_ are occluded, residuals beyond fHuber_ are down-weighted.
+//same poses, intrinsics and sum layout as registrationICP(), so both can be added up. returns the number of residuals.
+int registrationPhotometric( const float& fFx_, const float& fFy_, const float& u_, const float& v_, unsigned int uLevel_,
+	const float fDistThres_, const float fHuber_,
+	const float* pRwCur_, const float* pTwCur_, const float* pRwPrev_, const float* pTwPrev_,
+	const cv::Mat& cvmPtsWorldPrev_, const cv::Mat& cvmBWPrev_, const cv::Mat& cvmGxPrev_, const cv::Mat& cvmGyPrev_,
+	const cv::Mat& cvmPtsLocalCur_, const cv::Mat& cvmBWCur_,
+	double* pdSum_ );
+//preemptive RANSAC for cur = R * ref + T over 3 x N CV_32FC1 point pairs (rows x, y and z). nHypotheses_ minimal
+//3-point solutions are scored on blocks of nBlock_ pairs, half of them are dropped after each block until one
+//is left. pRw_ (column major) and pTw_ receive the winner, pvInliers_ flags the pairs within fInlierThres_ of it.
+//returns the number of inliers; the caller is expected to refine the pose over the inliers.
+int ransacAbsoluteOrientation( const cv::Mat& cvmRef_, const cv::Mat& cvmCur_, const float fInlierThres_, const int nHypotheses_, const int nBlock_,
+	float* pRw_/*col major*/, float* pTw_, std::vector<unsigned char>* pvInliers_ );
+//descriptor matching guided by a predicted pose: the reference features, already projected into the current image
+//(NaN where they could not be), are only compared with the current keypoints within fRadius_ pixels, found through a
+//grid of fRadius_ wide cells. binary descriptors, one CV_8UC1 row per feature, are compared by hamming distance and
+//matches beyond nMaxDistance_ are dropped; a current keypoint claimed by several references keeps the closest one.
+//pvMatches_ receives queryIdx = current, trainIdx = reference as cv::DescriptorMatcher::match(). returns their number
+int guidedMatch( const std::vector<cv::Point2f>& vRefProjected_, const cv::Mat& cvmRefDescriptors_,
+	const std::vector<cv::Point2f>& vCur_, const cv::Mat& cvmCurDescriptors_, const cv::Size& sImage_,
+	const float fRadius_, const int nMaxDistance_, std::vector<cv::DMatch>* pvMatches_ );
+//host version of pcl::device::integrateTsdfVolume(): fuses the CV_32FC1 depth (m) of level uLevel_ into the
+//(y*z) x x CV_16SC2 volume of (tsdf*32767, weight) pairs, voxel (x,y,z) centred at ((x,y,z)+.5)*fVoxelSize_ in world.
+//pRw_ (column major) is the world to camera rotation and pCw_ the camera centre in world, the intrinsics are of level 0.
+//with pnOrigin_ the volume is cyclic and covers the world voxels pnOrigin_ + [0,res)^3, world voxel g being stored at
+//g mod res, see CCubicGrids::enableRolling(). pcvmDirty_, a (y*z) x x CV_8UC1 over the bricks of nBrick_^3 voxels counted
+//from pnOrigin_, gets DIRTY_MESH | DIRTY_MIN_MAX where a tsdf changed or a voxel was first observed and is left as it is
+//elsewhere. each consumer clears its own bit: buildTsdfMinMaxPyramid() and CBrickMesh::update()
+void integrateTsdfVolume( const cv::Mat& cvmDepth_, unsigned int uLevel_, const float fVoxelSize_, const float fTruncDistanceM_,
+	const float* pRw_/*col major*/, const float* pCw_, const float& fFx_, const float& fFy_, const float& u_, const float& v_, cv::Mat* pcvmVolume_,
+	const int* pnOrigin_ = NULL, cv::Mat* pcvmDirty_ = NULL, const int nBrick_ = 8 );
+//the same fusion into sparse cubic blocks of nBlockSide_^3 voxels, x first then y then z, as CVoxelHashGrids keeps them:
+//block i is stored at vpBlocks_[i] and its first voxel is vBlockOrigins_[i]
+void integrateTsdfBlocks( const cv::Mat& cvmDepth_, unsigned int uLevel_, const float fVoxelSize_, const float fTruncDistanceM_,
+	const float* pRw_/*col major*/, const float* pCw_, const float& fFx_, const float& fFy_, const float& u_, const float& v_,
+	const std::vector<short*>& vpBlocks_, const std::vector<cv::Point3i>& vBlockOrigins_, const int nBlockSide_ );
+//min and max tsdf of the observed voxels over the bricks of nBrick_^3 voxels of a volume as integrateTsdfVolume(), the
+//bricks counted from pnOrigin_ of a cyclic volume and widened by a voxel on each side. level 0 holds ceil(res/nBrick_)
+//bricks a side as a (y*z) x x CV_32FC2 (min,max), (FLT_MAX,-FLT_MAX) where nothing is observed, and each further level
+//halves the side down to a single cell. to be rebuilt after each integration for raycastTsdfVolume(). given the flags of
+//integrateTsdfVolume() and a pyramid of the same bricks, only the bricks next to one flagged DIRTY_MIN_MAX and the cells
+//above them are rebuilt, and the bit is cleared; an empty pyramid or no flags rebuild it all
+void buildTsdfMinMaxPyramid( const cv::Mat& cvmVolume_, const int* pnOrigin_, const int nBrick_, std::vector<cv::Mat>* pvcvmPyramid_, cv::Mat* pcvmDirty_ = NULL );
+//host version of pcl::device::raycast(): CV_32FC3 points and normals in world of the first zero crossing along the rays
+//of level uLevel_, NaN where there is none within the volume. rays leap over the coarsest cell of vcvmPyramid_, from
+//buildTsdfMinMaxPyramid() of the same volume, that holds no negative tsdf, and the crossings are refined trilinearly
+void raycastTsdfVolume( const cv::Mat& cvmVolume_, const int* pnOrigin_, const std::vector<cv::Mat>& vcvmPyramid_, const int nBrick_,
+	const float fVoxelSize_, const float fTruncDistanceM_, const float* pRw_/*col major*/, const float* pCw_,
+	const float& fFx_, const float& fFy_, const float& u_, const float& v_, unsigned int uLevel_, cv::Mat* pcvmPts_, cv::Mat* pcvmNls_ );
+//CV_32FC3 <-> three CV_32FC1 planes of the same size, the planes may have their own row step
+void splitC3(const cv::Mat& cvmC3_, cv::Mat* pcvmPlanes_/*[3]*/);
+void mergeC3(const cv::Mat* pcvmPlanes_/*[3]*/, cv::Mat* pcvmC3_);
+}//cpu
+}//btl
+#endif
@@ -42,6 +42,9 @@
 #include "SemiDenseTracker.h"
 #include "SemiDenseTrackerOrb.h"
 #include "KeyFrame.h"
+#include "CpuLib.h"
+#include "VoxelHashGrids.h"
+#include "BrickMesh.h"
 #include "CubicGrids.h"
 #include "cuda/CudaLib.h"
 #include "cuda/pcl/internal.h"
@@ -59,11 +62,20 @@ CCubicGrids::CCubicGrids(ushort usResolution_,float fVolumeSizeM_)
 	_uVolumeTotal = _uVolumeLevel*_uResolution;
 	_fVoxelSizeM = _fVolumeSizeM/_uResolution;
 	_fTruncateDistanceM = _fVoxelSizeM*6;
+	_bRolling = false;
+	_fShiftThresholdM = _fVolumeSizeM/8;
 	//_cvgmYZxXVolContentCV.create(_uResolution,_uVolumeLevel,CV_16SC2);//x,y*z,
 	//_cvgmYZxXVolContentCV.setTo(std::numeric_limits<short>::max());
 	//_cvgmYZxXVolContentCV.setTo(0);
 
-	_cvgmYZxXVolContentCV.create(_uVolumeLevel,_uResolution,CV_16SC2);//y*z,x
+	if (btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend){
+		_cvmYZxXVolContent.create(_uVolumeLevel,_uResolution,CV_16SC2);//y*z,x
+		const int nBricks = (_uResolution + BRICK_SIDE - 1)/BRICK_SIDE;
+		_cvmDirtyBricks.create(nBricks*nBricks,nBricks,CV_8UC1);
+		_pBrickMesh.reset( new CBrickMesh(BRICK_SIDE) );
+	}
+	else
+		_cvgmYZxXVolContentCV.create(_uVolumeLevel,_uResolution,CV_16SC2);//y*z,x
 	reset();
 }
 CCubicGrids::~CCubicGrids(void)
@@ -86,12 +98,72 @@ void CCubicGrids::releaseVBOPBO()
 	//glDeleteBuffers(1, &_uPBO);
 }
 void CCubicGrids::reset(){
-	
+	if (_pVoxelHashGrids){
+		_pVoxelHashGrids->reset();
+		return;
+	}
+	_anOrigin[0] = _anOrigin[1] = _anOrigin[2] = 0;
+	if (_pStreamedGrids) _pStreamedGrids->reset();
+	if (btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend){
+		_cvmYZxXVolContent.setTo(cv::Scalar::all(0));//pack_tsdf(0.f,0)
+		btl::cpu::buildTsdfMinMaxPyramid(_cvmYZxXVolContent,_anOrigin,BRICK_SIDE,&_vcvmMinMaxPyramid);
+		_cvmDirtyBricks.setTo(cv::Scalar::all(0));
+		_pBrickMesh->reset();
+		return;
+	}
 	pcl::device::initVolume (&_cvgmYZxXVolContentCV);
 }
+void CCubicGrids::enableVoxelHashing(){
+	_pVoxelHashGrids.reset( new CVoxelHashGrids(_fVoxelSizeM,_fTruncateDistanceM) );
+	_cvmYZxXVolContent.release();
+	_cvgmYZxXVolContentCV.release();
+}
+void CCubicGrids::enableRolling(float fShiftThresholdM_){
+	//the device kernels address the volume without the wrap around
+	BTL_ASSERT( btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend, "CCubicGrids::enableRolling() needs CKeyFrame::CPU_BACKEND" );
+	_bRolling = true;
+	_fShiftThresholdM = fShiftThresholdM_;
+	_pStreamedGrids.reset( new CVoxelHashGrids(_fVoxelSizeM,_fTruncateDistanceM) );
+}
+void CCubicGrids::shiftVolume(const int* pnOrigin_){
+	const int nRes = int(_uResolution);
+	//one axis at a time, the box of the other axes is the current volume
+	for (int a = 0; a < 3; a++){
+		const int nD = pnOrigin_[a] - _anOrigin[a];
+		if (0 == nD) continue;
+		const int k = std::min( abs(nD), nRes );
+		int anLo[3], anHi[3];
+		for (int i = 0; i < 3; i++) { anLo[i] = _anOrigin[i]; anHi[i] = _anOrigin[i] + nRes; }
+		//the slices leaving the volume
+		anLo[a] = nD > 0 ? _anOrigin[a] : _anOrigin[a] + nRes - k;
+		anHi[a] = anLo[a] + k;
+		_pStreamedGrids->storeVolume(_cvmYZxXVolContent,anLo,anHi);
+		//the slices entering it take their place in the buffer
+		anLo[a] = nD > 0 ? pnOrigin_[a] + nRes - k : pnOrigin_[a];
+		anHi[a] = anLo[a] + k;
+		_pStreamedGrids->loadVolume(anLo,anHi,&_cvmYZxXVolContent);
+		_anOrigin[a] = pnOrigin_[a];
+	}
+	//the bricks moved with the origin, the next integration rebuilds the min/max pyramid in full
+	_vcvmMinMaxPyramid.clear();
+	return;
+}
+void CCubicGrids::streamOut(){
+	if (!_pStreamedGrids) _pStreamedGrids.reset( new CVoxelHashGrids(_fVoxelSizeM,_fTruncateDistanceM) );
+	const int anHi[3] = { _anOrigin[0] + int(_uResolution), _anOrigin[1] + int(_uResolution), _anOrigin[2] + int(_uResolution) };
+	_pStreamedGrids->storeVolume(_cvmYZxXVolContent,_anOrigin,anHi);
+}
 
 void CCubicGrids::gpuIntegrateFrameIntoVolumeCVCV(const btl::kinect::CKeyFrame& cFrame_){
 	//Note: the point cloud int cFrame_ must be transformed into world before calling it, i.e. it integrate a VMap NMap in world to the volume in world
+	if (_pVoxelHashGrids){
+		_pVoxelHashGrids->integrateFrame(cFrame_);
+		return;
+	}
+	if (btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend){
+		cpuIntegrateFrameIntoVolumeCVCV(cFrame_);
+		return;
+	}
 	Eigen::Matrix3f eimfRw = cFrame_._eimRw.transpose();//device cast do the transpose implicitly because eimcmRwCur is col major by default.
 	pcl::device::Mat33& devRw = pcl::device::device_cast<pcl::device::Mat33> (eimfRw);
 	Eigen::Vector3f eivfCw = - cFrame_._eimRw.transpose() *cFrame_._eivTw ; //get camera center in world coordinate
@@ -114,7 +186,35 @@ void CCubicGrids::gpuIntegrateFrameIntoVolumeCVCV(const btl::kinect::CKeyFrame&
 
 	return;
 }
+void CCubicGrids::cpuIntegrateFrameIntoVolumeCVCV(const btl::kinect::CKeyFrame& cFrame_){
+	Eigen::Vector3f eivfCw = - cFrame_._eimRw.transpose() *cFrame_._eivTw ; //get camera center in world coordinate
+	if (_bRolling){
+		//recentre on the point half the volume along the optical axis, the third row of Rw
+		const Eigen::Vector3f eivTarget = eivfCw + .5f*_fVolumeSizeM*cFrame_._eimRw.row(2).transpose();
+		const Eigen::Vector3f eivCentre = ( Eigen::Vector3f(float(_anOrigin[0]),float(_anOrigin[1]),float(_anOrigin[2])) + Eigen::Vector3f::Constant(.5f*_uResolution) )*_fVoxelSizeM;
+		if ( (eivTarget - eivCentre).cwiseAbs().maxCoeff() > _fShiftThresholdM ){
+			int anOrigin[3];
+			for (int i = 0; i < 3; i++) anOrigin[i] = int(floor(eivTarget(i)/_fVoxelSizeM + .5f)) - int(_uResolution/2);
+			shiftVolume(anOrigin);
+		}
+	}
+	btl::cpu::integrateTsdfVolume(*cFrame_._acvmPyrDepths[0],0,
+		_fVoxelSizeM,_fTruncateDistanceM,
+		cFrame_._eimRw.data(), eivfCw.data(),//camera parameters,
+		cFrame_._pRGBCamera->_fFx,cFrame_._pRGBCamera->_fFy,cFrame_._pRGBCamera->_u,cFrame_._pRGBCamera->_v,
+		&_cvmYZxXVolContent,_anOrigin,&_cvmDirtyBricks,BRICK_SIDE);
+	btl::cpu::buildTsdfMinMaxPyramid(_cvmYZxXVolContent,_anOrigin,BRICK_SIDE,&_vcvmMinMaxPyramid,&_cvmDirtyBricks);
+	return;
+}
 void CCubicGrids::gpuRaycast(btl::kinect::CKeyFrame* pVirtualFrame_, std::string& strPathFileName_ ) const {
+	if (_pVoxelHashGrids){
+		_pVoxelHashGrids->raycast(pVirtualFrame_);
+		return;
+	}
+	if (btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend){
+		cpuRaycast(pVirtualFrame_);
+		return;
+	}
 	//get VMap and NMap in world
 	pcl::device::Mat33& devRwCurTrans = pcl::device::device_cast<pcl::device::Mat33> (pVirtualFrame_->_eimRw);	//device cast do the transpose implicitly because eimcmRwCur is col major by default.
 	//Cw = -Rw'*Tw
@@ -146,7 +246,33 @@ void CCubicGrids::gpuRaycast(btl::kinect::CKeyFrame* pVirtualFrame_, std::string
 	return;
 }
 
+void CCubicGrids::cpuRaycast(btl::kinect::CKeyFrame* pVirtualFrame_) const{
+	//get VMap and NMap in world
+	Eigen::Vector3f eivCwCur = - pVirtualFrame_->_eimRw.transpose() * pVirtualFrame_->_eivTw ;
+	btl::cpu::raycastTsdfVolume(_cvmYZxXVolContent,_anOrigin,_vcvmMinMaxPyramid,BRICK_SIDE,_fVoxelSizeM,_fTruncateDistanceM,
+		pVirtualFrame_->_eimRw.data(),eivCwCur.data(),
+		pVirtualFrame_->_pRGBCamera->_fFx,pVirtualFrame_->_pRGBCamera->_fFy,pVirtualFrame_->_pRGBCamera->_u,pVirtualFrame_->_pRGBCamera->_v,0,
+		&*pVirtualFrame_->_acvmShrPtrPyrPts[0],&*pVirtualFrame_->_acvmShrPtrPyrNls[0]);
+	//down-sampling
+	for (short s=1; s<pVirtualFrame_->pyrHeight(); s++ ){
+		btl::cpu::resizeMap(false,*pVirtualFrame_->_acvmShrPtrPyrPts[s-1],&*pVirtualFrame_->_acvmShrPtrPyrPts[s]);
+		btl::cpu::resizeMap(true, *pVirtualFrame_->_acvmShrPtrPyrNls[s-1],&*pVirtualFrame_->_acvmShrPtrPyrNls[s]);
+	}//for each pyramid level
+	return;
+}
+
+unsigned int CCubicGrids::cpuMarchingCubes(std::vector<Eigen::Vector3f>* pvVertices_, std::vector<unsigned int>* pvIndices_){
+	BTL_ASSERT( btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend && !_pVoxelHashGrids, "CCubicGrids::cpuMarchingCubes() needs the host volume" );
+	_pBrickMesh->update(_cvmYZxXVolContent,_anOrigin,_fVoxelSizeM,_vcvmMinMaxPyramid[0],&_cvmDirtyBricks);
+	return _pBrickMesh->mesh(pvVertices_,pvIndices_);
+}
+unsigned int CCubicGrids::hashMarchingCubes(std::vector<Eigen::Vector3f>* pvTriangles_) const{
+	BTL_ASSERT( _pVoxelHashGrids, "CCubicGrids::hashMarchingCubes() needs enableVoxelHashing()" );
+	return _pVoxelHashGrids->marchingCubes(pvTriangles_);
+}
+
 void CCubicGrids::gpuCreateVBO(btl::gl_util::CGLUtil::tp_ptr pGL_){
+	BTL_ASSERT( btl::kinect::CKeyFrame::GPU_BACKEND == btl::kinect::CKeyFrame::_eBackend && !_pVoxelHashGrids, "CCubicGrids::gpuCreateVBO() needs the device volume" );
 	_pGL = pGL_;
 	if(_pGL){
 		_pGL->createVBO(_cvgmYZxXVolContentCV.rows,_cvgmYZxXVolContentCV.cols,3,sizeof(float),&_uVBO,&_pResourceVBO);
@@ -154,6 +280,7 @@ void CCubicGrids::gpuCreateVBO(btl::gl_util::CGLUtil::tp_ptr pGL_){
 	}
 }
 void CCubicGrids::gpuRenderVoxelInWorldCVGL(){
+	BTL_ASSERT( btl::kinect::CKeyFrame::GPU_BACKEND == btl::kinect::CKeyFrame::_eBackend && !_pVoxelHashGrids, "CCubicGrids::gpuRenderVoxelInWorldCVGL() needs the device volume" );
 	// map OpenGL buffer object for writing from CUDA
 	void *pDev;
 	cudaGraphicsMapResources(1, &_pResourceVBO, 0);
@@ -183,6 +310,7 @@ void CCubicGrids::gpuRenderVoxelInWorldCVGL(){
 }//gpuRenderVoxelInWorldCVGL()
 
 void CCubicGrids::gpuExportVolume(const std::string& strPath_, ushort usNo_, ushort usV_, ushort usAxis_) const{
+	BTL_ASSERT( btl::kinect::CKeyFrame::GPU_BACKEND == btl::kinect::CKeyFrame::_eBackend && !_pVoxelHashGrids, "CCubicGrids::gpuExportVolume() needs the device volume" );
 	cv::gpu::GpuMat cvgmCross(_uResolution,_uResolution,CV_8UC3);
 	btl::device::exportVolume2CrossSectionX(_cvgmYZxXVolContentCV,usV_,usAxis_,&cvgmCross);
 	cv::Mat cvmCross(_uResolution,_uResolution,CV_8UC3);
@@ -193,6 +321,7 @@ void CCubicGrids::gpuExportVolume(const std::string& strPath_, ushort usNo_, ush
 }
 
 void CCubicGrids::exportYML(const std::string& strPath_, const unsigned int uNo_/*= 0*/) const{
+	BTL_ASSERT( btl::kinect::CKeyFrame::GPU_BACKEND == btl::kinect::CKeyFrame::_eBackend && !_pVoxelHashGrids, "CCubicGrids::exportYML() needs the device volume" );
 	std::string strPathFileName = strPath_ + "volume"+  boost::lexical_cast<std::string> ( uNo_ )  + ".yml";
 
 	cv::FileStorage cFSWrite( strPathFileName.c_str(), cv::FileStorage::WRITE );
@@ -204,6 +333,7 @@ void CCubicGrids::exportYML(const std::string& strPath_, const unsigned int uNo_
 }
 
 void CCubicGrids::importYML(const std::string& strPath_) {
+	BTL_ASSERT( btl::kinect::CKeyFrame::GPU_BACKEND == btl::kinect::CKeyFrame::_eBackend && !_pVoxelHashGrids, "CCubicGrids::importYML() needs the device volume" );
 	cv::FileStorage cFSRead( strPath_.c_str(), cv::FileStorage::READ );
 	cv::Mat	cvmVolume(_uVolumeLevel,_uResolution,CV_16SC2);
 	cFSRead["cvgmYZxXVolContentCV"] >> cvmVolume;
@@ -212,6 +342,7 @@ void CCubicGrids::importYML(const std::string& strPath_) {
 }
 
 void CCubicGrids::gpuGetOccupiedVoxels(){
+	BTL_ASSERT( btl::kinect::CKeyFrame::GPU_BACKEND == btl::kinect::CKeyFrame::_eBackend && !_pVoxelHashGrids, "CCubicGrids::gpuGetOccupiedVoxels() needs the device volume" );
 /*
 	_cvgmOccupiedVoxelsBuffer.create( 3, static_cast<int> ( DEFAULT_OCCUPIED_VOXEL_BUFFER_SIZE ), CV_32SC1);    //int
 	int active_voxels = pcl::device::getOccupiedVoxels(_cvgmYZxXVolContentCV, _cvgmOccupiedVoxelsBuffer);  
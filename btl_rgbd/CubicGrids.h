@@ -3,6 +3,8 @@
 
 namespace btl{ namespace geometry
 {
+	class CVoxelHashGrids;
+	class CBrickMesh;
 
 	class CCubicGrids
 	{
@@ -16,6 +18,8 @@ namespace btl{ namespace geometry
 			DEFAULT_OCCUPIED_VOXEL_BUFFER_SIZE = 2 * 1000 * 1000      
 		};
 
+		enum { BRICK_SIDE = 8 }; //voxels a side of the bricks of _vcvmMinMaxPyramid
+
 	private:
 		void releaseVBOPBO();		//methods
 	public:
@@ -23,13 +27,39 @@ namespace btl{ namespace geometry
 		~CCubicGrids();
 		void gpuRenderVoxelInWorldCVGL();
 		void gpuCreateVBO(btl::gl_util::CGLUtil::tp_ptr pGL_);
+		//dispatches to cpuIntegrateFrameIntoVolumeCVCV() with CKeyFrame::CPU_BACKEND
 		void gpuIntegrateFrameIntoVolumeCVCV(const btl::kinect::CKeyFrame& cFrame_);
+		//same integration on the host volume, in parallel over voxel rows, see btl::cpu::integrateTsdfVolume()
+		void cpuIntegrateFrameIntoVolumeCVCV(const btl::kinect::CKeyFrame& cFrame_);
+		//dispatches to cpuRaycast() with CKeyFrame::CPU_BACKEND
 		void gpuRaycast(btl::kinect::CKeyFrame* pVirtualFrame_, std::string& strPathFileName_=std::string("")) const;
+		//fills the host point and normal pyramids of pVirtualFrame_ by casting level 0 on the host volume, leaping
+		//over empty space with _vcvmMinMaxPyramid, see btl::cpu::raycastTsdfVolume(), and down-sampling the other levels
+		void cpuRaycast(btl::kinect::CKeyFrame* pVirtualFrame_) const;
 		void reset();
+		//swaps the dense volume for the sparse CVoxelHashGrids of the same voxel size and truncation, which then takes
+		//over reset(), integration and raycasting; the volume size no longer bounds the scene. the functions which read the
+		//dense device volume, gpuCreateVBO(), gpuRenderVoxelInWorldCVGL(), gpuExportVolume(), gpuGetOccupiedVoxels() and
+		//the yml export and import, assert after it. hashMarchingCubes() meshes the sparse volume
+		void enableVoxelHashing();
+		//makes the host volume a rolling one, CKeyFrame::CPU_BACKEND only: once the point half the volume ahead of the
+		//camera is more than fShiftThresholdM_ off the volume centre, the volume shifts by whole voxel slices to recentre
+		//on it. world voxel g is kept at g mod _uResolution, so that a shift only streams the slices which leave the
+		//volume out to _pStreamedGrids and zeros or reloads those which enter it in place, and world coordinates stay put
+		void enableRolling(float fShiftThresholdM_);
+		//moves the volume so that world voxel pnOrigin_ is its first voxel
+		void shiftVolume(const int* pnOrigin_);
+		//stores the whole volume into _pStreamedGrids, whose marchingCubes() then meshes every place the volume visited
+		void streamOut();
 		void gpuExportVolume(const std::string& strPath_,ushort usNo_, ushort usV_, ushort usAxis_) const;
 
 
 		void gpuMarchingCubes();
+		//host marching cubes as an indexed mesh in world, 3 indices per triangle, with vertices shared by the triangles
+		//around them. only the bricks integration changed since the last call are re-meshed, see CBrickMesh. returns the triangles
+		unsigned int cpuMarchingCubes(std::vector<Eigen::Vector3f>* pvVertices_, std::vector<unsigned int>* pvIndices_);
+		//triangle soup of the sparse volume of enableVoxelHashing(), see CVoxelHashGrids::marchingCubes()
+		unsigned int hashMarchingCubes(std::vector<Eigen::Vector3f>* pvTriangles_) const;
 		void gpuGetOccupiedVoxels();
 		void exportYML(const std::string& strPath_, const unsigned int uNo_ = 0 ) const;
 		void importYML(const std::string& strPath_) ;
@@ -52,9 +82,19 @@ namespace btl{ namespace geometry
 		//must be larger than 2*voxelsize 
 		float _fTruncateDistanceM;
 		//host
-		cv::Mat _cvmYZxXVolContent; //y*z,x,CV_32FC1,x-first
+		cv::Mat _cvmYZxXVolContent; //y*z,x,CV_16SC2,x-first, the volume itself with CKeyFrame::CPU_BACKEND
+		std::vector<cv::Mat> _vcvmMinMaxPyramid; //tsdf min/max over the bricks of the host volume, updated on each integration
+		cv::Mat _cvmDirtyBricks; //CV_8UC1 over the same bricks, flagged by integration, see btl::cpu::DIRTY_MESH and DIRTY_MIN_MAX
+		boost::shared_ptr<CBrickMesh> _pBrickMesh; //the cached mesh of each brick
 		//device
 		cv::gpu::GpuMat _cvgmYZxXVolContentCV;
+		//sparse volume, NULL unless enableVoxelHashing() was called
+		boost::shared_ptr<CVoxelHashGrids> _pVoxelHashGrids;
+		//rolling volume, see enableRolling()
+		bool _bRolling;
+		float _fShiftThresholdM;
+		int _anOrigin[3]; //world voxel of the first voxel, 0 unless rolling
+		boost::shared_ptr<CVoxelHashGrids> _pStreamedGrids; //the slices which left the volume
 		//render context
 		btl::gl_util::CGLUtil::tp_ptr _pGL;
 		GLuint _uVBO;
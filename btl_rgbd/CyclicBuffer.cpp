@@ -0,0 +1,173 @@
+//boost
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+//stl
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdio.h>
+//opencv
+#include <opencv2/core/core.hpp>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+//openni
+#include <XnCppWrapper.h>
+//self
+#include "RgbdStream.h"
+#include "CyclicBuffer.h"
+
+namespace btl{ namespace kinect{
+
+//orders the slot content against the head/tail index published after/read before it.
+//x86 keeps stores and loads in order, so only the compiler has to be kept from reordering.
+static inline void memoryBarrier(){
+#ifdef _MSC_VER
+	_ReadWriteBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+CCyclicBuffer::CCyclicBuffer(xn::Context& context, xn::DepthGenerator& depthGenerator, xn::ImageGenerator& imageGenerator) :
+m_context(context), m_depthGenerator(depthGenerator), m_imageGenerator(imageGenerator), m_pFrames(NULL)
+{
+	m_nBufferSize = 0;
+	m_nHead = m_nTail = 0;
+	m_bRecording = false;
+	m_nDropped = m_nWritten = 0;
+}
+
+CCyclicBuffer::~CCyclicBuffer()
+{
+	stop();
+	if (m_pFrames) XN_DELETE_ARR(m_pFrames);
+}
+
+void CCyclicBuffer::Initialize( const char* cDirName_, XnUInt32 nSlots_ /*= DEFAULT_SLOTS*/ )
+{
+	stop();
+	const XnChar* strDirName = (const XnChar*) cDirName_;
+	xnOSStrCopy(m_strDirName, strDirName, XN_FILE_MAX_PATH);
+	//power of two so that the wrap around of the counters keeps the slot index continuous
+	m_nBufferSize = 1;
+	while (m_nBufferSize < nSlots_) m_nBufferSize <<= 1;
+	if (m_pFrames) XN_DELETE_ARR(m_pFrames);
+	m_pFrames = XN_NEW_ARR(SingleFrame, m_nBufferSize);
+	m_nHead = m_nTail = 0;
+}
+
+XnStatus CCyclicBuffer::start(const std::string& strFileName_)
+{
+	stop();
+	m_nHead = m_nTail = 0;
+	m_nDropped = m_nWritten = 0;
+	if (strFileName_.size() > 5 && 0 == strFileName_.compare(strFileName_.size()-5, 5, ".rgbd"))
+	{
+		XnMapOutputMode sMode;
+		m_depthGenerator.GetMapOutputMode(sMode);
+		printf("Creating file %s\n", strFileName_.c_str());
+		m_pStreamWriter.reset(new CRgbdStreamWriter(strFileName_, ushort(sMode.nXRes), ushort(sMode.nYRes)));
+		m_bRecording = true;
+		m_pWriter.reset(new boost::thread(boost::bind(&CCyclicBuffer::writerLoop, this)));
+		return XN_STATUS_OK;
+	}
+	xn::EnumerationErrors errors;
+	XnStatus rc;
+	// Create recorder
+	rc = m_context.CreateAnyProductionTree(XN_NODE_TYPE_RECORDER, NULL, m_recorder, &errors);	CHECK_RC_ERR(rc, "Create recorder", errors);
+	m_recorder.SetDestination(XN_RECORD_MEDIUM_FILE, strFileName_.c_str());
+	printf("Creating file %s\n", strFileName_.c_str());
+	// Create mock nodes based on the depth and image generator, they are fed by the writer thread only
+	rc = m_context.CreateMockNodeBasedOn(m_depthGenerator, NULL, m_mockDepth);		  CHECK_RC(rc, "Create depth node");
+	rc = m_recorder.AddNodeToRecording(m_mockDepth, XN_CODEC_16Z_EMB_TABLES);		  CHECK_RC(rc, "Add depth node");
+	rc = m_context.CreateMockNodeBasedOn(m_imageGenerator, NULL, m_mockImage);		  CHECK_RC(rc, "Create image node");
+	rc = m_recorder.AddNodeToRecording(m_mockImage, XN_CODEC_JPEG);					  CHECK_RC(rc, "Add image node");
+
+	m_bRecording = true;
+	m_pWriter.reset(new boost::thread(boost::bind(&CCyclicBuffer::writerLoop, this)));
+	return XN_STATUS_OK;
+}
+
+void CCyclicBuffer::stop()
+{
+	if (!m_pWriter) return;
+	//the writer drains what is left in the ring before it returns
+	m_bRecording = false;
+	m_pWriter->join();
+	m_pWriter.reset();
+	// Close recorder
+	if (m_pStreamWriter)
+	{
+		m_pStreamWriter->close();
+		m_pStreamWriter.reset();
+	}
+	else
+	{
+		m_recorder.Release();
+		m_mockDepth.Release();
+		m_mockImage.Release();
+	}
+	printf("%u frames recorded, %u dropped\n", m_nWritten, m_nDropped);
+}
+
+void CCyclicBuffer::Update(const xn::DepthMetaData& DepthMD_, const xn::ImageMetaData& ImageMD_)
+{
+	if (!m_bRecording) return;
+	const XnUInt32 nHead = m_nHead;
+	// the writer is a whole ring behind, drop rather than wait
+	if (nHead - m_nTail == m_nBufferSize) { ++m_nDropped; return; }
+	SingleFrame& sFrame = m_pFrames[nHead & (m_nBufferSize-1)];
+	sFrame.depthFrame.CopyFrom(DepthMD_);
+	sFrame.imageFrame.CopyFrom(ImageMD_);
+	memoryBarrier();
+	m_nHead = nHead + 1; //publish
+}
+
+void CCyclicBuffer::Update(const xn::DepthMetaData& DepthMD_, const xn::ImageMetaData& ImageMD_, float* pfTimeLeft_)
+{
+	Update(DepthMD_, ImageMD_);
+	*pfTimeLeft_ = getTimeLeft();
+}
+
+float CCyclicBuffer::getTimeLeft() const
+{
+	return (m_nBufferSize - (m_nHead - m_nTail))/30.f;
+}
+
+void CCyclicBuffer::writerLoop()
+{
+	for (;;)
+	{
+		const XnUInt32 nTail = m_nTail;
+		if (nTail == m_nHead)
+		{
+			if (!m_bRecording) break;
+			boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+			continue;
+		}
+		memoryBarrier();
+		SingleFrame& sFrame = m_pFrames[nTail & (m_nBufferSize-1)];
+		if (m_pStreamWriter)
+		{
+			const cv::Mat cvmDepth(sFrame.depthFrame.YRes(), sFrame.depthFrame.XRes(), CV_16UC1, (void*)sFrame.depthFrame.Data());
+			const cv::Mat cvmRGB(sFrame.imageFrame.YRes(), sFrame.imageFrame.XRes(), CV_8UC3, (void*)sFrame.imageFrame.RGB24Data());
+			m_pStreamWriter->write(cvmDepth, cvmRGB, sFrame.depthFrame.Timestamp());
+		}
+		else
+		{
+			m_mockDepth.SetData(sFrame.depthFrame);
+			m_mockImage.SetData(sFrame.imageFrame);
+			m_recorder.Record();
+		}
+		++m_nWritten;
+		memoryBarrier();
+		m_nTail = nTail + 1; //hand the slot back
+	}
+}
+
+}//kinect
+}//btl
@@ -1,6 +1,8 @@
-#ifndef BTL_NI_BUFFER
+#ifndef BTL_NI_BUFFER
 #define BTL_NI_BUFFER
 
+namespace boost{ class thread; }
+
 
 namespace btl{ namespace kinect{
 #define CHECK_RC(rc, what)											\
@@ -19,137 +21,39 @@ namespace btl{ namespace kinect{
 }											\
 	CHECK_RC(rc, what)							\
 }
-
 
-// The cyclic buffer, to which frames will be added and from where they will be dumped to files
+
+class CRgbdStreamWriter;
+
+// Single-producer/single-consumer ring of preallocated depth + image slots. The capture thread pushes
+// frames with Update() and never blocks, a writer thread started by start() drains the ring into an .oni
+// file, or a native stream if the file name ends with .rgbd (see RgbdStream.h), as it fills, so the length 
+// of a recording is bounded by the disk rather than by the ring. When the writer falls a whole ring behind,
+// Update() drops the new frame instead of waiting; getDroppedFrames() counts them and stop() reports them.
 class CCyclicBuffer
 {
 public:
 	typedef boost::scoped_ptr< CCyclicBuffer > tp_scoped_ptr;
-	
-	// Creation - set the OpenNI objects
-	CCyclicBuffer(xn::Context& context, xn::DepthGenerator& depthGenerator, xn::ImageGenerator& imageGenerator) :
-	m_context(context), m_depthGenerator(depthGenerator), m_imageGenerator(imageGenerator), m_pFrames(NULL)
-	{
-		m_nNextWrite = 0;
-		m_nBufferSize = 0;
-		m_nBufferCount = 0;
-	}
-	// Initialization - set outdir and time of each recording
-	void Initialize( const char* cDirName_, XnUInt32 nSeconds)
-	{
-		const XnChar* strDirName = (const XnChar*) cDirName_;
-		xnOSStrCopy(m_strDirName, strDirName, XN_FILE_MAX_PATH);
-		m_nBufferSize = nSeconds*30;
-		m_pFrames = XN_NEW_ARR(SingleFrame, m_nBufferSize);
-	}
-
-	void restart(){
-		m_nNextWrite = 0;
-	}
-
-	  // Save new data from OpenNI
-	void Update(const xn::DepthMetaData& DepthMD_, const xn::ImageMetaData& ImageMD_)
-	{
-		// Save latest depth frame
-		m_pFrames[m_nNextWrite].depthFrame.CopyFrom(DepthMD_);
-		// Save latest image frame
-		m_pFrames[m_nNextWrite].imageFrame.CopyFrom(ImageMD_);
-
-		// See if buffer is already full
-		if (m_nBufferCount < m_nBufferSize)
-		{
-			m_nBufferCount++;
-		}
-		// Make sure cyclic buffer pointers are good
-		m_nNextWrite++;
-		if (m_nNextWrite == m_nBufferSize)
-		{
-			m_nNextWrite = 0;
-		}
-	}
-	float getTimeLeft() const{
-		return (m_nBufferSize - m_nNextWrite)/30.f;
-	}
-	void Update(const xn::DepthMetaData& DepthMD_, const xn::ImageMetaData& ImageMD_, float* pfTimeLeft_)
-	{
-		// Make sure buffer pointers are good
-		if (m_nNextWrite == m_nBufferSize) { *pfTimeLeft_ = 0.f; return; }
+	enum { DEFAULT_SLOTS = 64 }; //~2 seconds the writer may lag behind the sensor
 
-		// Save latest depth frame
-		m_pFrames[m_nNextWrite].depthFrame.CopyFrom(DepthMD_);
-		// Save latest image frame
-		m_pFrames[m_nNextWrite].imageFrame.CopyFrom(ImageMD_);
-		m_nNextWrite++;
-		//compute the left in buffer
-		*pfTimeLeft_ = getTimeLeft();
-		return;
-	}
-
-	// Save the current state of the buffer to a file
-	XnStatus Dump(const std::string& strFileName_)
-	{
-		xn::MockDepthGenerator mockDepth;
-		xn::MockImageGenerator mockImage;
-
-		xn::EnumerationErrors errors;
-		XnStatus rc;
-
-		// Create recorder
-		rc = m_context.CreateAnyProductionTree(XN_NODE_TYPE_RECORDER, NULL, m_recorder, &errors);	CHECK_RC_ERR(rc, "Create recorder", errors);
-
-		/*// Create name of new file
-		time_t rawtime;
-		struct tm *timeinfo;
-		time(&rawtime);
-		timeinfo = localtime(&rawtime);
-		XnChar strFileName[XN_FILE_MAX_PATH];
-		sprintf(strFileName, "%s/%04d%02d%02d-%02d%02d%02d.oni", m_strDirName,
-			timeinfo->tm_year+1900, timeinfo->tm_mon+1, timeinfo->tm_mday, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
-		*/
-
-		m_recorder.SetDestination(XN_RECORD_MEDIUM_FILE, strFileName_.c_str());
-		printf("Creating file %s\n", strFileName_.c_str());
-
-		// Create mock nodes based on the depth generator, to save depth
-		rc = m_context.CreateMockNodeBasedOn(m_depthGenerator, NULL, mockDepth);		  CHECK_RC(rc, "Create depth node");
-		rc = m_recorder.AddNodeToRecording(mockDepth, XN_CODEC_16Z_EMB_TABLES);			  CHECK_RC(rc, "Add depth node");
-		// Create mock nodes based on the image generator, to save image
-		rc = m_context.CreateMockNodeBasedOn(m_imageGenerator, NULL, mockImage);		  CHECK_RC(rc, "Create image node");
-		rc = m_recorder.AddNodeToRecording(mockImage, XN_CODEC_JPEG);					  CHECK_RC(rc, "Add image node");
-		//dump from 0 to m_nNextWrite;
-		for (XnUInt32 i = 0; i < m_nNextWrite; ++i)
-		{
-			mockDepth.SetData(m_pFrames[i].depthFrame);
-			mockImage.SetData(m_pFrames[i].imageFrame);
-			m_recorder.Record();
-		}
-	/*
-		// Write frames from next index (which will be next to be written, and so the first available)
-		// this is only if a full loop was done, and this frame has meaningful data
-		if (m_nNextWrite < m_nBufferCount)
-		{
-			// Not first loop, right till end
-			for (XnUInt32 i = m_nNextWrite; i < m_nBufferSize; ++i)
-			{
-				mockDepth.SetData(m_pFrames[i].depthFrame);
-				mockImage.SetData(m_pFrames[i].imageFrame);
-				m_recorder.Record();
-			}
-		}
-		// Write frames from the beginning of the buffer to the last on written
-		for (XnUInt32 i = 0; i < m_nNextWrite; ++i)
-		{
-			mockDepth.SetData(m_pFrames[i].depthFrame);
-			mockImage.SetData(m_pFrames[i].imageFrame);
-			m_recorder.Record();
-		}*/
-
-		// Close recorder
-		m_recorder.Release();
-
-		return XN_STATUS_OK;
-	}//Dump
+	// Creation - set the OpenNI objects
+	CCyclicBuffer(xn::Context& context, xn::DepthGenerator& depthGenerator, xn::ImageGenerator& imageGenerator);
+	~CCyclicBuffer();
+	// Initialization - set outdir and the number of slots of the ring, rounded up to a power of two
+	void Initialize( const char* cDirName_, XnUInt32 nSlots_ = DEFAULT_SLOTS );
+	// create the recorder and launch the writer thread, stops a running recording first
+	XnStatus start(const std::string& strFileName_);
+	// drain the ring, join the writer thread and close the file
+	void stop();
+	bool isRecording() const { return m_bRecording; }
+
+	// Push the latest frames, dropped if the writer is behind by the whole ring
+	void Update(const xn::DepthMetaData& DepthMD_, const xn::ImageMetaData& ImageMD_);
+	void Update(const xn::DepthMetaData& DepthMD_, const xn::ImageMetaData& ImageMD_, float* pfTimeLeft_);
+	// how long, in seconds at 30 fps, the writer may still fall behind before frames get dropped
+	float getTimeLeft() const;
+	XnUInt32 getDroppedFrames() const { return m_nDropped; }
+	XnUInt32 getWrittenFrames() const { return m_nWritten; }
 
 protected:
 	struct SingleFrame
@@ -157,17 +61,26 @@ protected:
 		xn::DepthMetaData depthFrame;
 		xn::ImageMetaData imageFrame;
 	};
+	void writerLoop();
 
 	SingleFrame* m_pFrames;
-	XnUInt32 m_nNextWrite;
 	XnUInt32 m_nBufferSize;
-	XnUInt32 m_nBufferCount;
+	// the producer only writes m_nHead, the consumer only writes m_nTail, both count up and wrap around
+	volatile XnUInt32 m_nHead;
+	volatile XnUInt32 m_nTail;
+	volatile bool m_bRecording;
+	XnUInt32 m_nDropped;
+	XnUInt32 m_nWritten;
 	XnChar m_strDirName[XN_FILE_MAX_PATH];
 
 	xn::Context& m_context;
 	xn::DepthGenerator& m_depthGenerator;
 	xn::ImageGenerator& m_imageGenerator;
 	xn::Recorder m_recorder;
+	xn::MockDepthGenerator m_mockDepth;
+	xn::MockImageGenerator m_mockImage;
+	boost::shared_ptr< boost::thread > m_pWriter;
+	boost::shared_ptr< CRgbdStreamWriter > m_pStreamWriter; //instead of m_recorder
 
 private:
 	XN_DISABLE_COPY_AND_ASSIGN(CCyclicBuffer);
@@ -48,11 +48,21 @@ Eigen::Matrix< T , 4, 4 > setModelViewGLfromRTCV ( const Eigen::Matrix< T, 3, 3
 
     return mMat;
 }
+//inverse of setModelViewGLfromRTCV()
+template< class T >
+void setRTCVfromModelViewGL ( const Eigen::Matrix< T , 4, 4 >& mMat_, Eigen::Matrix< T, 3, 3 >* pR_, Eigen::Matrix< T, 3, 1 >* pT_ )
+{
+	*pR_ = mMat_.template topLeftCorner<3,3>();
+	*pT_ = mMat_.template topRightCorner<3,1>();
+	pR_->template bottomRows<2>() *= -1;
+	pT_->template bottomRows<2>() *= -1;
+}
 template< class T >
 Eigen::Matrix< T , 4, 4 > setModelViewGLfromRCCV ( const Eigen::Matrix< T, 3, 3 >& mR_, const Eigen::Matrix< T, 3, 1 >& vC_ )
 {
-	Eigen::Matrix< T, 3,1> eivT = -mR.transpose()*vC_;
-	return setModelViewGLfromRTCV(mR_,vC_);
+	//R maps world to camera, so the camera centre C has the translation T = -R*C
+	Eigen::Matrix< T, 3,1> eivT = -mR_*vC_;
+	return setModelViewGLfromRTCV(mR_,eivT);
 }
 template< class T1, class T2 >
 void unprojectCamera2World ( const int& nX_, const int& nY_, const unsigned short& nD_, const Eigen::Matrix< T1, 3, 3 >& mK_, Eigen::Matrix< T2, 3, 1 >* pVec_ )
@@ -207,6 +217,111 @@ T absoluteOrientation ( Eigen::Matrix<T,-1,-1,0,-1,-1> & eimA_, Eigen::Matrix<T,
 	return dE / eimA_.cols();
 }
 
+template< class T > /*batched absoluteOrientation() without scale for many small hypotheses*/
+void absoluteOrientationBatch ( const Eigen::Matrix<T,-1,-1,0,-1,-1>& eimA_, const Eigen::Matrix<T,-1,-1,0,-1,-1>& eimB_, const int* pIdx_, const int nPerHypo_, const int nHypo_,
+	Eigen::Matrix< T, 3, 3>* pR_, Eigen::Matrix< T , 3, 1 >* pT_ ){
+	// A is Ref B is Cur, B = R * A + T for the columns pIdx_[ h*nPerHypo_ ... (h+1)*nPerHypo_-1 ] of hypothesis h
+	// 4 hypotheses share one pass: their sums sit in the lanes of fixed size arrays and Horn's quaternion is found
+	// for all lanes at once. the largest root of the characteristic quartic of N is polished by Newton from the
+	// upper bound (|A|^2+|B|^2)/2 and the quaternion is read off the adjugate of N - lambda I, which has rank one.
+	// a lane whose adjugate vanishes (repeated root) falls back to a 3x3 SVD.
+	CHECK ( eimA_.rows() == 3 && eimB_.rows() == 3, " absoluteOrientationBatch() requires 3 x N inputs. " );
+	CHECK ( nPerHypo_ >= 3, " absoluteOrientationBatch() requires at least 3 pairs per hypothesis. " );
+	enum { LANES = 4, NEWTON = 8 };
+	typedef Eigen::Array< T, LANES, 1 > tp_lanes;
+	for ( int h0 = 0; h0 < nHypo_; h0 += LANES ){
+		const int nLanes = nHypo_ - h0 < LANES ? nHypo_ - h0 : LANES;
+		tp_lanes aSA[3], aSB[3], aSAB[9], tG; 
+		for ( int r = 0; r < 3; r++ ) { aSA[r].setZero(); aSB[r].setZero(); }
+		for ( int i = 0; i < 9; i++ ) aSAB[i].setZero();
+		tG.setZero();
+		for ( int k = 0; k < nPerHypo_; k++ ){
+			tp_lanes a[3], b[3];
+			for ( int l = 0; l < LANES; l++ ){
+				//idle lanes repeat the last hypothesis
+				const int nC = pIdx_[ ( h0 + ( l < nLanes ? l : nLanes - 1 ) ) * nPerHypo_ + k ];
+				for ( int r = 0; r < 3; r++ ) { a[r]( l ) = eimA_( r, nC ); b[r]( l ) = eimB_( r, nC ); }
+			}
+			for ( int r = 0; r < 3; r++ ) { aSA[r] += a[r]; aSB[r] += b[r]; tG += a[r] * a[r] + b[r] * b[r]; }
+			for ( int r = 0; r < 3; r++ ) for ( int c = 0; c < 3; c++ ) aSAB[r*3+c] += a[r] * b[c];
+		}
+		//remove the centroids
+		const T tInvN = T(1) / nPerHypo_;
+		tp_lanes aCA[3], aCB[3];
+		for ( int r = 0; r < 3; r++ ) { aCA[r] = aSA[r] * tInvN; aCB[r] = aSB[r] * tInvN; tG -= T(nPerHypo_) * ( aCA[r] * aCA[r] + aCB[r] * aCB[r] ); }
+		for ( int r = 0; r < 3; r++ ) for ( int c = 0; c < 3; c++ ) aSAB[r*3+c] -= T(nPerHypo_) * aCA[r] * aCB[c];
+		const tp_lanes &Sxx = aSAB[0], &Sxy = aSAB[1], &Sxz = aSAB[2], &Syx = aSAB[3], &Syy = aSAB[4], &Syz = aSAB[5], &Szx = aSAB[6], &Szy = aSAB[7], &Szz = aSAB[8];
+		//Horn's symmetric, traceless N
+		tp_lanes N[16];
+		N[0] = Sxx+Syy+Szz; N[1] = Syz-Szy;     N[2] = Szx-Sxz;      N[3] = Sxy-Syx;
+		N[5] = Sxx-Syy-Szz; N[6] = Sxy+Syx;     N[7] = Szx+Sxz;
+		N[10]= Syy-Sxx-Szz; N[11]= Syz+Szy;
+		N[15]= Szz-Sxx-Syy;
+		N[4] = N[1]; N[8] = N[2]; N[9] = N[6]; N[12] = N[3]; N[13] = N[7]; N[14] = N[11];
+		//lambda^4 + c2 lambda^2 + c1 lambda + c0, c2 = -2|S|^2, c1 = -8 det(S), c0 = det(N)
+		tp_lanes tC2; tC2.setZero();
+		for ( int i = 0; i < 9; i++ ) tC2 += aSAB[i] * aSAB[i];
+		tC2 *= T(-2);
+		const tp_lanes tC1 = T(-8) * ( Sxx * ( Syy * Szz - Syz * Szy ) - Sxy * ( Syx * Szz - Syz * Szx ) + Sxz * ( Syx * Szy - Syy * Szx ) );
+		tp_lanes s0 = N[0]*N[5] - N[4]*N[1], s1 = N[0]*N[6] - N[4]*N[2], s2 = N[0]*N[7] - N[4]*N[3];
+		tp_lanes s3 = N[1]*N[6] - N[5]*N[2], s4 = N[1]*N[7] - N[5]*N[3], s5 = N[2]*N[7] - N[6]*N[3];
+		tp_lanes c5 = N[10]*N[15] - N[14]*N[11], c4 = N[9]*N[15] - N[13]*N[11], c3 = N[9]*N[14] - N[13]*N[10];
+		tp_lanes c2 = N[8]*N[15] - N[12]*N[11], c1 = N[8]*N[14] - N[12]*N[10], c0 = N[8]*N[13] - N[12]*N[9];
+		const tp_lanes tC0 = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+		//Newton from above converges monotonically to the largest root
+		tp_lanes tL = tG * T(.5);
+		for ( int i = 0; i < NEWTON; i++ ){
+			const tp_lanes tL2 = tL * tL;
+			const tp_lanes tF  = ( tL2 + tC2 ) * tL2 + tC1 * tL + tC0;
+			const tp_lanes tDF = ( T(4) * tL2 + T(2) * tC2 ) * tL + tC1;
+			tL -= tF / ( tDF.abs() + std::numeric_limits<T>::min() );
+		}
+		//adjugate of M = N - lambda I
+		tp_lanes M[16];
+		for ( int i = 0; i < 16; i++ ) M[i] = N[i];
+		M[0] -= tL; M[5] -= tL; M[10] -= tL; M[15] -= tL;
+		s0 = M[0]*M[5] - M[4]*M[1]; s1 = M[0]*M[6] - M[4]*M[2]; s2 = M[0]*M[7] - M[4]*M[3];
+		s3 = M[1]*M[6] - M[5]*M[2]; s4 = M[1]*M[7] - M[5]*M[3]; s5 = M[2]*M[7] - M[6]*M[3];
+		c5 = M[10]*M[15] - M[14]*M[11]; c4 = M[9]*M[15] - M[13]*M[11]; c3 = M[9]*M[14] - M[13]*M[10];
+		c2 = M[8]*M[15] - M[12]*M[11]; c1 = M[8]*M[14] - M[12]*M[10]; c0 = M[8]*M[13] - M[12]*M[9];
+		tp_lanes aAdj[16];//row major, symmetric
+		aAdj[0]  =  M[5]*c5 - M[6]*c4 + M[7]*c3;  aAdj[1]  = -M[1]*c5 + M[2]*c4 - M[3]*c3;
+		aAdj[2]  =  M[13]*s5 - M[14]*s4 + M[15]*s3; aAdj[3] = -M[9]*s5 + M[10]*s4 - M[11]*s3;
+		aAdj[4]  = -M[4]*c5 + M[6]*c2 - M[7]*c1;  aAdj[5]  =  M[0]*c5 - M[2]*c2 + M[3]*c1;
+		aAdj[6]  = -M[12]*s5 + M[14]*s2 - M[15]*s1; aAdj[7] =  M[8]*s5 - M[10]*s2 + M[11]*s1;
+		aAdj[8]  =  M[4]*c4 - M[5]*c2 + M[7]*c0;  aAdj[9]  = -M[0]*c4 + M[1]*c2 - M[3]*c0;
+		aAdj[10] =  M[12]*s4 - M[13]*s2 + M[15]*s0; aAdj[11] = -M[8]*s4 + M[9]*s2 - M[11]*s0;
+		aAdj[12] = -M[4]*c3 + M[5]*c1 - M[6]*c0;  aAdj[13] =  M[0]*c3 - M[1]*c1 + M[2]*c0;
+		aAdj[14] = -M[12]*s3 + M[13]*s1 - M[14]*s0; aAdj[15] =  M[8]*s3 - M[9]*s1 + M[10]*s0;
+		for ( int l = 0; l < nLanes; l++ ){
+			Eigen::Matrix<T,3,1> eivCentroidA( aCA[0]( l ), aCA[1]( l ), aCA[2]( l ) ), eivCentroidB( aCB[0]( l ), aCB[1]( l ), aCB[2]( l ) );
+			Eigen::Matrix< T, 3, 3>& eimR = pR_[h0+l];
+			//the column with the largest diagonal entry is the best conditioned multiple of q
+			int j = 0;
+			for ( int i = 1; i < 4; i++ ) if ( std::abs( aAdj[i*5]( l ) ) > std::abs( aAdj[j*5]( l ) ) ) j = i;
+			Eigen::Matrix<T,4,1> q( aAdj[j]( l ), aAdj[4+j]( l ), aAdj[8+j]( l ), aAdj[12+j]( l ) );
+			const T tScale = tL( l ) * tL( l ) * tL( l );
+			if ( q.squaredNorm() > std::numeric_limits<T>::epsilon() * tScale * tScale && tScale > 0 ){
+				q.normalize();
+				const T w = q( 0 ), x = q( 1 ), y = q( 2 ), z = q( 3 );
+				eimR << w*w+x*x-y*y-z*z, 2*(x*y-w*z),     2*(x*z+w*y),
+				        2*(x*y+w*z),     w*w-x*x+y*y-z*z, 2*(y*z-w*x),
+				        2*(x*z-w*y),     2*(y*z+w*x),     w*w-x*x-y*y+z*z;
+			}
+			else{
+				//repeated root, SVD of the cross covariance sum (b - cb)(a - ca)^T
+				Eigen::Matrix<T,3,3> eimSigma;
+				for ( int r = 0; r < 3; r++ ) for ( int c = 0; c < 3; c++ ) eimSigma( r, c ) = aSAB[c*3+r]( l );
+				Eigen::JacobiSVD< Eigen::Matrix<T,3,3> > svd( eimSigma, Eigen::ComputeFullU | Eigen::ComputeFullV );
+				Eigen::Matrix<T,3,3> eimD = Eigen::Matrix<T,3,3>::Identity();
+				if ( svd.matrixU().determinant() * svd.matrixV().determinant() < 0 ) eimD( 2, 2 ) = -1;//reflection
+				eimR = svd.matrixU() * eimD * svd.matrixV().transpose();
+			}
+			pT_[h0+l] = eivCentroidB - eimR * eivCentroidA;
+		}
+	}//for each batch of hypotheses
+}
+
 template< class T, int ROW, int COL >
 T matNormL1 ( const Eigen::Matrix< T, ROW, COL >& eimMat1_, const Eigen::Matrix< T, ROW, COL >& eimMat2_ )
 {
@@ -13,6 +13,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/math/special_functions/fpclassify.hpp> //isnan
 #include <boost/lexical_cast.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 //stl
 #include <vector>
 #include <iostream>
@@ -44,16 +45,24 @@
 #include "KeyFrame.h"
 #include "CVUtil.hpp"
 #include "Utility.hpp"
+#include "CpuLib.h"
 #include "cuda/CudaLib.h"
 #include "cuda/pcl/internal.h"
 #include "cuda/Registartion.h"
 
+#define __nOrbMaxHamming 100 //of the 256 bits of an ORB descriptor, guided matching only
+#define __fICPConverged 5e-5f //rad or m, a pyramid level stops once the pose increment is below
+
 btl::utility::SNormalHist btl::kinect::CKeyFrame::_sNormalHist;
 btl::utility::SDistanceHist btl::kinect::CKeyFrame::_sDistanceHist;
 boost::shared_ptr<cv::Mat> btl::kinect::CKeyFrame::_acvmShrPtrAA[4];
 boost::shared_ptr<cv::gpu::GpuMat> btl::kinect::CKeyFrame::_acvgmShrPtrAA[4];//for rendering
 boost::shared_ptr<cv::gpu::GpuMat> btl::kinect::CKeyFrame::_acvgmShrPtrPyrDisparity[4];
 boost::shared_ptr<cv::gpu::GpuMat> btl::kinect::CKeyFrame::_acvgmShrPtrPyr32FC1Tmp[4];
+boost::shared_ptr<cv::Mat> btl::kinect::CKeyFrame::_acvmShrPtrPyrDisparity[4];
+boost::shared_ptr<cv::Mat> btl::kinect::CKeyFrame::_acvmShrPtrPyr32FC1Tmp[4];
+btl::kinect::CKeyFrame::tp_backend btl::kinect::CKeyFrame::_eBackend = btl::kinect::CKeyFrame::GPU_BACKEND;
+bool btl::kinect::CKeyFrame::_bSoA = false;
 
 boost::shared_ptr<cv::gpu::SURF_GPU> btl::kinect::CKeyFrame::_pSurf;
 boost::shared_ptr<cv::gpu::ORB_GPU>  btl::kinect::CKeyFrame::_pOrb;
@@ -66,9 +75,9 @@ boost::shared_ptr<cv::gpu::GpuMat> btl::kinect::CKeyFrame::_pcvgmV;
 
 cv::gpu::GpuMat cvgmTest,cvgmTmp;
 
-btl::kinect::CKeyFrame::CKeyFrame( btl::image::SCamera::tp_ptr pRGBCamera_, ushort uResolution_, ushort uPyrLevel_, const Eigen::Vector3f& eivCw_/*float fCwX_, float fCwY_, float fCwZ_*/ )
+btl::kinect::CKeyFrame::CKeyFrame( btl::image::SCamera::tp_ptr pRGBCamera_, ushort uResolution_, ushort uPyrLevel_, const Eigen::Vector3f& eivCw_/*float fCwX_, float fCwY_, float fCwZ_*/, uchar* pHostArena_ )
 :_pRGBCamera(pRGBCamera_),_uResolution(uResolution_),_uPyrHeight(uPyrLevel_),_eivInitCw(eivCw_){
-	allocate();
+	allocate(pHostArena_);
 	//_eivInitCw << fCwX_, fCwY_, fCwZ_; 
 	initRT();
 }
@@ -81,29 +90,67 @@ btl::kinect::CKeyFrame::CKeyFrame( CKeyFrame::tp_ptr pFrame_ )
 	allocate();
 	pFrame_->copyTo(this);
 }
-void btl::kinect::CKeyFrame::allocate(){
-	//disparity
+//the host containers of one level in the order they are laid out in an arena
+static const int __aHostArenaTypes[] = { CV_32FC3, CV_32FC3, CV_8UC3, CV_8UC1, CV_32FC1, CV_16SC1, CV_32FC1 };
+
+//heap allocated if ppArena_ points to NULL, otherwise a header into the arena which is then advanced 
+static cv::Mat* newHostMat(int nRows_, int nCols_, int nType_, uchar** ppArena_){
+	if( NULL == *ppArena_ ) return new cv::Mat(nRows_,nCols_,nType_);
+	cv::Mat* pMat = new cv::Mat(nRows_,nCols_,nType_,*ppArena_);
+	*ppArena_ += cv::alignSize(size_t(nRows_)*nCols_*CV_ELEM_SIZE(nType_), 32);
+	return pMat;
+}
+
+size_t btl::kinect::CKeyFrame::hostArenaBytes(const btl::image::SCamera* pRGBCamera_, ushort uPyrHeight_){
+	size_t sBytes = 0;
+	for(int i=0; i<uPyrHeight_; i++){
+		const size_t sPixels = size_t(pRGBCamera_->_sHeight >> i)*(pRGBCamera_->_sWidth >> i);
+		for (int j=0; j < int(sizeof(__aHostArenaTypes)/sizeof(int)); j++)
+			sBytes += cv::alignSize(sPixels*CV_ELEM_SIZE(__aHostArenaTypes[j]), 32);
+	}
+	return sBytes;
+}
+
+void btl::kinect::CKeyFrame::allocate(uchar* pHostArena_ /*= NULL*/){
+	//pHostArena_ must be 32-byte aligned and hold hostArenaBytes() bytes; it is owned by the caller
+	uchar* pArena = pHostArena_;
 	for(int i=0; i<_uPyrHeight; i++){
 		int nRows = _pRGBCamera->_sHeight >> i;
 		int nCols = _pRGBCamera->_sWidth >> i;//__aKinectW[_uResolution]>>i;
-		//host
-		_acvmShrPtrPyrPts[i] .reset(new cv::Mat(nRows,nCols,CV_32FC3));
-		_acvmShrPtrPyrNls[i] .reset(new cv::Mat(nRows,nCols,CV_32FC3));
-		_acvmShrPtrPyrRGBs[i].reset(new cv::Mat(nRows,nCols,CV_8UC3));
-		_acvmShrPtrPyrBWs[i] .reset(new cv::Mat(nRows,nCols,CV_8UC1));
-		_acvmPyrDepths[i]	 .reset(new cv::Mat(nRows,nCols,CV_32FC1));
+		//host, same order as __aHostArenaTypes
+		_acvmShrPtrPyrPts[i] .reset(newHostMat(nRows,nCols,CV_32FC3,&pArena));
+		_acvmShrPtrPyrNls[i] .reset(newHostMat(nRows,nCols,CV_32FC3,&pArena));
+		_acvmShrPtrPyrRGBs[i].reset(newHostMat(nRows,nCols,CV_8UC3,&pArena));
+		_acvmShrPtrPyrBWs[i] .reset(newHostMat(nRows,nCols,CV_8UC1,&pArena));
+		_acvmPyrDepths[i]	 .reset(newHostMat(nRows,nCols,CV_32FC1,&pArena));
+		//plane detection
+		_acvmShrPtrNormalClusters[i].reset(newHostMat(nRows,nCols,CV_16SC1,&pArena));
+		_acvmShrPtrDistanceClusters[i].reset(newHostMat(nRows,nCols,CV_32FC1,&pArena));
+		//host temporaries, shared by all frames: only (re)allocated when missing or of another size, so that a frame
+		//constructed or taken from the pool does not pull them from under a pyramid being built
+		if (!_acvmShrPtrPyrDisparity[i] || _acvmShrPtrPyrDisparity[i]->size() != cv::Size(nCols,nRows)){
+			_acvmShrPtrPyrDisparity[i].reset(new cv::Mat(nRows,nCols,CV_32FC1));
+			_acvmShrPtrPyr32FC1Tmp[i].reset(new cv::Mat(nRows,nCols,CV_32FC1));
+		}
+		if (CPU_BACKEND == _eBackend){
+			//keep the device containers empty, nothing touches the GPU
+			_acvgmShrPtrPyrPts[i] .reset(new cv::gpu::GpuMat);
+			_acvgmShrPtrPyrNls[i] .reset(new cv::gpu::GpuMat);
+			_acvgmShrPtrPyrRGBs[i].reset(new cv::gpu::GpuMat);
+			_acvgmShrPtrPyrBWs[i] .reset(new cv::gpu::GpuMat);
+			_acvgmShrPtrPyrDepths[i].reset(new cv::gpu::GpuMat);
+			continue;
+		}
 		//device
 		_acvgmShrPtrPyrPts[i] .reset(new cv::gpu::GpuMat(nRows,nCols,CV_32FC3));
 		_acvgmShrPtrPyrNls[i] .reset(new cv::gpu::GpuMat(nRows,nCols,CV_32FC3));
 		_acvgmShrPtrPyrRGBs[i].reset(new cv::gpu::GpuMat(nRows,nCols,CV_8UC3));
 		_acvgmShrPtrPyrBWs[i] .reset(new cv::gpu::GpuMat(nRows,nCols,CV_8UC1));
 		_acvgmShrPtrPyrDepths[i].reset(new cv::gpu::GpuMat(nRows,nCols,CV_32FC1));
-		//plane detection
-		_acvmShrPtrNormalClusters[i].reset(new cv::Mat(nRows,nCols,CV_16SC1));
-		_acvmShrPtrDistanceClusters[i].reset(new cv::Mat(nRows,nCols,CV_32FC1));
-		//device
-		_acvgmShrPtrPyrDisparity[i].reset(new cv::gpu::GpuMat(nRows,nCols,CV_32FC1));
-		_acvgmShrPtrPyr32FC1Tmp[i].reset(new cv::gpu::GpuMat(nRows,nCols,CV_32FC1));
+		if (!_acvgmShrPtrPyrDisparity[i] || _acvgmShrPtrPyrDisparity[i]->size() != cv::Size(nCols,nRows)){
+			_acvgmShrPtrPyrDisparity[i].reset(new cv::gpu::GpuMat(nRows,nCols,CV_32FC1));
+			_acvgmShrPtrPyr32FC1Tmp[i].reset(new cv::gpu::GpuMat(nRows,nCols,CV_32FC1));
+		}
 	}
 
 	_eConvention = btl::utility::BTL_CV;
@@ -161,8 +208,8 @@ void btl::kinect::CKeyFrame::copyTo( CKeyFrame* pKF_, const short sLevel_ ) cons
 	//device
 	if( !_acvgmShrPtrPyrPts[sLevel_]->empty()) _acvgmShrPtrPyrPts[sLevel_]->copyTo(*pKF_->_acvgmShrPtrPyrPts[sLevel_]);
 	if( !_acvgmShrPtrPyrNls[sLevel_]->empty()) _acvgmShrPtrPyrNls[sLevel_]->copyTo(*pKF_->_acvgmShrPtrPyrNls[sLevel_]);
-	_acvgmShrPtrPyrRGBs[sLevel_]->copyTo(*pKF_->_acvgmShrPtrPyrRGBs[sLevel_]);
-	_acvgmShrPtrPyrBWs[sLevel_]->copyTo(*pKF_->_acvgmShrPtrPyrBWs[sLevel_]);
+	if( !_acvgmShrPtrPyrRGBs[sLevel_]->empty()) _acvgmShrPtrPyrRGBs[sLevel_]->copyTo(*pKF_->_acvgmShrPtrPyrRGBs[sLevel_]);
+	if( !_acvgmShrPtrPyrBWs[sLevel_]->empty()) _acvgmShrPtrPyrBWs[sLevel_]->copyTo(*pKF_->_acvgmShrPtrPyrBWs[sLevel_]);
 	pKF_->_eConvention = _eConvention;
 }
 
@@ -170,12 +217,14 @@ void btl::kinect::CKeyFrame::copyTo( CKeyFrame* pKF_ ) const{
 	for(int i=0; i<_uPyrHeight; i++) {
 		copyTo(pKF_,i);
 	}
-	_acvgmShrPtrPyrDepths[0]->copyTo(*pKF_->_acvgmShrPtrPyrDepths[0]);
+	if( !_acvmPyrDepths[0]->empty()) _acvmPyrDepths[0]->copyTo(*pKF_->_acvmPyrDepths[0]); //integrated on the host by CPU_BACKEND
+	if( !_acvgmShrPtrPyrDepths[0]->empty()) _acvgmShrPtrPyrDepths[0]->copyTo(*pKF_->_acvgmShrPtrPyrDepths[0]);
 	//copy surf features
 	
 	if( !_vKeyPoints.empty() ){
 		_cvgmKeyPoints.copyTo(pKF_->_cvgmKeyPoints);
 		_cvgmDescriptors.copyTo(pKF_->_cvgmDescriptors);
+		_cvmDescriptors.copyTo(pKF_->_cvmDescriptors);
 		pKF_->_vKeyPoints.resize(_vKeyPoints.size());
 		std::copy( _vKeyPoints.begin(), _vKeyPoints.end(), pKF_->_vKeyPoints.begin() );
 	}
@@ -191,12 +240,14 @@ void btl::kinect::CKeyFrame::copyImageTo( CKeyFrame* pKF_ ) const{
 		_acvmShrPtrPyrRGBs[sLevel_]->copyTo(*pKF_->_acvmShrPtrPyrRGBs[sLevel_]);
 		_acvmShrPtrPyrBWs[sLevel_]->copyTo(*pKF_->_acvmShrPtrPyrBWs[sLevel_]);
 		//device
+		if( CPU_BACKEND == _eBackend ) continue;
 		_acvgmShrPtrPyrRGBs[sLevel_]->copyTo(*pKF_->_acvgmShrPtrPyrRGBs[sLevel_]);
 		_acvgmShrPtrPyrBWs[sLevel_]->copyTo(*pKF_->_acvgmShrPtrPyrBWs[sLevel_]);
 	}
 	if( !_vKeyPoints.empty() ){
 		_cvgmKeyPoints.copyTo(pKF_->_cvgmKeyPoints);
 		_cvgmDescriptors.copyTo(pKF_->_cvgmDescriptors);
+		_cvmDescriptors.copyTo(pKF_->_cvmDescriptors);
 		pKF_->_vKeyPoints.resize(_vKeyPoints.size());
 		std::copy( _vKeyPoints.begin(), _vKeyPoints.end(), pKF_->_vKeyPoints.begin() );
 	}
@@ -240,6 +291,88 @@ void btl::kinect::CKeyFrame::exportPCL(const std::string& strPath_, const std::s
 
 	return;
 }
+//a fixed buffer in front of an ofstream, so that streaming small records costs neither a write each nor unbounded memory
+class CBufferedWriter{
+public:
+	CBufferedWriter(std::ofstream& fOut_):_fOut(fOut_),_sUsed(0){}
+	~CBufferedWriter(){ flush(); }
+	void write(const void* pData_, size_t sBytes_){
+		if( _sUsed + sBytes_ > sizeof(_acBuffer) ) flush();
+		memcpy(_acBuffer + _sUsed, pData_, sBytes_);
+		_sUsed += sBytes_;
+	}
+	void flush(){ _fOut.write(_acBuffer,_sUsed); _sUsed = 0; }
+private:
+	std::ofstream& _fOut;
+	size_t _sUsed;
+	char _acBuffer[1<<16];
+};
+
+unsigned int btl::kinect::CKeyFrame::exportPointCloud(const std::string& strPath_, const std::string& strFileName_, tp_cloud_format eFormat_ /*= PLY_CLOUD*/, short sLevel_ /*= -1*/) const{
+	BTL_ASSERT( sLevel_ < _uPyrHeight, "CKeyFrame::exportPointCloud() the pyramid level does not exist" );
+	const short sFirst = sLevel_ < 0? 0 : sLevel_;
+	const short sLast  = sLevel_ < 0? _uPyrHeight - 1 : sLevel_;
+	//1st pass, count the valid points for the header
+	unsigned int uPoints = 0;
+	for (short l = sFirst; l <= sLast; l++){
+		const cv::Mat& cvmPts = *_acvmShrPtrPyrPts[l];
+		const cv::Mat& cvmNls = *_acvmShrPtrPyrNls[l];
+		for (int r = 0; r < cvmPts.rows; r++){
+			const float* pPt = cvmPts.ptr<float>(r);
+			const float* pNl = cvmNls.ptr<float>(r);
+			for (int c = 0; c < cvmPts.cols; c++, pPt += 3, pNl += 3)
+				if( !boost::math::isnan<float>(pPt[2]) && !boost::math::isnan<float>(pNl[2]) ) uPoints++;
+		}
+	}
+	//header
+	std::string strPathFileName = strPath_ + strFileName_;
+	std::ofstream fOut(strPathFileName.c_str(),std::ios::out|std::ios::binary);
+	BTL_ASSERT( fOut.is_open(), "CKeyFrame::exportPointCloud() cannot open the file" );
+	if( PLY_CLOUD == eFormat_ ){
+		fOut << "ply\nformat binary_little_endian 1.0\n";
+		fOut << "element vertex " << uPoints << "\n";
+		fOut << "property float x\nproperty float y\nproperty float z\n";
+		fOut << "property float nx\nproperty float ny\nproperty float nz\n";
+		fOut << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+		fOut << "end_header\n";
+	}
+	else{
+		fOut << "# .PCD v0.7 - Point Cloud Data file format\n";
+		fOut << "VERSION 0.7\nFIELDS x y z normal_x normal_y normal_z rgb\n";
+		fOut << "SIZE 4 4 4 4 4 4 4\nTYPE F F F F F F F\nCOUNT 1 1 1 1 1 1 1\n";
+		fOut << "WIDTH " << uPoints << "\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\n";
+		fOut << "POINTS " << uPoints << "\nDATA binary\n";
+	}
+	//2nd pass, interleaved records
+	{
+		CBufferedWriter cWriter(fOut);
+		for (short l = sFirst; l <= sLast; l++){
+			const cv::Mat& cvmPts = *_acvmShrPtrPyrPts[l];
+			const cv::Mat& cvmNls = *_acvmShrPtrPyrNls[l];
+			const cv::Mat& cvmRGBs= *_acvmShrPtrPyrRGBs[l];
+			for (int r = 0; r < cvmPts.rows; r++){
+				const float* pPt = cvmPts.ptr<float>(r);
+				const float* pNl = cvmNls.ptr<float>(r);
+				const uchar* pRGB= cvmRGBs.ptr<uchar>(r);
+				for (int c = 0; c < cvmPts.cols; c++, pPt += 3, pNl += 3, pRGB += 3){
+					if( boost::math::isnan<float>(pPt[2]) || boost::math::isnan<float>(pNl[2]) ) continue;
+					cWriter.write(pPt,3*sizeof(float));
+					cWriter.write(pNl,3*sizeof(float));
+					if( PLY_CLOUD == eFormat_ ) cWriter.write(pRGB,3);
+					else{
+						//pcl packs rgb as 0x00RRGGBB into a float
+						const unsigned int uRGB = (unsigned int)pRGB[0] << 16 | (unsigned int)pRGB[1] << 8 | (unsigned int)pRGB[2];
+						cWriter.write(&uRGB,sizeof(unsigned int));
+					}
+				}//for each col
+			}//for each row
+		}//for each level
+	}
+	BTL_ASSERT( fOut.good(), "CKeyFrame::exportPointCloud() writing failed" );
+	fOut.close();
+	return uPoints;
+}
+
 void btl::kinect::CKeyFrame::exportYML(const std::string& strPath_, const std::string& strYMLName_){
 	using namespace btl::utility;
 
@@ -294,6 +427,111 @@ void btl::kinect::CKeyFrame::importYML(const std::string& strPath_, const std::s
 
 
 
+//layout of the binary snapshot, all in host byte order.
+//the header is followed by the planes of each level in the order of __aSnapshotTypes,
+//every plane starts at a multiple of 64 bytes from the beginning of the file and is stored without row padding.
+static const char __acSnapshotMagic[8] = {'B','T','L','K','F','R','M','\0'};
+static const unsigned int __uSnapshotVersion = 1;
+enum { SNAPSHOT_PLANES = 5, SNAPSHOT_ALIGNMENT = 64 };
+static const int __aSnapshotTypes[SNAPSHOT_PLANES] = { CV_32FC3, CV_32FC3, CV_8UC3, CV_8UC1, CV_32FC1 }; //pts, nls, rgbs, bws, depths
+struct SSnapshotHeader{
+	char _acMagic[8];
+	unsigned int _uVersion;
+	unsigned short _uPyrHeight, _uResolution;
+	unsigned short _sWidth, _sHeight; //level 0
+	float _fFx, _fFy, _u, _v;
+	float _afRw[9]; //column major
+	float _afTw[3];
+	float _afInitCw[3];
+	unsigned long long _aauOffsets[4][SNAPSHOT_PLANES];
+};
+//keeps the mapping alive as long as any of the cv::Mat headers into it
+struct SMappedMatRelease{
+	SMappedMatRelease(const boost::shared_ptr<boost::iostreams::mapped_file>& pFile_):_pFile(pFile_){}
+	void operator()(cv::Mat* pMat_) const { delete pMat_; }
+	boost::shared_ptr<boost::iostreams::mapped_file> _pFile;
+};
+
+void btl::kinect::CKeyFrame::exportBinary(const std::string& strPath_, const std::string& strFileName_) const{
+	const boost::shared_ptr<cv::Mat>* aapPlanes[SNAPSHOT_PLANES] = { _acvmShrPtrPyrPts, _acvmShrPtrPyrNls, _acvmShrPtrPyrRGBs, _acvmShrPtrPyrBWs, _acvmPyrDepths };
+	SSnapshotHeader sHeader;
+	memset(&sHeader,0,sizeof(SSnapshotHeader));
+	memcpy(sHeader._acMagic,__acSnapshotMagic,sizeof(__acSnapshotMagic));
+	sHeader._uVersion = __uSnapshotVersion;
+	sHeader._uPyrHeight = _uPyrHeight;
+	sHeader._uResolution = _uResolution;
+	sHeader._sWidth = _pRGBCamera->_sWidth;
+	sHeader._sHeight = _pRGBCamera->_sHeight;
+	sHeader._fFx = _pRGBCamera->_fFx; sHeader._fFy = _pRGBCamera->_fFy;
+	sHeader._u = _pRGBCamera->_u;     sHeader._v = _pRGBCamera->_v;
+	memcpy(sHeader._afRw,_eimRw.data(),sizeof(sHeader._afRw));
+	memcpy(sHeader._afTw,_eivTw.data(),sizeof(sHeader._afTw));
+	memcpy(sHeader._afInitCw,_eivInitCw.data(),sizeof(sHeader._afInitCw));
+	//offsets
+	size_t sOffset = cv::alignSize(sizeof(SSnapshotHeader),SNAPSHOT_ALIGNMENT);
+	for (int i = 0; i < _uPyrHeight; i++)
+	for (int j = 0; j < SNAPSHOT_PLANES; j++){
+		const cv::Mat& cvmPlane = *aapPlanes[j][i];
+		BTL_ASSERT( cvmPlane.type() == __aSnapshotTypes[j] && cvmPlane.rows == (_pRGBCamera->_sHeight>>i) && cvmPlane.cols == (_pRGBCamera->_sWidth>>i), "CKeyFrame::exportBinary() unexpected pyramid layout" );
+		sHeader._aauOffsets[i][j] = sOffset;
+		sOffset += cv::alignSize(cvmPlane.rows*cvmPlane.cols*cvmPlane.elemSize(),SNAPSHOT_ALIGNMENT);
+	}
+	//write
+	std::string strPathFileName = strPath_ + strFileName_;
+	std::ofstream fOut(strPathFileName.c_str(),std::ios::out|std::ios::binary);
+	BTL_ASSERT( fOut.is_open(), "CKeyFrame::exportBinary() cannot open the file" );
+	const char acZeros[SNAPSHOT_ALIGNMENT] = {0};
+	fOut.write((const char*)&sHeader,sizeof(SSnapshotHeader));
+	fOut.write(acZeros,cv::alignSize(sizeof(SSnapshotHeader),SNAPSHOT_ALIGNMENT) - sizeof(SSnapshotHeader));
+	for (int i = 0; i < _uPyrHeight; i++)
+	for (int j = 0; j < SNAPSHOT_PLANES; j++){
+		const cv::Mat& cvmPlane = *aapPlanes[j][i];
+		const size_t sRowBytes = cvmPlane.cols*cvmPlane.elemSize();
+		for (int r = 0; r < cvmPlane.rows; r++) fOut.write((const char*)cvmPlane.ptr(r),sRowBytes);
+		fOut.write(acZeros,cv::alignSize(sRowBytes*cvmPlane.rows,SNAPSHOT_ALIGNMENT) - sRowBytes*cvmPlane.rows);
+	}
+	BTL_ASSERT( fOut.good(), "CKeyFrame::exportBinary() writing failed" );
+	fOut.close();
+}
+
+void btl::kinect::CKeyFrame::importBinary(const std::string& strPath_, const std::string& strFileName_){
+	std::string strPathFileName = strPath_ + strFileName_;
+	//copy-on-write, the frame may modify its pyramid without touching the file
+	boost::shared_ptr<boost::iostreams::mapped_file> pFile(new boost::iostreams::mapped_file(strPathFileName,boost::iostreams::mapped_file::priv));
+	BTL_ASSERT( pFile->is_open() && pFile->size() >= sizeof(SSnapshotHeader), "CKeyFrame::importBinary() cannot map the file" );
+	uchar* pData = (uchar*)pFile->data();
+	const SSnapshotHeader& sHeader = *(const SSnapshotHeader*)pData;
+	BTL_ASSERT( 0 == memcmp(sHeader._acMagic,__acSnapshotMagic,sizeof(__acSnapshotMagic)) && __uSnapshotVersion == sHeader._uVersion, "CKeyFrame::importBinary() not a keyframe snapshot or unsupported version" );
+	BTL_ASSERT( sHeader._uPyrHeight == _uPyrHeight && sHeader._uResolution == _uResolution && sHeader._sWidth == _pRGBCamera->_sWidth && sHeader._sHeight == _pRGBCamera->_sHeight, "CKeyFrame::importBinary() the snapshot does not match the frame" );
+	//the pts were unprojected with the intrinsics of the snapshot
+	BTL_ASSERT( sHeader._fFx == _pRGBCamera->_fFx && sHeader._fFy == _pRGBCamera->_fFy && sHeader._u == _pRGBCamera->_u && sHeader._v == _pRGBCamera->_v, "CKeyFrame::importBinary() the snapshot was taken with another camera" );
+	//the planes
+	boost::shared_ptr<cv::Mat>* aapPlanes[SNAPSHOT_PLANES] = { _acvmShrPtrPyrPts, _acvmShrPtrPyrNls, _acvmShrPtrPyrRGBs, _acvmShrPtrPyrBWs, _acvmPyrDepths };
+	for (int i = 0; i < _uPyrHeight; i++)
+	for (int j = 0; j < SNAPSHOT_PLANES; j++){
+		const int nRows = _pRGBCamera->_sHeight >> i;
+		const int nCols = _pRGBCamera->_sWidth >> i;
+		const unsigned long long uOffset = sHeader._aauOffsets[i][j];
+		BTL_ASSERT( aapPlanes[j][i] && aapPlanes[j][i]->type() == __aSnapshotTypes[j] && aapPlanes[j][i]->rows == nRows && aapPlanes[j][i]->cols == nCols, "CKeyFrame::importBinary() the frame is not allocated for this snapshot" );
+		BTL_ASSERT( 0 == uOffset % SNAPSHOT_ALIGNMENT && uOffset + size_t(nRows)*nCols*CV_ELEM_SIZE(__aSnapshotTypes[j]) <= pFile->size(), "CKeyFrame::importBinary() corrupted plane offsets" );
+		aapPlanes[j][i].reset( new cv::Mat(nRows,nCols,__aSnapshotTypes[j],pData + uOffset), SMappedMatRelease(pFile) );
+	}
+	//the pose
+	memcpy(_eimRw.data(),sHeader._afRw,sizeof(sHeader._afRw));
+	memcpy(_eivTw.data(),sHeader._afTw,sizeof(sHeader._afTw));
+	memcpy(_eivInitCw.data(),sHeader._afInitCw,sizeof(sHeader._afInitCw));
+	updateMVInv();
+	if (CPU_BACKEND == _eBackend) return;
+	//the tracker and the renderer read the device pyramid
+	for (int i = 0; i < _uPyrHeight; i++){
+		_acvgmShrPtrPyrPts[i]->upload(*_acvmShrPtrPyrPts[i]);
+		_acvgmShrPtrPyrNls[i]->upload(*_acvmShrPtrPyrNls[i]);
+		_acvgmShrPtrPyrRGBs[i]->upload(*_acvmShrPtrPyrRGBs[i]);
+		_acvgmShrPtrPyrBWs[i]->upload(*_acvmShrPtrPyrBWs[i]);
+		_acvgmShrPtrPyrDepths[i]->upload(*_acvmPyrDepths[i]);
+	}
+}
+
 void btl::kinect::CKeyFrame::establishPlaneCorrespondences( const CKeyFrame& sReferenceKF_) {
 /*
 	CHECK ( !_vMatches.empty(), "SKeyFrame::calcRT() _vMatches should not calculated." );
@@ -348,6 +586,7 @@ void btl::kinect::CKeyFrame::extractSurfFeatures ()  {
 void btl::kinect::CKeyFrame::extractOrbFeatures ()  {
 	(*_pOrb)(*_acvgmShrPtrPyrBWs[0], cv::gpu::GpuMat(), _cvgmKeyPoints, _cvgmDescriptors);
 	_pOrb->downloadKeyPoints(_cvgmKeyPoints, _vKeyPoints);
+	_cvgmDescriptors.download(_cvmDescriptors); //for guided matching
 	return;
 }
 
@@ -399,6 +638,41 @@ void btl::kinect::CKeyFrame::gpuConvert2ColorGraph( cv::gpu::GpuMat* pcvgmU_, cv
 	cvgmOnes.convertTo(*pcvgmColorGraph_,CV_8UC3,255);
 }
 
+//preemptive RANSAC over the matched pairs, then Horn over the inliers. too few pairs or too few inliers fall back to
+//Horn over all pairs as before.
+static const int   __nRansacMinPairs   = 12;
+static const int   __nRansacHypotheses = 256;
+static const int   __nRansacBlock      = 16;
+static const float __fRansacInlierThres = .05f;//metre
+static float robustAbsoluteOrientation( Eigen::MatrixXf& eimRefWorld_, Eigen::MatrixXf& eimCurCam_, Eigen::Matrix3f* peimRw_, Eigen::Vector3f* peivTw_, unsigned short* pInliers_ ){
+	const int nSize = (int)eimCurCam_.cols();
+	float fS2;
+	std::vector<uchar> vInliers;
+	int nInliers = 0;
+	if ( nSize >= __nRansacMinPairs ){
+		cv::Mat cvmRef ( 3, nSize, CV_32FC1 ), cvmCur ( 3, nSize, CV_32FC1 );
+		for ( int k = 0; k < 3; k++ ) for ( int i = 0; i < nSize; i++ ){
+			cvmRef.ptr<float>(k)[i] = eimRefWorld_(k,i);
+			cvmCur.ptr<float>(k)[i] = eimCurCam_(k,i);
+		}
+		Eigen::Matrix3f eimRw; Eigen::Vector3f eivTw;
+		nInliers = btl::cpu::ransacAbsoluteOrientation ( cvmRef, cvmCur, __fRansacInlierThres, __nRansacHypotheses, __nRansacBlock, eimRw.data(), eivTw.data(), &vInliers );
+	}
+	if ( nInliers < 3 ){
+		*pInliers_ = (unsigned short)nSize;
+		return btl::utility::absoluteOrientation < float > ( eimRefWorld_, eimCurCam_, false, peimRw_, peivTw_, &fS2 );
+	}
+	//refinement over the inliers
+	Eigen::MatrixXf eimRefInlier ( 3, nInliers ), eimCurInlier ( 3, nInliers );
+	for ( int i = 0, j = 0; i < nSize; i++ ) if ( vInliers[i] ) {
+		eimRefInlier.col ( j ) = eimRefWorld_.col ( i );
+		eimCurInlier.col ( j ) = eimCurCam_.col ( i );
+		j++;
+	}
+	*pInliers_ = (unsigned short)nInliers;
+	return btl::utility::absoluteOrientation < float > ( eimRefInlier, eimCurInlier, false, peimRw_, peivTw_, &fS2 );
+}
+
 double btl::kinect::CKeyFrame::calcRT ( const CKeyFrame& sPrevKF_, const unsigned short sLevel_ , const double dDistanceThreshold_, unsigned short* pInliers_) {
 	// - The reference frame must contain a calibrated Rw and Tw. 
 	// - The point cloud in the reference frame must be transformed into the world coordinate system.
@@ -488,91 +762,45 @@ double btl::kinect::CKeyFrame::calcRT ( const CKeyFrame& sPrevKF_, const unsigne
         eimRefWorld ( 2, i ) = _pReferencePts[ *cit_Ref + 2 ];
         i++;
     }
-    float dS2;
-    float fErrorBest = btl::utility::absoluteOrientation < float > ( eimRefWorld, eimCurCam , false, &_eimRw, &_eivTw, &dS2 ); // eimB_ = R * eimA_ + T;
-
-	//PRINT ( fErrorBest );
-	//PRINT ( _eimR );
-	//PRINT ( _eivT );
-	double dThreshold = fErrorBest;
-        
-    /*
-    if ( nSize > 30 ) {
-                            
-            // random generator
-            boost::mt19937 rng;
-            boost::uniform_real<> gen ( 0, 1 );
-            boost::variate_generator< boost::mt19937&, boost::uniform_real<> > dice ( rng, gen );
-            double dError;
-            Eigen::Matrix3d eimR;
-            Eigen::Vector3d eivT;
-            double dS;
-            std::vector< int > vVoterIdx;
-            Eigen::Matrix3d eimRBest;
-            Eigen::Vector3d eivTBest;
-            std::vector< int > vVoterIdxBest;
-            int nMax = 0;
-            std::vector < int > vRndIdx;
-            Eigen::MatrixXd eimXTmp ( 3, 5 ), eimYTmp ( 3, 5 );
-            
-            for ( int n = 0; n < 500; n++ ) {
-                select5Rand (  eimRefWorld, eimCurCam, dice, &eimYTmp, &eimXTmp );
-                dError = btl::utility::absoluteOrientation < double > ( eimYTmp, eimXTmp, false, &eimR, &eivT, &dS );
-            
-                if ( dError > dThreshold ) {
-                    continue;
-                }
-            
-                //voting
-                int nVotes = voting ( eimRefWorld, eimCurCam, eimR, eivT, dThreshold, &vVoterIdx );
-                if ( nVotes > eimCurCam.cols() *.75 ) {
-                    nMax = nVotes;
-                    eimRBest = eimR;
-                    eivTBest = eivT;
-                    vVoterIdxBest = vVoterIdx;
-                    break;
-                }
-            
-                if ( nVotes > nMax ){
-                    nMax = nVotes;
-                    eimRBest = eimR;
-                    eivTBest = eivT;
-                    vVoterIdxBest = vVoterIdx;
-                }
-            }
-            
-            if ( nMax <= 6 ){
-            	std::cout << "try increase the threshould" << std::endl;
-                return fErrorBest;
-            }
-            
-            Eigen::MatrixXd eimXInlier ( 3, vVoterIdxBest.size() );
-            Eigen::MatrixXd eimYInlier ( 3, vVoterIdxBest.size() );
-            selectInlier ( eimRefWorld, eimCurCam, vVoterIdxBest, &eimYInlier, &eimXInlier );
-            fErrorBest = btl::utility::absoluteOrientation < double > (  eimYInlier , eimXInlier , false, &eimRNew, &eivTNew, &fS2 );
-            
-            PRINT ( nMax );
-            PRINT ( fErrorBest );
-            //PRINT ( _eimR );
-            //PRINT ( _eivT );
-            *pInliers_ = (unsigned short)nMax;
-        }//if*/
-    
+    float fErrorBest = robustAbsoluteOrientation ( eimRefWorld, eimCurCam, &_eimRw, &_eivTw, pInliers_ ); // eimB_ = R * eimA_ + T;
+
 	//apply new pose
 	updateMVInv();
     return fErrorBest;
 }// calcRT
 
-double btl::kinect::CKeyFrame::calcRTOrb ( const CKeyFrame& sPrevKF_, const double dDistanceThreshold_, unsigned short* pInliers_) {
+double btl::kinect::CKeyFrame::calcRTOrb ( const CKeyFrame& sPrevKF_, const double dDistanceThreshold_, unsigned short* pInliers_, const float fSearchRadius_/* = 0.f*/) {
 	// - The previous frame must contain a calibrated Rw and Tw. 
 	// - The point cloud in the previous frame must be transformed into the world coordinate system.
 	// - The current frame's Rw and Tw must be initialized as the reference's Rw Tw. (This is for fDist = norm3<float>() ) 
 	// - The point cloud in the current frame must be in the camera coordinate system.
 	//BTL_ASSERT(sPrevKF_._vKeyPoints.size()>10,"extractSurfFeatures() Too less Orb features detected in the reference frame")
 	const unsigned short sLevel_ = 0;
-	//matching from current to reference
-	cv::gpu::BruteForceMatcher_GPU< cv::HammingLUT > cBruteMatcher;
-	cBruteMatcher.match(_cvgmDescriptors, sPrevKF_._cvgmDescriptors, _vMatches);  
+	if( fSearchRadius_ > 0.f && !sPrevKF_._cvmDescriptors.empty() && !_cvmDescriptors.empty() ){
+		//matching guided by the current R,T: the reference features are projected into the current image and only
+		//matched to the current keypoints around them
+		const float*const pPrevPts = (const float*)sPrevKF_._acvmShrPtrPyrPts[sLevel_]->data;
+		std::vector<cv::Point2f> vRefProjected(sPrevKF_._vKeyPoints.size()), vCur(_vKeyPoints.size());
+		for ( size_t i = 0; i < sPrevKF_._vKeyPoints.size(); i++ ){
+			const int nX = cvRound ( sPrevKF_._vKeyPoints[i].pt.x );
+			const int nY = cvRound ( sPrevKF_._vKeyPoints[i].pt.y );
+			const float* pPt = pPrevPts + nY * __aKinectW[_uResolution] * 3 + nX * 3;
+			vRefProjected[i].x = vRefProjected[i].y = std::numeric_limits<float>::quiet_NaN();
+			if ( boost::math::isnan<float>( pPt[2] ) ) continue;
+			const Eigen::Vector3f eivPt = _eimRw * Eigen::Map<const Eigen::Vector3f>( pPt ) + _eivTw;
+			if ( eivPt(2) <= 0.f ) continue;
+			vRefProjected[i].x = _pRGBCamera->_fFx * eivPt(0) / eivPt(2) + _pRGBCamera->_u;
+			vRefProjected[i].y = _pRGBCamera->_fFy * eivPt(1) / eivPt(2) + _pRGBCamera->_v;
+		}
+		for ( size_t i = 0; i < _vKeyPoints.size(); i++ ) vCur[i] = _vKeyPoints[i].pt;
+		btl::cpu::guidedMatch( vRefProjected, sPrevKF_._cvmDescriptors, vCur, _cvmDescriptors, _acvmShrPtrPyrBWs[sLevel_]->size(),
+			fSearchRadius_, __nOrbMaxHamming, &_vMatches );
+	}
+	else{
+		//matching from current to reference
+		cv::gpu::BruteForceMatcher_GPU< cv::HammingLUT > cBruteMatcher;
+		cBruteMatcher.match(_cvgmDescriptors, sPrevKF_._cvgmDescriptors, _vMatches);  
+	}
 	PRINT(_vMatches.size());
 	std::sort( _vMatches.begin(), _vMatches.end() );
 	if (_vMatches.size()> 300) { _vMatches.erase( _vMatches.begin()+ 300, _vMatches.end() ); }
@@ -606,7 +834,6 @@ double btl::kinect::CKeyFrame::calcRTOrb ( const CKeyFrame& sPrevKF_, const doub
 	}//for ( std::vector< cv::DMatch >::const_iterator cit = _vMatches.begin(); cit != _vMatches.end(); cit++ )
             
     int nSize = _vDepthIdxCur.size(); 
-	*pInliers_ = nSize;
 	PRINT(nSize);
 	//if nSize smaller than a threshould, quit
     Eigen::MatrixXf eimCurCam ( 3, nSize ), eimRefWorld ( 3, nSize );
@@ -622,13 +849,7 @@ double btl::kinect::CKeyFrame::calcRTOrb ( const CKeyFrame& sPrevKF_, const doub
         eimRefWorld ( 2, i ) = _pPrevPts[ *cit_Ref + 2 ];
         i++;
     }
-    float fS2;
-    float dErrorBest = btl::utility::absoluteOrientation < float > ( eimRefWorld, eimCurCam , false, &_eimRw, &_eivTw, &fS2 ); // eimB_ = R * eimA_ + T;
-
-	//PRINT ( dErrorBest );
-	//PRINT ( _eimR );
-	//PRINT ( _eivT );
-	float dThreshold = dErrorBest;
+    float dErrorBest = robustAbsoluteOrientation ( eimRefWorld, eimCurCam, &_eimRw, &_eivTw, pInliers_ ); // eimB_ = R * eimA_ + T;
 
 	updateMVInv();
     return dErrorBest;
@@ -1003,9 +1224,14 @@ void btl::kinect::CKeyFrame::select5Rand ( const Eigen::MatrixXd& eimX_, const E
 }//end of select5Rand()
 void btl::kinect::CKeyFrame::gpuTransformToWorldCVCV(const ushort usLevel_){
 	if (usLevel_>=_uPyrHeight) return;
-	btl::device::transformLocalToWorldCVCV(_eimRw.data(),_eivTw.data(),&*_acvgmShrPtrPyrPts[usLevel_],&*_acvgmShrPtrPyrNls[usLevel_]);
-	_acvgmShrPtrPyrPts[usLevel_]->download(*_acvmShrPtrPyrPts[usLevel_]);
-	_acvgmShrPtrPyrNls[usLevel_]->download(*_acvmShrPtrPyrNls[usLevel_]);
+	if (CPU_BACKEND == _eBackend){
+		btl::cpu::transformLocalToWorldCVCV(_eimRw.data(),_eivTw.data(),&*_acvmShrPtrPyrPts[usLevel_],&*_acvmShrPtrPyrNls[usLevel_]);
+	}
+	else{
+		btl::device::transformLocalToWorldCVCV(_eimRw.data(),_eivTw.data(),&*_acvgmShrPtrPyrPts[usLevel_],&*_acvgmShrPtrPyrNls[usLevel_]);
+		_acvgmShrPtrPyrPts[usLevel_]->download(*_acvmShrPtrPyrPts[usLevel_]);
+		_acvgmShrPtrPyrNls[usLevel_]->download(*_acvmShrPtrPyrNls[usLevel_]);
+	}
 #if !USE_PBO
 #endif
 }//gpuTransformToWorldCVCV()
@@ -1152,6 +1378,56 @@ bool btl::kinect::CKeyFrame::isMovedwrtReferencInRadiusM(const CKeyFrame* const
 	return ( dRot > dRotAngleThreshold_ || dTrn > dTranslationThreshold_);
 }
 
+//solves the point-to-plane normal equations accumulated by registrationICP() (upper triangle of A row by row,
+//each row followed by its entry of b) and applies the increment to Rw, Tw. false if the system is degenerate.
+//pfStep_ receives the size of the increment, the larger of its angle (rad) and its translation (m)
+static bool updatePoseICP(const double* aSum_, Eigen::Matrix3f* peimRwCur_, Eigen::Vector3f* peivTwCur_, float* pfStep_ = NULL){
+	//declare A and b
+	Eigen::Matrix<double, 6, 6, Eigen::RowMajor> A;
+	Eigen::Matrix<double, 6, 1> b;
+	//retrieve A and b from the sums
+	short sShift = 0;
+	for (int i = 0; i < 6; ++i){   // rows
+		for (int j = i; j < 7; ++j) { // cols + b
+			double value = aSum_[sShift++];
+			if (j == 6)       // vector b
+				b.data()[i] = value;
+			else
+				A.data()[j * 6 + i] = A.data()[i * 6 + j] = value;
+		}//for each col
+	}//for each row
+	//checking nullspace
+	double dDet = A.determinant ();
+	if (fabs (dDet) < 1e-15 || dDet != dDet ){
+		if (dDet != dDet) std::cout << "qnan" << std::endl;
+		//reset ();
+		return false;
+	}//if dDet is rational
+	//float maxc = A.maxCoeff();
+
+	Eigen::Matrix<float, 6, 1> result = A.llt ().solve (b).cast<float>();
+	//Eigen::Matrix<float, 6, 1> result = A.jacobiSvd(ComputeThinU | ComputeThinV).solve(b);
+
+	float alpha = result (0);
+	float beta  = result (1);
+	float gamma = result (2);
+
+	Eigen::Matrix3f Rinc = (Eigen::Matrix3f)Eigen::AngleAxisf (gamma, Eigen::Vector3f::UnitZ ()) * Eigen::AngleAxisf (beta, Eigen::Vector3f::UnitY ()) * Eigen::AngleAxisf (alpha, Eigen::Vector3f::UnitX ());
+	Eigen::Vector3f tinc = result.tail<3> ();
+
+	//compose
+	//eivTwCur   = Rinc * eivTwCur + tinc;
+	//eimrmRwCur = Rinc * eimrmRwCur;
+	Eigen::Vector3f eivTinv = - peimRwCur_->transpose()* *peivTwCur_;
+	Eigen::Matrix3f eimRinv = peimRwCur_->transpose();
+	eivTinv = Rinc * eivTinv + tinc;
+	eimRinv = Rinc * eimRinv;
+	*peivTwCur_ = - eimRinv.transpose() * eivTinv;
+	*peimRwCur_ = eimRinv.transpose();
+	if (pfStep_) *pfStep_ = std::max( result.head<3>().norm(), tinc.norm() );
+	return true;
+}
+
 void btl::kinect::CKeyFrame::gpuImageICP(const CKeyFrame* pPrevFrameWorld_, const btl::image::semidense::CSemiDenseTrackerOrb* pSDTracker_){
 	// the point cloud in previous frame has been transformed into the world coordinate
 	// the current frame is still in camera coordinate
@@ -1191,49 +1467,7 @@ void btl::kinect::CKeyFrame::gpuImageICP(const CKeyFrame* pPrevFrameWorld_, cons
 
 			cv::Mat cvmSumBuf;
 			cvgmSumBuf.download (cvmSumBuf);
-			double* aHostTmp = (double*) cvmSumBuf.data;
-			//declare A and b
-			Eigen::Matrix<double, 6, 6, Eigen::RowMajor> A;
-			Eigen::Matrix<double, 6, 1> b;
-			//retrieve A and b from cvmSumBuf
-			short sShift = 0;
-			for (int i = 0; i < 6; ++i){   // rows
-				for (int j = i; j < 7; ++j) { // cols + b
-					double value = aHostTmp[sShift++];
-					if (j == 6)       // vector b
-						b.data()[i] = value;
-					else
-						A.data()[j * 6 + i] = A.data()[i * 6 + j] = value;
-				}//for each col
-			}//for each row
-			//checking nullspace
-			double dDet = A.determinant ();
-			if (fabs (dDet) < 1e-15 || dDet != dDet ){
-				if (dDet != dDet) std::cout << "qnan" << std::endl;
-				//reset ();
-				return ;
-			}//if dDet is rational
-			//float maxc = A.maxCoeff();
-
-			Eigen::Matrix<float, 6, 1> result = A.llt ().solve (b).cast<float>();
-			//Eigen::Matrix<float, 6, 1> result = A.jacobiSvd(ComputeThinU | ComputeThinV).solve(b);
-
-			float alpha = result (0);
-			float beta  = result (1);
-			float gamma = result (2);
-
-			Eigen::Matrix3f Rinc = (Eigen::Matrix3f)Eigen::AngleAxisf (gamma, Eigen::Vector3f::UnitZ ()) * Eigen::AngleAxisf (beta, Eigen::Vector3f::UnitY ()) * Eigen::AngleAxisf (alpha, Eigen::Vector3f::UnitX ());
-			Eigen::Vector3f tinc = result.tail<3> ();
-
-			//compose
-			//eivTwCur   = Rinc * eivTwCur + tinc;
-			//eimrmRwCur = Rinc * eimrmRwCur;
-			Eigen::Vector3f eivTinv = - eimrmRwCur.transpose()* eivTwCur;
-			Eigen::Matrix3f eimRinv = eimrmRwCur.transpose();
-			eivTinv = Rinc * eivTinv + tinc;
-			eimRinv = Rinc * eimRinv;
-			eivTwCur = - eimRinv.transpose() * eivTinv;
-			eimrmRwCur = eimRinv.transpose();
+			if (!updatePoseICP((const double*) cvmSumBuf.data, &eimrmRwCur, &eivTwCur)) return;
 		}//for each iteration
 	}//for each pyramid level
 	_eimRw = eimrmRwCur;
@@ -1242,7 +1476,7 @@ void btl::kinect::CKeyFrame::gpuImageICP(const CKeyFrame* pPrevFrameWorld_, cons
 	return;
 }
 
-void btl::kinect::CKeyFrame::gpuICP(const CKeyFrame* pPrevFrameWorld_,bool bUsePrevRTAsInitial_){
+int btl::kinect::CKeyFrame::gpuICP(const CKeyFrame* pPrevFrameWorld_,bool bUsePrevRTAsInitial_){
 	// the point cloud in previous frame has been transformed into the world coordinate
 	// the current frame is still in camera coordinate
 
@@ -1266,6 +1500,7 @@ void btl::kinect::CKeyFrame::gpuICP(const CKeyFrame* pPrevFrameWorld_,bool bUseP
 		eimrmRwCur = _eimRw;//.transpose();   //because by default eimrmRwPrev is colume major
 		eivTwCur = _eivTw;
 	}//other wise just use, the R & T have been updated by calcRT() using appearance-based approach 
+	int nIterations = 0;
 
 	//from low resolution to high
 	for (short sPyrLevel = _uPyrHeight-1; sPyrLevel >= 0; sPyrLevel--){
@@ -1286,58 +1521,104 @@ void btl::kinect::CKeyFrame::gpuICP(const CKeyFrame* pPrevFrameWorld_,bool bUseP
 			
 			cv::Mat cvmSumBuf;
 			cvgmSumBuf.download (cvmSumBuf);
-			double* aHostTmp = (double*) cvmSumBuf.data;
-			//declare A and b
-			Eigen::Matrix<double, 6, 6, Eigen::RowMajor> A;
-			Eigen::Matrix<double, 6, 1> b;
-			//retrieve A and b from cvmSumBuf
-			short sShift = 0;
-			for (int i = 0; i < 6; ++i){   // rows
-				for (int j = i; j < 7; ++j) { // cols + b
-					double value = aHostTmp[sShift++];
-					if (j == 6)       // vector b
-						b.data()[i] = value;
-					else
-						A.data()[j * 6 + i] = A.data()[i * 6 + j] = value;
-				}//for each col
-			}//for each row
-			//checking nullspace
-			double dDet = A.determinant ();
-			if (fabs (dDet) < 1e-15 || dDet != dDet ){
-				if (dDet != dDet) std::cout << "qnan" << std::endl;
-				//reset ();
-				return ;
-			}//if dDet is rational
-			//float maxc = A.maxCoeff();
-
-			Eigen::Matrix<float, 6, 1> result = A.llt ().solve (b).cast<float>();
-			//Eigen::Matrix<float, 6, 1> result = A.jacobiSvd(ComputeThinU | ComputeThinV).solve(b);
-
-			float alpha = result (0);
-			float beta  = result (1);
-			float gamma = result (2);
-
-			Eigen::Matrix3f Rinc = (Eigen::Matrix3f)Eigen::AngleAxisf (gamma, Eigen::Vector3f::UnitZ ()) * Eigen::AngleAxisf (beta, Eigen::Vector3f::UnitY ()) * Eigen::AngleAxisf (alpha, Eigen::Vector3f::UnitX ());
-			Eigen::Vector3f tinc = result.tail<3> ();
-
-			//compose
-			//eivTwCur   = Rinc * eivTwCur + tinc;
-			//eimrmRwCur = Rinc * eimrmRwCur;
-			Eigen::Vector3f eivTinv = - eimrmRwCur.transpose()* eivTwCur;
-			Eigen::Matrix3f eimRinv = eimrmRwCur.transpose();
-			eivTinv = Rinc * eivTinv + tinc;
-			eimRinv = Rinc * eimRinv;
-			eivTwCur = - eimRinv.transpose() * eivTinv;
-			eimrmRwCur = eimRinv.transpose();
+			nIterations++;
+			float fStep;
+			if (!updatePoseICP((const double*) cvmSumBuf.data, &eimrmRwCur, &eivTwCur, &fStep)) return nIterations;
+			if (fStep < __fICPConverged) break;
 		}//for each iteration
 	}//for each pyramid level
 	_eimRw = eimrmRwCur;
 	_eivTw = eivTwCur;
 
-	return;
+	return nIterations;
 }
 
+int btl::kinect::CKeyFrame::cpuICP(const CKeyFrame* pPrevFrameWorld_,bool bUsePrevRTAsInitial_){
+	//host version of gpuICP(), works on the host pyramids:
+	//the previous frame in world and the current one in camera coordinate
+	const short asICPIterations[] = {10, 5, 0, 4};
+	const float fDistThreshold = 0.10f; //meters
+	const float fSinAngleThres_ = sin (20.f * 3.14159254f / 180.f);
+	//get R,T of current frame
+	Eigen::Matrix3f eimRwCur = bUsePrevRTAsInitial_? pPrevFrameWorld_->_eimRw : _eimRw;
+	Eigen::Vector3f eivTwCur = bUsePrevRTAsInitial_? pPrevFrameWorld_->_eivTw : _eivTw;
+	double adSum[27];
+	int nIterations = 0;
+	//from low resolution to high
+	for (short sPyrLevel = _uPyrHeight-1; sPyrLevel >= 0; sPyrLevel--){
+		//the current vertices are read once per iteration, split them once per level
+		if (_bSoA && asICPIterations[sPyrLevel] > 0) splitSoA(sPyrLevel);
+		for ( short sIter = 0; sIter < asICPIterations[sPyrLevel]; ++sIter ){
+			//projective association and reduction
+			if (_bSoA)
+				btl::cpu::registrationICP( _pRGBCamera->_fFx,_pRGBCamera->_fFy,_pRGBCamera->_u,_pRGBCamera->_v, sPyrLevel,
+					fDistThreshold,fSinAngleThres_,
+					eimRwCur.data(), eivTwCur.data(), pPrevFrameWorld_->_eimRw.data(), pPrevFrameWorld_->_eivTw.data(),
+					*pPrevFrameWorld_->_acvmShrPtrPyrPts[sPyrLevel],*pPrevFrameWorld_->_acvmShrPtrPyrNls[sPyrLevel],
+					_acvmPyrPtPlanes[sPyrLevel],_acvmPyrNlPlanes[sPyrLevel], adSum );
+			else
+				btl::cpu::registrationICP( _pRGBCamera->_fFx,_pRGBCamera->_fFy,_pRGBCamera->_u,_pRGBCamera->_v, sPyrLevel,
+					fDistThreshold,fSinAngleThres_,
+					eimRwCur.data(), eivTwCur.data(), pPrevFrameWorld_->_eimRw.data(), pPrevFrameWorld_->_eivTw.data(),
+					*pPrevFrameWorld_->_acvmShrPtrPyrPts[sPyrLevel],*pPrevFrameWorld_->_acvmShrPtrPyrNls[sPyrLevel],
+					*_acvmShrPtrPyrPts[sPyrLevel],*_acvmShrPtrPyrNls[sPyrLevel], adSum );
+			nIterations++;
+			float fStep;
+			if (!updatePoseICP(adSum, &eimRwCur, &eivTwCur, &fStep)) return nIterations;
+			if (fStep < __fICPConverged) break;
+		}//for each iteration
+	}//for each pyramid level
+	_eimRw = eimRwCur;
+	_eivTw = eivTwCur;
+	return nIterations;
+}
+
+int btl::kinect::CKeyFrame::cpuDenseRGBD(const CKeyFrame* pPrevFrameWorld_,bool bUsePrevRTAsInitial_, float fGeometricWeight_ /*= 0.f*/){
+	const short asIterations[] = {5, 8, 10, 10};
+	const float fDistThreshold = 0.10f; //meters
+	const float fSinAngleThres_ = sin (20.f * 3.14159254f / 180.f);
+	const float fHuber = 0.05f; //intensity/255
+	//get R,T of current frame
+	Eigen::Matrix3f eimRwCur = bUsePrevRTAsInitial_? pPrevFrameWorld_->_eimRw : _eimRw;
+	Eigen::Vector3f eivTwCur = bUsePrevRTAsInitial_? pPrevFrameWorld_->_eivTw : _eivTw;
+	double adSum[27], adSumICP[27];
+	cv::Mat cvmGx, cvmGy;
+	int nIterations = 0;
+	//from low resolution to high
+	for (short sPyrLevel = _uPyrHeight-1; sPyrLevel >= 0; sPyrLevel--){
+		//the previous image does not move, its gradients are shared by all iterations
+		btl::cpu::imageGradient(*pPrevFrameWorld_->_acvmShrPtrPyrBWs[sPyrLevel],&cvmGx,&cvmGy);
+		for ( short sIter = 0; sIter < asIterations[sPyrLevel]; ++sIter ){
+			btl::cpu::registrationPhotometric( _pRGBCamera->_fFx,_pRGBCamera->_fFy,_pRGBCamera->_u,_pRGBCamera->_v, sPyrLevel,
+				fDistThreshold,fHuber,
+				eimRwCur.data(), eivTwCur.data(), pPrevFrameWorld_->_eimRw.data(), pPrevFrameWorld_->_eivTw.data(),
+				*pPrevFrameWorld_->_acvmShrPtrPyrPts[sPyrLevel],*pPrevFrameWorld_->_acvmShrPtrPyrBWs[sPyrLevel],cvmGx,cvmGy,
+				*_acvmShrPtrPyrPts[sPyrLevel],*_acvmShrPtrPyrBWs[sPyrLevel], adSum );
+			if (fGeometricWeight_ > 0.f){
+				btl::cpu::registrationICP( _pRGBCamera->_fFx,_pRGBCamera->_fFy,_pRGBCamera->_u,_pRGBCamera->_v, sPyrLevel,
+					fDistThreshold,fSinAngleThres_,
+					eimRwCur.data(), eivTwCur.data(), pPrevFrameWorld_->_eimRw.data(), pPrevFrameWorld_->_eivTw.data(),
+					*pPrevFrameWorld_->_acvmShrPtrPyrPts[sPyrLevel],*pPrevFrameWorld_->_acvmShrPtrPyrNls[sPyrLevel],
+					*_acvmShrPtrPyrPts[sPyrLevel],*_acvmShrPtrPyrNls[sPyrLevel], adSumICP );
+				const double dW2 = double(fGeometricWeight_)*fGeometricWeight_;
+				for (int i = 0; i < 27; i++) adSum[i] += dW2*adSumICP[i];
+			}
+			nIterations++;
+			float fStep;
+			if (!updatePoseICP(adSum, &eimRwCur, &eivTwCur, &fStep)) return nIterations;
+			if (fStep < __fICPConverged) break;
+		}//for each iteration
+	}//for each pyramid level
+	_eimRw = eimRwCur;
+	_eivTw = eivTwCur;
+	return nIterations;
+}
+
 void btl::kinect::CKeyFrame::constructPyramid(const float fSigmaSpace_, const float fSigmaDisparity_){
+	if (CPU_BACKEND == _eBackend){
+		cpuConstructPyramid(fSigmaSpace_,fSigmaDisparity_);
+		return;
+	}
 	//bilateral filtering in disparity 
 	_acvgmShrPtrPyrDisparity[0]->setTo(std::numeric_limits<float>::quiet_NaN());
 	btl::device::cudaDepth2Disparity(*_acvgmShrPtrPyrDepths[0], &*_acvgmShrPtrPyr32FC1Tmp[0]);
@@ -1383,6 +1664,52 @@ void btl::kinect::CKeyFrame::constructPyramid(const float fSigmaSpace_, const fl
 	return;
 }
 
+void btl::kinect::CKeyFrame::cpuConstructPyramid(const float fSigmaSpace_, const float fSigmaDisparity_){
+	//same steps as the device path in constructPyramid(), all in host memory
+	//bilateral filtering in disparity 
+	btl::cpu::depth2Disparity(*_acvmPyrDepths[0], &*_acvmShrPtrPyr32FC1Tmp[0]);
+	btl::cpu::bilateralFiltering(*_acvmShrPtrPyr32FC1Tmp[0],fSigmaSpace_,fSigmaDisparity_,&*_acvmShrPtrPyrDisparity[0]);
+	btl::cpu::disparity2Depth(*_acvmShrPtrPyrDisparity[0],&*_acvmPyrDepths[0]);
+	//down-sampling
+	for( unsigned int i=1; i<_uPyrHeight; i++ )	{
+		btl::cpu::pyrDown( *_acvmShrPtrPyrDisparity[i-1],fSigmaDisparity_,&*_acvmShrPtrPyr32FC1Tmp[i]);
+		btl::cpu::bilateralFiltering(*_acvmShrPtrPyr32FC1Tmp[i],fSigmaSpace_,fSigmaDisparity_,&*_acvmShrPtrPyrDisparity[i]);
+		btl::cpu::disparity2Depth(*_acvmShrPtrPyrDisparity[i],&*_acvmPyrDepths[i]);
+	}
+	//get pts and normals and transform from local to world
+	for( unsigned int i=0; i<_uPyrHeight; i++ )	{
+		btl::cpu::unprojectRGBCVm(*_acvmPyrDepths[i],_pRGBCamera->_fFx,_pRGBCamera->_fFy,_pRGBCamera->_u,_pRGBCamera->_v, i,&*_acvmShrPtrPyrPts[i] );
+		btl::cpu::fastNormalEstimation(*_acvmShrPtrPyrPts[i],&*_acvmShrPtrPyrNls[i]);
+		btl::cpu::transformLocalToWorldCVCV(_eimRw.data(),_eivTw.data(),&*_acvmShrPtrPyrPts[i],&*_acvmShrPtrPyrNls[i]);
+	}
+	return;
+}
+
+void btl::kinect::CKeyFrame::allocateSoA(const ushort usLevel_){
+	const int nRows = _pRGBCamera->_sHeight>>usLevel_;
+	const int nCols = _pRGBCamera->_sWidth>>usLevel_;
+	//6 planes, rows padded to 8 floats so that each row starts on a 32-byte boundary
+	const int nStep = (nCols + 7) & ~7;
+	const size_t sPlane = size_t(nRows)*nStep*sizeof(float);
+	_acvmSoABuffers[usLevel_].create(1, int(6*sPlane + 32), CV_8UC1);
+	uchar* pPlane = cv::alignPtr(_acvmSoABuffers[usLevel_].data, 32);
+	for (int j = 0; j < 3; j++, pPlane += sPlane) _acvmPyrPtPlanes[usLevel_][j] = cv::Mat(nRows,nCols,CV_32FC1,pPlane,nStep*sizeof(float));
+	for (int j = 0; j < 3; j++, pPlane += sPlane) _acvmPyrNlPlanes[usLevel_][j] = cv::Mat(nRows,nCols,CV_32FC1,pPlane,nStep*sizeof(float));
+}
+void btl::kinect::CKeyFrame::splitSoA(const ushort usLevel_){
+	if (_acvmSoABuffers[usLevel_].empty()) allocateSoA(usLevel_);
+	btl::cpu::splitC3(*_acvmShrPtrPyrPts[usLevel_],_acvmPyrPtPlanes[usLevel_]);
+	btl::cpu::splitC3(*_acvmShrPtrPyrNls[usLevel_],_acvmPyrNlPlanes[usLevel_]);
+}
+void btl::kinect::CKeyFrame::splitSoA(){
+	for (ushort usI=0;usI<_uPyrHeight;usI++) splitSoA(usI);
+}
+void btl::kinect::CKeyFrame::mergeSoA(const ushort usLevel_){
+	BTL_ASSERT(!_acvmSoABuffers[usLevel_].empty(), "CKeyFrame::mergeSoA() the planes are not allocated, call splitSoA() first");
+	btl::cpu::mergeC3(_acvmPyrPtPlanes[usLevel_],&*_acvmShrPtrPyrPts[usLevel_]);
+	btl::cpu::mergeC3(_acvmPyrNlPlanes[usLevel_],&*_acvmShrPtrPyrNls[usLevel_]);
+}
+
 void btl::kinect::CKeyFrame::applyClassifier(btl::gl_util::CGLUtil::tp_ptr pGL_, float fThreshold_, const unsigned short usLevel_)
 {
 	//////////////////////////////////
@@ -25,20 +25,33 @@ public:
 	typedef boost::scoped_ptr< CKeyFrame > tp_scoped_ptr;
 	typedef CKeyFrame* tp_ptr;
 	enum tp_cluster { NORMAL_CLUSTER, DISTANCE_CLUSTER};
+	enum tp_backend { GPU_BACKEND, CPU_BACKEND }; //where constructPyramid() runs
+	enum tp_cloud_format { PLY_CLOUD, PCD_CLOUD }; //binary formats of exportPointCloud()
 
 public:
-    CKeyFrame( btl::image::SCamera::tp_ptr pRGBCamera_, ushort uResolution_, ushort uPyrLevel_, const Eigen::Vector3f& eivCw_ );
+    CKeyFrame( btl::image::SCamera::tp_ptr pRGBCamera_, ushort uResolution_, ushort uPyrLevel_, const Eigen::Vector3f& eivCw_, uchar* pHostArena_ = NULL );
 	CKeyFrame(CKeyFrame::tp_ptr pFrame_);
     ~CKeyFrame() {}
+	//bytes of host memory the pyramid containers occupy when carved out of an arena, see CKeyFramePool
+	static size_t hostArenaBytes(const btl::image::SCamera* pRGBCamera_, ushort uPyrHeight_);
 	// detect the correspondences 
 	void extractSurfFeatures ();
 	//calculate the R and T relative to Reference Frame.
 	double calcRT ( const CKeyFrame& sReferenceKF_, const unsigned short sLevel_ , const double dDistanceThreshold_, unsigned short* pInliers_);
 	void extractOrbFeatures ();
-	double calcRTOrb ( const CKeyFrame& sPrevKF_, const double dDistanceThreshold_, unsigned short* pInliers_);
+	//fSearchRadius_ > 0 matches guided by the current R,T, which must then be a prediction of the pose: the reference
+	//features are projected into the current image and only compared with the keypoints within fSearchRadius_ pixels.
+	//0 matches all descriptors by brute force
+	double calcRTOrb ( const CKeyFrame& sPrevKF_, const double dDistanceThreshold_, unsigned short* pInliers_, const float fSearchRadius_ = 0.f);
 	void calcRTSemiDense( const CKeyFrame& sPrevKF_ );
 
-	void gpuICP(const CKeyFrame* pRefFrameWorld_,bool bUseReferenceRTAsInitial);
+	//the ICP solvers return the number of iterations run, a level is left early once the pose increment is negligible
+	int gpuICP(const CKeyFrame* pRefFrameWorld_,bool bUseReferenceRTAsInitial);
+	//same as gpuICP() on the host pyramids, the current pts/nls in camera and the reference ones in world coordinate
+	int cpuICP(const CKeyFrame* pRefFrameWorld_,bool bUseReferenceRTAsInitial);
+	//direct RGB-D odometry on the host pyramids: coarse-to-fine gauss-newton on the photometric error of the bw images,
+	//plus the point-to-plane error of cpuICP() weighted by fGeometricWeight_ when it is positive. needs the host bw pyramids
+	int cpuDenseRGBD(const CKeyFrame* pRefFrameWorld_,bool bUseReferenceRTAsInitial, float fGeometricWeight_ = 0.f);
 	double gpuCalcRTBroxOpticalFlow ( const CKeyFrame& sPrevFrameWorld_, const double dDistanceThreshold_, unsigned short* pInliers_);
 	void gpuImageICP(const CKeyFrame* pPrevFrameWorld_, const btl::image::semidense::CSemiDenseTrackerOrb* pSDTracker_);
 
@@ -85,6 +98,8 @@ public:
 	void gpuTransformToWorldCVCV();
 	void updateMVInv();
 	void constructPyramid(const float fSigmaSpace_, const float fSigmaDisparity_);
+	//host version of constructPyramid(), takes _acvmPyrDepths[0] and fills the host depth, pts and nls pyramid
+	void cpuConstructPyramid(const float fSigmaSpace_, const float fSigmaDisparity_);
 	void setRTFromC(float fXA_, float fYA_, float fZA_, float fCwX_,float fCwY_,float fCwZ_);
 	void setRTFromC(const Eigen::Matrix3f& eimRotation_, const Eigen::Vector3f& eivCw_);
 	void setRTw(const Eigen::Matrix3f& eimRotation_, const Eigen::Vector3f& eivTw_);
@@ -94,9 +109,27 @@ public:
 	void gpuBoundaryDetector(float fThreshold_, const unsigned short usPyrLevel_);
 	void exportYML(const std::string& strPath_, const std::string& strYMLName_);
 	void importYML(const std::string& strPath_, const std::string& strYMLName_);
+	//versioned binary snapshot of the host pyramid: a fixed header followed by 64-byte aligned raw planes
+	void exportBinary(const std::string& strPath_, const std::string& strFileName_) const;
+	//memory-maps the snapshot copy-on-write; the host pyramid becomes headers into the mapping, nothing is copied
+	//the snapshot must match the camera, resolution and pyramid height of the frame. GPU_BACKEND uploads the device pyramid
+	void importBinary(const std::string& strPath_, const std::string& strFileName_);
 	void exportPCL(const std::string& strPath_, const std::string& strYMLName_);
+	//streams the host pts, nls and rgbs of level sLevel_ (all levels if negative) into one binary PLY or PCD file,
+	//skipping points with NaN position or normal. the host pyramid must be up to date. returns the number of points written.
+	unsigned int exportPointCloud(const std::string& strPath_, const std::string& strFileName_, tp_cloud_format eFormat_ = PLY_CLOUD, short sLevel_ = -1) const;
 
 	ushort pyrHeight() {return _uPyrHeight;}
+	//structure-of-arrays view of the pts and nls, allocated by the first splitSoA() and valid until the pts/nls change.
+	//every row of a plane is 32-byte aligned, soaStep() gives the row step in floats
+	void splitSoA(const ushort usLevel_); //interleaved -> planes
+	void splitSoA();
+	void mergeSoA(const ushort usLevel_); //planes -> interleaved, after a kernel has written the planes
+	const float* ptPlane(const ushort usLevel_, const int nAxis_, const int nRow_ = 0) const { return _acvmPyrPtPlanes[usLevel_][nAxis_].ptr<float>(nRow_); }
+	const float* nlPlane(const ushort usLevel_, const int nAxis_, const int nRow_ = 0) const { return _acvmPyrNlPlanes[usLevel_][nAxis_].ptr<float>(nRow_); }
+	float* ptPlane(const ushort usLevel_, const int nAxis_, const int nRow_ = 0) { return _acvmPyrPtPlanes[usLevel_][nAxis_].ptr<float>(nRow_); }
+	float* nlPlane(const ushort usLevel_, const int nAxis_, const int nRow_ = 0) { return _acvmPyrNlPlanes[usLevel_][nAxis_].ptr<float>(nRow_); }
+	int soaStep(const ushort usLevel_) const { return int(_acvmPyrPtPlanes[usLevel_][0].step/sizeof(float)); }
 	void initRT();
 	void setRTTo(const CKeyFrame& cFrame_ );
 	void assignRTfromGL();
@@ -112,7 +145,8 @@ private:
 	//for normal cluster
 	void clusterNormal(const unsigned short& uPyrLevel_,cv::Mat* pcvmLabel_,std::vector< std::vector< unsigned int > >* pvvLabelPointIdx_);
 	void gpuClusterNormal(const unsigned short uPyrLevel_,cv::Mat* pcvmLabel_,btl::geometry::tp_plane_obj_list* pvPlaneObjs_);
-	void allocate();
+	void allocate(uchar* pHostArena_ = NULL);
+	void allocateSoA(const ushort usLevel_);
 	void establishPlaneCorrespondences( const CKeyFrame& sReferenceKF_);
 	void gpuConvert2ColorGraph( cv::gpu::GpuMat* pcvgmU_, cv::gpu::GpuMat* pcvgmV_, cv::gpu::GpuMat* pcvgmColorGraph_ );
 
@@ -134,6 +168,15 @@ public:
 	static boost::shared_ptr<cv::gpu::GpuMat> _acvgmShrPtrPyrDisparity[4];
 	static boost::shared_ptr<cv::gpu::GpuMat> _acvgmShrPtrPyr32FC1Tmp[4];
 	static boost::shared_ptr<cv::gpu::GpuMat> _pcvgmPrev,_pcvgmCurr,_pcvgmU,_pcvgmV;
+	static boost::shared_ptr<cv::Mat> _acvmShrPtrPyrDisparity[4];
+	static boost::shared_ptr<cv::Mat> _acvmShrPtrPyr32FC1Tmp[4];
+	//CPU_BACKEND leaves the device pyramid unallocated so that no CUDA device is needed
+	static tp_backend _eBackend;
+	//cpuICP() reads the current pts and nls through the SoA planes, can be toggled at any time
+	static bool _bSoA;
+	//X,Y,Z and Nx,Ny,Nz planes (CV_32FC1) pointing into _acvmSoABuffers
+	cv::Mat _acvmPyrPtPlanes[4][3];
+	cv::Mat _acvmPyrNlPlanes[4][3];
 
 
 
@@ -181,11 +224,15 @@ private:
 	//device
 	cv::gpu::GpuMat _cvgmKeyPoints;
 	cv::gpu::GpuMat _cvgmDescriptors;
+	cv::Mat _cvmDescriptors; //host copy of the ORB descriptors
 	//plane correspondences
 	std::vector<SPlaneCorrespondence> _vPlaneCorrespondences;
 
 	ushort _uPyrHeight;
 	ushort _uResolution;
+	//owns the aligned memory of the 6 planes of each level
+	cv::Mat _acvmSoABuffers[4];
+	friend class CKeyFramePool;
 	
 };//end of class
 
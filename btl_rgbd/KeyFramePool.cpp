@@ -0,0 +1,110 @@
+//gl, only the types GLUtil.h needs for KeyFrame.h
+#include <gl/glew.h>
+#include <cuda_gl_interop.h>
+//boost
+#include <boost/random.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
+//stl
+#include <vector>
+#include <list>
+#include <algorithm>
+//opencv
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/gpu/gpu.hpp>
+//eigen
+#include <Eigen/Core>
+//self
+#include "OtherUtil.hpp"
+#include "Converters.hpp"
+#include "EigenUtil.hpp"
+#include "Camera.h"
+#include "Kinect.h"
+#include "GLUtil.h"
+#include "PlaneObj.h"
+#include "Histogram.h"
+#include "SemiDenseTracker.h"
+#include "SemiDenseTrackerOrb.h"
+#include "KeyFrame.h"
+#include "KeyFramePool.h"
+
+btl::kinect::CKeyFramePool::tp_shared_ptr btl::kinect::CKeyFramePool::create( const CKeyFrame& cFrame_, ushort uCapacity_ /*= 2*/ ){
+	return tp_shared_ptr( new CKeyFramePool(cFrame_,uCapacity_) );
+}
+
+btl::kinect::CKeyFramePool::CKeyFramePool( const CKeyFrame& cFrame_, ushort uCapacity_ )
+:_pRGBCamera(cFrame_._pRGBCamera),_uResolution(cFrame_._uResolution),_uPyrHeight(cFrame_._uPyrHeight),_eivInitCw(cFrame_._eivInitCw){
+	_sFrameBytes = CKeyFrame::hostArenaBytes(_pRGBCamera,_uPyrHeight);
+	grow(uCapacity_);
+}
+
+btl::kinect::CKeyFramePool::~CKeyFramePool(){
+	//all handed out frames are back, otherwise their deleters would still keep the pool alive
+	for (std::vector< CKeyFrame::tp_ptr >::iterator it = _vFrames.begin(); it != _vFrames.end(); ++it) delete *it;
+}
+
+void btl::kinect::CKeyFramePool::grow( ushort uFrames_ ){
+	if( 0 == uFrames_ ) return;
+	//one contiguous block for uFrames_ frames, each frame starts on a 32-byte boundary as _sFrameBytes is a multiple of 32
+	_vArenas.push_back( cv::Mat(1, int(_sFrameBytes*uFrames_ + 32), CV_8UC1) );
+	uchar* pArena = cv::alignPtr(_vArenas.back().data, 32);
+	for (ushort i=0; i<uFrames_; i++, pArena += _sFrameBytes){
+		CKeyFrame::tp_ptr pFrame = new CKeyFrame(_pRGBCamera,_uResolution,_uPyrHeight,_eivInitCw,pArena);
+		_vFrames.push_back(pFrame);
+		_vFree.push_back(pFrame);
+	}
+}
+
+btl::kinect::CKeyFrame::tp_shared_ptr btl::kinect::CKeyFramePool::acquire(){
+	CKeyFrame::tp_ptr pFrame;
+	{
+		boost::mutex::scoped_lock lock(_mtxFree);
+		//double the pool when running dry
+		if( _vFree.empty() ) grow( ushort( std::max<size_t>( _vFrames.size(), 1 ) ) );
+		pFrame = _vFree.back();
+		_vFree.pop_back();
+	}
+	return CKeyFrame::tp_shared_ptr( pFrame, SRelease(shared_from_this()) );
+}
+
+btl::kinect::CKeyFrame::tp_shared_ptr btl::kinect::CKeyFramePool::acquire( CKeyFrame::tp_ptr pFrame_ ){
+	BTL_ASSERT( fits(*pFrame_), "CKeyFramePool::acquire() the frame does not match the shape of the pool" );
+	CKeyFrame::tp_shared_ptr pFrame = acquire();
+	pFrame_->copyTo(pFrame.get());
+	return pFrame;
+}
+
+bool btl::kinect::CKeyFramePool::fits( const CKeyFrame& cFrame_ ) const{
+	return cFrame_._uPyrHeight == _uPyrHeight && cFrame_._uResolution == _uResolution && 
+		cFrame_._pRGBCamera->_sWidth == _pRGBCamera->_sWidth && cFrame_._pRGBCamera->_sHeight == _pRGBCamera->_sHeight;
+}
+
+size_t btl::kinect::CKeyFramePool::available() const{
+	boost::mutex::scoped_lock lock(_mtxFree);
+	return _vFree.size();
+}
+
+void btl::kinect::CKeyFramePool::release( CKeyFrame::tp_ptr pFrame_ ){
+	clear(pFrame_);
+	boost::mutex::scoped_lock lock(_mtxFree);
+	_vFree.push_back(pFrame_);
+}
+
+void btl::kinect::CKeyFramePool::clear( CKeyFrame::tp_ptr pFrame_ ){
+	//drop what a previous user left behind, the pyramid memory stays where it is
+	pFrame_->_vKeyPoints.clear();
+	pFrame_->_vMatches.clear();
+	pFrame_->_cvgmKeyPoints.release();
+	pFrame_->_cvgmDescriptors.release();
+	pFrame_->_vPlaneCorrespondences.clear();
+	pFrame_->_vPlaneObjsNormal.clear();
+	for (int i=0; i<4; i++) pFrame_->_vPlaneObjsDistanceNormal[i].clear();
+	pFrame_->_eConvention = btl::utility::BTL_CV;
+	pFrame_->_bIsReferenceFrame = false;
+	pFrame_->_bRenderPlane = false;
+	pFrame_->_eClusterType = CKeyFrame::NORMAL_CLUSTER;
+	pFrame_->_nColorIdx = 0;
+	pFrame_->initRT();
+}
@@ -0,0 +1,55 @@
+#ifndef BTL_KEYFRAME_POOL
+#define BTL_KEYFRAME_POOL
+
+namespace btl{ namespace kinect
+{
+//recycles CKeyFrames of one camera/pyramid shape. the host pyramids of the frames are carved out of
+//a few large 32-byte aligned arenas instead of 7 x pyramid height separate allocations per frame.
+//a frame handed out by acquire() goes back to the free list when its last shared_ptr dies, the pool 
+//itself lives until then.
+class CKeyFramePool : public boost::enable_shared_from_this< CKeyFramePool >
+{
+public:
+	typedef boost::shared_ptr< CKeyFramePool > tp_shared_ptr;
+
+	//frames shaped like cFrame_ (camera, resolution, pyramid height and initial camera centre)
+	static tp_shared_ptr create( const CKeyFrame& cFrame_, ushort uCapacity_ = 2 );
+	~CKeyFramePool();
+	//a frame with initial pose, content of the pyramid undefined
+	CKeyFrame::tp_shared_ptr acquire();
+	//a copy of pFrame_
+	CKeyFrame::tp_shared_ptr acquire( CKeyFrame::tp_ptr pFrame_ );
+	//whether frames of the pool can hold a copy of cFrame_
+	bool fits( const CKeyFrame& cFrame_ ) const;
+	size_t available() const;
+	size_t capacity() const { return _vFrames.size(); }
+
+private:
+	CKeyFramePool( const CKeyFrame& cFrame_, ushort uCapacity_ );
+	void grow( ushort uFrames_ );
+	void release( CKeyFrame::tp_ptr pFrame_ );
+	static void clear( CKeyFrame::tp_ptr pFrame_ );
+
+	//deleter of the handed out shared_ptr, keeps the pool alive
+	struct SRelease{
+		SRelease(const tp_shared_ptr& pPool_):_pPool(pPool_){}
+		void operator()(CKeyFrame::tp_ptr pFrame_) const { _pPool->release(pFrame_); }
+		tp_shared_ptr _pPool;
+	};
+
+	btl::image::SCamera::tp_ptr _pRGBCamera;
+	ushort _uResolution;
+	ushort _uPyrHeight;
+	Eigen::Vector3f _eivInitCw;
+	size_t _sFrameBytes; //CKeyFrame::hostArenaBytes()
+
+	std::vector< cv::Mat > _vArenas; //one per grow()
+	std::vector< CKeyFrame::tp_ptr > _vFrames; //owned by the pool
+	std::vector< CKeyFrame::tp_ptr > _vFree;
+	mutable boost::mutex _mtxFree;
+};//CKeyFramePool
+
+}//kinect
+}//btl
+
+#endif
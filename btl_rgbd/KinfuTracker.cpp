@@ -15,6 +15,8 @@
 #include <boost/random.hpp>
 #include <boost/generator_iterator.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 //openncv
 #include <opencv2/gpu/gpumat.hpp>
@@ -33,11 +35,21 @@
 #include "SemiDenseTracker.h"
 #include "SemiDenseTrackerOrb.h"
 #include "KeyFrame.h"
+#include "KeyFramePool.h"
 #include "CyclicBuffer.h"
 #include "VideoSourceKinect.hpp"
 #include "CubicGrids.h"
+#include "PoseGraph.h"
+#include "MotionModel.h"
 #include "KinfuTracker.h"
 
+#define __fKeyFrameAngle (M_PI_4/4.5) //10 degrees
+#define __fKeyFrameDistM 0.1f
+#define __uMaxKeyFrames 15 //stored for loop closures, with the reference frame they fill a pool of 16
+#define __nLoopNodeGap 10 //key frames between a loop closure candidate and the latest one
+#define __fLoopDistM 0.3f
+#define __fLoopAngle (M_PI/6.) //30 degrees
+
 
 namespace btl{ namespace geometry
 {
@@ -46,6 +58,203 @@ namespace btl{ namespace geometry
 	{
 		_nMethod = CKinFuTracker::ICP;
 		_bTrackOnly = false;
+		_bCpuICP = false;
+		_fRGBDGeometricWeight = 0.f;
+		_fOrbSearchRadius = 0.f;
+		_nLastNode = -1;
+		_uPoseGraphVersion = 0;
+		_uFrame = 0;
+		_nIterations = 0;
+	}
+
+	void CKinFuTracker::setMotionModel(bool bMotionModel_){
+		if (!bMotionModel_) _pMotionModel.reset();
+		else if (!_pMotionModel) _pMotionModel.reset(new CMotionModel);
+	}
+
+	bool CKinFuTracker::predictPose( btl::kinect::CKeyFrame::tp_ptr pFrame_, unsigned int uFrame_ ) const{
+		if (!_pMotionModel) return false;
+		Eigen::Matrix3f eimR; Eigen::Vector3f eivT;
+		if (!_pMotionModel->predict(_veimPoses,_vuPoseFrames,uFrame_,&eimR,&eivT)) return false;
+		pFrame_->setRTw(eimR,eivT);
+		return true;
+	}
+
+	void CKinFuTracker::initialisePose( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ ){
+		pCurFrame_->setRTTo(*_pPrevFrameWorld);
+		predictPose(pCurFrame_,_uFrame);
+	}
+
+	void CKinFuTracker::storePose( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ ){
+		pCurFrame_->setView(&_eimCurPose);
+		_veimPoses.push_back(_eimCurPose);
+		_vuPoseFrames.push_back(_uFrame);
+	}
+
+	bool CKinFuTracker::isMoved( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ ) const{
+		Eigen::Matrix3f eimRPrev; Eigen::Vector3f eivTPrev;
+		btl::utility::setRTCVfromModelViewGL(_veimPoses.back(),&eimRPrev,&eivTPrev);
+		Eigen::AngleAxisf eAA(pCurFrame_->_eimRw*eimRPrev.transpose());
+		const Eigen::Vector3f eivC = pCurFrame_->_eimRw.transpose()*pCurFrame_->_eivTw - eimRPrev.transpose()*eivTPrev;
+		return ( fabs(eAA.angle()) > M_PI_4/45. || eivC.norm() > 0.02f );
+	}
+	int CKinFuTracker::refineICP( btl::kinect::CKeyFrame::tp_ptr pCurFrame_, bool bUseReferenceRTAsInitial_ ){
+		if (_bCpuICP || btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend)
+			return pCurFrame_->cpuICP ( _pPrevFrameWorld.get(), bUseReferenceRTAsInitial_ );
+		return pCurFrame_->gpuICP ( _pPrevFrameWorld.get(), bUseReferenceRTAsInitial_ );
+	}
+
+	void CKinFuTracker::setPoseGraph(bool bPoseGraph_){
+		if (!bPoseGraph_) {
+			_pPoseGraph.reset(); //joins the solver
+			_vnKeyFrameNodes.clear(); _vpKeyFrames.clear();
+			return;
+		}
+		if (_pPoseGraph) return;
+		_pPoseGraph.reset(new CPoseGraph);
+		_pPoseGraph->start();
+		_nLastNode = -1;
+	}
+
+	void CKinFuTracker::updatePoseGraph( btl::kinect::CKeyFrame::tp_ptr pCurFrame_, bool bWorld_ ){
+		if (_nLastNode >= 0){
+			//relative pose to the last key frame, Xcur = R*Xlast + T
+			const Eigen::Matrix3f eimR = pCurFrame_->_eimRw*_eimLastNodeR.transpose();
+			const Eigen::Vector3f eivT = pCurFrame_->_eivTw - eimR*_eivLastNodeT;
+			Eigen::AngleAxisf eAA(eimR);
+			const Eigen::Vector3f eivC = -eimR.transpose()*eivT;
+			if( fabs(eAA.angle()) < __fKeyFrameAngle && eivC.norm() < __fKeyFrameDistM ) return;
+			const int nNode = _pPoseGraph->addNode(pCurFrame_->_eimRw,pCurFrame_->_eivTw);
+			_pPoseGraph->addEdge(_nLastNode,nNode,eimR,eivT);
+			_nLastNode = nNode;
+		}
+		else{
+			_pPoseGraph->clear();
+			_nLastNode = _pPoseGraph->addNode(pCurFrame_->_eimRw,pCurFrame_->_eivTw);
+			_uPoseGraphVersion = _pPoseGraph->version();
+			_vuNodePoses.clear();
+			_vnKeyFrameNodes.clear(); _vpKeyFrames.clear();
+		}
+		_vuNodePoses.push_back( (unsigned int)(_veimPoses.size()-1) );
+		_eimLastNodeR = pCurFrame_->_eimRw;
+		_eivLastNodeT = pCurFrame_->_eivTw;
+		if (bWorld_) detectLoopClosure(pCurFrame_); //the registration needs the key frame in world as reference
+		storeKeyFrame(pCurFrame_,bWorld_);
+	}
+
+	void CKinFuTracker::storeKeyFrame( btl::kinect::CKeyFrame::tp_ptr pCurFrame_, bool bWorld_ ){
+		if (_vpKeyFrames.size() >= __uMaxKeyFrames){
+			//drop every second one, the remaining ones still cover the whole trajectory
+			size_t j = 0;
+			for (size_t i=0; i<_vpKeyFrames.size(); i+=2, j++){
+				_vnKeyFrameNodes[j] = _vnKeyFrameNodes[i];
+				_vpKeyFrames[j] = _vpKeyFrames[i];
+			}
+			_vnKeyFrameNodes.resize(j); _vpKeyFrames.resize(j);
+		}
+		btl::kinect::CKeyFrame::tp_shared_ptr pKeyFrame = _pFramePool->acquire(pCurFrame_);
+		if (bWorld_){
+			//back to camera coordinates: Xc = R*Xw + T is the world transform of the inverse pose (R',-R'T)
+			const Eigen::Matrix3f eimR = pCurFrame_->_eimRw;
+			const Eigen::Vector3f eivT = pCurFrame_->_eivTw;
+			pKeyFrame->setRTw(eimR.transpose(),-eimR.transpose()*eivT);
+			pKeyFrame->gpuTransformToWorldCVCV();
+			pKeyFrame->setRTw(eimR,eivT);
+		}
+		_vnKeyFrameNodes.push_back(_nLastNode);
+		_vpKeyFrames.push_back(pKeyFrame);
+	}
+
+	void CKinFuTracker::detectLoopClosure( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ ){
+		//the closest stored key frame well behind the latest one looking about the same way
+		const Eigen::Vector3f eivC = -pCurFrame_->_eimRw.transpose()*pCurFrame_->_eivTw;
+		const Eigen::Vector3f eivV = pCurFrame_->_eimRw.row(2).transpose(); //viewing direction in world
+		int nBest = -1;
+		float fBest = __fLoopDistM;
+		Eigen::Matrix3f eimRBest; Eigen::Vector3f eivTBest;
+		for (size_t i=0; i<_vnKeyFrameNodes.size() && _vnKeyFrameNodes[i] <= _nLastNode - __nLoopNodeGap; i++){
+			Eigen::Matrix3f eimR; Eigen::Vector3f eivT;
+			_pPoseGraph->getPose(_vnKeyFrameNodes[i],&eimR,&eivT);
+			const float fDist = (eimR.transpose()*eivT + eivC).norm();
+			if( fDist >= fBest || eimR.row(2).dot(eivV.transpose()) < cos(__fLoopAngle) ) continue;
+			nBest = int(i); fBest = fDist;
+			eimRBest = eimR; eivTBest = eivT;
+		}
+		if (nBest < 0) return;
+		//register the old key frame, starting from its pose in the graph, against the latest one
+		btl::kinect::CKeyFrame::tp_ptr pOld = _vpKeyFrames[nBest].get();
+		pOld->setRTw(eimRBest,eivTBest);
+		if (_bCpuICP || btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend)
+			pOld->cpuICP( pCurFrame_, false );
+		else
+			pOld->gpuICP( pCurFrame_, false );
+		//the drift around the loop is expected to be small, a registration far off the graph pose failed
+		Eigen::AngleAxisf eAA(pOld->_eimRw*eimRBest.transpose());
+		const Eigen::Vector3f eivDC = pOld->_eimRw.transpose()*pOld->_eivTw - eimRBest.transpose()*eivTBest;
+		if( fabs(eAA.angle()) > __fKeyFrameAngle || eivDC.norm() > __fKeyFrameDistM ) return;
+		//Xcur = R*Xold + T
+		const Eigen::Matrix3f eimR = pCurFrame_->_eimRw*pOld->_eimRw.transpose();
+		addLoopClosure(_vnKeyFrameNodes[nBest],eimR,pCurFrame_->_eivTw - eimR*pOld->_eivTw);
+	}
+
+	void CKinFuTracker::applyPoseGraph(){
+		const unsigned int uVersion = _pPoseGraph->version();
+		if (uVersion == _uPoseGraphVersion || _vuNodePoses.empty()) return;
+		_uPoseGraphVersion = uVersion;
+		//correction of each node from the tracked to the optimised pose, (Ro,To) = (Rt*Rg, Rt*Tg + Tt)
+		const size_t uNodes = _vuNodePoses.size();
+		std::vector<Eigen::Matrix3f> veimRg(uNodes);
+		std::vector<Eigen::Vector3f> veivTg(uNodes);
+		float fShift = 0.f;
+		for (size_t k=0; k<uNodes; k++){
+			Eigen::Matrix3f eimRt,eimRo; Eigen::Vector3f eivTt,eivTo;
+			btl::utility::setRTCVfromModelViewGL(_veimPoses[_vuNodePoses[k]],&eimRt,&eivTt);
+			_pPoseGraph->getPose(int(k),&eimRo,&eivTo);
+			veimRg[k] = eimRt.transpose()*eimRo;
+			veivTg[k] = eimRt.transpose()*(eivTo - eivTt);
+			fShift = (eimRo.transpose()*eivTo - eimRt.transpose()*eivTt).norm();
+		}
+		//only a correction of the latest key frame is worth moving the map for
+		Eigen::AngleAxisf eAA(veimRg.back());
+		if( fabs(eAA.angle()) < M_PI_4/45. && fShift < 0.02f ) return;
+		//the poses up to the next key frame follow their key frame
+		for (size_t k=0; k<uNodes; k++){
+			const size_t uEnd = k+1 < uNodes ? _vuNodePoses[k+1] : _veimPoses.size();
+			for (size_t i=_vuNodePoses[k]; i<uEnd; i++){
+				Eigen::Matrix3f eimR; Eigen::Vector3f eivT;
+				btl::utility::setRTCVfromModelViewGL(_veimPoses[i],&eimR,&eivT);
+				_veimPoses[i] = btl::utility::setModelViewGLfromRTCV( Eigen::Matrix3f(eimR*veimRg[k]), Eigen::Vector3f(eimR*veivTg[k] + eivT) );
+			}
+		}
+		_eimCurPose = _veimPoses.back();
+		_pPoseGraph->getPose(_nLastNode,&_eimLastNodeR,&_eivLastNodeT);
+		//move the reference frame with the map, X' = Rg'(X - Tg)
+		const Eigen::Matrix3f eimRRef = _pPrevFrameWorld->_eimRw*veimRg.back();
+		const Eigen::Vector3f eivTRef = _pPrevFrameWorld->_eimRw*veivTg.back() + _pPrevFrameWorld->_eivTw;
+		_pPrevFrameWorld->setRTw(veimRg.back(),veivTg.back());
+		_pPrevFrameWorld->gpuTransformToWorldCVCV();
+		_pPrevFrameWorld->setRTw(eimRRef,eivTRef);
+		if (_bTrackOnly) return;
+		//rebuild the volume from the stored key frames at their optimised poses
+		_pCubicGrids->reset();
+		for (size_t i=0; i<_vpKeyFrames.size(); i++){
+			Eigen::Matrix3f eimR; Eigen::Vector3f eivT;
+			_pPoseGraph->getPose(_vnKeyFrameNodes[i],&eimR,&eivT);
+			_vpKeyFrames[i]->setRTw(eimR,eivT);
+			_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_vpKeyFrames[i]);
+		}
+	}
+
+	void CKinFuTracker::addLoopClosure(int nNode_, const Eigen::Matrix3f& eimR_, const Eigen::Vector3f& eivT_){
+		if (!_pPoseGraph || _nLastNode < 0 || nNode_ == _nLastNode) return;
+		_pPoseGraph->addEdge(nNode_,_nLastNode,eimR_,eivT_);
+	}
+
+	void CKinFuTracker::getKeyFramePose(int nNode_, Eigen::Matrix4f* pSystemPose_) const{
+		BTL_ASSERT( _pPoseGraph, "CKinFuTracker::getKeyFramePose() needs setPoseGraph(true)" );
+		Eigen::Matrix3f eimR; Eigen::Vector3f eivT;
+		_pPoseGraph->getPose(nNode_,&eimR,&eivT);
+		*pSystemPose_ = btl::utility::setModelViewGLfromRTCV(eimR,eivT);
 	}
 
 	void CKinFuTracker::init(const btl::kinect::CKeyFrame::tp_ptr pKeyFrame_){
@@ -64,12 +273,26 @@ namespace btl{ namespace geometry
 		case SURF:
 			initSURF(pKeyFrame_);
 			break;
+		case RGBD:
+			initRGBD(pKeyFrame_);
+			break;
+		}
+		_uFrame = 0;
+		_vuPoseFrames.assign(_veimPoses.size(),_uFrame);
+		_vnIterations.clear();
+		if (_pPoseGraph){
+			_nLastNode = -1;
+			updatePoseGraph(pKeyFrame_,false);
 		}
 		return;
 	}
 
 	void CKinFuTracker::track(btl::kinect::CKeyFrame::tp_ptr pCurFrame_,bool bTrackOnly_/* = false*/){
 		_bTrackOnly = bTrackOnly_;
+		const size_t uPoses = _veimPoses.size();
+		_uFrame++;
+		_nIterations = 0;
+		if (_pPoseGraph) applyPoseGraph();
 		switch(_nMethod)
 		{
 		case ICP:
@@ -84,10 +307,23 @@ namespace btl{ namespace geometry
 		case SURF:
 			trackSURF(pCurFrame_);
 			break;
+		case RGBD:
+			trackRGBD(pCurFrame_);
+			break;
 		}
+		_vnIterations.push_back(_nIterations);
+		//a pose is stored only if tracking accepted the frame
+		if (_pPoseGraph && _veimPoses.size() > uPoses) updatePoseGraph(pCurFrame_,true);
 		return;
 	}
 
+	void CKinFuTracker::resetPrevFrame(btl::kinect::CKeyFrame::tp_ptr pKeyFrame_){
+		//return the old frame first so that re-initialisation keeps reusing the same pooled frame
+		_pPrevFrameWorld.reset();
+		if( !_pFramePool || !_pFramePool->fits(*pKeyFrame_) ) _pFramePool = btl::kinect::CKeyFramePool::create(*pKeyFrame_);
+		_pPrevFrameWorld = _pFramePool->acquire(pKeyFrame_);
+	}
+
 	void CKinFuTracker::initICP(const btl::kinect::CKeyFrame::tp_ptr pKeyFrame_)
 	{
 		//input key frame must be defined in local camera system
@@ -98,7 +334,7 @@ namespace btl{ namespace geometry
 		pKeyFrame_->setView(&_eimCurPose);
 		_veimPoses.push_back(_eimCurPose); // the first pose is initialize by the pKeyFrame_;
 		//copy pKeyFrame_ to _pPrevFrameWorld
-		_pPrevFrameWorld.reset(new btl::kinect::CKeyFrame(pKeyFrame_));	
+		resetPrevFrame(pKeyFrame_);
 		_pPrevFrameWorld->gpuTransformToWorldCVCV();//transform from camera to world
 		//integrate the frame into the world
 		_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_pPrevFrameWorld);
@@ -108,23 +344,22 @@ namespace btl{ namespace geometry
 	void CKinFuTracker::trackICP(btl::kinect::CKeyFrame::tp_ptr pCurFrame_){
 		//the current frame is defined in camera system
 		//PRINTSTR("ICP tracking.");
-		pCurFrame_->setRTTo(*_pPrevFrameWorld);//initialize the current un-calibrated frame as the previous frame
-		pCurFrame_->gpuICP ( _pPrevFrameWorld.get(), false );//refine the R,T with w.r.t. previous key frame
-		if( pCurFrame_->isMovedwrtReferencInRadiusM( _pPrevFrameWorld.get(),M_PI_4/45.,0.02) ){ //test if the current frame have been moving
+		initialisePose(pCurFrame_);//initialize the current un-calibrated frame as the previous frame, or as predicted by the motion model
+		_nIterations = refineICP( pCurFrame_, false );//refine the R,T with w.r.t. previous key frame
+		if( isMoved( pCurFrame_ ) ){ //test if the current frame have been moving
 			pCurFrame_->gpuTransformToWorldCVCV();
 			if(!_bTrackOnly) _pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*pCurFrame_);
-			//refresh prev frame in world as the ray casted virtual frame
-			_pPrevFrameWorld->setRTTo( *pCurFrame_ );
+			//store R t pose
+			storePose(pCurFrame_);
+			//refresh prev frame in world as the ray casted virtual frame, at the pose predicted for the next frame if any
+			if (!predictPose( &*_pPrevFrameWorld, _uFrame+1 )) _pPrevFrameWorld->setRTTo( *pCurFrame_ );
 			_pCubicGrids->gpuRaycast( &*_pPrevFrameWorld ); //get virtual frame
 			pCurFrame_->copyImageTo(&*_pPrevFrameWorld); //fill in the color info
-			//store R t pose
-			pCurFrame_->setView(&_eimCurPose);
-			_veimPoses.push_back(_eimCurPose);
 		}//if current frame moved
 		return;
 	} //trackICP()
 	void CKinFuTracker::setCurrView( Eigen::Matrix4f* pSystemPose_ ) const{
-		_pPrevFrameWorld->setView(&*pSystemPose_);//set as i-1 
+		*pSystemPose_ = _eimCurPose;//set as i-1, the reference frame may be ray casted ahead of it 
 	}
 	void CKinFuTracker::setPrevView( Eigen::Matrix4f* pSystemPose_ ){
 		_uViewNO = --_uViewNO % _veimPoses.size(); 
@@ -146,7 +381,7 @@ namespace btl{ namespace geometry
 		pKeyFrame_->setView(&_eimCurPose);
 		_veimPoses.push_back(_eimCurPose); // the first pose is initialize by the pKeyFrame_;
 		//copy pKeyFrame_ to _pPrevFrameWorld
-		_pPrevFrameWorld.reset(new btl::kinect::CKeyFrame(pKeyFrame_));	
+		resetPrevFrame(pKeyFrame_);
 		_pPrevFrameWorld->gpuTransformToWorldCVCV();//transform from camera to world
 		//integrate the frame into the world
 		_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_pPrevFrameWorld);
@@ -158,36 +393,34 @@ namespace btl{ namespace geometry
 	{
 		//the current frame is defined in camera system
 		//PRINTSTR("ICP tracking.");
-		pCurFrame_->setRTTo(*_pPrevFrameWorld);//initialize the current un-calibrated frame as the previous frame
+		initialisePose(pCurFrame_);//initialize the current un-calibrated frame as the previous frame, or as predicted by the motion model
 		//trackICP camera motion
 		pCurFrame_->extractOrbFeatures();
 		ushort uInliers;
-		double dError = pCurFrame_->calcRTOrb ( *_pPrevFrameWorld,.2,&uInliers ); //roughly estimate R,T w.r.t. last key frame,
+		double dError = pCurFrame_->calcRTOrb ( *_pPrevFrameWorld,.2,&uInliers,_fOrbSearchRadius ); //roughly estimate R,T w.r.t. last key frame,
 		PRINT(uInliers)
 		if ( uInliers > 60) {
-			pCurFrame_->gpuICP ( _pPrevFrameWorld.get(), false );//refine the R,T with w.r.t. previous key frame
-			if( pCurFrame_->isMovedwrtReferencInRadiusM( _pPrevFrameWorld.get(),M_PI_4/45.,0.02) ){ //test if the current frame have been moving
+			_nIterations = refineICP( pCurFrame_, false );//refine the R,T with w.r.t. previous key frame
+			if( isMoved( pCurFrame_ ) ){ //test if the current frame have been moving
 				pCurFrame_->gpuTransformToWorldCVCV();
 				if(!_bTrackOnly) _pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*pCurFrame_);
-				//refresh prev frame in world as the ray casted virtual frame
-				_pPrevFrameWorld->setRTTo( *pCurFrame_ );
-				_pCubicGrids->gpuRaycast( &*_pPrevFrameWorld ); //get virtual frame
 				//store R t pose
-				pCurFrame_->setView(&_eimCurPose);
-				_veimPoses.push_back(_eimCurPose);
+				storePose(pCurFrame_);
+				//refresh prev frame in world as the ray casted virtual frame, at the pose predicted for the next frame if any
+				if (!predictPose( &*_pPrevFrameWorld, _uFrame+1 )) _pPrevFrameWorld->setRTTo( *pCurFrame_ );
+				_pCubicGrids->gpuRaycast( &*_pPrevFrameWorld ); //get virtual frame
 				pCurFrame_->copyImageTo(&*_pPrevFrameWorld);
 			}//if current frame moved
 		}else{
-			pCurFrame_->gpuICP ( _pPrevFrameWorld.get(), true );//refine the R,T with w.r.t. previous key frame
-			if( pCurFrame_->isMovedwrtReferencInRadiusM( _pPrevFrameWorld.get(),M_PI_4/45.,0.02) ){ //test if the current frame have been moving
+			_nIterations = refineICP( pCurFrame_, true );//refine the R,T with w.r.t. previous key frame
+			if( isMoved( pCurFrame_ ) ){ //test if the current frame have been moving
 				pCurFrame_->gpuTransformToWorldCVCV();
 				_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*pCurFrame_);
-				//refresh prev frame in world as the ray casted virtual frame
-				_pPrevFrameWorld->setRTTo( *pCurFrame_ );
-				_pCubicGrids->gpuRaycast( &*_pPrevFrameWorld ); //get virtual frame
 				//store R t pose
-				pCurFrame_->setView(&_eimCurPose);
-				_veimPoses.push_back(_eimCurPose);
+				storePose(pCurFrame_);
+				//refresh prev frame in world as the ray casted virtual frame, at the pose predicted for the next frame if any
+				if (!predictPose( &*_pPrevFrameWorld, _uFrame+1 )) _pPrevFrameWorld->setRTTo( *pCurFrame_ );
+				_pCubicGrids->gpuRaycast( &*_pPrevFrameWorld ); //get virtual frame
 				pCurFrame_->copyImageTo(&*_pPrevFrameWorld);
 			}//if current frame moved
 		}
@@ -204,7 +437,7 @@ namespace btl{ namespace geometry
 		pKeyFrame_->setView(&_eimCurPose);
 		_veimPoses.push_back(_eimCurPose); // the first pose is initialize by the pKeyFrame_;
 		//copy pKeyFrame_ to _pPrevFrameWorld
-		_pPrevFrameWorld.reset(new btl::kinect::CKeyFrame(pKeyFrame_));	
+		resetPrevFrame(pKeyFrame_);
 		_pPrevFrameWorld->gpuTransformToWorldCVCV();//transform from camera to world
 		//integrate the frame into the world
 		_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_pPrevFrameWorld);
@@ -217,21 +450,20 @@ namespace btl{ namespace geometry
 	{
 		//the current frame is defined in camera system
 		//PRINTSTR("ICP tracking.");
-		pCurFrame_->setRTTo(*_pPrevFrameWorld);//initialize the current un-calibrated frame as the previous frame
+		initialisePose(pCurFrame_);//initialize the current un-calibrated frame as the previous frame, or as predicted by the motion model
 		//trackICP camera motion
 		pCurFrame_->extractOrbFeatures();
 		ushort uInliers;
-		double dError = pCurFrame_->calcRTOrb ( *_pPrevFrameWorld, .2, &uInliers ); //roughly estimate R,T w.r.t. last key frame,
-		if ( /*uInliers > 300 &&*/ pCurFrame_->isMovedwrtReferencInRadiusM( _pPrevFrameWorld.get(), M_PI_4/45., 0.02 )) {//test if the current frame have been moving
+		double dError = pCurFrame_->calcRTOrb ( *_pPrevFrameWorld, .2, &uInliers, _fOrbSearchRadius ); //roughly estimate R,T w.r.t. last key frame,
+		if ( /*uInliers > 300 &&*/ isMoved( pCurFrame_ ) ) {//test if the current frame moved from the last stored pose
 			pCurFrame_->gpuTransformToWorldCVCV();
 			if(!_bTrackOnly) _pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*pCurFrame_);
-			//refresh prev frame in world as the ray casted virtual frame
+			//the features need a real image, the reference is the frame itself at its tracked pose rather than a predicted one
 			_pPrevFrameWorld->setRTTo( *pCurFrame_ );
 			pCurFrame_->copyTo(&*_pPrevFrameWorld);
 			//pCurFrame_->copyImageTo(&*_pPrevFrameWorld);
 			//store R t pose
-			pCurFrame_->setView(&_eimCurPose);
-			_veimPoses.push_back(_eimCurPose);
+			storePose(pCurFrame_);
 		}
 		return;
 	}//trackORB
@@ -246,7 +478,7 @@ namespace btl{ namespace geometry
 		pKeyFrame_->setView(&_eimCurPose);
 		_veimPoses.push_back(_eimCurPose); // the first pose is initialize by the pKeyFrame_;
 		//copy pKeyFrame_ to _pPrevFrameWorld
-		_pPrevFrameWorld.reset(new btl::kinect::CKeyFrame(pKeyFrame_));	
+		resetPrevFrame(pKeyFrame_);
 		_pPrevFrameWorld->gpuTransformToWorldCVCV();//transform from camera to world
 		//integrate the frame into the world
 		_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_pPrevFrameWorld);
@@ -259,21 +491,20 @@ namespace btl{ namespace geometry
 	{
 		//the current frame is defined in camera system
 		//PRINTSTR("ICP tracking.");
-		pCurFrame_->setRTTo(*_pPrevFrameWorld);//initialize the current un-calibrated frame as the previous frame
+		initialisePose(pCurFrame_);//initialize the current un-calibrated frame as the previous frame, or as predicted by the motion model
 		//trackICP camera motion
 		pCurFrame_->extractSurfFeatures();
 		ushort uInliers;
 		double dError = pCurFrame_->calcRT ( *_pPrevFrameWorld,0,.2,&uInliers ); //roughly estimate R,T w.r.t. last key frame,
-		if ( /*uInliers > 300 && */pCurFrame_->isMovedwrtReferencInRadiusM( _pPrevFrameWorld.get(),M_PI_4/45.,0.02)) {//test if the current frame have been moving
+		if ( /*uInliers > 300 && */isMoved( pCurFrame_ ) ) {//test if the current frame moved from the last stored pose
 
 			pCurFrame_->gpuTransformToWorldCVCV();
 			_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*pCurFrame_);
-			//refresh prev frame in world as the ray casted virtual frame
+			//the features need a real image, the reference is the frame itself at its tracked pose rather than a predicted one
 			_pPrevFrameWorld->setRTTo( *pCurFrame_ );
 			pCurFrame_->copyTo(&*_pPrevFrameWorld);
 			//store R t pose
-			pCurFrame_->setView(&_eimCurPose);
-			_veimPoses.push_back(_eimCurPose);
+			storePose(pCurFrame_);
 		}
 		return;
 	}//trackORB
@@ -288,7 +519,7 @@ namespace btl{ namespace geometry
 		pKeyFrame_->setView(&_eimCurPose);
 		_veimPoses.push_back(_eimCurPose); // the first pose is initialize by the pKeyFrame_;
 		//copy pKeyFrame_ to _pPrevFrameWorld
-		_pPrevFrameWorld.reset(new btl::kinect::CKeyFrame(pKeyFrame_));	
+		resetPrevFrame(pKeyFrame_);
 		_pPrevFrameWorld->gpuTransformToWorldCVCV();//transform from camera to world
 		//integrate the frame into the world
 		_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_pPrevFrameWorld);
@@ -300,22 +531,21 @@ namespace btl{ namespace geometry
 	{
 		//the current frame is defined in camera system
 		//PRINTSTR("ICP tracking.");
-		pCurFrame_->setRTTo(*_pPrevFrameWorld);//initialize the current un-calibrated frame as the previous frame
+		initialisePose(pCurFrame_);//initialize the current un-calibrated frame as the previous frame, or as predicted by the motion model
 		//trackICP camera motion
 		pCurFrame_->extractSurfFeatures();
 		ushort uInliers;
 		double dError = pCurFrame_->calcRT ( *_pPrevFrameWorld,0,.2,&uInliers ); //roughly estimate R,T w.r.t. last key frame,
 		if ( uInliers > 300) {
-			pCurFrame_->gpuICP ( _pPrevFrameWorld.get(), false );//refine the R,T with w.r.t. previous key frame
-			if( pCurFrame_->isMovedwrtReferencInRadiusM( _pPrevFrameWorld.get(),M_PI_4/45.,0.02) ){ //test if the current frame have been moving
+			_nIterations = refineICP( pCurFrame_, false );//refine the R,T with w.r.t. previous key frame
+			if( isMoved( pCurFrame_ ) ){ //test if the current frame have been moving
 				pCurFrame_->gpuTransformToWorldCVCV();
 				if(!_bTrackOnly) _pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*pCurFrame_);
-				//refresh prev frame in world as the ray casted virtual frame
-				_pPrevFrameWorld->setRTTo( *pCurFrame_ );
-				_pCubicGrids->gpuRaycast( &*_pPrevFrameWorld ); //get virtual frame
 				//store R t pose
-				pCurFrame_->setView(&_eimCurPose);
-				_veimPoses.push_back(_eimCurPose);
+				storePose(pCurFrame_);
+				//refresh prev frame in world as the ray casted virtual frame, at the pose predicted for the next frame if any
+				if (!predictPose( &*_pPrevFrameWorld, _uFrame+1 )) _pPrevFrameWorld->setRTTo( *pCurFrame_ );
+				_pCubicGrids->gpuRaycast( &*_pPrevFrameWorld ); //get virtual frame
 				pCurFrame_->copyImageTo(&*_pPrevFrameWorld);
 			}//if current frame moved
 		}
@@ -332,7 +562,7 @@ namespace btl{ namespace geometry
 		pKeyFrame_->setView(&_eimCurPose);
 		_veimPoses.push_back(_eimCurPose); // the first pose is initialize by the pKeyFrame_;
 		//copy pKeyFrame_ to _pPrevFrameWorld
-		_pPrevFrameWorld.reset(new btl::kinect::CKeyFrame(pKeyFrame_));	
+		resetPrevFrame(pKeyFrame_);
 		_pPrevFrameWorld->gpuTransformToWorldCVCV();//transform from camera to world
 		//integrate the frame into the world
 		_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_pPrevFrameWorld);
@@ -348,7 +578,7 @@ namespace btl{ namespace geometry
 		pKeyFrame_->setView(&_eimCurPose);
 		_veimPoses.push_back(_eimCurPose); // the first pose is initialize by the pKeyFrame_;
 		//copy pKeyFrame_ to _pPrevFrameWorld
-		_pPrevFrameWorld.reset(new btl::kinect::CKeyFrame(pKeyFrame_));	
+		resetPrevFrame(pKeyFrame_);
 		_pPrevFrameWorld->gpuTransformToWorldCVCV();//transform from camera to world
 		//integrate the frame into the world
 		_pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_pPrevFrameWorld);
@@ -362,14 +592,14 @@ namespace btl{ namespace geometry
 	{
 		//the current frame is defined in camera system
 		//PRINTSTR("ICP tracking.");
-		pCurFrame_->setRTTo(*_pPrevFrameWorld);//initialize the current un-calibrated frame as the previous frame
+		initialisePose(pCurFrame_);//initialize the current un-calibrated frame as the previous frame, or as predicted by the motion model
 		//trackICP camera motion
 		_pSemiDenseOrb->track(pCurFrame_->_acvgmShrPtrPyrBWs);
 		PRINT(_pSemiDenseOrb->_uMatchedPoints);
 
 		pCurFrame_->gpuImageICP(_pPrevFrameWorld.get(),_pSemiDenseOrb.get());
 
-		if( pCurFrame_->isMovedwrtReferencInRadiusM( _pPrevFrameWorld.get(),M_PI_4/45.,0.02) ){ //test if the current frame have been moving
+		if( isMoved( pCurFrame_ ) ){ //test if the current frame moved from the last stored pose
 			pCurFrame_->gpuTransformToWorldCVCV();
 			if(!_bTrackOnly) _pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*pCurFrame_);
 			//refresh prev frame in world as the ray casted virtual frame
@@ -378,12 +608,43 @@ namespace btl{ namespace geometry
 
 		_pCubicGrids->gpuRaycast( &*_pPrevFrameWorld ); //get virtual frame at current pose
 		//store R t pose
-		pCurFrame_->setView(&_eimCurPose);
-		_veimPoses.push_back(_eimCurPose);
+		storePose(pCurFrame_);
 		pCurFrame_->copyImageTo(&*_pPrevFrameWorld);
 		return;
 	}//trackORBICP
 
+	void CKinFuTracker::initRGBD( btl::kinect::CKeyFrame::tp_ptr pKeyFrame_ )
+	{
+		//input key frame must be defined in local camera system
+		_pCubicGrids->reset();
+		_veimPoses.clear();
+		_veimPoses.reserve(1000);
+		//initialize pose
+		pKeyFrame_->setView(&_eimCurPose);
+		_veimPoses.push_back(_eimCurPose); // the first pose is initialize by the pKeyFrame_;
+		//copy pKeyFrame_ to _pPrevFrameWorld
+		resetPrevFrame(pKeyFrame_);
+		_pPrevFrameWorld->gpuTransformToWorldCVCV();//transform from camera to world
+		//integrate the frame into the world
+		if(!_bTrackOnly) _pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*_pPrevFrameWorld);
+	}
+
+	void CKinFuTracker::trackRGBD( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ )
+	{
+		//the current frame is defined in camera system
+		initialisePose(pCurFrame_);//initialize the current un-calibrated frame as the previous frame, or as predicted by the motion model
+		_nIterations = pCurFrame_->cpuDenseRGBD( _pPrevFrameWorld.get(), false, _fRGBDGeometricWeight );
+		if( isMoved( pCurFrame_ ) ){ //test if the current frame moved from the last stored pose
+			pCurFrame_->gpuTransformToWorldCVCV();
+			if(!_bTrackOnly) _pCubicGrids->gpuIntegrateFrameIntoVolumeCVCV(*pCurFrame_);
+			//the photometric error needs a real image, the reference is the last frame that moved rather than a ray casted one
+			pCurFrame_->copyTo(&*_pPrevFrameWorld);
+			//store R t pose
+			storePose(pCurFrame_);
+		}//if current frame moved
+		return;
+	}//trackRGBD
+
 
 }//geometry
 }//btl
\ No newline at end of file
@@ -10,12 +10,33 @@ namespace btl{ namespace geometry
 		//type
 		typedef boost::shared_ptr<CKinFuTracker> tp_shared_ptr;
 
-		enum{ICP, ORBICP, ORB, SURF, SURFICP};
+		enum{ICP, ORBICP, ORB, SURF, SURFICP, RGBD};
 	public:
 		//both pKeyFrame_ and pCubicGrids_ must be allocated before hand
 		CKinFuTracker(btl::kinect::CKeyFrame::tp_ptr pKeyFrame_,CCubicGrids::tp_shared_ptr pCubicGrids_ /*ushort usVolumeResolution_,float fVolumeSizeM_*/ );
 		~CKinFuTracker(){;}
 		void setMethod(int nMethod_){ _nMethod = nMethod_;}
+		//run the ICP of the ICP, ORB + ICP and SURF + ICP methods on the host pyramids, always the case with CKeyFrame::CPU_BACKEND
+		void setCpuICP(bool bCpuICP_){ _bCpuICP = bCpuICP_;}
+		//weight of the point-to-plane term of the RGBD method, 0 for photometric only
+		void setRGBDGeometricWeight(float fWeight_){ _fRGBDGeometricWeight = fWeight_;}
+		//collect key frame poses into a pose graph solved on a background thread, see PoseGraph.h. revisited key frames
+		//add loop closures, a solve that moves the latest key frame also moves the poses, the reference frame and the volume
+		void setPoseGraph(bool bPoseGraph_);
+		//constraint from a loop closure detector: the pose of the latest key frame relative to key frame nNode_
+		void addLoopClosure(int nNode_, const Eigen::Matrix3f& eimR_, const Eigen::Vector3f& eivT_);
+		//the optimised world to camera pose of key frame nNode_, in GL convention as _veimPoses
+		void getKeyFramePose(int nNode_, Eigen::Matrix4f* pSystemPose_) const;
+		CPoseGraph::tp_shared_ptr poseGraph() const { return _pPoseGraph; }
+		//start tracking from the pose predicted by a damped constant velocity model instead of the previous pose,
+		//the ICP method also ray casts its reference at the predicted pose of the next frame, see MotionModel.h
+		void setMotionModel(bool bMotionModel_);
+		CMotionModel::tp_shared_ptr motionModel() const { return _pMotionModel; }
+		//ICP or gauss-newton iterations run for each frame tracked since init(), 0 for the feature only methods
+		const std::vector<int>& iterations() const { return _vnIterations; }
+		//ORB methods: match only within fRadius_ pixels of the reference features projected through the initial pose,
+		//best combined with setMotionModel(). 0 for brute force matching
+		void setOrbSearchRadius(float fRadius_){ _fOrbSearchRadius = fRadius_;}
 		void init(btl::kinect::CKeyFrame::tp_ptr pKeyFrame_);
 		void track(btl::kinect::CKeyFrame::tp_ptr pCurFrame_,bool bTrackOnly_ = false);
 		void setNextView( Eigen::Matrix4f* pSystemPose_ );
@@ -44,21 +65,64 @@ namespace btl{ namespace geometry
 		//semi dense + ICP
 		void initSemiDenseICP( btl::kinect::CKeyFrame::tp_ptr pKeyFrame_ );
 		void trackSemiDenseICP( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ );
+		//direct photometric (+ geometric) odometry on the host pyramids, frame to frame
+		void initRGBD( btl::kinect::CKeyFrame::tp_ptr pKeyFrame_ );
+		void trackRGBD( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ );
+		//replace _pPrevFrameWorld by a pooled copy of pKeyFrame_
+		void resetPrevFrame( btl::kinect::CKeyFrame::tp_ptr pKeyFrame_ );
+		//add a node and an odometry edge when the tracked frame moved far enough from the last key frame,
+		//bWorld_ once its points were transformed into world
+		void updatePoseGraph( btl::kinect::CKeyFrame::tp_ptr pCurFrame_, bool bWorld_ );
+		//keeps a copy of the key frame in camera coordinates for loop closures and re-integration
+		void storeKeyFrame( btl::kinect::CKeyFrame::tp_ptr pCurFrame_, bool bWorld_ );
+		//registers the closest stored key frame seen from about the same place by ICP and adds the loop closure
+		void detectLoopClosure( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ );
+		//carries the poses after a solve over to _veimPoses, the reference frame and the volume
+		void applyPoseGraph();
+		//the previous pose, or the prediction of the motion model
+		void initialisePose( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ );
+		//sets pFrame_ to the pose predicted for frame uFrame_, false and untouched without a prediction
+		bool predictPose( btl::kinect::CKeyFrame::tp_ptr pFrame_, unsigned int uFrame_ ) const;
+		//appends the pose of pCurFrame_ to _veimPoses
+		void storePose( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ );
+		//motion w.r.t. the last stored pose, the reference frame may sit at a predicted one
+		bool isMoved( btl::kinect::CKeyFrame::tp_ptr pCurFrame_ ) const;
+		//refines the pose of pCurFrame_ against _pPrevFrameWorld on the host or the device, see setCpuICP()
+		int refineICP( btl::kinect::CKeyFrame::tp_ptr pCurFrame_, bool bUseReferenceRTAsInitial_ );
 
 
 
 		CCubicGrids::tp_shared_ptr _pCubicGrids;
-		btl::kinect::CKeyFrame::tp_scoped_ptr _pPrevFrameWorld;
+		btl::kinect::CKeyFramePool::tp_shared_ptr _pFramePool;
+		btl::kinect::CKeyFrame::tp_shared_ptr _pPrevFrameWorld;
 
 		btl::image::SCamera::tp_ptr _pRGBCamera; //share the content of the RGBCamera with those from VideoKinectSource
 		Eigen::Matrix4f _eimCurPose;
 		unsigned int _uViewNO;
 		std::vector<Eigen::Matrix4f> _veimPoses;
+		std::vector<unsigned int> _vuPoseFrames; //frame number of each of _veimPoses
+		unsigned int _uFrame; //frames tracked since init()
+		int _nIterations; //of the current frame
+		std::vector<int> _vnIterations;
 		int _nMethod;
 		bool _bTrackOnly;
+		bool _bCpuICP;
+		float _fRGBDGeometricWeight;
+		float _fOrbSearchRadius;
 
 		btl::image::semidense::CSemiDenseTrackerOrb::tp_scoped_ptr _pSemiDenseOrb;
 
+		CPoseGraph::tp_shared_ptr _pPoseGraph;
+		int _nLastNode;
+		Eigen::Matrix3f _eimLastNodeR; //pose of the last key frame, as tracked or as last applied from the graph
+		Eigen::Vector3f _eivLastNodeT;
+		std::vector<unsigned int> _vuNodePoses; //index into _veimPoses of each node
+		unsigned int _uPoseGraphVersion; //last solve applied
+		std::vector<int> _vnKeyFrameNodes; //node of each of _vpKeyFrames, ascending
+		std::vector<btl::kinect::CKeyFrame::tp_shared_ptr> _vpKeyFrames; //pooled, in camera coordinates
+
+		CMotionModel::tp_shared_ptr _pMotionModel;
+
 	};//CKinFuTracker
 
 }//geometry
@@ -0,0 +1,105 @@
+//boost
+#include <boost/shared_ptr.hpp>
+//stl
+#include <vector>
+#include <limits>
+#define _USE_MATH_DEFINES
+#include <math.h>
+//eigen
+#include <Eigen/Dense>
+#include "EigenUtil.hpp"
+#include "MotionModel.h"
+
+namespace btl{ namespace geometry
+{
+
+static inline Eigen::Matrix3d skew(const Eigen::Vector3d& eivV_){
+	Eigen::Matrix3d eimS;
+	eimS << 0, -eivV_(2), eivV_(1), eivV_(2), 0, -eivV_(0), -eivV_(1), eivV_(0), 0;
+	return eimS;
+}
+
+//twist [w;v] of the rigid motion X' = R*X + T
+static Eigen::Matrix<double,6,1> logSE3(const Eigen::Matrix3d& eimR_, const Eigen::Vector3d& eivT_){
+	Eigen::AngleAxisd eAA(eimR_);
+	const double dTheta = eAA.angle();
+	const Eigen::Vector3d eivW = eAA.axis()*dTheta;
+	const Eigen::Matrix3d eimW = skew(eivW);
+	Eigen::Matrix3d eimVInv = Eigen::Matrix3d::Identity() - 0.5*eimW;
+	if (dTheta > 1e-6)
+		eimVInv += (1. - dTheta*sin(dTheta)/(2.*(1.-cos(dTheta))))/(dTheta*dTheta) * eimW*eimW;
+	else
+		eimVInv += eimW*eimW/12.;
+	Eigen::Matrix<double,6,1> eivXi;
+	eivXi << eivW, eimVInv*eivT_;
+	return eivXi;
+}
+
+static void expSE3(const Eigen::Matrix<double,6,1>& eivXi_, Eigen::Matrix3d* peimR_, Eigen::Vector3d* peivT_){
+	const Eigen::Vector3d eivW = eivXi_.head<3>();
+	const double dTheta = eivW.norm();
+	const Eigen::Matrix3d eimW = skew(eivW);
+	Eigen::Matrix3d eimV = Eigen::Matrix3d::Identity();
+	if (dTheta > 1e-6){
+		*peimR_ = Eigen::AngleAxisd(dTheta, eivW/dTheta).toRotationMatrix();
+		eimV += (1.-cos(dTheta))/(dTheta*dTheta)*eimW + (dTheta-sin(dTheta))/(dTheta*dTheta*dTheta)*eimW*eimW;
+	}
+	else{
+		*peimR_ = Eigen::Matrix3d::Identity() + eimW;
+		eimV += 0.5*eimW;
+	}
+	*peivT_ = eimV*eivXi_.tail<3>();
+}
+
+CMotionModel::CMotionModel()
+{
+	_uHistory = 4;
+	_fDamping = .9f;
+	_fMaxAngle = float(M_PI/18.); //10 degrees
+	_fMaxDist = .1f;
+}
+
+bool CMotionModel::predict(const std::vector<Eigen::Matrix4f>& veimPoses_, const std::vector<unsigned int>& vuFrames_, unsigned int uFrame_,
+	Eigen::Matrix3f* peimRw_, Eigen::Vector3f* peivTw_) const{
+	const size_t uPoses = std::min(veimPoses_.size(), vuFrames_.size());
+	if (uPoses < 2 || _uHistory < 2) return false;
+	const size_t uFirst = uPoses - std::min<size_t>(uPoses, _uHistory);
+	const unsigned int uLast = vuFrames_[uPoses-1];
+	if (uFrame_ <= uLast) return false;
+	//weighted mean of the per frame twists between consecutive poses
+	Eigen::Matrix3f eimR; Eigen::Vector3f eivT;
+	btl::utility::setRTCVfromModelViewGL(veimPoses_[uFirst],&eimR,&eivT);
+	Eigen::Matrix3d eimRPrev = eimR.cast<double>();
+	Eigen::Vector3d eivTPrev = eivT.cast<double>();
+	Eigen::Matrix<double,6,1> eivXi = Eigen::Matrix<double,6,1>::Zero();
+	double dWeights = 0.;
+	for (size_t i = uFirst+1; i < uPoses; i++){
+		btl::utility::setRTCVfromModelViewGL(veimPoses_[i],&eimR,&eivT);
+		const Eigen::Matrix3d eimRCur = eimR.cast<double>();
+		const Eigen::Vector3d eivTCur = eivT.cast<double>();
+		//relative motion of the camera, Xi = R*Xi-1 + T
+		const Eigen::Matrix3d eimRRel = eimRCur*eimRPrev.transpose();
+		const Eigen::Vector3d eivTRel = eivTCur - eimRRel*eivTPrev;
+		const unsigned int uGap = vuFrames_[i] > vuFrames_[i-1] ? vuFrames_[i] - vuFrames_[i-1] : 1;
+		const double dW = pow(double(_fDamping), double(uLast - vuFrames_[i]));
+		eivXi += dW/uGap*logSE3(eimRRel,eivTRel);
+		dWeights += dW;
+		eimRPrev = eimRCur;
+		eivTPrev = eivTCur;
+	}
+	if (dWeights < std::numeric_limits<double>::epsilon()) return false;
+	eivXi /= dWeights;
+	if (eivXi.head<3>().norm() > _fMaxAngle || eivXi.tail<3>().norm() > _fMaxDist) return false;
+	//extrapolate by sum_{k=1..n} damping^k frames
+	const unsigned int uFrames = uFrame_ - uLast;
+	const double dD = _fDamping;
+	const double dScale = dD < 1. ? dD*(1.-pow(dD,double(uFrames)))/(1.-dD) : double(uFrames);
+	Eigen::Matrix3d eimRInc; Eigen::Vector3d eivTInc;
+	expSE3(dScale*eivXi,&eimRInc,&eivTInc);
+	*peimRw_ = (eimRInc*eimRPrev).cast<float>();
+	*peivTw_ = (eimRInc*eivTPrev + eivTInc).cast<float>();
+	return true;
+}
+
+}//geometry
+}//btl
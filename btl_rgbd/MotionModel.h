@@ -0,0 +1,32 @@
+#ifndef BTL_GEOMETRY_MOTION_MODEL
+#define BTL_GEOMETRY_MOTION_MODEL
+
+namespace btl{ namespace geometry
+{
+
+// Damped constant velocity model on SE(3) for the initial pose of tracking. The velocity is the weighted mean of the
+// twists between the last _uHistory stored poses, each divided by the number of frames between its two poses and
+// weighted by _fDamping to the power of its age in frames. It is extrapolated from the last pose with a decay of
+// _fDamping per frame, so that the prediction falls back towards the zero motion guess when frames are skipped.
+class CMotionModel
+{
+public:
+	typedef boost::shared_ptr<CMotionModel> tp_shared_ptr;
+
+	CMotionModel();
+	//predicts the world to camera pose, Xc = R*Xw + T, of frame uFrame_ from veimPoses_, GL model view matrices as
+	//CKinFuTracker::_veimPoses, tracked at frames vuFrames_. returns false and leaves R, T untouched if there is no
+	//usable motion: fewer than 2 poses, or a velocity beyond _fMaxAngle/_fMaxDist which is taken as a tracking glitch
+	bool predict(const std::vector<Eigen::Matrix4f>& veimPoses_, const std::vector<unsigned int>& vuFrames_, unsigned int uFrame_,
+		Eigen::Matrix3f* peimRw_, Eigen::Vector3f* peivTw_) const;
+
+	unsigned int _uHistory; //poses the velocity is estimated from, at least 2
+	float _fDamping; //in (0,1], 1 for an undamped constant velocity
+	float _fMaxAngle; //rad per frame
+	float _fMaxDist; //m per frame
+};
+
+}//geometry
+}//btl
+
+#endif
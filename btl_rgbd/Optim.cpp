@@ -3,7 +3,7 @@
 #include <math.h>
 #include <vector>
 
-#include "optim.hpp"
+#include "Optim.hpp"
 #include <algorithm>
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
@@ -28,12 +28,15 @@ COptim::COptim()
 	// for gradient calculation using finite difference
 	m_nIter = 0;
 	m_Cost = 0;
+	_bParallelJacobian = false;
 
 	m_LnAlg_List[0] = "Golden Section";
 
 	m_MdAlg_List[0] = "Conjugate Gradient";
 	m_MdAlg_List[1] = "Direction Sets";
 	m_MdAlg_List[2] = "Gradient Descendent";
+	m_MdAlg_List[3] = "Levenberg Marquardt";
+	m_MdAlg_List[4] = "Gauss Newton";
 }
 
 COptim::~COptim()
@@ -57,6 +60,12 @@ bool COptim::Go()
 
 		case (GRADIENTDESCENDENT):
 			return GradientDescendent(_cvmX);
+
+		case (LEVENBERGMARQUARDT):
+			return LevenbergMarquardt(_cvmX);
+
+		case (GAUSSNEWTON):
+			return GaussNewton(_cvmX);
 	
 		default:
 			return GradientDescendent(_cvmX);
@@ -138,6 +147,218 @@ void COptim::dFunc(const cv::Mat_<double>& X, cv::Mat_<double>& G)
 	}
 }
 
+bool COptim::Residual(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmR_ )
+{
+	return false;
+}
+
+//each thread perturbs its own copy of X, one column of J per parameter
+class CNumericJacobian : public cv::ParallelLoopBody
+{
+public:
+	CNumericJacobian(COptim* pOptim_, const cv::Mat_<double>& cvmX_, const cv::Mat_<double>& cvmDelta_, cv::Mat_<double>* pcvmJ_)
+		: _pOptim(pOptim_), _cvmX(cvmX_), _cvmDelta(cvmDelta_), _pcvmJ(pcvmJ_) {}
+
+	void operator()(const cv::Range& r) const
+	{
+		cv::Mat_<double> cvmX = _cvmX.clone();
+		cv::Mat_<double> cvmRp, cvmRm;
+		double* pX = (double*)cvmX.data;
+		const double* pDelta = (const double*)_cvmDelta.data;
+		for (int i = r.start; i < r.end; i++){
+			const double dX = pX[i];
+			pX[i] = dX + pDelta[i];
+			_pOptim->Residual(cvmX, cvmRp);
+			pX[i] = dX - pDelta[i];
+			_pOptim->Residual(cvmX, cvmRm);
+			pX[i] = dX;
+			// J(:,i) = ( R(X+dX) - R(X-dX) ) / 2dX
+			for (int j = 0; j < _pcvmJ->rows; j++)
+				(*_pcvmJ)(j, i) = (cvmRp(j, 0) - cvmRm(j, 0)) / (2 * pDelta[i]);
+		}
+	}
+private:
+	COptim* _pOptim;
+	const cv::Mat_<double>& _cvmX;
+	const cv::Mat_<double>& _cvmDelta;
+	cv::Mat_<double>* _pcvmJ;
+};
+
+void COptim::Jacobian(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmJ_ )
+{
+	CHECK( cvmX_.size() == _cvmDelta.size(),  "m_vDelta is set incorrectly." );
+	cv::Mat_<double> cvmR;
+	Residual(cvmX_, cvmR);
+	cvmJ_.create( cvmR.rows, (int)cvmX_.total() );
+	CNumericJacobian cJacobian(this, cvmX_, _cvmDelta, &cvmJ_);
+	if (_bParallelJacobian)
+		cv::parallel_for_( cv::Range(0, (int)cvmX_.total()), cJacobian );
+	else
+		cJacobian( cv::Range(0, (int)cvmX_.total()) );
+}
+
+bool COptim::LevenbergMarquardt( cv::Mat_<double>& X)
+{
+	cout << "COptim::LevenbergMarquardt() ";
+	cv::Mat_<double> R, R1, J, A, G, D, X1;
+	double lastCost, Cost1, mu, nu, rho;
+
+	// initialize at the starting point
+	m_nIter = 0;
+	if (!Residual(X, R))
+	{
+		cout << "Residual() is not provided. ";
+		return false;
+	}
+	m_Cost = R.dot(R);
+	Jacobian(X, J);
+	A = J.t()*J;
+	G = J.t()*R;	// half of the gradient of R'R
+
+	// initial damping from the scale of J'J (Nielsen)
+	mu = 0.;
+	for (int i=0; i<A.rows; i++)
+		mu = std::max(mu, A(i,i));
+	mu *= 1.0e-3;
+	nu = 2.;
+
+	for(m_nIter=1; m_nIter<=m_nMaxMdIter; m_nIter++)
+	{
+		lastCost = m_Cost;
+
+		_vCosts.push_back( m_Cost );
+		_vcvmXs.push_back( X.clone() );
+		_vcvmGs.push_back( G.clone() );
+		Display();
+
+		// if the magnitude of the gradient vanishes, 
+		// the current point is a (local) minimum
+		if (G.dot(G)<=m_MinMdGrad)
+		{
+			return true;
+		}
+
+		// solve ( J'J + mu I ) D = -J'R, raise mu until the step reduces the cost
+		bool bAccepted = false;
+		for (int nTry=0; nTry<m_nMaxLnIter && !bAccepted; nTry++)
+		{
+			cv::Mat_<double> AD = A + cv::Mat_<double>::eye(A.rows, A.cols)*mu;
+			if (!cv::solve(AD, -G, D, cv::DECOMP_CHOLESKY))
+			{
+				mu *= nu; nu *= 2.;
+				continue;
+			}
+			// the step is too small to move X
+			if (cv::norm(D) <= m_MdTol*(cv::norm(X)+m_MdTol))
+			{
+				return true;
+			}
+
+			X1 = X + D.reshape(1, X.rows);
+			Residual(X1, R1);
+			Cost1 = R1.dot(R1);
+
+			// actual over predicted reduction, the latter is D'(mu D - J'R)
+			rho = (m_Cost - Cost1)/(D.dot(D*mu - G) + OPTIM_TINY);
+			if (rho > 0.)
+			{
+				X1.copyTo(X);
+				R1.copyTo(R);
+				m_Cost = Cost1;
+				Jacobian(X, J);
+				A = J.t()*J;
+				G = J.t()*R;
+				mu *= std::max(1./3., 1.-(2.*rho-1.)*(2.*rho-1.)*(2.*rho-1.));
+				nu = 2.;
+				bAccepted = true;
+			}
+			else
+			{
+				mu *= nu; nu *= 2.;
+			}
+		}
+		if (!bAccepted)
+		{
+			return false;
+		}
+
+		// check if terminating condition has been met
+		if (2.0*fabs(m_Cost-lastCost)<=m_MdTol*(fabs(m_Cost)+fabs(lastCost)+OPTIM_TINY))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool COptim::GaussNewton( cv::Mat_<double>& X)
+{
+	cout << "COptim::GaussNewton() ";
+	cv::Mat_<double> R, R1, J, G, D, X1;
+	double lastCost, Cost1, step;
+
+	// initialize at the starting point
+	m_nIter = 0;
+	if (!Residual(X, R))
+	{
+		cout << "Residual() is not provided. ";
+		return false;
+	}
+	m_Cost = R.dot(R);
+
+	for(m_nIter=1; m_nIter<=m_nMaxMdIter; m_nIter++)
+	{
+		Jacobian(X, J);
+		G = J.t()*R;
+		lastCost = m_Cost;
+
+		_vCosts.push_back( m_Cost );
+		_vcvmXs.push_back( X.clone() );
+		_vcvmGs.push_back( G.clone() );
+		Display();
+
+		if (G.dot(G)<=m_MinMdGrad)
+		{
+			return true;
+		}
+
+		// J'J D = -J'R, fails if J is rank deficient
+		if (!cv::solve(J.t()*J, -G, D, cv::DECOMP_CHOLESKY))
+		{
+			return false;
+		}
+		if (cv::norm(D) <= m_MdTol*(cv::norm(X)+m_MdTol))
+		{
+			return true;
+		}
+
+		// halve the step until the cost goes down
+		step = 1.;
+		Cost1 = m_Cost;
+		for (int nTry=0; nTry<m_nMaxLnIter; nTry++, step *= .5)
+		{
+			X1 = X + D.reshape(1, X.rows)*step;
+			Residual(X1, R1);
+			Cost1 = R1.dot(R1);
+			if (Cost1 < m_Cost) break;
+		}
+		if (Cost1 >= m_Cost)
+		{
+			return false;
+		}
+		X1.copyTo(X);
+		R1.copyTo(R);
+		m_Cost = Cost1;
+
+		// check if terminating condition has been met
+		if (2.0*fabs(m_Cost-lastCost)<=m_MdTol*(fabs(m_Cost)+fabs(lastCost)+OPTIM_TINY))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 bool COptim::ConjugateGradient( cv::Mat_<double>& X)
 {
 	cout << "COptim::ConjugateGradient() ";
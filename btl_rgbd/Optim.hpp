@@ -44,6 +44,8 @@ public:
 		CONJUGATE,		// conjugate	: conjugate gradient search
 		DIRECTIONSETS,	// powell		: direction set (powell's) method, no derivatives
 		GRADIENTDESCENDENT,// gradient   : gradient descendent search
+		LEVENBERGMARQUARDT,// lm		: levenberg-marquardt on the residuals, needs Residual()
+		GAUSSNEWTON,	// gn		: gauss-newton with step halving, needs Residual()
 		MAXMDALG
 	};
 
@@ -78,6 +80,10 @@ public:
 		_cvmDelta.at<double>( nIdx_, 0 ) = (fabs(dx_)>1.0e-20 ? fabs(dx_) : 1.0e-20);
 	}
 
+	// evaluate the finite-difference jacobian over the parameters in parallel, off by default.
+	// only for a Residual() that is re-entrant, i.e. keeps no state in the object
+	void setParallelJacobian(bool bParallel_) {_bParallelJacobian = bParallel_;}
+
 	// retrievers
 	inline const string& GetMdAlgName(int idx) const {return m_MdAlg_List[idx];}
 	inline const string& GetLnAlgName(int idx) const {return m_LnAlg_List[idx];}
@@ -113,6 +119,12 @@ public:
 	// override this by the gradient of the cost function
 	// default is by finite-difference
 	virtual void dFunc(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmG_ );
+	// least-squares problems override this by the residual vector, cvmR_ is a column vector
+	// default returns false, i.e. Func() is not a sum of squares and LM/GN can not be used
+	virtual bool Residual(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmR_ );
+	// override this by the analytic jacobian dR/dX, # of residuals by # of parameters
+	// default is by central finite-difference over the parameters, see setParallelJacobian()
+	virtual void Jacobian(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmJ_ );
 	// serializations
 
 protected:
@@ -120,6 +132,9 @@ protected:
 	virtual bool ConjugateGradient(cv::Mat_<double>& X);
 	virtual bool DirectionSets(cv::Mat_<double>& X);
 	virtual bool GradientDescendent(cv::Mat_<double>& X);
+	// m_Cost is R'R for the least-squares algorithms
+	virtual bool LevenbergMarquardt(cv::Mat_<double>& X);
+	virtual bool GaussNewton(cv::Mat_<double>& X);
 /**
 * @brief search for the local minimum along the direction D
 *
@@ -153,6 +168,7 @@ protected:
 
 	// for gradient calculation using finite difference
 	cv::Mat_<double> _cvmDelta;
+	bool _bParallelJacobian;
 
 	// output
 	int m_nIter;		// current number of iterations
@@ -4,9 +4,33 @@
 #include <vector>
 
 #include <algorithm>
+#include "EigenUtil.hpp"
 #include "Optim.hpp"
 #include "OptimCamPose.h"
 
+#define __dNormalWeight 10. //same as in Func()
+#define __dPlaneHuber 0.05 //on sqrt( |10*dn|^2 + dd^2 )
+#define __nPlaneGNIter 10
+
+namespace btl{ namespace utility{
+//H^+ g restricted to the eigen vectors of H above dDegenerate_*trace(H), the others are stored in peimNull_
+static int solveConstrained(const Eigen::Matrix3d& eimH_, const Eigen::Vector3d& eivG_, double dDegenerate_, Eigen::Vector3d* peivX_, Eigen::Matrix3d* peimNull_){
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eSolver(eimH_);
+	const double dThres = dDegenerate_*eimH_.trace();
+	int nNull = 0;
+	peivX_->setZero();
+	for (int i=0; i<3; i++) {
+		const Eigen::Vector3d eivV = eSolver.eigenvectors().col(i);
+		if (eSolver.eigenvalues()(i) > dThres && eSolver.eigenvalues()(i) > 0 )
+			*peivX_ += eivV*(eivV.dot(eivG_)/eSolver.eigenvalues()(i));
+		else
+			peimNull_->col(nNull++) = eivV;
+	}
+	return nNull;
+}
+}//utility
+}//btl
+
 bool btl::utility::COptimCamPose::isOK(){
 	PRINTSTR( "isOK()" );
 	//set row vector
@@ -66,7 +90,7 @@ double btl::utility::COptimCamPose::Func( const cv::Mat_<double>& cvmX_ )
 	//read R and T from _cvmX
 	cv::Mat cvmR,cvmT;
 	cv::Rodrigues(cvmX_.colRange(0,3),cvmR);
-	cvmT = _cvmX.colRange(3,6); 
+	cvmT = cvmX_.colRange(3,6); 
 
 	cv::Mat cvmSE3 = setSE3(cvmR,cvmT);//transform ref->world
 	double dE = 0;
@@ -104,3 +128,109 @@ void btl::utility::COptimCamPose::dFunc(const cv::Mat_<double>& cvmX_, cv::Mat_<
 		cvmX0.at<double>(0,i) = cvmX_.at<double>(0,i);
 	}
 }
+
+bool btl::utility::COptimCamPose::Residual(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmR_ )
+{
+	cv::Mat_<double> cvmR;
+	cv::Rodrigues(cvmX_.colRange(0,3),cvmR);
+	const double* pT = (const double*) cvmX_.data + 3;
+
+	cvmR_.create(4*_cvmPlaneCur.cols,1);
+	for (int c=0; c<_cvmPlaneCur.cols; c++) {
+		const double dW = sqrt(_cvmPlaneWeight(0,c));
+		const double dNx = _cvmPlaneCur(0,c), dNy = _cvmPlaneCur(1,c), dNz = _cvmPlaneCur(2,c);
+		//R'*n_cur
+		for (int a=0; a<3; a++)
+			cvmR_(4*c+a,0) = 10*dW*( _cvmPlaneRef(a,c) - (cvmR(0,a)*dNx + cvmR(1,a)*dNy + cvmR(2,a)*dNz) );
+		//T'*n_cur + d_cur
+		cvmR_(4*c+3,0) = dW*( _cvmPlaneRef(3,c) - (pT[0]*dNx + pT[1]*dNy + pT[2]*dNz + _cvmPlaneCur(3,c)) );
+	}
+	return true;
+}
+
+void btl::utility::COptimCamPose::Jacobian(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmJ_ )
+{
+	//cvmDR(k,3*b+a) = dR(b,a)/dX(k)
+	cv::Mat_<double> cvmR, cvmDR;
+	cv::Rodrigues(cvmX_.colRange(0,3),cvmR,cvmDR);
+
+	cvmJ_.create(4*_cvmPlaneCur.cols,6);
+	cvmJ_.setTo(0.);
+	for (int c=0; c<_cvmPlaneCur.cols; c++) {
+		const double dW = sqrt(_cvmPlaneWeight(0,c));
+		for (int a=0; a<3; a++)
+			for (int k=0; k<3; k++)
+				cvmJ_(4*c+a,k) = -10*dW*( cvmDR(k,a)*_cvmPlaneCur(0,c) + cvmDR(k,3+a)*_cvmPlaneCur(1,c) + cvmDR(k,6+a)*_cvmPlaneCur(2,c) );
+		for (int j=0; j<3; j++)
+			cvmJ_(4*c+3,3+j) = -dW*_cvmPlaneCur(j,c);
+	}
+}
+
+int btl::utility::COptimCamPose::solvePlaneToPlane(Eigen::Matrix3d* peimR_, Eigen::Vector3d* peivT_, bool bInitialise_, Eigen::Matrix<double,6,Eigen::Dynamic>* peimUnconstrained_, double dDegenerate_)
+{
+	const int nPlanes = _cvmPlaneCur.cols;
+	Eigen::Matrix3d eimR = bInitialise_? Eigen::Matrix3d::Identity() : *peimR_;
+	Eigen::Vector3d eivT = bInitialise_? Eigen::Vector3d::Zero() : *peivT_;
+	std::vector<double> vW(nPlanes);
+	for (int c=0; c<nPlanes; c++) vW[c] = _cvmPlaneWeight(0,c);
+
+	Eigen::Matrix3d eimHw, eimHt, eimNullW, eimNullT;
+	Eigen::Vector3d eivGw, eivGt, eivW, eivV;
+	int nNullW = 3, nNullT = 3;
+	for (int nIter = 0; nIter < __nPlaneGNIter; nIter++){
+		eimHw.setZero(); eimHt.setZero(); eivGw.setZero(); eivGt.setZero();
+		Eigen::Matrix3d eimM = Eigen::Matrix3d::Zero();
+		for (int c=0; c<nPlanes; c++) {
+			const Eigen::Vector3d eivN(_cvmPlaneCur(0,c),_cvmPlaneCur(1,c),_cvmPlaneCur(2,c));
+			const Eigen::Vector3d eivM(_cvmPlaneRef(0,c),_cvmPlaneRef(1,c),_cvmPlaneRef(2,c));
+			//ref plane in cur: normal a = R*m, distance e - a'T
+			const Eigen::Vector3d eivA = eimR*eivM;
+			const double dRd = _cvmPlaneCur(3,c) - _cvmPlaneRef(3,c) + eivA.dot(eivT);
+			//huber weight
+			double dW = vW[c];
+			const double dE = sqrt( __dNormalWeight*__dNormalWeight*(eivN-eivA).squaredNorm() + dRd*dRd );
+			if (dE > __dPlaneHuber) dW *= __dPlaneHuber/dE;
+			//rotation: r = n - exp(w)a, dr/dw = [a]x ; translation: r = d - e + a'(T+v), dr/dv = a'
+			eimHw += dW*(eivA.squaredNorm()*Eigen::Matrix3d::Identity() - eivA*eivA.transpose());
+			eivGw += dW*eivA.cross(eivN);
+			eimHt += dW*eivA*eivA.transpose();
+			eivGt -= dW*dRd*eivA;
+			eimM += dW*eivN*eivM.transpose();
+		}
+		nNullW = solveConstrained(eimHw,eivGw,dDegenerate_,&eivW,&eimNullW);
+		nNullT = solveConstrained(eimHt,eivGt,dDegenerate_,&eivV,&eimNullT);
+		if (bInitialise_ && nIter == 0 && nNullW == 0){
+			//closed-form rotation from the normals, min sum w|n - R*m|^2
+			Eigen::JacobiSVD<Eigen::Matrix3d> svd(eimM, Eigen::ComputeFullU | Eigen::ComputeFullV);
+			Eigen::Matrix3d eimD = Eigen::Matrix3d::Identity();
+			eimD(2,2) = (svd.matrixU()*svd.matrixV().transpose()).determinant() > 0 ? 1 : -1;
+			eimR = svd.matrixU()*eimD*svd.matrixV().transpose();
+			continue;
+		}
+		//left update on SE(3): Xc = exp(w)(R*Xr + T) + v
+		Eigen::Matrix3d eimDR;
+		setRotMatrixUsingExponentialMap(eivW(0),eivW(1),eivW(2),&eimDR);
+		eimR = eimDR*eimR;
+		eivT = eimDR*eivT + eivV;
+		if (eivW.squaredNorm() + eivV.squaredNorm() < 1e-20) break;
+	}
+
+	*peimR_ = eimR;
+	*peivT_ = eivT;
+	//keep _cvmX consistent for getRT() and Func()
+	cv::Mat_<double> cvmR(3,3), cvmRVec;
+	for (int r=0; r<3; r++) for (int c=0; c<3; c++) cvmR(r,c) = eimR(r,c);
+	cv::Rodrigues(cvmR,cvmRVec);
+	_cvmX.create(1,6);
+	for (int i=0; i<3; i++){
+		_cvmX(0,i) = ((const double*)cvmRVec.data)[i];
+		_cvmX(0,3+i) = eivT(i);
+	}
+
+	if (peimUnconstrained_){
+		peimUnconstrained_->setZero(6,nNullW+nNullT);
+		for (int i=0; i<nNullW; i++) peimUnconstrained_->block<3,1>(0,i) = eimNullW.col(i);
+		for (int i=0; i<nNullT; i++) peimUnconstrained_->block<3,1>(3,nNullW+i) = eimNullT.col(i);
+	}
+	return nNullW + nNullT;
+}
@@ -13,10 +13,21 @@ public:
 	// default is the Rosenbrock's Function
 	virtual double Func( const cv::Mat_<double>& cvmX_ );
 	virtual void  dFunc(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmG_ );
+	// least-squares form of Func(), 4 residuals per plane: 10*sqrt(w)*normal error and sqrt(w)*distance error
+	virtual bool Residual(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmR_ );
+	// analytic, through the jacobian of cv::Rodrigues()
+	virtual void Jacobian(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmJ_ );
 	//| R' 0 |
 	//| T' 1 | SE3
 	cv::Mat setSE3( const cv::Mat& cvmR_, const cv::Mat& cvmT_ );
 	void getRT(Eigen::Matrix3d* peimR_, Eigen::Vector3d* peivT_);
+	//closed-form initialisation plus gauss-newton on SE(3), independent of Go(). R and T map ref to cur, Xc = R*Xr + T, and
+	//are used as the initial guess when bInitialise_ is false. directions whose eigen value is below dDegenerate_*trace of
+	//the rotation or translation block are not updated and returned as columns [w;t] of peimUnconstrained_.
+	//returns the # of unconstrained directions, 0 when the planes fix the pose. _cvmX is set to the result.
+	int solvePlaneToPlane(Eigen::Matrix3d* peimR_, Eigen::Vector3d* peivT_, bool bInitialise_ = true,
+		Eigen::Matrix<double,6,Eigen::Dynamic>* peimUnconstrained_ = NULL, double dDegenerate_ = 1e-2);
+	//planes (n,d) with n'X + d = 0, i.e. d is the negated SPlaneObj::_dAvgPosition
 	cv::Mat_<double>	_cvmPlaneRef; //4 by # of planes
 	cv::Mat_<double>	_cvmPlaneCur; //4 by # of planes
 	cv::Mat_<double>    _cvmPlaneWeight;//1 by # of planes
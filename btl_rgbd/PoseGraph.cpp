@@ -0,0 +1,274 @@
+//boost
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+//stl
+#include <vector>
+#include <iostream>
+//eigen
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include "OtherUtil.hpp"
+#include "PoseGraph.h"
+
+namespace btl{ namespace geometry
+{
+
+struct CPoseGraph::SFactorisation{
+	Eigen::SimplicialLDLT< Eigen::SparseMatrix<double> > _eLDLT;
+};
+
+static inline Eigen::Matrix3d skew(const Eigen::Vector3d& eivV_){
+	Eigen::Matrix3d eimS;
+	eimS << 0, -eivV_(2), eivV_(1), eivV_(2), 0, -eivV_(0), -eivV_(1), eivV_(0), 0;
+	return eimS;
+}
+
+static inline Eigen::Matrix3d expSO3(const Eigen::Vector3d& eivW_){
+	const double dTheta = eivW_.norm();
+	if (dTheta < 1e-12) return Eigen::Matrix3d::Identity() + skew(eivW_);
+	return Eigen::AngleAxisd(dTheta, eivW_/dTheta).toRotationMatrix();
+}
+
+static inline Eigen::Vector3d logSO3(const Eigen::Matrix3d& eimR_){
+	Eigen::AngleAxisd eAA(eimR_);
+	return eAA.axis()*eAA.angle();
+}
+
+//adjoint of (R,T) for the twist ordering [w;v]
+static inline CPoseGraph::tp_mat6 adjoint(const Eigen::Matrix3d& eimR_, const Eigen::Vector3d& eivT_){
+	CPoseGraph::tp_mat6 eimAd;
+	eimAd.setZero();
+	eimAd.block<3,3>(0,0) = eimR_;
+	eimAd.block<3,3>(3,0) = skew(eivT_)*eimR_;
+	eimAd.block<3,3>(3,3) = eimR_;
+	return eimAd;
+}
+
+CPoseGraph::CPoseGraph(){
+	_nMaxIter = 10;
+	_dRelinearise = 1e-3;
+	_bDirty = _bStop = false;
+	_uVersion = 0;
+	_uGeneration = _uSolverGeneration = 0;
+	_bNewStructure = true;
+	_pFactorisation.reset(new SFactorisation);
+	_pMutex.reset(new boost::mutex);
+	_pSolverMutex.reset(new boost::mutex);
+	_pWakeUp.reset(new boost::condition_variable);
+}
+
+CPoseGraph::~CPoseGraph(){
+	stop();
+}
+
+int CPoseGraph::addNode(const Eigen::Matrix3f& eimRw_, const Eigen::Vector3f& eivTw_){
+	SNode sNode;
+	sNode._eimR = eimRw_.cast<double>();
+	sNode._eivT = eivTw_.cast<double>();
+	sNode._eivMoved.setZero();
+	boost::mutex::scoped_lock lock(*_pMutex);
+	_vNodes.push_back(sNode);
+	return int(_vNodes.size())-1;
+}
+
+void CPoseGraph::addEdge(int nFrom_, int nTo_, const Eigen::Matrix3f& eimR_, const Eigen::Vector3f& eivT_, float fRotWeight_ /*= 1e4f*/, float fTransWeight_ /*= 1e4f*/){
+	SEdge sEdge;
+	sEdge._nFrom = nFrom_;
+	sEdge._nTo = nTo_;
+	sEdge._eimR = eimR_.cast<double>();
+	sEdge._eivT = eivT_.cast<double>();
+	sEdge._dRotWeight = fRotWeight_;
+	sEdge._dTransWeight = fTransWeight_;
+	sEdge._bLinearised = false;
+	{
+		boost::mutex::scoped_lock lock(*_pMutex);
+		BTL_ASSERT( nFrom_ >= 0 && nTo_ >= 0 && nFrom_ < int(_vNodes.size()) && nTo_ < int(_vNodes.size()) && nFrom_ != nTo_, "CPoseGraph::addEdge() invalid nodes." );
+		_vEdges.push_back(sEdge);
+		_bDirty = true;
+	}
+	_pWakeUp->notify_one();
+}
+
+void CPoseGraph::getPose(int nNode_, Eigen::Matrix3f* peimRw_, Eigen::Vector3f* peivTw_) const{
+	boost::mutex::scoped_lock lock(*_pMutex);
+	BTL_ASSERT( nNode_ >= 0 && nNode_ < int(_vNodes.size()), "CPoseGraph::getPose() invalid node." );
+	*peimRw_ = _vNodes[nNode_]._eimR.cast<float>();
+	*peivTw_ = _vNodes[nNode_]._eivT.cast<float>();
+}
+
+int CPoseGraph::nodes() const{
+	boost::mutex::scoped_lock lock(*_pMutex);
+	return int(_vNodes.size());
+}
+
+void CPoseGraph::clear(){
+	//the solver copies belong to the solver, it drops them once it sees the new generation
+	boost::mutex::scoped_lock lock(*_pMutex);
+	_vNodes.clear(); _vEdges.clear();
+	_bDirty = false;
+	_uGeneration++;
+	_uVersion++;
+}
+
+void CPoseGraph::optimise(){
+	solve();
+}
+
+void CPoseGraph::start(){
+	if (_pSolver) return;
+	_bStop = false;
+	_pSolver.reset(new boost::thread(boost::bind(&CPoseGraph::solverLoop, this)));
+}
+
+void CPoseGraph::stop(){
+	if (!_pSolver) return;
+	{
+		boost::mutex::scoped_lock lock(*_pMutex);
+		_bStop = true;
+	}
+	_pWakeUp->notify_one();
+	_pSolver->join();
+	_pSolver.reset();
+}
+
+void CPoseGraph::solverLoop(){
+	for (;;){
+		{
+			boost::mutex::scoped_lock lock(*_pMutex);
+			while (!_bDirty && !_bStop) _pWakeUp->wait(lock);
+			if (_bStop) return;
+		}
+		solve();
+	}
+}
+
+void CPoseGraph::solve(){
+	boost::mutex::scoped_lock lockSolver(*_pSolverMutex);
+	//take over what was added since the last solve
+	{
+		boost::mutex::scoped_lock lock(*_pMutex);
+		if (_uSolverGeneration != _uGeneration){
+			//cleared since the last solve
+			_vSolverNodes.clear(); _vSolverEdges.clear();
+			_bNewStructure = true;
+			_uSolverGeneration = _uGeneration;
+		}
+		if (_vSolverNodes.size() != _vNodes.size() || _vSolverEdges.size() != _vEdges.size()) _bNewStructure = true;
+		_vSolverNodes.insert(_vSolverNodes.end(), _vNodes.begin()+_vSolverNodes.size(), _vNodes.end());
+		_vSolverEdges.insert(_vSolverEdges.end(), _vEdges.begin()+_vSolverEdges.size(), _vEdges.end());
+		_bDirty = false;
+	}
+	const size_t nSolved = _vSolverNodes.size();
+	if (nSolved < 2 || _vSolverEdges.empty()) return;
+
+	gaussNewton();
+
+	//write back, the nodes added in the meantime keep their pose relative to the last solved node
+	boost::mutex::scoped_lock lock(*_pMutex);
+	if (_uSolverGeneration != _uGeneration) return; //cleared while solving
+	const SNode& sOld = _vNodes[nSolved-1];
+	const SNode& sNew = _vSolverNodes[nSolved-1];
+	//Tk' = Tk * Told^-1 * Tnew
+	const Eigen::Matrix3d eimR = sOld._eimR.transpose()*sNew._eimR;
+	const Eigen::Vector3d eivT = sOld._eimR.transpose()*(sNew._eivT - sOld._eivT);
+	for (size_t k = nSolved; k < _vNodes.size(); k++){
+		_vNodes[k]._eivT = _vNodes[k]._eimR*eivT + _vNodes[k]._eivT;
+		_vNodes[k]._eimR = _vNodes[k]._eimR*eimR;
+	}
+	for (size_t k = 0; k < nSolved; k++){
+		_vNodes[k]._eimR = _vSolverNodes[k]._eimR;
+		_vNodes[k]._eivT = _vSolverNodes[k]._eivT;
+	}
+	_uVersion++;
+}
+
+void CPoseGraph::gaussNewton(){
+	const int nNodes = int(_vSolverNodes.size());
+	const int nVars = 6*(nNodes-1); //node 0 is fixed
+	std::vector<bool> vRelinearise(nNodes);
+	std::vector< Eigen::Triplet<double> > vTriplets;
+	vTriplets.reserve(_vSolverEdges.size()*4*36 + nVars);
+	Eigen::SparseMatrix<double> eimH(nVars,nVars);
+	Eigen::VectorXd eivB(nVars), eivDx(nVars);
+
+	for (int nIter = 0; nIter < _nMaxIter; nIter++){
+		if (_uSolverGeneration != _uGeneration) return; //cancelled by clear()
+		for (int k = 0; k < nNodes; k++){
+			vRelinearise[k] = _vSolverNodes[k]._eivMoved.norm() > _dRelinearise;
+			if (vRelinearise[k]) _vSolverNodes[k]._eivMoved.setZero();
+		}
+		vTriplets.clear();
+		eivB.setZero();
+		for (std::vector<SEdge>::iterator itEdge = _vSolverEdges.begin(); itEdge != _vSolverEdges.end(); itEdge++){
+			const SNode& sFrom = _vSolverNodes[itEdge->_nFrom];
+			const SNode& sTo = _vSolverNodes[itEdge->_nTo];
+			//E = Z^-1 * Tto * Tfrom^-1, identity when the edge is met
+			const Eigen::Matrix3d eimRzInv = itEdge->_eimR.transpose();
+			const Eigen::Vector3d eivTzInv = -eimRzInv*itEdge->_eivT;
+			const Eigen::Matrix3d eimRrel = sTo._eimR*sFrom._eimR.transpose();
+			const Eigen::Vector3d eivTrel = sTo._eivT - eimRrel*sFrom._eivT;
+			const Eigen::Matrix3d eimRE = eimRzInv*eimRrel;
+			const Eigen::Vector3d eivTE = eimRzInv*eivTrel + eivTzInv;
+			tp_vec6 eivE;
+			eivE.head<3>() = logSO3(eimRE);
+			eivE.tail<3>() = eivTE;
+			if (!itEdge->_bLinearised || vRelinearise[itEdge->_nFrom] || vRelinearise[itEdge->_nTo]){
+				//e(exp(a)E) ~ e + M*a, Tto <- exp(d)Tto gives a = Ad(Z^-1)d, Tfrom <- exp(d)Tfrom gives a = -Ad(E)d
+				tp_mat6 eimM = tp_mat6::Identity();
+				eimM.block<3,3>(3,0) = -skew(eivTE);
+				itEdge->_eimJTo = eimM*adjoint(eimRzInv,eivTzInv);
+				itEdge->_eimJFrom = -eimM*adjoint(eimRE,eivTE);
+				itEdge->_bLinearised = true;
+			}
+			const int anIdx[2] = { 6*(itEdge->_nFrom-1), 6*(itEdge->_nTo-1) };
+			const tp_mat6* apJ[2] = { &itEdge->_eimJFrom, &itEdge->_eimJTo };
+			tp_mat6 aeimJtW[2];
+			for (int a = 0; a < 2; a++){
+				aeimJtW[a] = apJ[a]->transpose();
+				aeimJtW[a].leftCols<3>() *= itEdge->_dRotWeight;
+				aeimJtW[a].rightCols<3>() *= itEdge->_dTransWeight;
+			}
+			for (int a = 0; a < 2; a++){
+				if (anIdx[a] < 0) continue;
+				eivB.segment<6>(anIdx[a]) += aeimJtW[a]*eivE;
+				for (int b = 0; b < 2; b++){
+					if (anIdx[b] < 0) continue;
+					const tp_mat6 eimHab = aeimJtW[a]*(*apJ[b]);
+					for (int r = 0; r < 6; r++) for (int c = 0; c < 6; c++)
+						vTriplets.push_back(Eigen::Triplet<double>(anIdx[a]+r,anIdx[b]+c,eimHab(r,c)));
+				}
+			}
+		}//for each edge
+		//nodes not reached by any edge stay where they are
+		for (int i = 0; i < nVars; i++) vTriplets.push_back(Eigen::Triplet<double>(i,i,1e-6));
+		eimH.setFromTriplets(vTriplets.begin(),vTriplets.end());
+
+		if (_bNewStructure){
+			_pFactorisation->_eLDLT.analyzePattern(eimH);
+			_bNewStructure = false;
+		}
+		_pFactorisation->_eLDLT.factorize(eimH);
+		if (_pFactorisation->_eLDLT.info() != Eigen::Success){
+			std::cout << "CPoseGraph: factorisation failed." << std::endl;
+			return;
+		}
+		eivDx = _pFactorisation->_eLDLT.solve(-eivB);
+
+		//left update T <- exp(dx)T
+		for (int k = 1; k < nNodes; k++){
+			const tp_vec6 eivD = eivDx.segment<6>(6*(k-1));
+			const Eigen::Matrix3d eimDR = expSO3(eivD.head<3>());
+			SNode& sNode = _vSolverNodes[k];
+			sNode._eimR = eimDR*sNode._eimR;
+			sNode._eivT = eimDR*sNode._eivT + eivD.tail<3>();
+			sNode._eivMoved += eivD;
+		}
+		if (eivDx.norm() < 1e-8) break;
+	}
+}
+
+}//geometry
+}//btl
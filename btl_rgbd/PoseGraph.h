@@ -0,0 +1,87 @@
+#ifndef BTL_GEOMETRY_POSE_GRAPH
+#define BTL_GEOMETRY_POSE_GRAPH
+
+namespace boost{ class thread; class mutex; class condition_variable; }
+
+namespace btl{ namespace geometry
+{
+
+// Pose graph over key frame poses. A node is a world to camera pose, Xc = R*Xw + T, as _eimRw/_eivTw of CKeyFrame,
+// an edge is a measured relative pose between two nodes, Xj = R*Xi + T, from tracking or from a loop closure.
+// The graph is solved by Gauss-Newton on SE(3) with a sparse Cholesky factorisation, the first node is held fixed.
+// Edges are only relinearised once one of their nodes moved by more than a threshold, and the symbolic factorisation is
+// reused until nodes or edges are added. With start() the solver runs on its own thread, so that addNode()/addEdge()
+// never wait for it; nodes added while it runs are carried along with the correction of the last solved node.
+class CPoseGraph
+{
+public:
+	typedef boost::shared_ptr<CPoseGraph> tp_shared_ptr;
+	typedef Eigen::Matrix<double,6,6,Eigen::DontAlign> tp_mat6;
+	typedef Eigen::Matrix<double,6,1,Eigen::DontAlign> tp_vec6;
+
+	CPoseGraph();
+	~CPoseGraph();
+	//returns the index of the new node
+	int addNode(const Eigen::Matrix3f& eimRw_, const Eigen::Vector3f& eivTw_);
+	//relative pose from node nFrom_ to node nTo_, the weights are the inverse variances of rotation (rad) and translation (m)
+	void addEdge(int nFrom_, int nTo_, const Eigen::Matrix3f& eimR_, const Eigen::Vector3f& eivT_, float fRotWeight_ = 1e4f, float fTransWeight_ = 1e4f);
+	void getPose(int nNode_, Eigen::Matrix3f* peimRw_, Eigen::Vector3f* peivTw_) const;
+	int nodes() const;
+	//bumped after each solve, so that callers can tell when the poses changed
+	unsigned int version() const { return _uVersion; }
+	//drops all nodes and edges without waiting for a running solve, whose result is discarded
+	void clear();
+
+	//solve on the calling thread
+	void optimise();
+	//solve on a background thread whenever edges were added
+	void start();
+	void stop();
+
+	int _nMaxIter;
+	double _dRelinearise; //minimum |dx| of a node since its last linearisation before its edges are relinearised
+
+protected:
+	struct SNode{
+		Eigen::Matrix3d _eimR;
+		Eigen::Vector3d _eivT;
+		tp_vec6 _eivMoved; //accumulated update since the edges were linearised
+	};
+	struct SEdge{
+		int _nFrom,_nTo;
+		Eigen::Matrix3d _eimR;
+		Eigen::Vector3d _eivT;
+		double _dRotWeight, _dTransWeight;
+		bool _bLinearised;
+		tp_mat6 _eimJFrom,_eimJTo; //d error / d left update of the nodes
+	};
+	//syncs new nodes and edges into the solver copies, solves, and writes the poses back
+	void solve();
+	void gaussNewton();
+	void solverLoop();
+
+	//shared with the tracking thread, guarded by _pMutex
+	std::vector<SNode> _vNodes;
+	std::vector<SEdge> _vEdges;
+	bool _bDirty;
+	bool _bStop;
+	volatile unsigned int _uVersion;
+	volatile unsigned int _uGeneration; //bumped by clear(), a solve of an older generation is cancelled
+	//owned by the solver
+	std::vector<SNode> _vSolverNodes;
+	std::vector<SEdge> _vSolverEdges;
+	bool _bNewStructure;
+	unsigned int _uSolverGeneration; //generation of the solver copies
+	struct SFactorisation;
+	boost::shared_ptr< SFactorisation > _pFactorisation; //kept for its symbolic analysis
+
+	boost::shared_ptr< boost::mutex > _pMutex;
+	boost::shared_ptr< boost::mutex > _pSolverMutex; //one solve at a time
+	boost::shared_ptr< boost::condition_variable > _pWakeUp;
+	boost::shared_ptr< boost::thread > _pSolver;
+};
+
+}//geometry
+}//btl
+
+#endif
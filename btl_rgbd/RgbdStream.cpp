@@ -0,0 +1,207 @@
+//boost
+#include <boost/shared_ptr.hpp>
+//stl
+#include <vector>
+#include <string>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+//opencv
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+//self
+#include "OtherUtil.hpp"
+#include "RgbdStream.h"
+
+namespace btl{ namespace kinect{
+
+const char SRgbdStream::_acMagic[8]      = {'B','T','L','R','G','B','D','\0'};
+const char SRgbdStream::_acIndexMagic[8] = {'B','T','L','I','N','D','X','\0'};
+
+static inline void putVarint(unsigned int uValue_, std::vector<uchar>* pvCode_){
+	while (uValue_ >= 0x80){ pvCode_->push_back(uchar(uValue_ | 0x80)); uValue_ >>= 7; }
+	pvCode_->push_back(uchar(uValue_));
+}
+static inline bool getVarint(const uchar*& pCode_, const uchar* pEnd_, unsigned int* puValue_){
+	unsigned int uValue = 0;
+	for (int nShift = 0; pCode_ < pEnd_ && nShift < 32; nShift += 7){
+		const uchar uByte = *pCode_++;
+		uValue |= (unsigned int)(uByte & 0x7f) << nShift;
+		if (!(uByte & 0x80)) { *puValue_ = uValue; return true; }
+	}
+	return false;
+}
+
+void SRgbdStream::encodeDepth(const cv::Mat& cvmDepth_, std::vector<uchar>* pvCode_){
+	BTL_ASSERT(cvmDepth_.type() == CV_16UC1, "SRgbdStream::encodeDepth() depth must be CV_16UC1");
+	pvCode_->clear();
+	pvCode_->reserve(cvmDepth_.rows*cvmDepth_.cols);
+	int nPrev = 0;
+	unsigned int uRun = 0;
+	for (int r = 0; r < cvmDepth_.rows; r++){
+		const ushort* pDepth = cvmDepth_.ptr<ushort>(r);
+		for (int c = 0; c < cvmDepth_.cols; c++){
+			const int nDelta = int(pDepth[c]) - nPrev;
+			if (0 == nDelta) { uRun++; continue; }
+			if (uRun) { pvCode_->push_back(0); putVarint(uRun,pvCode_); uRun = 0; }
+			putVarint( (unsigned int)((nDelta << 1) ^ (nDelta >> 31)), pvCode_ ); //zigzag, never 0
+			nPrev = pDepth[c];
+		}//for each col
+	}//for each row
+	if (uRun) { pvCode_->push_back(0); putVarint(uRun,pvCode_); }
+}
+
+bool SRgbdStream::decodeDepth(const uchar* pCode_, size_t sBytes_, cv::Mat* pcvmDepth_){
+	BTL_ASSERT(pcvmDepth_->type() == CV_16UC1 && pcvmDepth_->isContinuous(), "SRgbdStream::decodeDepth() depth must be continuous CV_16UC1");
+	const uchar* pEnd = pCode_ + sBytes_;
+	ushort* pDepth = (ushort*)pcvmDepth_->data;
+	ushort* const pDepthEnd = pDepth + pcvmDepth_->total();
+	int nPrev = 0;
+	unsigned int uValue;
+	while (pDepth < pDepthEnd){
+		if (!getVarint(pCode_,pEnd,&uValue)) return false;
+		if (0 == uValue){
+			if (!getVarint(pCode_,pEnd,&uValue) || uValue > (unsigned int)(pDepthEnd - pDepth)) return false;
+			std::fill(pDepth, pDepth + uValue, ushort(nPrev));
+			pDepth += uValue;
+		}
+		else{
+			nPrev += int(uValue >> 1) ^ -int(uValue & 1);
+			*pDepth++ = ushort(nPrev);
+		}
+	}
+	return pCode_ == pEnd;
+}
+
+CRgbdStreamWriter::CRgbdStreamWriter(const std::string& strPathFileName_, ushort uWidth_, ushort uHeight_, int nJpegQuality_ /*= 90*/)
+:_uWidth(uWidth_),_uHeight(uHeight_){
+	_fOut.open(strPathFileName_.c_str(),std::ios::out|std::ios::binary);
+	BTL_ASSERT(_fOut.is_open(), "CRgbdStreamWriter() cannot open the file");
+	_fOut.write(SRgbdStream::_acMagic,sizeof(SRgbdStream::_acMagic));
+	const unsigned int uVersion = SRgbdStream::_uVersion;
+	_fOut.write((const char*)&uVersion,sizeof(uVersion));
+	_fOut.write((const char*)&_uWidth,sizeof(_uWidth));
+	_fOut.write((const char*)&_uHeight,sizeof(_uHeight));
+	_vJpegParams.push_back(CV_IMWRITE_JPEG_QUALITY);
+	_vJpegParams.push_back(nJpegQuality_);
+}
+
+CRgbdStreamWriter::~CRgbdStreamWriter(){
+	close();
+}
+
+void CRgbdStreamWriter::write(const cv::Mat& cvmDepth_, const cv::Mat& cvmRGB_, unsigned long long uTimestamp_){
+	BTL_ASSERT(_fOut.is_open(), "CRgbdStreamWriter::write() the stream is closed");
+	BTL_ASSERT(cvmDepth_.rows == _uHeight && cvmDepth_.cols == _uWidth && cvmRGB_.size() == cvmDepth_.size() && cvmRGB_.type() == CV_8UC3, "CRgbdStreamWriter::write() unexpected frame size or type");
+	SRgbdStream::encodeDepth(cvmDepth_,&_vDepthCode);
+	//the channels go in and come out in the same order, no need to swap RGB to BGR
+	cv::imencode(".jpg",cvmRGB_,_vRGBCode,_vJpegParams);
+	_vIndex.push_back(std::make_pair((unsigned long long)_fOut.tellp(),uTimestamp_));
+	const unsigned int auBytes[2] = { (unsigned int)_vDepthCode.size(), (unsigned int)_vRGBCode.size() };
+	_fOut.write((const char*)&uTimestamp_,sizeof(uTimestamp_));
+	_fOut.write((const char*)auBytes,sizeof(auBytes));
+	_fOut.write((const char*)&_vDepthCode[0],auBytes[0]);
+	_fOut.write((const char*)&_vRGBCode[0],auBytes[1]);
+}
+
+void CRgbdStreamWriter::close(){
+	if (!_fOut.is_open()) return;
+	const unsigned long long uIndexOffset = _fOut.tellp();
+	for (size_t i = 0; i < _vIndex.size(); i++){
+		_fOut.write((const char*)&_vIndex[i].first,sizeof(unsigned long long));
+		_fOut.write((const char*)&_vIndex[i].second,sizeof(unsigned long long));
+	}
+	const unsigned int uFrames = frames();
+	_fOut.write((const char*)&uIndexOffset,sizeof(uIndexOffset));
+	_fOut.write((const char*)&uFrames,sizeof(uFrames));
+	_fOut.write(SRgbdStream::_acIndexMagic,sizeof(SRgbdStream::_acIndexMagic));
+	_fOut.close();
+}
+
+CRgbdStreamReader::CRgbdStreamReader(const std::string& strPathFileName_)
+:_uNext(0){
+	_fIn.open(strPathFileName_.c_str(),std::ios::in|std::ios::binary);
+	BTL_ASSERT(_fIn.is_open(), "CRgbdStreamReader() cannot open the file");
+	char acMagic[8]; unsigned int uVersion;
+	_fIn.read(acMagic,sizeof(acMagic));
+	_fIn.read((char*)&uVersion,sizeof(uVersion));
+	_fIn.read((char*)&_uWidth,sizeof(_uWidth));
+	_fIn.read((char*)&_uHeight,sizeof(_uHeight));
+	BTL_ASSERT(_fIn.good() && 0 == memcmp(acMagic,SRgbdStream::_acMagic,sizeof(acMagic)) && SRgbdStream::_uVersion == uVersion, "CRgbdStreamReader() not an rgbd stream or unsupported version");
+	const unsigned long long uFirstFrame = _fIn.tellg();
+	//footer
+	_fIn.seekg(0,std::ios::end);
+	const unsigned long long uEnd = _fIn.tellg();
+	const unsigned int uFooterBytes = sizeof(unsigned long long) + sizeof(unsigned int) + sizeof(SRgbdStream::_acIndexMagic);
+	unsigned long long uIndexOffset = 0; unsigned int uFrames = 0;
+	if (uEnd >= uFirstFrame + uFooterBytes){
+		_fIn.seekg(uEnd - uFooterBytes);
+		_fIn.read((char*)&uIndexOffset,sizeof(uIndexOffset));
+		_fIn.read((char*)&uFrames,sizeof(uFrames));
+		_fIn.read(acMagic,sizeof(acMagic));
+	}
+	if (_fIn.good() && 0 == memcmp(acMagic,SRgbdStream::_acIndexMagic,sizeof(acMagic)) && uIndexOffset + uFrames*2*sizeof(unsigned long long) + uFooterBytes == uEnd){
+		_vIndex.resize(uFrames);
+		_fIn.seekg(uIndexOffset);
+		for (unsigned int i = 0; i < uFrames; i++){
+			_fIn.read((char*)&_vIndex[i].first,sizeof(unsigned long long));
+			_fIn.read((char*)&_vIndex[i].second,sizeof(unsigned long long));
+		}
+	}
+	else{
+		_fIn.clear();
+		_fIn.seekg(uFirstFrame);
+		scan(uEnd);
+	}
+	_fIn.clear();
+	seek(0);
+}
+
+void CRgbdStreamReader::scan(unsigned long long uEnd_){
+	PRINTSTR("CRgbdStreamReader::scan() the stream has no index, rebuilding it");
+	_vIndex.clear();
+	unsigned long long uTimestamp; unsigned int auBytes[2];
+	for (;;){
+		const unsigned long long uOffset = _fIn.tellg();
+		_fIn.read((char*)&uTimestamp,sizeof(uTimestamp));
+		_fIn.read((char*)auBytes,sizeof(auBytes));
+		//a frame cut short by a crash is dropped
+		if (!_fIn.good() || uOffset + sizeof(uTimestamp) + sizeof(auBytes) + auBytes[0] + auBytes[1] > uEnd_) break;
+		_vIndex.push_back(std::make_pair(uOffset,uTimestamp));
+		_fIn.seekg(auBytes[0] + auBytes[1], std::ios::cur);
+	}
+}
+
+void CRgbdStreamReader::seek(unsigned int uFrame_){
+	_uNext = std::min<unsigned int>(uFrame_, frames());
+}
+
+void CRgbdStreamReader::seekTimestamp(unsigned long long uTimestamp_){
+	unsigned int uFrame = 0;
+	while (uFrame < frames() && _vIndex[uFrame].second < uTimestamp_) uFrame++;
+	seek(uFrame);
+}
+
+bool CRgbdStreamReader::read(cv::Mat* pcvmDepth_, cv::Mat* pcvmRGB_, unsigned long long* puTimestamp_ /*= NULL*/){
+	if (_uNext >= frames()) return false;
+	unsigned long long uTimestamp; unsigned int auBytes[2];
+	_fIn.seekg(_vIndex[_uNext++].first);
+	_fIn.read((char*)&uTimestamp,sizeof(uTimestamp));
+	_fIn.read((char*)auBytes,sizeof(auBytes));
+	_vDepthCode.resize(auBytes[0]+1);
+	_vRGBCode.resize(auBytes[1]+1);
+	_fIn.read((char*)&_vDepthCode[0],auBytes[0]);
+	_fIn.read((char*)&_vRGBCode[0],auBytes[1]);
+	BTL_ASSERT(_fIn.good(), "CRgbdStreamReader::read() truncated frame");
+	pcvmDepth_->create(_uHeight,_uWidth,CV_16UC1);
+	const bool bDepth = SRgbdStream::decodeDepth(&_vDepthCode[0],auBytes[0],pcvmDepth_);
+	BTL_ASSERT(bDepth, "CRgbdStreamReader::read() corrupted depth");
+	_vRGBCode.resize(auBytes[1]);
+	*pcvmRGB_ = cv::imdecode(_vRGBCode,CV_LOAD_IMAGE_COLOR);
+	BTL_ASSERT(!pcvmRGB_->empty() && pcvmRGB_->rows == _uHeight && pcvmRGB_->cols == _uWidth, "CRgbdStreamReader::read() corrupted rgb");
+	if (puTimestamp_) *puTimestamp_ = uTimestamp;
+	return true;
+}
+
+}//kinect
+}//btl
@@ -0,0 +1,82 @@
+#ifndef BTL_RGBD_STREAM
+#define BTL_RGBD_STREAM
+/**
+* @file RgbdStream.h
+* @brief project-native recording format: lossless delta/run-length coded 16-bit depth + JPEG RGB, 
+* a timestamp per frame and a seek index at the end of the file. Needs no device library.
+*
+* layout (host byte order)
+*   header  : magic "BTLRGBD", version, width, height
+*   frame   : timestamp, depth bytes, rgb bytes, depth code, rgb jpeg    (repeated)
+*   index   : offset and timestamp of each frame
+*   footer  : offset of the index, number of frames, magic "BTLINDX"
+*/
+
+namespace btl{ namespace kinect{
+
+struct SRgbdStream{
+	//depth is coded in raster order as the difference to the previous pixel: a non-zero difference is 
+	//zigzag mapped to an unsigned int > 0 and written as LEB128 varint, a run of zero differences as 0 
+	//followed by the varint run length.
+	static void encodeDepth(const cv::Mat& cvmDepth_, std::vector<uchar>* pvCode_); //CV_16UC1
+	//returns false if the code is corrupted; pcvmDepth_ must be allocated as CV_16UC1 of the original size
+	static bool decodeDepth(const uchar* pCode_, size_t sBytes_, cv::Mat* pcvmDepth_);
+
+	static const char _acMagic[8];
+	static const char _acIndexMagic[8];
+	static const unsigned int _uVersion = 1;
+};
+
+class CRgbdStreamWriter
+{
+public:
+	typedef boost::shared_ptr<CRgbdStreamWriter> tp_shared_ptr;
+
+	CRgbdStreamWriter(const std::string& strPathFileName_, ushort uWidth_, ushort uHeight_, int nJpegQuality_ = 90);
+	~CRgbdStreamWriter(); //close()
+	//cvmDepth_ CV_16UC1 in mm, cvmRGB_ CV_8UC3; uTimestamp_ in micro-seconds
+	void write(const cv::Mat& cvmDepth_, const cv::Mat& cvmRGB_, unsigned long long uTimestamp_);
+	//appends the seek index, the file is not seekable without it
+	void close();
+	unsigned int frames() const { return (unsigned int)_vIndex.size(); }
+
+private:
+	std::ofstream _fOut;
+	ushort _uWidth, _uHeight;
+	std::vector<int> _vJpegParams;
+	std::vector<uchar> _vDepthCode, _vRGBCode; //reused between frames
+	std::vector< std::pair<unsigned long long,unsigned long long> > _vIndex; //offset, timestamp
+};
+
+class CRgbdStreamReader
+{
+public:
+	typedef boost::shared_ptr<CRgbdStreamReader> tp_shared_ptr;
+
+	CRgbdStreamReader(const std::string& strPathFileName_);
+	ushort width() const { return _uWidth; }
+	ushort height() const { return _uHeight; }
+	unsigned int frames() const { return (unsigned int)_vIndex.size(); }
+	unsigned long long timestamp(unsigned int uFrame_) const { return _vIndex[uFrame_].second; }
+	//the frame read by the next read()
+	void seek(unsigned int uFrame_);
+	//the first frame at or after uTimestamp_
+	void seekTimestamp(unsigned long long uTimestamp_);
+	//returns false at the end of the stream
+	bool read(cv::Mat* pcvmDepth_, cv::Mat* pcvmRGB_, unsigned long long* puTimestamp_ = NULL);
+
+private:
+	//rebuilds the index of a file whose writer did not close it
+	void scan(unsigned long long uEnd_);
+
+	std::ifstream _fIn;
+	ushort _uWidth, _uHeight;
+	unsigned int _uNext;
+	std::vector<uchar> _vDepthCode, _vRGBCode;
+	std::vector< std::pair<unsigned long long,unsigned long long> > _vIndex;
+};
+
+}//kinect
+}//btl
+
+#endif
@@ -25,6 +25,7 @@
 //openni
 #include <XnCppWrapper.h>
 #include "CyclicBuffer.h"
+#include "RgbdStream.h"
 //self
 #include "Camera.h"
 #include "Utility.hpp"
@@ -36,11 +37,18 @@
 #include "SemiDenseTrackerOrb.h"
 #include "KeyFrame.h"
 #include "VideoSourceKinect.hpp"
+#include "CpuLib.h"
 #include "cuda/CudaLib.h"
 
 #include <iostream>
 #include <string>
 #include <limits>
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #ifndef CHECK_RC_
 #define CHECK_RC_(rc, what)	\
@@ -54,7 +62,7 @@ namespace btl{ namespace kinect
 
 bool VideoSourceKinect::_bIsSequenceEnds = false;
 VideoSourceKinect::VideoSourceKinect (ushort uResolution_, ushort uPyrHeight_, bool bUseNIRegistration_,const Eigen::Vector3f& eivCw_/*float fCwX_, float fCwY_, float fCwZ_*/ )
-:_bUseNIRegistration(bUseNIRegistration_),_uResolution(uResolution_),_uPyrHeight(uPyrHeight_)
+:_bUseNIRegistration(bUseNIRegistration_),_uResolution(uResolution_),_uPyrHeight(uPyrHeight_),_bRepeat(false)
 {
 	/*boost::posix_time::ptime _cT0, _cT1;
 	boost::posix_time::time_duration _cTDAll;
@@ -78,11 +86,13 @@ VideoSourceKinect::VideoSourceKinect (ushort uResolution_, ushort uPyrHeight_, b
 	// allocate memory for later use ( registrate the depth with rgb image
 	// refreshed for every frame
 	// pre-allocate cvgm to increase the speed
-	_cvgmIRWorld        .create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC3);
-	_cvgmRGBWorld       .create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC3);
-	_cvgmAlignedRawDepth.create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC1);
-	_cvgm32FC1Tmp       .create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC1);
-	_cvgmUndistDepth    .create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC1);
+	if (CKeyFrame::GPU_BACKEND == CKeyFrame::_eBackend){
+		_cvgmIRWorld        .create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC3);
+		_cvgmRGBWorld       .create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC3);
+		_cvgmAlignedRawDepth.create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC1);
+		_cvgm32FC1Tmp       .create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC1);
+		_cvgmUndistDepth    .create(__aKinectH[_uResolution], __aKinectW[_uResolution],CV_32FC1);
+	}//the host capture of CKeyFrame::CPU_BACKEND needs no device buffer
 
 	//import camera parameters
 	_pRGBCamera.reset(new btl::image::SCamera("XtionRGB.yml"/*btl::kinect::SCamera::CAMERA_RGB*/,_uResolution));
@@ -108,14 +118,16 @@ VideoSourceKinect::VideoSourceKinect (ushort uResolution_, ushort uPyrHeight_, b
 	btl::kinect::CKeyFrame::_pBroxOpticalFlow.reset(new cv::gpu::BroxOpticalFlow(80,100,0.5,3,10,5));
 
 	//
-	btl::kinect::CKeyFrame::_pcvgmPrev.reset(new cv::gpu::GpuMat(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1));
-	btl::kinect::CKeyFrame::_pcvgmCurr.reset(new cv::gpu::GpuMat(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1));
-	btl::kinect::CKeyFrame::_pcvgmU.reset(new cv::gpu::GpuMat(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1));
-	btl::kinect::CKeyFrame::_pcvgmV.reset(new cv::gpu::GpuMat(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1));
-
-	extern cv::gpu::GpuMat cvgmTest,cvgmTmp;
-	cvgmTest.create(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1);
-	cvgmTmp.create(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1);
+	if (CKeyFrame::GPU_BACKEND == CKeyFrame::_eBackend){
+		btl::kinect::CKeyFrame::_pcvgmPrev.reset(new cv::gpu::GpuMat(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1));
+		btl::kinect::CKeyFrame::_pcvgmCurr.reset(new cv::gpu::GpuMat(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1));
+		btl::kinect::CKeyFrame::_pcvgmU.reset(new cv::gpu::GpuMat(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1));
+		btl::kinect::CKeyFrame::_pcvgmV.reset(new cv::gpu::GpuMat(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1));
+
+		extern cv::gpu::GpuMat cvgmTest,cvgmTmp;
+		cvgmTest.create(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1);
+		cvgmTmp.create(btl::kinect::__aKinectH[_uResolution],btl::kinect::__aKinectW[_uResolution],CV_32FC1);
+	}
 
 	_bIsSequenceEnds = false;
 
@@ -173,7 +185,10 @@ void VideoSourceKinect::initRecorder(std::string& strPath_, ushort nTimeInSecond
 	_nMode = RECORDING;
 	PRINTSTR("Initialize RGBD data recorder...");
 	_pCyclicBuffer.reset(new CCyclicBuffer(_cContext,_cDepthGen,_cImgGen));
-	_pCyclicBuffer->Initialize(".", nTimeInSecond_);//strPath_.c_str()
+	//frames are streamed to disk while recording, nTimeInSecond_ is how far the writer may lag behind the sensor
+	//before frames get dropped. Initialize() rounds the slots up to a power of two.
+	const XnUInt32 nSlots = nTimeInSecond_ > 0 ? XnUInt32(nTimeInSecond_)*_sModeVGA.nFPS : XnUInt32(CCyclicBuffer::DEFAULT_SLOTS);
+	_pCyclicBuffer->Initialize(".", nSlots);//strPath_.c_str()
 
 	_nLastDepthTime = 0;
 	_nLastImageTime = 0;
@@ -188,6 +203,15 @@ void VideoSourceKinect::initPlayer(std::string& strPathFileName_, bool bRepeat_)
 	PRINTSTR("Initialize Player recorder...");
 	//when you need to replay the file, call this function
 	_bIsSequenceEnds = false;
+	_pStreamReader.reset();
+	if (strPathFileName_.size() > 5 && 0 == strPathFileName_.compare(strPathFileName_.size()-5, 5, ".rgbd")){
+		//native stream, no device library involved
+		_pStreamReader.reset(new CRgbdStreamReader(strPathFileName_));
+		BTL_ASSERT(_pStreamReader->width() == __aKinectW[_uResolution] && _pStreamReader->height() == __aKinectH[_uResolution], "VideoSourceKinect::initPlayer() the stream does not match the resolution");
+		_bRepeat = bRepeat_;
+		PRINTSTR(" Done.");
+		return;
+	}
 	XnStatus nRetVal = _cContext.Init(); CHECK_RC_(nRetVal, "Initialize _cContext");
 	nRetVal = _cContext.OpenFileRecording(strPathFileName_.c_str(), _cPlayer ); CHECK_RC_(nRetVal, "Open oni file");
 	_cPlayer.SetRepeat(bRepeat_);
@@ -329,7 +353,7 @@ void VideoSourceKinect::getNextFrameRecording(int* pnStatus_, float* pfTimeLeft_
 	switch (*pnStatus_&MASK_RECORDER)
 	{
 	case START_RECORDING://restart
-		_pCyclicBuffer->restart();
+		_pCyclicBuffer->start(_strDumpFileName);
 		_pCyclicBuffer->Update(_cDepthMD, _cImgMD, &*pfTimeLeft_);
 		*pnStatus_ = (*pnStatus_&(~MASK_RECORDER))|CONTINUE_RECORDING;
 		break;
@@ -341,9 +365,8 @@ void VideoSourceKinect::getNextFrameRecording(int* pnStatus_, float* pfTimeLeft_
 		_pCyclicBuffer->Update(_cDepthMD, _cImgMD, &*pfTimeLeft_);
 		break;
 	case DUMP_RECORDING://dump
-		_pCyclicBuffer->Dump(_strDumpFileName);
+		_pCyclicBuffer->stop();//the frames are on disk already, wait for the writer to drain the ring
 		*pfTimeLeft_=0;
-		_pCyclicBuffer->restart();
 		*pnStatus_ = (*pnStatus_&(~MASK_RECORDER))|STOP_RECORDING;
 		break;
 	default:
@@ -378,7 +401,9 @@ void VideoSourceKinect::getNextFrameRecording(int* pnStatus_, float* pfTimeLeft_
 	cvmRGB.copyTo(_cvmRGB);
 	cvmDep.convertTo(_cvmDepth,CV_32FC1);
 	//mail capturing function
-	if (_bUseNIRegistration)
+	if (CKeyFrame::CPU_BACKEND == CKeyFrame::_eBackend)
+		cpuBuildPyramidCVm(_fCutOffDistance);
+	else if (_bUseNIRegistration)
 		gpuBuildPyramidUseNICVm(_fCutOffDistance);
 	else
 		gpuBuildPyramidCVm();
@@ -386,8 +411,41 @@ void VideoSourceKinect::getNextFrameRecording(int* pnStatus_, float* pfTimeLeft_
     return;
 }
 
+void VideoSourceKinect::getNextFrameStream(int* pnStatus_)
+{
+	switch (*pnStatus_&MASK1)
+	{
+	case PAUSE://hold the current frame
+		if (!_cvmRawDepth.empty()) break;
+	case CONTINUE:
+		if (!_pStreamReader->read(&_cvmRawDepth,&_cvmRGB)){
+			//end of the sequence
+			if (!_bRepeat && !_cvmRawDepth.empty()) { *pnStatus_ = PAUSE; break; }
+			_pStreamReader->seek(0);
+			const bool bRead = _pStreamReader->read(&_cvmRawDepth,&_cvmRGB);
+			BTL_ASSERT(bRead, "VideoSourceKinect::getNextFrameStream() the stream is empty");
+		}
+		break;
+	default:
+		PRINTSTR("convert to the status of CONTINUE");
+		*pnStatus_ = (*pnStatus_&(~MASK1))|CONTINUE;
+		getNextFrameStream(pnStatus_);
+		return;
+	}
+	_cvmRawDepth.convertTo(_cvmDepth,CV_32FC1);
+	//mail capturing function
+	if (CKeyFrame::CPU_BACKEND == CKeyFrame::_eBackend)
+		cpuBuildPyramidCVm(_fCutOffDistance);
+	else if (_bUseNIRegistration)
+		gpuBuildPyramidUseNICVm(_fCutOffDistance);
+	else
+		gpuBuildPyramidCVm();
+	_pCurrFrame->initRT();
+}
+
 void VideoSourceKinect::getNextFrameNormal(int* pnStatus_)
 {
+	if (_pStreamReader) { getNextFrameStream(pnStatus_); return; }
 	if(_bIsSequenceEnds) { *pnStatus_ = PAUSE; _bIsSequenceEnds = false; }
 	XnStatus nRetVal = 0;
 	switch (*pnStatus_&MASK1)
@@ -415,7 +473,9 @@ void VideoSourceKinect::getNextFrameNormal(int* pnStatus_)
 	cvmRGB.copyTo(_cvmRGB);
 	cvmDep.convertTo(_cvmDepth,CV_32FC1);
 	//mail capturing function
-	if (_bUseNIRegistration)
+	if (CKeyFrame::CPU_BACKEND == CKeyFrame::_eBackend)
+		cpuBuildPyramidCVm(_fCutOffDistance);
+	else if (_bUseNIRegistration)
 		gpuBuildPyramidUseNICVm(_fCutOffDistance);
 	else
 		gpuBuildPyramidCVm();
@@ -569,6 +629,36 @@ void VideoSourceKinect::gpuBuildPyramidCVm( ){
 
 	return;
 }
+void VideoSourceKinect::cpuBuildPyramidCVm(float fCutOffDistance_){
+	//host version of gpuBuildPyramidUseNICVm() and gpuBuildPyramidCVm() for CKeyFrame::CPU_BACKEND, no device buffer is touched
+	cv::remap(_cvmRGB, *_pCurrFrame->_acvmShrPtrPyrRGBs[0], _pRGBCamera->_cvmMapX, _pRGBCamera->_cvmMapY, cv::INTER_NEAREST, cv::BORDER_CONSTANT );
+	cv::Mat& cvmDepth = *_pCurrFrame->_acvmPyrDepths[0];
+	if (_bUseNIRegistration){
+		cv::remap(_cvmDepth, _cvmUndistDepth, _pRGBCamera->_cvmMapX, _pRGBCamera->_cvmMapY, cv::INTER_NEAREST, cv::BORDER_CONSTANT );
+		//mm to m, 0 and beyond fCutOffDistance_ are invalid as in cudaDepth2Disparity2()
+		_cvmUndistDepth.convertTo(cvmDepth, CV_32FC1, .001);
+		cvmDepth.setTo(std::numeric_limits<float>::quiet_NaN(), cvmDepth <= 0.f | cvmDepth >= fCutOffDistance_);
+	}
+	else{
+		cv::remap(_cvmDepth, _cvmUndistDepth, _pIRCamera->_cvmMapX, _pIRCamera->_cvmMapY, cv::INTER_NEAREST, cv::BORDER_CONSTANT );
+		//registered with the rgb camera in m by the fused single pass
+		alignDepthWithRGB( _cvmUndistDepth, &cvmDepth );
+	}
+	//bilateral filtering, pts and nls. at the identity pose constructPyramid() leaves them in camera coordinate
+	_pCurrFrame->_eimRw.setIdentity();
+	_pCurrFrame->_eivTw.setZero();
+	_pCurrFrame->constructPyramid(_fSigmaSpace,_fSigmaDisparity);
+	_pCurrFrame->initRT();
+	//generate black and white and down-sampling
+	cv::cvtColor(*_pCurrFrame->_acvmShrPtrPyrRGBs[0],*_pCurrFrame->_acvmShrPtrPyrBWs[0],cv::COLOR_RGB2GRAY);
+	for( unsigned int i=1; i<_uPyrHeight; i++ )	{
+		cv::pyrDown(*_pCurrFrame->_acvmShrPtrPyrRGBs[i-1],*_pCurrFrame->_acvmShrPtrPyrRGBs[i]);
+		cv::cvtColor(*_pCurrFrame->_acvmShrPtrPyrRGBs[i],*_pCurrFrame->_acvmShrPtrPyrBWs[i],cv::COLOR_RGB2GRAY);
+	}
+	//scale the depth map
+	btl::cpu::scaleDepthCVmCVm(0,_pRGBCamera->_fFx,_pRGBCamera->_fFy,_pRGBCamera->_u,_pRGBCamera->_v,&*_pCurrFrame->_acvmPyrDepths[0]);
+	return;
+}
 void VideoSourceKinect::gpuAlignDepthWithRGB( const cv::gpu::GpuMat& cvgmUndistortDepth_ , cv::gpu::GpuMat* pcvgmAligned_){
 	//clean data containers
 	//unproject the depth map to IR coordinate and cudaUnprojectIRCVCV() no need to preset quiet_NaN
@@ -582,16 +672,115 @@ void VideoSourceKinect::gpuAlignDepthWithRGB( const cv::gpu::GpuMat& cvgmUndisto
 	//findRange(*pcvgmAligned_);
 	return;
 }
+//keep the nearest depth when several IR pixels land on the same RGB pixel.
+//positive floats and the quiet_NaN used as "empty" compare the same as their int bit patterns,
+//so a CAS loop on the bits is a lock-free z-buffer.
+static inline void atomicMinDepth( float* pfDepth_, float fZ_ ){
+	int nNew = *reinterpret_cast<int*>(&fZ_);
+#ifdef _MSC_VER
+	volatile long* pnDst = reinterpret_cast<volatile long*>(pfDepth_);
+	long nOld = *pnDst;
+	while( nNew < nOld ){
+		long nSeen = _InterlockedCompareExchange( pnDst, nNew, nOld );
+		if( nSeen == nOld ) break;
+		nOld = nSeen;
+	}
+#else
+	int* pnDst = reinterpret_cast<int*>(pfDepth_);
+	int nOld = *(volatile int*)pnDst;
+	while( nNew < nOld ){
+		int nSeen = __sync_val_compare_and_swap( pnDst, nOld, nNew );
+		if( nSeen == nOld ) break;
+		nOld = nSeen;
+	}
+#endif
+}
+//fused unprojectIR() + transformIR2RGB() + projectRGB(), each thread handles a band of IR rows
+class CAlignDepthWithRGB : public cv::ParallelLoopBody
+{
+public:
+	CAlignDepthWithRGB(const cv::Mat& cvmDepth_, const btl::image::SCamera& sIR_, const btl::image::SCamera& sRGB_, const float* pR_, const float* pRT_, cv::Mat* pcvmAligned_)
+	:_cvmDepth(cvmDepth_),_sIR(sIR_),_sRGB(sRGB_),_pR(pR_),_pRT(pRT_),_pcvmAligned(pcvmAligned_){}
+
+	virtual void operator()(const cv::Range& sRows_) const{
+		const int nCols = _cvmDepth.cols;
+		const float fInvFx = 1.f/_sIR._fFx;
+		for( int r = sRows_.start; r < sRows_.end; r++ ){
+			const float* pDepth = _cvmDepth.ptr<float>(r);
+			const float fY = ( r - _sIR._v ) / _sIR._fFy;
+			int c = 0;
+#if CV_SSE2
+			const __m128 m128Min = _mm_set1_ps(400.f), m128Max = _mm_set1_ps(3000.f);
+			const __m128 m128mm2m = _mm_set1_ps(.001f), m128Near = _mm_set1_ps(.4f);
+			const __m128 m128U = _mm_set1_ps(_sIR._u), m128InvFx = _mm_set1_ps(fInvFx), m128Y = _mm_set1_ps(fY);
+			const __m128 m128Idx = _mm_set_ps(3.f,2.f,1.f,0.f);
+			const __m128 m128R0 = _mm_set1_ps(_pR[0]), m128R1 = _mm_set1_ps(_pR[1]), m128R2 = _mm_set1_ps(_pR[2]);
+			const __m128 m128R3 = _mm_set1_ps(_pR[3]), m128R4 = _mm_set1_ps(_pR[4]), m128R5 = _mm_set1_ps(_pR[5]);
+			const __m128 m128R6 = _mm_set1_ps(_pR[6]), m128R7 = _mm_set1_ps(_pR[7]), m128R8 = _mm_set1_ps(_pR[8]);
+			const __m128 m128T0 = _mm_set1_ps(_pRT[0]), m128T1 = _mm_set1_ps(_pRT[1]), m128T2 = _mm_set1_ps(_pRT[2]);
+			const __m128 m128Fx = _mm_set1_ps(_sRGB._fFx), m128Fy = _mm_set1_ps(_sRGB._fFy);
+			const __m128 m128Cx = _mm_set1_ps(_sRGB._u),   m128Cy = _mm_set1_ps(_sRGB._v);
+			CV_DECL_ALIGNED(16) int anX[4], anY[4];
+			CV_DECL_ALIGNED(16) float afZ[4];
+			for( ; c <= nCols - 4; c += 4 ){
+				__m128 m128D = _mm_loadu_ps( pDepth + c );
+				__m128 m128Valid = _mm_and_ps( _mm_cmpgt_ps( m128D, m128Min ), _mm_cmplt_ps( m128D, m128Max ) );
+				if( !_mm_movemask_ps(m128Valid) ) continue;
+				//unproject IR
+				__m128 m128Z = _mm_mul_ps( m128D, m128mm2m );
+				__m128 m128X = _mm_mul_ps( _mm_mul_ps( _mm_sub_ps( _mm_add_ps( _mm_set1_ps((float)c), m128Idx ), m128U ), m128InvFx ), m128Z );
+				__m128 m128YY= _mm_mul_ps( m128Y, m128Z );
+				//IR to RGB
+				__m128 m128Xr = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(m128R0,m128X), _mm_mul_ps(m128R1,m128YY) ), _mm_mul_ps(m128R2,m128Z) ), m128T0 );
+				__m128 m128Yr = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(m128R3,m128X), _mm_mul_ps(m128R4,m128YY) ), _mm_mul_ps(m128R5,m128Z) ), m128T1 );
+				__m128 m128Zr = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps(m128R6,m128X), _mm_mul_ps(m128R7,m128YY) ), _mm_mul_ps(m128R8,m128Z) ), m128T2 );
+				m128Valid = _mm_and_ps( m128Valid, _mm_cmpgt_ps( m128Zr, m128Near ) );
+				int nMask = _mm_movemask_ps(m128Valid);
+				if( !nMask ) continue;
+				//project RGB, invalid lanes may divide by 0 but are masked out below
+				__m128 m128InvZ = _mm_div_ps( _mm_set1_ps(1.f), m128Zr );
+				_mm_store_si128( (__m128i*)anX, _mm_cvtps_epi32( _mm_add_ps( _mm_mul_ps( _mm_mul_ps( m128Fx, m128Xr ), m128InvZ ), m128Cx ) ) );
+				_mm_store_si128( (__m128i*)anY, _mm_cvtps_epi32( _mm_add_ps( _mm_mul_ps( _mm_mul_ps( m128Fy, m128Yr ), m128InvZ ), m128Cy ) ) );
+				_mm_store_ps( afZ, m128Zr );
+				for( int i = 0; i < 4; i++ ){
+					if( nMask & (1<<i) ) splat( anX[i], anY[i], afZ[i] );
+				}
+			}//for each 4 pixels
+#endif
+			for( ; c < nCols; c++ ){
+				const float fD = pDepth[c];
+				if( !( 400.f < fD && fD < 3000.f ) ) continue;
+				const float fZ = fD*.001f;
+				const float fX = ( c - _sIR._u ) * fInvFx * fZ;
+				const float fYY= fY * fZ;
+				const float fXr = _pR[0]*fX + _pR[1]*fYY + _pR[2]*fZ - _pRT[0];
+				const float fYr = _pR[3]*fX + _pR[4]*fYY + _pR[5]*fZ - _pRT[1];
+				const float fZr = _pR[6]*fX + _pR[7]*fYY + _pR[8]*fZ - _pRT[2];
+				if( fZr <= .4f ) continue;
+				splat( cvRound( _sRGB._fFx * fXr / fZr + _sRGB._u ), cvRound( _sRGB._fFy * fYr / fZr + _sRGB._v ), fZr );
+			}//for each remaining pixel
+		}//for each row
+	}
+private:
+	inline void splat( int nX_, int nY_, float fZ_ ) const{
+		if( nX_ < 0 || nX_ >= _pcvmAligned->cols || nY_ < 0 || nY_ >= _pcvmAligned->rows || fZ_ >= 3.f ) return;
+		atomicMinDepth( _pcvmAligned->ptr<float>(nY_) + nX_, fZ_ );
+	}
+	const cv::Mat& _cvmDepth;
+	const btl::image::SCamera& _sIR;
+	const btl::image::SCamera& _sRGB;
+	const float* _pR;
+	const float* _pRT;
+	cv::Mat* _pcvmAligned;
+};//class CAlignDepthWithRGB
+
 void VideoSourceKinect::alignDepthWithRGB( const cv::Mat& cvUndistortDepth_ , cv::Mat* pcvAligned_)
 {
-	// initialize the Registered depth as NULLs
-	//pcvAligned_->setTo(0);
-	//unproject the depth map to IR coordinate
-	//unprojectIR      ( cvUndistortDepth_, &_cvmIRWorld );
-	//transform from IR coordinate to RGB coordinate
-	//transformIR2RGB  ( _cvmIRWorld, &_cvmRGBWorld );
-	//project RGB coordinate to image to register the depth with rgb image
-	//projectRGB       ( _cvmRGBWorld,&(*pcvAligned_) );
+	CHECK( CV_32FC1 == cvUndistortDepth_.type() && CV_32FC1 == pcvAligned_->type(), "alignDepthWithRGB(): depth must be CV_32FC1" );
+	// initialize the registered depth as NaNs, the z-buffer keeps the nearest surface
+	pcvAligned_->setTo(std::numeric_limits<float>::quiet_NaN());
+	//unproject IR, transform to RGB and project in a single pass without intermediate buffers
+	cv::parallel_for_( cv::Range(0,cvUndistortDepth_.rows), CAlignDepthWithRGB(cvUndistortDepth_,*_pIRCamera,*_pRGBCamera,_aR,_aRT,pcvAligned_) );
 	return;
 }
 void VideoSourceKinect::unprojectIR ( const cv::Mat& cvmDepth_, cv::Mat* pcvmIRWorld_)
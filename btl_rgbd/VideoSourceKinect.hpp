@@ -14,6 +14,8 @@
 namespace btl{
 namespace kinect{
 
+class CRgbdStreamReader;
+
 
 
 
@@ -31,6 +33,7 @@ public:
     VideoSourceKinect(ushort uResolution_, ushort uPyrHeight_, bool bUseNIRegistration_,const Eigen::Vector3f& eivCw_);
     virtual ~VideoSourceKinect();
 	void initKinect();
+	//nTimeInSecond_ sizes the recording ring: how long the disk writer may lag before frames are dropped (0: ~2 s)
 	void initRecorder(std::string& strPath_, ushort nTimeInSecond_);
 	void initPlayer(std::string& strPathFileName_,bool bRepeat_);
 	// 1. need to call getNextFrame() before hand
@@ -61,6 +64,8 @@ protected:
 
 	void getNextFrameRecording( int* pnStatus_, float* pfTimeLeft_);
 	void getNextFrameNormal(int* pnStatus_);
+	//playing back a native .rgbd stream
+	void getNextFrameStream(int* pnStatus_);
 
 	void importYML();
 	// convert the depth map/ir camera to be aligned with the rgb camera
@@ -75,6 +80,8 @@ protected:
 	void buildPyramid(btl::utility::tp_coordinate_convention eConvention_ );
 	void gpuBuildPyramidCVm( );
 	void gpuBuildPyramidUseNICVm(float fCutOffDistance_);
+	//host capture of CKeyFrame::CPU_BACKEND
+	void cpuBuildPyramidCVm(float fCutOffDistance_);
 	//for debug
 	void findRange(const cv::Mat& cvmMat_);
 	void findRange(const cv::gpu::GpuMat& cvgmMat_);
@@ -150,6 +157,10 @@ protected:
 	//controlling flag
 	bool _bUseNIRegistration;
 	static bool _bIsSequenceEnds;
+	//set by initPlayer() for .rgbd files, OpenNI is not used for playing back then
+	boost::shared_ptr<CRgbdStreamReader> _pStreamReader;
+	cv::Mat _cvmRawDepth; //CV_16UC1 read from _pStreamReader
+	bool _bRepeat;
 	XnCallbackHandle _handle;
 	std::string _strDumpFileName;
 	int _nMode; 
@@ -0,0 +1,535 @@
+//gl, only the types GLUtil.h needs for KeyFrame.h
+#include <gl/glew.h>
+#include <cuda_gl_interop.h>
+//boost
+#include <boost/random.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+//stl
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <math.h>
+//opencv
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/internal.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/gpu/gpu.hpp>
+//eigen
+#include <Eigen/Core>
+//self
+#include "OtherUtil.hpp"
+#include "Converters.hpp"
+#include "EigenUtil.hpp"
+#include "Camera.h"
+//what KeyFrame.h refers to
+#include "GLUtil.h"
+#include "PlaneObj.h"
+#include "Histogram.h"
+#include "SemiDenseTracker.h"
+#include "SemiDenseTrackerOrb.h"
+#include "KeyFrame.h"
+#include "CpuLib.h"
+#include "VoxelHashGrids.h"
+
+//the marching cubes tables of MarchingCubs.cpp
+extern const int edgeTable[256];
+extern const int triTable[256][16];
+extern const int numVertsTable[256];
+
+namespace btl{ namespace geometry
+{
+
+static const float _fNaN = std::numeric_limits<float>::quiet_NaN();
+
+//the primes of Teschner et al. 2003, also used by Niessner et al. 2013
+static inline size_t hashBlock(int nX_, int nY_, int nZ_){
+	return size_t( unsigned(nX_)*73856093u ^ unsigned(nY_)*19349669u ^ unsigned(nZ_)*83492791u );
+}
+//the cell of nSide_ voxels or blocks which n_ falls in, rounding down for negative n_ as well
+static inline int floorDiv(int n_, int nSide_){
+	return n_ >= 0 ? n_/nSide_ : -1 - (-1 - n_)/nSide_;
+}
+static inline int blockOf(int nVoxel_){
+	return floorDiv(nVoxel_,CVoxelHashGrids::BLOCK_SIDE);
+}
+//floor() without the libm call, for |fX_| well within the int range
+static inline int floorInt(float fX_){
+	const int n = int(fX_);
+	return n - int(fX_ < float(n));
+}
+//n_ mod nRes_ in [0,nRes_), the place of world voxel n_ in a cyclic volume of nRes_ voxels
+static inline int wrap(int n_, int nRes_){
+	const int m = n_ % nRes_;
+	return m < 0 ? m + nRes_ : m;
+}
+static inline bool lessBlock(const cv::Point3i& sA_, const cv::Point3i& sB_){
+	return sA_.x != sB_.x ? sA_.x < sB_.x : sA_.y != sB_.y ? sA_.y < sB_.y : sA_.z < sB_.z;
+}
+
+//voxel reads through the hash, one reader per thread as it remembers the last block it looked up
+class CVoxelReader
+{
+public:
+	CVoxelReader(const CVoxelHashGrids& cGrids_)
+	:_cGrids(cGrids_),_nX(std::numeric_limits<int>::max()),_nY(0),_nZ(0),_pBlock(NULL){}
+	//NULL if the block of the voxel is not allocated
+	const short* voxel(int nX_, int nY_, int nZ_){
+		const int nBX = blockOf(nX_), nBY = blockOf(nY_), nBZ = blockOf(nZ_);
+		if (nBX != _nX || nBY != _nY || nBZ != _nZ){
+			_nX = nBX; _nY = nBY; _nZ = nBZ;
+			const int nBlock = _cGrids.findBlock(nBX,nBY,nBZ);
+			_pBlock = nBlock < 0 ? NULL : _cGrids.voxels(nBlock);
+		}
+		if (!_pBlock) return NULL;
+		const int S = CVoxelHashGrids::BLOCK_SIDE;
+		return _pBlock + 2*( ( (nZ_ - nBZ*S)*S + (nY_ - nBY*S) )*S + (nX_ - nBX*S) );
+	}
+	//false if the voxel has never been observed
+	bool tsdf(int nX_, int nY_, int nZ_, float* pfTsdf_){
+		const short* pV = voxel(nX_,nY_,nZ_);
+		if (!pV || 0 == pV[1]) return false;
+		*pfTsdf_ = pV[0]/32767.f;
+		return true;
+	}
+	//trilinear interpolation at (fX_,fY_,fZ_) in voxels, the voxel centres being at integers
+	bool interpolate(float fX_, float fY_, float fZ_, float* pfTsdf_){
+		const int nX = floorInt(fX_), nY = floorInt(fY_), nZ = floorInt(fZ_);
+		const float a = fX_ - nX, b = fY_ - nY, c = fZ_ - nZ;
+		float f[8];
+		for (int i = 0; i < 8; i++)
+			if (!tsdf( nX + (i&1), nY + (i>>1&1), nZ + (i>>2), f+i )) return false;
+		*pfTsdf_ = (1-c)*( (1-b)*( (1-a)*f[0] + a*f[1] ) + b*( (1-a)*f[2] + a*f[3] ) )
+			+ c*( (1-b)*( (1-a)*f[4] + a*f[5] ) + b*( (1-a)*f[6] + a*f[7] ) );
+		return true;
+	}
+private:
+	const CVoxelHashGrids& _cGrids;
+	int _nX, _nY, _nZ; //the cached block
+	const short* _pBlock;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//the blocks crossed by the ray of each pixel between depth - truncation and depth + truncation, walked block by block
+//as Amanatides and Woo 1987. the distances along the ray are compared with the raw depth as in the integration, so
+//that the band holds every voxel the integration can touch. sorted and made unique per row of the depth.
+class CAllocateBlocks : public cv::ParallelLoopBody
+{
+public:
+	enum { MAX_STEPS = 64 };
+	CAllocateBlocks(const cv::Mat& cvmDepth_, const float* pRw_, const float* pCw_, const float fFx_, const float fFy_, const float fU_, const float fV_,
+		const float fBlockSize_, const float fTrunc_, std::vector< std::vector<cv::Point3i> >* pvvBlocks_)
+	:_cvmDepth(cvmDepth_),_fFx(fFx_),_fFy(fFy_),_fU(fU_),_fV(fV_),_fBlockSize(fBlockSize_),_fTrunc(fTrunc_),_pvvBlocks(pvvBlocks_){
+		//pRw_ is column major, read row by row it gives Rw^T
+		for (int i = 0; i < 9; i++) _aRwTrans[i] = pRw_[i];
+		for (int i = 0; i < 3; i++) _aCw[i] = pCw_[i];
+	}
+	virtual void operator()(const cv::Range& sRows_) const{
+		const float* R = _aRwTrans;
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			std::vector<cv::Point3i>& vBlocks = (*_pvvBlocks)[r];
+			vBlocks.clear();
+			const float* pDepth = _cvmDepth.ptr<float>(r);
+			for (int c = 0; c < _cvmDepth.cols; c++){
+				const float fD = pDepth[c];
+				if (!(fD > 0.f)) continue; //NaN compares false
+				const float x = (c - _fU)/_fFx, y = (r - _fV)/_fFy;
+				const float fInvNorm = 1.f/sqrtf( x*x + y*y + 1.f );
+				const float aDir[3] = { (R[0]*x + R[1]*y + R[2])*fInvNorm, (R[3]*x + R[4]*y + R[5])*fInvNorm, (R[6]*x + R[7]*y + R[8])*fInvNorm };
+				traverse( aDir, std::max( 0.f, fD - _fTrunc ), fD + _fTrunc, &vBlocks );
+			}//for each col
+			std::sort( vBlocks.begin(), vBlocks.end(), lessBlock );
+			vBlocks.erase( std::unique( vBlocks.begin(), vBlocks.end() ), vBlocks.end() );
+		}//for each row
+	}
+private:
+	void traverse(const float* pDir_, const float fT0_, const float fT1_, std::vector<cv::Point3i>* pvBlocks_) const{
+		int anB[3], anEnd[3], anStep[3];
+		float afTMax[3], afTDelta[3];
+		for (int i = 0; i < 3; i++){
+			const float fP0 = _aCw[i] + fT0_*pDir_[i];
+			anB[i] = int(floor(fP0/_fBlockSize));
+			anEnd[i] = int(floor( (_aCw[i] + fT1_*pDir_[i])/_fBlockSize ));
+			if (pDir_[i] > 0.f){
+				anStep[i] = 1;
+				afTMax[i] = fT0_ + ( (anB[i]+1)*_fBlockSize - fP0 )/pDir_[i];
+				afTDelta[i] = _fBlockSize/pDir_[i];
+			}
+			else if (pDir_[i] < 0.f){
+				anStep[i] = -1;
+				afTMax[i] = fT0_ + ( anB[i]*_fBlockSize - fP0 )/pDir_[i];
+				afTDelta[i] = -_fBlockSize/pDir_[i];
+			}
+			else{
+				anStep[i] = 0;
+				afTMax[i] = afTDelta[i] = std::numeric_limits<float>::max();
+			}
+		}
+		for (int n = 0; n < MAX_STEPS; n++){
+			pvBlocks_->push_back( cv::Point3i(anB[0],anB[1],anB[2]) );
+			if (anB[0] == anEnd[0] && anB[1] == anEnd[1] && anB[2] == anEnd[2]) break;
+			const int k = afTMax[0] < afTMax[1] ? (afTMax[0] < afTMax[2] ? 0 : 2) : (afTMax[1] < afTMax[2] ? 1 : 2);
+			if (afTMax[k] > fT1_) break;
+			anB[k] += anStep[k];
+			afTMax[k] += afTDelta[k];
+		}
+	}
+	const cv::Mat& _cvmDepth;
+	float _aRwTrans[9], _aCw[3];
+	float _fFx, _fFy, _fU, _fV;
+	float _fBlockSize, _fTrunc;
+	std::vector< std::vector<cv::Point3i> >* _pvvBlocks;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//marches each ray through the allocated blocks, leaving an unallocated block at once. inside the blocks the step is
+//the distance the tsdf allows but at least a voxel, and the first + to - crossing is refined on the trilinear tsdf.
+//the normal is the normalised tsdf gradient, NaN where a neighbour is unobserved as in pcl::device::raycast()
+class CRaycastBlocks : public cv::ParallelLoopBody
+{
+public:
+	CRaycastBlocks(const CVoxelHashGrids& cGrids_, const float* pRw_, const float* pCw_, const float fFx_, const float fFy_, const float fU_, const float fV_,
+		cv::Mat* pcvmPts_, cv::Mat* pcvmNls_)
+	:_cGrids(cGrids_),_fFx(fFx_),_fFy(fFy_),_fU(fU_),_fV(fV_),_pcvmPts(pcvmPts_),_pcvmNls(pcvmNls_){
+		for (int i = 0; i < 9; i++) _aRwTrans[i] = pRw_[i];
+		for (int i = 0; i < 3; i++) _aCw[i] = pCw_[i];
+	}
+	virtual void operator()(const cv::Range& sRows_) const{
+		CVoxelReader cReader(_cGrids);
+		const float* R = _aRwTrans;
+		const float fS = _cGrids._fVoxelSizeM, fInvS = 1.f/fS;
+		const float fBlockSize = fS*CVoxelHashGrids::BLOCK_SIDE;
+		const float fTrunc = _cGrids._fTruncateDistanceM, fMaxRange = _cGrids._fMaxRangeM;
+		for (int r = sRows_.start; r < sRows_.end; r++){
+			float* pPt = _pcvmPts->ptr<float>(r);
+			float* pNl = _pcvmNls->ptr<float>(r);
+			for (int c = 0; c < _pcvmPts->cols; c++, pPt += 3, pNl += 3){
+				pPt[0] = pPt[1] = pPt[2] = pNl[0] = pNl[1] = pNl[2] = _fNaN;
+				const float x = (c - _fU)/_fFx, y = (r - _fV)/_fFy;
+				const float fInvNorm = 1.f/sqrtf( x*x + y*y + 1.f );
+				const float d[3] = { (R[0]*x + R[1]*y + R[2])*fInvNorm, (R[3]*x + R[4]*y + R[5])*fInvNorm, (R[6]*x + R[7]*y + R[8])*fInvNorm };
+				float fT = 0.f, fTPrev = 0.f, fPrev = 0.f;
+				bool bPrev = false;
+				while (fT < fMaxRange){
+					const float p[3] = { _aCw[0] + fT*d[0], _aCw[1] + fT*d[1], _aCw[2] + fT*d[2] };
+					const int nX = floorInt(p[0]*fInvS), nY = floorInt(p[1]*fInvS), nZ = floorInt(p[2]*fInvS);
+					const short* pV = cReader.voxel(nX,nY,nZ);
+					if (!pV){
+						//jump to where the ray leaves the block, or the whole super block if it is empty
+						int anB[3] = { blockOf(nX), blockOf(nY), blockOf(nZ) };
+						float fCell = fBlockSize;
+						const int S = CVoxelHashGrids::SUPER_SIDE;
+						if (!_cGrids.hasSuperBlock( floorDiv(anB[0],S), floorDiv(anB[1],S), floorDiv(anB[2],S) )){
+							for (int i = 0; i < 3; i++) anB[i] = floorDiv(anB[i],S);
+							fCell *= S;
+						}
+						float fExit = std::numeric_limits<float>::max();
+						for (int i = 0; i < 3; i++){
+							if (d[i] > 0.f) fExit = std::min( fExit, ( (anB[i]+1)*fCell - _aCw[i] )/d[i] );
+							else if (d[i] < 0.f) fExit = std::min( fExit, ( anB[i]*fCell - _aCw[i] )/d[i] );
+						}
+						fT = std::max( fT, fExit ) + 1e-3f*fS;
+						bPrev = false;
+						continue;
+					}
+					if (0 == pV[1]){
+						fT += fS;
+						bPrev = false;
+						continue;
+					}
+					const float f = pV[0]/32767.f;
+					if (f < 0.f){
+						if (bPrev) surface( &cReader, d, fTPrev, fPrev, fT, f, pPt, pNl );
+						break;
+					}
+					bPrev = true;
+					fPrev = f;
+					fTPrev = fT;
+					fT += std::max( fS, .8f*f*fTrunc );
+				}//along the ray
+			}//for each col
+		}//for each row
+	}
+private:
+	void surface(CVoxelReader* pReader_, const float* d, const float fT0_, const float fF0_, const float fT1_, const float fF1_, float* pPt_, float* pNl_) const{
+		const float fInvS = 1.f/_cGrids._fVoxelSizeM;
+		float fT = fT0_ + (fT1_ - fT0_)*fF0_/(fF0_ - fF1_);
+		float fA, fB;
+		if (pReader_->interpolate( (_aCw[0] + fT0_*d[0])*fInvS - .5f, (_aCw[1] + fT0_*d[1])*fInvS - .5f, (_aCw[2] + fT0_*d[2])*fInvS - .5f, &fA ) &&
+			pReader_->interpolate( (_aCw[0] + fT1_*d[0])*fInvS - .5f, (_aCw[1] + fT1_*d[1])*fInvS - .5f, (_aCw[2] + fT1_*d[2])*fInvS - .5f, &fB ) &&
+			fA > 0.f && fB < 0.f)
+			fT = fT0_ + (fT1_ - fT0_)*fA/(fA - fB);
+		for (int i = 0; i < 3; i++) pPt_[i] = _aCw[i] + fT*d[i];
+		//central differences one voxel apart
+		const float g[3] = { pPt_[0]*fInvS - .5f, pPt_[1]*fInvS - .5f, pPt_[2]*fInvS - .5f };
+		float afN[3];
+		for (int i = 0; i < 3; i++){
+			float gp[3] = { g[0], g[1], g[2] }, gm[3] = { g[0], g[1], g[2] };
+			gp[i] += 1.f; gm[i] -= 1.f;
+			if (!pReader_->interpolate( gp[0], gp[1], gp[2], &fA ) || !pReader_->interpolate( gm[0], gm[1], gm[2], &fB )) return;
+			afN[i] = fA - fB;
+		}
+		const float fNorm = sqrtf( afN[0]*afN[0] + afN[1]*afN[1] + afN[2]*afN[2] );
+		if (!(fNorm > 0.f)) return;
+		for (int i = 0; i < 3; i++) pNl_[i] = afN[i]/fNorm;
+	}
+	const CVoxelHashGrids& _cGrids;
+	float _aRwTrans[9], _aCw[3];
+	float _fFx, _fFy, _fU, _fV;
+	cv::Mat* _pcvmPts;
+	cv::Mat* _pcvmNls;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//the cells whose first corner lies in each block, with the corners, edges and tables of pcl::device::TrianglesGenerator.
+//cells with an unobserved corner are skipped. the triangles of block i go to (*pvvTriangles_)[i]
+class CMarchingCubesBlocks : public cv::ParallelLoopBody
+{
+public:
+	CMarchingCubesBlocks(const CVoxelHashGrids& cGrids_, std::vector< std::vector<Eigen::Vector3f> >* pvvTriangles_)
+	:_cGrids(cGrids_),_pvvTriangles(pvvTriangles_){}
+	virtual void operator()(const cv::Range& sBlocks_) const{
+		static const int anCorner[8][3] = { {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0}, {0,0,1}, {1,0,1}, {1,1,1}, {0,1,1} };
+		static const int anEdge[12][2] = { {0,1}, {1,2}, {2,3}, {3,0}, {4,5}, {5,6}, {6,7}, {7,4}, {0,4}, {1,5}, {2,6}, {3,7} };
+		CVoxelReader cReader(_cGrids);
+		const int S = CVoxelHashGrids::BLOCK_SIDE;
+		const float fS = _cGrids._fVoxelSizeM;
+		for (int n = sBlocks_.start; n < sBlocks_.end; n++){
+			std::vector<Eigen::Vector3f>& vTriangles = (*_pvvTriangles)[n];
+			vTriangles.clear();
+			const cv::Point3i& sB = _cGrids.blockCoordinate(n);
+			for (int z = sB.z*S; z < (sB.z+1)*S; z++)
+			for (int y = sB.y*S; y < (sB.y+1)*S; y++)
+			for (int x = sB.x*S; x < (sB.x+1)*S; x++){
+				float f[8];
+				int nCube = 0, i = 0;
+				for (; i < 8; i++){
+					if (!cReader.tsdf( x + anCorner[i][0], y + anCorner[i][1], z + anCorner[i][2], f+i )) break;
+					nCube |= int(f[i] < 0.f) << i;
+				}
+				if (i < 8 || 0 == edgeTable[nCube]) continue;
+				Eigen::Vector3f aeivVertices[12];
+				for (int e = 0; e < 12; e++){
+					if (!(edgeTable[nCube] & (1 << e))) continue;
+					const int* p0 = anCorner[anEdge[e][0]];
+					const int* p1 = anCorner[anEdge[e][1]];
+					const float f0 = f[anEdge[e][0]], f1 = f[anEdge[e][1]];
+					const float t = -f0/(f1 - f0 + 1e-15f);
+					aeivVertices[e] = Eigen::Vector3f( x + .5f + p0[0] + t*(p1[0]-p0[0]), y + .5f + p0[1] + t*(p1[1]-p0[1]), z + .5f + p0[2] + t*(p1[2]-p0[2]) )*fS;
+				}
+				for (int v = 0; v < numVertsTable[nCube]; v++)
+					vTriangles.push_back( aeivVertices[ triTable[nCube][v] ] );
+			}//for each cell
+		}//for each block
+	}
+private:
+	const CVoxelHashGrids& _cGrids;
+	std::vector< std::vector<Eigen::Vector3f> >* _pvvTriangles;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//moves the world box [_anLo,_anHi) between a cyclic dense volume, as CCubicGrids with enableRolling(), and the blocks,
+//in parallel over the z slices of the box. storing either lists the blocks holding an observed voxel of each slice or
+//copies the voxels of every allocated block, loading copies the voxels back and zeros those without a block.
+class CExchangeVolume : public cv::ParallelLoopBody
+{
+public:
+	enum { COLLECT, STORE, LOAD };
+	CExchangeVolume(int nMode_, const int* pnLo_, const int* pnHi_, CVoxelHashGrids* pGrids_, cv::Mat* pcvmVolume_, std::vector< std::vector<cv::Point3i> >* pvvBlocks_)
+	:_nMode(nMode_),_pGrids(pGrids_),_pcvmVolume(pcvmVolume_),_pvvBlocks(pvvBlocks_){
+		for (int i = 0; i < 3; i++) { _anLo[i] = pnLo_[i]; _anHi[i] = pnHi_[i]; }
+	}
+	virtual void operator()(const cv::Range& sSlices_) const{
+		const int nRes = _pcvmVolume->cols, S = CVoxelHashGrids::BLOCK_SIDE;
+		int anCached[3] = { std::numeric_limits<int>::max(), 0, 0 };
+		short* pBlock = NULL;
+		for (int z = sSlices_.start; z < sSlices_.end; z++){
+			std::vector<cv::Point3i>* pvBlocks = COLLECT == _nMode ? &(*_pvvBlocks)[z - _anLo[2]] : NULL;
+			if (pvBlocks) pvBlocks->clear();
+			for (int y = _anLo[1]; y < _anHi[1]; y++){
+				short* pRow = _pcvmVolume->ptr<short>( wrap(z,nRes)*nRes + wrap(y,nRes) );
+				for (int x = _anLo[0]; x < _anHi[0]; x++){
+					short* pV = pRow + 2*wrap(x,nRes);
+					const int nBX = blockOf(x), nBY = blockOf(y), nBZ = blockOf(z);
+					if (COLLECT == _nMode){
+						if (0 == pV[1]) continue;
+						if (pvBlocks->empty() || pvBlocks->back() != cv::Point3i(nBX,nBY,nBZ)) pvBlocks->push_back( cv::Point3i(nBX,nBY,nBZ) );
+						continue;
+					}
+					if (nBX != anCached[0] || nBY != anCached[1] || nBZ != anCached[2]){
+						anCached[0] = nBX; anCached[1] = nBY; anCached[2] = nBZ;
+						const int nBlock = _pGrids->findBlock(nBX,nBY,nBZ);
+						pBlock = nBlock < 0 ? NULL : _pGrids->voxels(nBlock);
+					}
+					short* pB = pBlock ? pBlock + 2*( ( (z - nBZ*S)*S + (y - nBY*S) )*S + (x - nBX*S) ) : NULL;
+					if (STORE == _nMode){
+						if (pB) { pB[0] = pV[0]; pB[1] = pV[1]; }
+					}
+					else{
+						pV[0] = pB ? pB[0] : 0; pV[1] = pB ? pB[1] : 0;//pack_tsdf(0.f,0)
+					}
+				}//for each x
+			}//for each y
+			if (!pvBlocks) continue;
+			std::sort( pvBlocks->begin(), pvBlocks->end(), lessBlock );
+			pvBlocks->erase( std::unique( pvBlocks->begin(), pvBlocks->end() ), pvBlocks->end() );
+		}//for each z
+	}
+private:
+	int _nMode;
+	int _anLo[3], _anHi[3];
+	CVoxelHashGrids* _pGrids;
+	cv::Mat* _pcvmVolume;
+	std::vector< std::vector<cv::Point3i> >* _pvvBlocks;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+CVoxelHashGrids::CVoxelHashGrids(float fVoxelSizeM_, float fTruncateDistanceM_)
+:_fVoxelSizeM(fVoxelSizeM_),_fTruncateDistanceM(fTruncateDistanceM_)
+{
+	_fMaxRangeM = 8.f;
+	reset();
+}
+void CVoxelHashGrids::reset(){
+	_vBlocks.clear();
+	_vuStamps.clear();
+	_vcvmPages.clear();
+	_vnBuckets.assign(INITIAL_BUCKETS,-1);
+	_vSuperBlocks.clear();
+	_vnSuperBuckets.assign(INITIAL_BUCKETS,-1);
+	_uFrame = 0;
+}
+size_t CVoxelHashGrids::memory() const{
+	return _vcvmPages.size()*BLOCKS_PER_PAGE*BLOCK_VOXELS*2*sizeof(short) + _vnBuckets.size()*sizeof(int)
+		+ _vBlocks.capacity()*sizeof(cv::Point3i) + _vuStamps.capacity()*sizeof(unsigned int)
+		+ _vnSuperBuckets.size()*sizeof(int) + _vSuperBlocks.capacity()*sizeof(cv::Point3i);
+}
+int CVoxelHashGrids::findKey(const std::vector<int>& vnBuckets_, const std::vector<cv::Point3i>& vKeys_, int nX_, int nY_, int nZ_){
+	const size_t uMask = vnBuckets_.size() - 1;
+	for (size_t h = hashBlock(nX_,nY_,nZ_) & uMask; vnBuckets_[h] >= 0; h = (h+1) & uMask){
+		const cv::Point3i& sK = vKeys_[vnBuckets_[h]];
+		if (sK.x == nX_ && sK.y == nY_ && sK.z == nZ_) return vnBuckets_[h];
+	}
+	return -1;
+}
+int CVoxelHashGrids::insertKey(std::vector<int>* pvnBuckets_, std::vector<cv::Point3i>* pvKeys_, int nX_, int nY_, int nZ_, bool* pbNew_){
+	std::vector<int>& vnBuckets = *pvnBuckets_;
+	size_t uMask = vnBuckets.size() - 1;
+	size_t h = hashBlock(nX_,nY_,nZ_) & uMask;
+	for (; vnBuckets[h] >= 0; h = (h+1) & uMask){
+		const cv::Point3i& sK = (*pvKeys_)[vnBuckets[h]];
+		if (sK.x == nX_ && sK.y == nY_ && sK.z == nZ_) { *pbNew_ = false; return vnBuckets[h]; }
+	}
+	*pbNew_ = true;
+	const int nKey = int(pvKeys_->size());
+	pvKeys_->push_back( cv::Point3i(nX_,nY_,nZ_) );
+	vnBuckets[h] = nKey;
+	//keep the load factor at most one half so that the probes stay short
+	if (2*pvKeys_->size() <= vnBuckets.size()) return nKey;
+	vnBuckets.assign(2*vnBuckets.size(),-1);
+	uMask = vnBuckets.size() - 1;
+	for (int n = 0; n < int(pvKeys_->size()); n++){
+		const cv::Point3i& sK = (*pvKeys_)[n];
+		for (h = hashBlock(sK.x,sK.y,sK.z) & uMask; vnBuckets[h] >= 0; h = (h+1) & uMask);
+		vnBuckets[h] = n;
+	}
+	return nKey;
+}
+int CVoxelHashGrids::allocateBlock(int nX_, int nY_, int nZ_){
+	bool bNew;
+	const int nBlock = insertKey(&_vnBuckets,&_vBlocks,nX_,nY_,nZ_,&bNew);
+	if (!bNew) return nBlock;
+	if (0 == nBlock % BLOCKS_PER_PAGE)
+		_vcvmPages.push_back( cv::Mat(BLOCKS_PER_PAGE,BLOCK_VOXELS,CV_16SC2,cv::Scalar::all(0)) );//pack_tsdf(0.f,0)
+	_vuStamps.push_back(0);
+	insertKey(&_vnSuperBuckets,&_vSuperBlocks,floorDiv(nX_,SUPER_SIDE),floorDiv(nY_,SUPER_SIDE),floorDiv(nZ_,SUPER_SIDE),&bNew);
+	return nBlock;
+}
+
+void CVoxelHashGrids::integrateFrame(const btl::kinect::CKeyFrame& cFrame_){
+	//the device depth is the filtered one
+	cv::Mat cvmDepth;
+	if (btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend)
+		cvmDepth = *cFrame_._acvmPyrDepths[0];
+	else
+		cFrame_._acvgmShrPtrPyrDepths[0]->download(cvmDepth);
+	const float fFx = cFrame_._pRGBCamera->_fFx, fFy = cFrame_._pRGBCamera->_fFy, u = cFrame_._pRGBCamera->_u, v = cFrame_._pRGBCamera->_v;
+	Eigen::Vector3f eivCw = - cFrame_._eimRw.transpose() *cFrame_._eivTw ; //get camera center in world coordinate
+	//allocation pass, the hash itself is only written by this thread
+	std::vector< std::vector<cv::Point3i> > vvBlocks(cvmDepth.rows);
+	cv::parallel_for_( cv::Range(0,cvmDepth.rows), CAllocateBlocks(cvmDepth,cFrame_._eimRw.data(),eivCw.data(),fFx,fFy,u,v,_fVoxelSizeM*BLOCK_SIDE,_fTruncateDistanceM,&vvBlocks) );
+	_uFrame++;
+	std::vector<int> vnTouched;
+	for (size_t r = 0; r < vvBlocks.size(); r++)
+	for (size_t i = 0; i < vvBlocks[r].size(); i++){
+		const cv::Point3i& sB = vvBlocks[r][i];
+		const int nBlock = allocateBlock(sB.x,sB.y,sB.z);
+		if (_uFrame == _vuStamps[nBlock]) continue;
+		_vuStamps[nBlock] = _uFrame;
+		vnTouched.push_back(nBlock);
+	}
+	//integration pass over the blocks of this frame
+	std::vector<short*> vpBlocks(vnTouched.size());
+	std::vector<cv::Point3i> vOrigins(vnTouched.size());
+	for (size_t i = 0; i < vnTouched.size(); i++){
+		vpBlocks[i] = voxels(vnTouched[i]);
+		vOrigins[i] = _vBlocks[vnTouched[i]]*int(BLOCK_SIDE);
+	}
+	btl::cpu::integrateTsdfBlocks(cvmDepth,0,_fVoxelSizeM,_fTruncateDistanceM,
+		cFrame_._eimRw.data(), eivCw.data(),//camera parameters,
+		fFx,fFy,u,v,vpBlocks,vOrigins,BLOCK_SIDE);
+	return;
+}
+
+void CVoxelHashGrids::storeVolume(const cv::Mat& cvmVolume_, const int* pnLo_, const int* pnHi_){
+	if (pnLo_[0] >= pnHi_[0] || pnLo_[1] >= pnHi_[1] || pnLo_[2] >= pnHi_[2]) return;
+	cv::Mat cvmVolume = cvmVolume_; //only read by the collect and store passes
+	//blocks are only allocated where the volume observed something, the hash itself is only written by this thread
+	std::vector< std::vector<cv::Point3i> > vvBlocks(pnHi_[2] - pnLo_[2]);
+	cv::parallel_for_( cv::Range(pnLo_[2],pnHi_[2]), CExchangeVolume(CExchangeVolume::COLLECT,pnLo_,pnHi_,this,&cvmVolume,&vvBlocks) );
+	for (size_t z = 0; z < vvBlocks.size(); z++)
+	for (size_t i = 0; i < vvBlocks[z].size(); i++)
+		allocateBlock(vvBlocks[z][i].x,vvBlocks[z][i].y,vvBlocks[z][i].z);
+	//the volume is newer than any block it overlaps, unobserved voxels included
+	cv::parallel_for_( cv::Range(pnLo_[2],pnHi_[2]), CExchangeVolume(CExchangeVolume::STORE,pnLo_,pnHi_,this,&cvmVolume,NULL) );
+	return;
+}
+void CVoxelHashGrids::loadVolume(const int* pnLo_, const int* pnHi_, cv::Mat* pcvmVolume_) const{
+	if (pnLo_[0] >= pnHi_[0] || pnLo_[1] >= pnHi_[1] || pnLo_[2] >= pnHi_[2]) return;
+	//the load pass only reads the blocks
+	cv::parallel_for_( cv::Range(pnLo_[2],pnHi_[2]), CExchangeVolume(CExchangeVolume::LOAD,pnLo_,pnHi_,const_cast<CVoxelHashGrids*>(this),pcvmVolume_,NULL) );
+	return;
+}
+
+void CVoxelHashGrids::raycast(btl::kinect::CKeyFrame* pFrame_) const{
+	//get VMap and NMap in world
+	Eigen::Vector3f eivCw = - pFrame_->_eimRw.transpose() * pFrame_->_eivTw ;
+	cv::parallel_for_( cv::Range(0,pFrame_->_acvmShrPtrPyrPts[0]->rows), CRaycastBlocks(*this,pFrame_->_eimRw.data(),eivCw.data(),
+		pFrame_->_pRGBCamera->_fFx,pFrame_->_pRGBCamera->_fFy,pFrame_->_pRGBCamera->_u,pFrame_->_pRGBCamera->_v,
+		&*pFrame_->_acvmShrPtrPyrPts[0],&*pFrame_->_acvmShrPtrPyrNls[0]) );
+	//down-sampling
+	for (short s=1; s<pFrame_->pyrHeight(); s++ ){
+		btl::cpu::resizeMap(false,*pFrame_->_acvmShrPtrPyrPts[s-1],&*pFrame_->_acvmShrPtrPyrPts[s]);
+		btl::cpu::resizeMap(true, *pFrame_->_acvmShrPtrPyrNls[s-1],&*pFrame_->_acvmShrPtrPyrNls[s]);
+	}//for each pyramid level
+	if (btl::kinect::CKeyFrame::CPU_BACKEND == btl::kinect::CKeyFrame::_eBackend) return;
+	for (short s=0; s<pFrame_->pyrHeight(); s++ ){
+		pFrame_->_acvgmShrPtrPyrPts[s]->upload(*pFrame_->_acvmShrPtrPyrPts[s]);
+		pFrame_->_acvgmShrPtrPyrNls[s]->upload(*pFrame_->_acvmShrPtrPyrNls[s]);
+	}
+	return;
+}
+
+unsigned int CVoxelHashGrids::marchingCubes(std::vector<Eigen::Vector3f>* pvTriangles_) const{
+	std::vector< std::vector<Eigen::Vector3f> > vvTriangles(_vBlocks.size());
+	cv::parallel_for_( cv::Range(0,int(_vBlocks.size())), CMarchingCubesBlocks(*this,&vvTriangles) );
+	size_t uTotal = 0;
+	for (size_t i = 0; i < vvTriangles.size(); i++) uTotal += vvTriangles[i].size();
+	pvTriangles_->clear();
+	pvTriangles_->reserve(uTotal);
+	for (size_t i = 0; i < vvTriangles.size(); i++) pvTriangles_->insert(pvTriangles_->end(),vvTriangles[i].begin(),vvTriangles[i].end());
+	return (unsigned int)(uTotal/3);
+}
+
+}//geometry
+}//btl
@@ -0,0 +1,72 @@
+#ifndef BTL_GEOMETRY_VOXEL_HASH_GRIDS
+#define BTL_GEOMETRY_VOXEL_HASH_GRIDS
+
+namespace btl{ namespace geometry
+{
+
+// Sparse TSDF volume for unbounded scenes. The voxels are kept in blocks of BLOCK_SIDE^3 which are only allocated where
+// a depth frame saw a surface, and found through an open addressing spatial hash on the integer block coordinates, so
+// that the memory grows with the observed surface area rather than with the cube of the extent. Voxel (x,y,z) is
+// centred at ((x,y,z)+.5)*_fVoxelSizeM in world for any integer x, y and z, and holds the same (tsdf*32767, weight)
+// pair as CCubicGrids, fused by the same update. Each step only visits allocated blocks: integrateFrame() the blocks
+// within the truncation of the current depth, raycast() skips unallocated blocks as a whole and marchingCubes() runs
+// over the allocated blocks. Rays cross empty space a super block of SUPER_SIDE^3 blocks at a time where they can.
+class CVoxelHashGrids
+{
+public:
+	typedef boost::shared_ptr<CVoxelHashGrids> tp_shared_ptr;
+	enum { BLOCK_SIDE = 8, BLOCK_VOXELS = BLOCK_SIDE*BLOCK_SIDE*BLOCK_SIDE, BLOCKS_PER_PAGE = 1024, SUPER_SIDE = 8, INITIAL_BUCKETS = 1 << 16 };
+
+	CVoxelHashGrids(float fVoxelSizeM_, float fTruncateDistanceM_);
+	void reset();
+	//allocates the blocks along the rays of the depth of level 0 within the truncation of the surface, then fuses the
+	//depth into the blocks allocated or touched by this frame only
+	void integrateFrame(const btl::kinect::CKeyFrame& cFrame_);
+	//points and normals in world of the first zero crossing along each ray from the pose of pFrame_, NaN where there is
+	//none within _fMaxRangeM; level 0 is casted and the other levels are down-sampled from it, as CCubicGrids::gpuRaycast().
+	//the host maps are uploaded to the device ones with CKeyFrame::GPU_BACKEND
+	void raycast(btl::kinect::CKeyFrame* pFrame_) const;
+	//triangle soup in world, 3 consecutive points per triangle as pcl::gpu::MarchingCubes::run(). returns the triangles
+	unsigned int marchingCubes(std::vector<Eigen::Vector3f>* pvTriangles_) const;
+	//copy the world voxels [pnLo_,pnHi_) of a cyclic dense volume, world voxel g at g mod res as with
+	//CCubicGrids::enableRolling(), into the blocks, allocating blocks only where the volume observed something.
+	//loadVolume() copies them back and zeros the voxels of the box without a block
+	void storeVolume(const cv::Mat& cvmVolume_, const int* pnLo_, const int* pnHi_);
+	void loadVolume(const int* pnLo_, const int* pnHi_, cv::Mat* pcvmVolume_) const;
+
+	//index of block (nX_,nY_,nZ_), in block units, or -1 if it is not allocated
+	int findBlock(int nX_, int nY_, int nZ_) const { return findKey(_vnBuckets,_vBlocks,nX_,nY_,nZ_); }
+	//whether super block (nX_,nY_,nZ_), in super block units, holds any allocated block
+	bool hasSuperBlock(int nX_, int nY_, int nZ_) const { return findKey(_vnSuperBuckets,_vSuperBlocks,nX_,nY_,nZ_) >= 0; }
+	short* voxels(int nBlock_) { return _vcvmPages[nBlock_/BLOCKS_PER_PAGE].ptr<short>(nBlock_%BLOCKS_PER_PAGE); }
+	const short* voxels(int nBlock_) const { return _vcvmPages[nBlock_/BLOCKS_PER_PAGE].ptr<short>(nBlock_%BLOCKS_PER_PAGE); }
+	const cv::Point3i& blockCoordinate(int nBlock_) const { return _vBlocks[nBlock_]; }
+	unsigned int blocks() const { return (unsigned int)_vBlocks.size(); }
+	//bytes held by the blocks and the hash table
+	size_t memory() const;
+
+	float _fVoxelSizeM;
+	float _fTruncateDistanceM;
+	float _fMaxRangeM; //rays are casted up to there
+
+protected:
+	//returns the index of block (nX_,nY_,nZ_), allocating it if needed
+	int allocateBlock(int nX_, int nY_, int nZ_);
+	//open addressing with linear probing over vnBuckets_, which hold indices into vKeys_ or -1 for empty
+	static int findKey(const std::vector<int>& vnBuckets_, const std::vector<cv::Point3i>& vKeys_, int nX_, int nY_, int nZ_);
+	//doubles the buckets once they are half full
+	static int insertKey(std::vector<int>* pvnBuckets_, std::vector<cv::Point3i>* pvKeys_, int nX_, int nY_, int nZ_, bool* pbNew_);
+
+	std::vector<cv::Point3i> _vBlocks; //block coordinates
+	std::vector<unsigned int> _vuStamps; //the last frame which touched each block
+	std::vector<cv::Mat> _vcvmPages; //BLOCKS_PER_PAGE x BLOCK_VOXELS CV_16SC2 each, so that the blocks never move
+	std::vector<int> _vnBuckets; //block indices, -1 for empty, the size is a power of 2 and at least twice the blocks
+	std::vector<cv::Point3i> _vSuperBlocks; //super blocks with at least one allocated block
+	std::vector<int> _vnSuperBuckets;
+	unsigned int _uFrame;
+};
+
+}//geometry
+}//btl
+
+#endif
@@ -16,6 +16,8 @@
 #include <boost/random.hpp>
 #include <boost/generator_iterator.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 //openncv
 #include <opencv2/gpu/gpumat.hpp>
@@ -34,9 +36,12 @@
 #include "SemiDenseTracker.h"
 #include "SemiDenseTrackerOrb.h"
 #include "KeyFrame.h"
+#include "KeyFramePool.h"
 #include "CyclicBuffer.h"
 #include "VideoSourceKinect.hpp"
 #include "CubicGrids.h"
+#include "PoseGraph.h"
+#include "MotionModel.h"
 #include "KinfuTracker.h"
 #define _nReserved 5
 
@@ -69,6 +74,7 @@ Eigen::Vector3f _eivCw(1.5f,1.5f,-0.3f);
 bool _bUseNIRegistration = true;
 ushort _uCubicGridResolution = 512;
 float _fVolumeSize = 3.f;
+bool _bVoxelHashing = false; //sparse volume of the same voxel size, for scenes larger than _fVolumeSize
 int _nMode = 3;//btl::kinect::VideoSourceKinect::PLAYING_BACK
 std::string _oniFileName("x.oni"); // the openni file 
 bool _bRepeat = false;// repeatedly play the sequence 
@@ -121,6 +127,7 @@ void loadFromYml(){
 	cFSRead["bUseNIRegistration"] >> _bUseNIRegistration;
 	cFSRead["uCubicGridResolution"] >> _uCubicGridResolution;
 	cFSRead["fVolumeSize"] >> _fVolumeSize;
+	cFSRead["bVoxelHashing"] >> _bVoxelHashing;
 	//rendering
 	cFSRead["bDisplayImage"] >> _bDisplayImage;
 	cFSRead["bLightOn"] >> _bLightOn;
@@ -154,6 +161,7 @@ void saveToYml(){
 	cFSWrite << "bUseNIRegistration" << _bUseNIRegistration;
 	cFSWrite << "uCubicGridResolution" << _uCubicGridResolution;
 	cFSWrite << "fVolumeSize" << _fVolumeSize;
+	cFSWrite << "bVoxelHashing" << _bVoxelHashing;
 	//rendering
 	cFSWrite << "bDisplayImage" << _pGL->_bDisplayCamera;
 	cFSWrite << "bLightOn"  << _pGL->_bEnableLighting;
@@ -233,6 +241,7 @@ void init ( ){
 	_pKFrame.reset(new btl::kinect::CKeyFrame(_pKinect->_pCurrFrame.get()));
 	//initialize the cubic grids
 	_pCubicGrids.reset( new btl::geometry::CCubicGrids(_uCubicGridResolution,_fVolumeSize) );
+	if (_bVoxelHashing) _pCubicGrids->enableVoxelHashing();
 	//initialize the tracker
 	_pTracker.reset( new btl::geometry::CKinFuTracker(_pKinect->_pCurrFrame.get(),_pCubicGrids));
 	if (!_strTrackingMethod.compare("ICP")){
@@ -255,6 +264,7 @@ void init ( ){
 	//initialize the tracker ICP
 	_pVirtualFrameWorldICP.reset(new btl::kinect::CKeyFrame(_pKinect->_pRGBCamera.get(),_uResolution,_uPyrHeight,_eivCw));	
 	_pCubicGridsICP.reset( new btl::geometry::CCubicGrids(_uCubicGridResolution,_fVolumeSize) );
+	if (_bVoxelHashing) _pCubicGridsICP->enableVoxelHashing();
 	_pTrackerICP.reset( new btl::geometry::CKinFuTracker(_pKinect->_pCurrFrame.get(),_pCubicGridsICP));
 	_pTrackerICP->setMethod(btl::geometry::CKinFuTracker::ICP);
 	_pTrackerICP->init(_pKinect->_pCurrFrame.get());
@@ -37,6 +37,8 @@
 #include <boost/random.hpp>
 #include <boost/generator_iterator.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "Utility.hpp"
@@ -54,9 +56,12 @@
 #include "SemiDenseTracker.h"
 #include "SemiDenseTrackerOrb.h"
 #include "KeyFrame.h"
+#include "KeyFramePool.h"
 #include "CyclicBuffer.h"
 #include "VideoSourceKinect.hpp"
 #include "CubicGrids.h"
+#include "PoseGraph.h"
+#include "MotionModel.h"
 #include "KinfuTracker.h"
 
 #include <QGLViewer/qglviewer.h>
@@ -4,17 +4,25 @@
 #include "../CVUtil.hpp"
 #include "../EigenUtil.hpp"
 #include "TestCuda.h"
+#include "TestKeyFrame.h"
+#include "TestRgbdStream.h"
+#include "TestVoxelHashGrids.h"
 #include <vector>
 #include <list>
+#include <algorithm>
 using namespace btl::utility;
 #include <opencv2/gpu/gpu.hpp>
 #include <gl/freeglut.h>
 #include "../Camera.h"
+#include "../BrickMesh.h"
 #include <limits>
 #include "../Optim.hpp"
+#include "../OptimCamPose.h"
+#include "../PoseGraph.h"
 #include "../cuda/pcl/internal.h"
 #include "Teapot.h"
 #include "TryCpp.h"
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 
 
@@ -142,6 +150,294 @@ void testConvert2DisparityDomain()
 	double dDiff = btl::utility::matNormL1<float>(cvDepth,cvResult);
 	PRINT( dDiff );
 }
+void testBilateralFilterInDisparity()
+{
+	PRINTSTR("test: CVUtil::bilateralFilterInDisparity() vs. the three-pass path at each pyramid level");
+	const float fSigmaSpace = 1.5f;
+	const float fSigmaDisparity = 1.f/.6f - 1.f/(.6f+0.01f);
+	//slanted plane with noise and holes
+	cv::Mat cvmDepth(480, 640, CV_32FC1);
+	cv::RNG cRNG;
+	for(int r = 0; r < cvmDepth.rows; r++ )
+	for(int c = 0; c < cvmDepth.cols; c++ ){
+		cvmDepth.at<float>(r,c) = cRNG.uniform(0.f,1.f) < 0.05f ? 0.f : 1.f + c*0.002f + (float)cRNG.gaussian(0.005);
+	}
+	cv::Mat cvmLevel = cvmDepth;
+	for(int i = 0; i < 4; i++ ){
+		cv::Mat cvmDisparity, cvmFilteredDisparity, cvmThreePass;
+		boost::posix_time::ptime cT0 = boost::posix_time::microsec_clock::local_time();
+		btl::utility::convert2DisparityDomain<float>( cvmLevel, &cvmDisparity );
+		cv::bilateralFilter(cvmDisparity, cvmFilteredDisparity, 0, fSigmaDisparity, fSigmaSpace);
+		btl::utility::convert2DepthDomain<float>( cvmFilteredDisparity, &cvmThreePass, CV_32FC1 );
+		boost::posix_time::ptime cT1 = boost::posix_time::microsec_clock::local_time();
+		cv::Mat cvmFused;
+		btl::cpu::bilateralFilteringInDisparity( cvmLevel, fSigmaSpace, fSigmaDisparity, &cvmFused );
+		boost::posix_time::ptime cT2 = boost::posix_time::microsec_clock::local_time();
+		PRINT(i);
+		PRINT( (cT1-cT0).total_microseconds() );
+		PRINT( (cT2-cT1).total_microseconds() );
+		//compare where both are valid
+		cv::Mat cvmMask = (cvmLevel > 0);
+		const double dMeanDiff = cv::norm( cvmThreePass, cvmFused, cv::NORM_L1, cvmMask )/cv::countNonZero(cvmMask);
+		PRINT( dMeanDiff );
+		//the fused filter only differs by its range table, well below the 5 mm noise
+		BTL_ASSERT( dMeanDiff < 1e-3, "testBilateralFilterInDisparity() the fused filter is off the three-pass path by more than 1 mm" );
+		cv::Mat cvmHalf;
+		btl::utility::downSampling<float>( cvmLevel, &cvmHalf );
+		cvmLevel = cvmHalf;
+	}
+}
+void testRegistrationICPSoA()
+{
+	PRINTSTR("test: btl::cpu::registrationICP() on X,Y,Z planes vs. the interleaved pts and nls");
+	const int nRows = 120, nCols = 163; //not a multiple of 4, the scalar tail is used as well
+	const float fFx = 280.f, fFy = 280.f, u = 163.f, v = 120.f;
+	cv::Mat cvmPts(nRows,nCols,CV_32FC3), cvmNls(nRows,nCols,CV_32FC3);
+	cv::RNG cRNG(3);
+	for (int r = 0; r < nRows; r++)
+	for (int c = 0; c < nCols; c++){
+		float* pPt = cvmPts.ptr<float>(r) + 3*c;
+		float* pNl = cvmNls.ptr<float>(r) + 3*c;
+		const float fZ = 1.5f + .2f*sinf(c*.05f) + cRNG.uniform(0.f,.01f);
+		pPt[0] = (c - nCols/2)*fZ/fFx*2; pPt[1] = (r - nRows/2)*fZ/fFy*2; pPt[2] = fZ;
+		const Eigen::Vector3f eivN = Eigen::Vector3f( cRNG.uniform(-.2f,.2f), cRNG.uniform(-.2f,.2f), -1.f ).normalized();
+		pNl[0] = eivN(0); pNl[1] = eivN(1); pNl[2] = eivN(2);
+		if (0 == (r*nCols + c) % 37) pPt[0] = pNl[0] = std::numeric_limits<float>::quiet_NaN();
+	}
+	cv::Mat acvmPtPlanes[3], acvmNlPlanes[3];
+	btl::cpu::splitC3( cvmPts, acvmPtPlanes );
+	btl::cpu::splitC3( cvmNls, acvmNlPlanes );
+	const Eigen::Matrix3f eimRwCur = Eigen::AngleAxisf(.02f,Eigen::Vector3f(0.f,1.f,.3f).normalized()).toRotationMatrix();
+	const Eigen::Vector3f eivTwCur(.01f,-.02f,.005f), eivTwPrev(0.f,0.f,0.f);
+	const Eigen::Matrix3f eimRwPrev = Eigen::Matrix3f::Identity();
+	double adInterleaved[27], adPlanes[27];
+	const int nInterleaved = btl::cpu::registrationICP( fFx, fFy, u, v, 1, .1f, .34f, eimRwCur.data(), eivTwCur.data(), eimRwPrev.data(), eivTwPrev.data(),
+		cvmPts, cvmNls, cvmPts, cvmNls, adInterleaved );
+	const int nPlanes = btl::cpu::registrationICP( fFx, fFy, u, v, 1, .1f, .34f, eimRwCur.data(), eivTwCur.data(), eimRwPrev.data(), eivTwPrev.data(),
+		cvmPts, cvmNls, acvmPtPlanes, acvmNlPlanes, adPlanes );
+	int nDiff = 0;
+	for (int i = 0; i < 27; i++) nDiff += adInterleaved[i] != adPlanes[i];
+	PRINT( nInterleaved );
+	BTL_ASSERT( nInterleaved > 0 && nInterleaved == nPlanes, "testRegistrationICPSoA() the two layouts find different correspondences" );
+	BTL_ASSERT( 0 == nDiff, "testRegistrationICPSoA() the two layouts give different sums" );
+}
+//the voxel update of pcl::device::tsdf23, one voxel at a time, to check the clipped and SSE paths against
+static void integrateTsdfReference( const cv::Mat& cvmDepth_, const float fVoxelSize_, const float fTrunc_, const Eigen::Matrix3f& eimRw_, const Eigen::Vector3f& eivCw_,
+	const float fFx_, const float fFy_, const float u_, const float v_, cv::Mat* pcvmVolume_ ){
+	const int nRes = pcvmVolume_->cols;
+	for (int z = 0; z < nRes; z++)
+	for (int y = 0; y < nRes; y++){
+		short* pV = pcvmVolume_->ptr<short>(z*nRes + y);
+		for (int x = 0; x < nRes; x++, pV += 2){
+			const Eigen::Vector3f eivG = Eigen::Vector3f(x + .5f, y + .5f, z + .5f)*fVoxelSize_ - eivCw_;
+			const Eigen::Vector3f eivC = eimRw_*eivG;
+			if (!(eivC(2) > 0.f)) continue;
+			const int nU = cvRound( eivC(0)*fFx_/eivC(2) + u_ ), nV = cvRound( eivC(1)*fFy_/eivC(2) + v_ );
+			if (nU < 0 || nV < 0 || nU >= cvmDepth_.cols || nV >= cvmDepth_.rows) continue;
+			const float fD = cvmDepth_.at<float>(nV,nU);
+			const float fSdf = fD - eivG.norm();
+			if (0.f == fD || fSdf < -fTrunc_) continue;
+			const float fTsdf = std::min( 1.f, fSdf/fTrunc_ );
+			const float fWeight = pV[1];
+			const float fNew = ( pV[0]/32767.f*fWeight + fTsdf )/( fWeight + 1.f );
+			pV[0] = short( std::max( -32767.f, std::min( 32767.f, fNew*32767.f ) ) );
+			pV[1] = short( std::min( fWeight + 1.f, 128.f ) );
+		}
+	}
+}
+//depth of a sphere in front of a plane, as seen from the origin of the camera
+static void renderSphere( const float fFx_, const float fFy_, const float u_, const float v_, const float fScale_, cv::Mat* pcvmDepth_ ){
+	const Eigen::Vector3f eivCentre(.1f,-.05f,1.5f);
+	for (int r = 0; r < pcvmDepth_->rows; r++)
+	for (int c = 0; c < pcvmDepth_->cols; c++){
+		const Eigen::Vector3f eivD = Eigen::Vector3f( (c - u_)/fFx_, (r - v_)/fFy_, 1.f ).normalized();
+		const float fB = eivD.dot(eivCentre), fDisc = fB*fB - eivCentre.squaredNorm() + .16f;
+		pcvmDepth_->at<float>(r,c) = fScale_*( fDisc > 0.f ? fB - sqrtf(fDisc) : 2.5f/eivD(2) );
+	}
+}
+void testIntegrateTsdfVolume()
+{
+	PRINTSTR("test: btl::cpu::integrateTsdfVolume() vs. a voxel by voxel tsdf23, plain and cyclic volume");
+	const int nRes = 128;
+	const float fVoxelSize = .02f, fTrunc = 6*fVoxelSize;
+	const float fFx = 525.f, fFy = 525.f, u = 319.5f, v = 239.5f;
+	const Eigen::Matrix3f eimRw = Eigen::AngleAxisf(.3f,Eigen::Vector3f(.2f,1.f,.1f).normalized()).toRotationMatrix();
+	const Eigen::Vector3f eivCw(1.2f,1.6f,.4f);
+	cv::Mat cvmDepth(480,640,CV_32FC1);
+	cv::Mat cvmVolume(nRes*nRes,nRes,CV_16SC2,cv::Scalar::all(0)), cvmReference(nRes*nRes,nRes,CV_16SC2,cv::Scalar::all(0));
+	//fuse twice so that the running average is checked as well
+	for (int i = 0; i < 2; i++){
+		renderSphere( fFx, fFy, u, v, 1.f + .003f*i, &cvmDepth );
+		btl::cpu::integrateTsdfVolume( cvmDepth, 0, fVoxelSize, fTrunc, eimRw.data(), eivCw.data(), fFx, fFy, u, v, &cvmVolume );
+		integrateTsdfReference( cvmDepth, fVoxelSize, fTrunc, eimRw, eivCw, fFx, fFy, u, v, &cvmReference );
+	}
+	//a voxel centre right on a pixel border may round to the other pixel, allow 1 in 10000 of the observed voxels
+	int nObserved = 0, nDiff = 0;
+	for (int r = 0; r < cvmVolume.rows; r++){
+		const short* pV = cvmVolume.ptr<short>(r);
+		const short* pRef = cvmReference.ptr<short>(r);
+		for (int x = 0; x < nRes; x++){
+			nObserved += 0 != pRef[2*x+1];
+			nDiff += abs( pV[2*x] - pRef[2*x] ) > 1 || pV[2*x+1] != pRef[2*x+1];
+		}
+	}
+	PRINT( nObserved );
+	PRINT( nDiff );
+	BTL_ASSERT( nObserved > 0 && nDiff*10000 <= nObserved, "testIntegrateTsdfVolume() the volume is off the voxel by voxel tsdf23" );
+	//the cyclic volume keeps world voxel g at g mod res
+	const int anOrigin[3] = { -40, 20, -10 };
+	cv::Mat cvmCyclic(nRes*nRes,nRes,CV_16SC2,cv::Scalar::all(0));
+	for (int i = 0; i < 2; i++){
+		renderSphere( fFx, fFy, u, v, 1.f + .003f*i, &cvmDepth );
+		btl::cpu::integrateTsdfVolume( cvmDepth, 0, fVoxelSize, fTrunc, eimRw.data(), eivCw.data(), fFx, fFy, u, v, &cvmCyclic, anOrigin );
+	}
+	int nOverlap = 0; nDiff = 0;
+	for (int z = std::max( 0, anOrigin[2] ); z < std::min( nRes, anOrigin[2] + nRes ); z++)
+	for (int y = std::max( 0, anOrigin[1] ); y < std::min( nRes, anOrigin[1] + nRes ); y++)
+	for (int x = std::max( 0, anOrigin[0] ); x < std::min( nRes, anOrigin[0] + nRes ); x++){
+		const short* pV = cvmCyclic.ptr<short>( (z % nRes)*nRes + y % nRes ) + 2*(x % nRes);
+		const short* pRef = cvmReference.ptr<short>( z*nRes + y ) + 2*x;
+		nOverlap++;
+		nDiff += abs( pV[0] - pRef[0] ) > 1 || pV[1] != pRef[1];
+	}
+	PRINT( nOverlap );
+	PRINT( nDiff );
+	BTL_ASSERT( nOverlap > 0 && nDiff*10000 <= nOverlap, "testIntegrateTsdfVolume() the cyclic volume is off the plain one" );
+}
+void testGuidedMatch()
+{
+	PRINTSTR("test: btl::cpu::guidedMatch() vs. brute force matching within the radius");
+	const cv::Size sImage(640,480);
+	const float fRadius = 15.f;
+	const int nMaxDistance = 60, nCur = 2000, nRef = 1500;
+	cv::RNG cRNG(7);
+	std::vector<cv::Point2f> vCur(nCur), vRef(nRef);
+	cv::Mat cvmCur(nCur,32,CV_8UC1), cvmRef(nRef,32,CV_8UC1);
+	cRNG.fill( cvmCur, cv::RNG::UNIFORM, 0, 256 );
+	cRNG.fill( cvmRef, cv::RNG::UNIFORM, 0, 256 );
+	for (int c = 0; c < nCur; c++) vCur[c] = cv::Point2f( cRNG.uniform(0.f,float(sImage.width)), cRNG.uniform(0.f,float(sImage.height)) );
+	//most references are a current keypoint moved a few pixels with a few bits flipped, some are not projected
+	for (int r = 0; r < nRef; r++){
+		if (cRNG.uniform(0.f,1.f) < .05f) { vRef[r] = cv::Point2f( std::numeric_limits<float>::quiet_NaN(), 0.f ); continue; }
+		const int c = cRNG.uniform(0,nCur);
+		vRef[r] = vCur[c] + cv::Point2f( cRNG.uniform(-10.f,10.f), cRNG.uniform(-10.f,10.f) );
+		if (cRNG.uniform(0.f,1.f) < .8f){
+			cvmCur.row(c).copyTo( cvmRef.row(r) );
+			for (int k = cRNG.uniform(0,40); k > 0; k--) cvmRef.at<uchar>(r,cRNG.uniform(0,32)) ^= uchar(1 << cRNG.uniform(0,8));
+		}
+	}
+	std::vector<cv::DMatch> vMatches;
+	btl::cpu::guidedMatch( vRef, cvmRef, vCur, cvmCur, sImage, fRadius, nMaxDistance, &vMatches );
+	//the nearest current descriptor within the radius of every reference, then the closest reference of every keypoint
+	std::vector<int> vClaim(nCur,-1), vBestDist(nRef,nMaxDistance+1);
+	for (int r = 0; r < nRef; r++){
+		if (vRef[r].x != vRef[r].x) continue;
+		int nBest = -1;
+		for (int c = 0; c < nCur; c++){
+			const cv::Point2f sD = vCur[c] - vRef[r];
+			if (sD.x*sD.x + sD.y*sD.y > fRadius*fRadius) continue;
+			const int nDist = int( cv::norm( cvmRef.row(r), cvmCur.row(c), cv::NORM_HAMMING ) );
+			if (nDist < vBestDist[r]) { vBestDist[r] = nDist; nBest = c; }
+		}
+		if (nBest >= 0 && (vClaim[nBest] < 0 || vBestDist[r] < vBestDist[vClaim[nBest]])) vClaim[nBest] = r;
+	}
+	int nBruteForce = 0, nDiff = 0;
+	for (int c = 0; c < nCur; c++) nBruteForce += vClaim[c] >= 0;
+	for (size_t m = 0; m < vMatches.size(); m++){
+		const int c = vMatches[m].queryIdx, r = vMatches[m].trainIdx;
+		nDiff += vClaim[c] != r || int(vMatches[m].distance) != vBestDist[r];
+	}
+	PRINT( vMatches.size() );
+	PRINT( nBruteForce );
+	PRINT( nDiff );
+	BTL_ASSERT( nBruteForce > 0 && int(vMatches.size()) == nBruteForce, "testGuidedMatch() the number of matches differs from brute force" );
+	BTL_ASSERT( 0 == nDiff, "testGuidedMatch() a match differs from brute force" );
+}
+void testAbsoluteOrientationBatch()
+{
+	PRINTSTR("test: btl::utility::absoluteOrientationBatch() vs. absoluteOrientation() of each hypothesis");
+	const int nPairs = 500, nHypo = 1023, nPerHypo = 3;
+	cv::RNG cRNG(11);
+	const Eigen::Matrix3f eimR = Eigen::AngleAxisf(.4f,Eigen::Vector3f(.3f,-1.f,.2f).normalized()).toRotationMatrix();
+	const Eigen::Vector3f eivT(.1f,-.2f,.3f);
+	Eigen::MatrixXf eimRef(3,nPairs), eimCur(3,nPairs);
+	for (int i = 0; i < nPairs; i++){
+		eimRef.col(i) = Eigen::Vector3f( cRNG.uniform(-1.f,1.f), cRNG.uniform(-1.f,1.f), cRNG.uniform(1.f,3.f) );
+		eimCur.col(i) = eimR*eimRef.col(i) + eivT + Eigen::Vector3f( float(cRNG.gaussian(.005)), float(cRNG.gaussian(.005)), float(cRNG.gaussian(.005)) );
+	}
+	//the minimal sets of the RANSAC hypotheses, the last lanes left idle
+	std::vector<int> vIdx(nHypo*nPerHypo);
+	for (size_t i = 0; i < vIdx.size(); i++) vIdx[i] = cRNG.uniform(0,nPairs);
+	std::vector<Eigen::Matrix3f> vR(nHypo);
+	std::vector<Eigen::Vector3f> vT(nHypo);
+	btl::utility::absoluteOrientationBatch<float>( eimRef, eimCur, &vIdx[0], nPerHypo, nHypo, &vR[0], &vT[0] );
+	float fMaxDiffR = 0.f, fMaxDiffT = 0.f;
+	int nSkipped = 0;
+	for (int h = 0; h < nHypo; h++){
+		Eigen::MatrixXf eimA(3,nPerHypo), eimB(3,nPerHypo);
+		for (int k = 0; k < nPerHypo; k++) { eimA.col(k) = eimRef.col(vIdx[h*nPerHypo+k]); eimB.col(k) = eimCur.col(vIdx[h*nPerHypo+k]); }
+		//a set with a repeated or nearly collinear pair has no well defined rotation
+		const Eigen::Vector3f eivAB = eimA.col(1) - eimA.col(0), eivAC = eimA.col(2) - eimA.col(0);
+		const float fArea = eivAB.cross(eivAC).norm();
+		if (fArea < .05f) { nSkipped++; continue; }
+		Eigen::Matrix3f eimRh; Eigen::Vector3f eivTh; float fScale;
+		btl::utility::absoluteOrientation<float>( eimA, eimB, false, &eimRh, &eivTh, &fScale );
+		fMaxDiffR = std::max( fMaxDiffR, (vR[h]-eimRh).cwiseAbs().maxCoeff() );
+		fMaxDiffT = std::max( fMaxDiffT, (vT[h]-eivTh).cwiseAbs().maxCoeff() );
+	}
+	PRINT( nSkipped );
+	PRINT( fMaxDiffR );
+	PRINT( fMaxDiffT );
+	//the batch finds Horn's quaternion by newton in float, the reference uses svd
+	BTL_ASSERT( nSkipped < nHypo/2, "testAbsoluteOrientationBatch() too few well conditioned hypotheses to compare" );
+	BTL_ASSERT( fMaxDiffR < 1e-2f && fMaxDiffT < 1e-2f, "testAbsoluteOrientationBatch() the batch is off absoluteOrientation()" );
+}
+//triangles as sorted lists of their corners, so that meshes are compared whatever their order and sharing
+static void sortedTriangles( const std::vector<Eigen::Vector3f>& vVertices_, const std::vector<unsigned int>& vIndices_, std::vector< std::vector<float> >* pvTriangles_ ){
+	pvTriangles_->clear();
+	for (size_t i = 0; i < vIndices_.size(); i += 3){
+		//start from the smallest corner, keeping the winding
+		int k = 0;
+		for (int j = 1; j < 3; j++) if (std::lexicographical_compare( vVertices_[vIndices_[i+j]].data(), vVertices_[vIndices_[i+j]].data()+3, vVertices_[vIndices_[i+k]].data(), vVertices_[vIndices_[i+k]].data()+3 )) k = j;
+		std::vector<float> vTriangle;
+		for (int j = 0; j < 3; j++) vTriangle.insert( vTriangle.end(), vVertices_[vIndices_[i+(k+j)%3]].data(), vVertices_[vIndices_[i+(k+j)%3]].data()+3 );
+		pvTriangles_->push_back(vTriangle);
+	}
+	std::sort( pvTriangles_->begin(), pvTriangles_->end() );
+}
+void testBrickMesh()
+{
+	PRINTSTR("test: btl::geometry::CBrickMesh re-meshing the flagged bricks vs. meshing all of them, cyclic volume");
+	const int nRes = 256, nBrick = 8, nBricks = nRes/nBrick;
+	const float fVoxelSize = .02f, fTrunc = 6*fVoxelSize;
+	const float fFx = 525.f, fFy = 525.f, u = 319.5f, v = 239.5f;
+	const int anOrigin[3] = { -50, 30, -20 };
+	cv::Mat cvmVolume(nRes*nRes,nRes,CV_16SC2,cv::Scalar::all(0)), cvmDirty(nBricks*nBricks,nBricks,CV_8UC1,cv::Scalar::all(0));
+	cv::Mat cvmDepth(480,640,CV_32FC1);
+	std::vector<cv::Mat> vcvmMinMax;
+	btl::geometry::CBrickMesh cIncremental(nBrick);
+	for (int i = 0; i < 4; i++){
+		const Eigen::Matrix3f eimRw = Eigen::AngleAxisf(.3f+.02f*i,Eigen::Vector3f(.2f,1.f,.1f).normalized()).toRotationMatrix();
+		const Eigen::Vector3f eivCw(1.2f+.02f*i,2.f,.6f);
+		renderSphere( fFx, fFy, u, v, 1.f + .002f*i, &cvmDepth );
+		btl::cpu::integrateTsdfVolume( cvmDepth, 0, fVoxelSize, fTrunc, eimRw.data(), eivCw.data(), fFx, fFy, u, v, &cvmVolume, anOrigin, &cvmDirty, nBrick );
+		btl::cpu::buildTsdfMinMaxPyramid( cvmVolume, anOrigin, nBrick, &vcvmMinMax, &cvmDirty );
+		std::vector<Eigen::Vector3f> vVertices, vAllVertices;
+		std::vector<unsigned int> vIndices, vAllIndices;
+		cIncremental.update( cvmVolume, anOrigin, fVoxelSize, vcvmMinMax[0], &cvmDirty );
+		const unsigned int uTriangles = cIncremental.mesh( &vVertices, &vIndices );
+		btl::geometry::CBrickMesh cAll(nBrick);
+		cv::Mat cvmNone(nBricks*nBricks,nBricks,CV_8UC1,cv::Scalar::all(0));
+		cAll.update( cvmVolume, anOrigin, fVoxelSize, vcvmMinMax[0], &cvmNone );
+		const unsigned int uAllTriangles = cAll.mesh( &vAllVertices, &vAllIndices );
+		std::vector< std::vector<float> > vTriangles, vAllTriangles;
+		sortedTriangles( vVertices, vIndices, &vTriangles );
+		sortedTriangles( vAllVertices, vAllIndices, &vAllTriangles );
+		PRINT( uTriangles );
+		BTL_ASSERT( uTriangles > 0 && uTriangles == uAllTriangles, "testBrickMesh() the incremental mesh has a different number of triangles" );
+		BTL_ASSERT( vVertices.size() == vAllVertices.size() && vTriangles == vAllTriangles, "testBrickMesh() the incremental mesh differs from meshing all the bricks" );
+	}
+}
 /*
 void testClearMat()
 {
@@ -188,6 +484,149 @@ void testCOptim(){
 	cOptim.setMethod( btl::utility::COptim::GRADIENTDESCENDENT );
 	cOptim.Go();
 }
+//the rosenbrock function as a sum of squares, R = ( 10(x1-x0^2), 1-x0 ), minimum at (1,1)
+class COptimRosenbrock : public btl::utility::COptim
+{
+public:
+	virtual bool isOK(){
+		_cvmX.create(2,1);
+		_cvmX(0,0) = -1.2; _cvmX(1,0) = 1.;
+		_cvmDelta.create(_cvmX.size());
+		_cvmDelta.setTo(1e-6);
+		_vCosts.clear(); _vcvmXs.clear(); _vcvmGs.clear();
+		return true;
+	}
+	virtual void Display() {}
+	virtual double Func(const cv::Mat_<double>& cvmX_){
+		cv::Mat_<double> cvmR;
+		Residual(cvmX_, cvmR);
+		return cvmR.dot(cvmR);
+	}
+	virtual bool Residual(const cv::Mat_<double>& cvmX_, cv::Mat_<double>& cvmR_ ){
+		cvmR_.create(2,1);
+		cvmR_(0,0) = 10.*( cvmX_(1,0) - cvmX_(0,0)*cvmX_(0,0) );
+		cvmR_(1,0) = 1. - cvmX_(0,0);
+		return true;
+	}
+};
+void testCOptimLeastSquares(){
+	PRINTSTR("test btl::utility::COptim LEVENBERGMARQUARDT and GAUSSNEWTON");
+	const int anMethod[2] = { btl::utility::COptim::LEVENBERGMARQUARDT, btl::utility::COptim::GAUSSNEWTON };
+	for (int m = 0; m < 2; m++)
+	for (int p = 0; p < 2; p++){
+		COptimRosenbrock cOptim;
+		cOptim.setMethod( anMethod[m] );
+		cOptim.setParallelJacobian( p == 1 );
+		cOptim.SetMdTol( 1e-12 );
+		const bool bConverged = cOptim.Go();
+		PRINT( cOptim.Iter() );
+		BTL_ASSERT( bConverged, "testCOptimLeastSquares() did not converge" );
+		BTL_ASSERT( fabs( cOptim.GetX()(0,0) - 1. ) < 1e-5 && fabs( cOptim.GetX()(1,0) - 1. ) < 1e-5 && cOptim.Cost() < 1e-10, "testCOptimLeastSquares() wrong minimum" );
+		BTL_ASSERT( cOptim.Iter() < 50, "testCOptimLeastSquares() too many iterations" );
+	}
+}
+//a known pose from four non-parallel plane pairs, then three parallel planes that fix neither the rotation about
+//their normal nor the translation along the plane
+void testSolvePlaneToPlane(){
+	PRINTSTR("test btl::utility::COptimCamPose::solvePlaneToPlane()");
+	Eigen::Matrix3d eimRTrue;
+	btl::utility::setRotMatrixUsingExponentialMap( .3, -.2, .25, &eimRTrue );
+	const Eigen::Vector3d eivTTrue( .1, -.3, .5 );
+	const double adRef[4][4] = { {0,0,1,-2.}, {1,0,0,.5}, {0,1,0,-.7}, {.6,.64,.48,-1.5} };
+	btl::utility::COptimCamPose cOpt;
+	cOpt._cvmPlaneRef.create(4,4); cOpt._cvmPlaneCur.create(4,4); cOpt._cvmPlaneWeight.create(1,4);
+	for (int c=0; c<4; c++){
+		const Eigen::Vector3d eivM( adRef[c][0], adRef[c][1], adRef[c][2] );
+		//Xc = R*Xr + T: n = R*m, d = e - n'T
+		const Eigen::Vector3d eivN = eimRTrue*eivM;
+		for (int r=0; r<3; r++) { cOpt._cvmPlaneRef(r,c) = eivM(r); cOpt._cvmPlaneCur(r,c) = eivN(r); }
+		cOpt._cvmPlaneRef(3,c) = adRef[c][3];
+		cOpt._cvmPlaneCur(3,c) = adRef[c][3] - eivN.dot(eivTTrue);
+		cOpt._cvmPlaneWeight(0,c) = 1.;
+	}
+	Eigen::Matrix3d eimR; Eigen::Vector3d eivT;
+	Eigen::Matrix<double,6,Eigen::Dynamic> eimUnconstrained;
+	int nFree = cOpt.solvePlaneToPlane( &eimR, &eivT, true, &eimUnconstrained );
+	PRINT( (eimR-eimRTrue).norm() ); PRINT( (eivT-eivTTrue).norm() );
+	BTL_ASSERT( 0 == nFree && 0 == eimUnconstrained.cols(), "testSolvePlaneToPlane() the pose is fixed by the planes" );
+	BTL_ASSERT( (eimR-eimRTrue).norm() < 1e-6 && (eivT-eivTTrue).norm() < 1e-6, "testSolvePlaneToPlane() wrong pose" );
+	//from a perturbed initial guess
+	btl::utility::setRotMatrixUsingExponentialMap( .1, .1, -.1, &eimR );
+	eimR = eimR*eimRTrue; eivT = eivTTrue + Eigen::Vector3d( .05, .05, -.05 );
+	nFree = cOpt.solvePlaneToPlane( &eimR, &eivT, false );
+	BTL_ASSERT( 0 == nFree && (eimR-eimRTrue).norm() < 1e-6 && (eivT-eivTTrue).norm() < 1e-6, "testSolvePlaneToPlane() wrong pose from an initial guess" );
+	//parallel planes: the rotation about the normal and the two in-plane translations are free
+	const Eigen::Vector3d eivM(0,0,1), eivN = eimRTrue*eivM;
+	cOpt._cvmPlaneRef.create(4,3); cOpt._cvmPlaneCur.create(4,3); cOpt._cvmPlaneWeight.create(1,3);
+	for (int c=0; c<3; c++){
+		for (int r=0; r<3; r++) { cOpt._cvmPlaneRef(r,c) = eivM(r); cOpt._cvmPlaneCur(r,c) = eivN(r); }
+		cOpt._cvmPlaneRef(3,c) = -1. - c;
+		cOpt._cvmPlaneCur(3,c) = -1. - c - eivN.dot(eivTTrue);
+		cOpt._cvmPlaneWeight(0,c) = 1.;
+	}
+	nFree = cOpt.solvePlaneToPlane( &eimR, &eivT, true, &eimUnconstrained );
+	PRINT( nFree );
+	BTL_ASSERT( 3 == nFree && 3 == eimUnconstrained.cols(), "testSolvePlaneToPlane() parallel planes must be degenerate" );
+	//the free rotation is about the normal, the free translations are orthogonal to it
+	for (int i=0; i<3; i++){
+		const Eigen::Vector3d eivW = eimUnconstrained.topRows(3).col(i), eivV = eimUnconstrained.bottomRows(3).col(i);
+		if (0 == i) {
+			BTL_ASSERT( fabs( fabs( eivW.dot(eivN) ) - 1. ) < 1e-6 && eivV.norm() < 1e-12, "testSolvePlaneToPlane() wrong free rotation" );
+		}
+		else {
+			BTL_ASSERT( fabs( eivV.dot(eivN) ) < 1e-6 && fabs( eivV.norm() - 1. ) < 1e-6 && eivW.norm() < 1e-12, "testSolvePlaneToPlane() wrong free translation" );
+		}
+	}
+	//the constrained part is still recovered
+	BTL_ASSERT( (eimR*eivM - eivN).norm() < 1e-6 && fabs( eivN.dot(eivT) - eivN.dot(eivTTrue) ) < 1e-6, "testSolvePlaneToPlane() wrong constrained part" );
+}
+void testPoseGraphSquareLoop(){
+	PRINTSTR("test btl::geometry::CPoseGraph on a square loop with drift");
+	//16 key frames 0.5 m apart round a 2 x 2 m square, turning 90 degrees about y at each corner. node 16 is back at node 0
+	const int nNodes = 17;
+	std::vector<Eigen::Matrix3f> veimRTrue(nNodes); std::vector<Eigen::Vector3f> veivTTrue(nNodes);
+	for (int k=0; k<nNodes; k++){
+		const int nSide = (k/4)%4, nStep = k%4;
+		const Eigen::Vector3f aeivCorner[4] = { Eigen::Vector3f(0,0,0), Eigen::Vector3f(2,0,0), Eigen::Vector3f(2,0,2), Eigen::Vector3f(0,0,2) };
+		const Eigen::Vector3f eivC = aeivCorner[nSide] + (aeivCorner[(nSide+1)%4]-aeivCorner[nSide])*(nStep/4.f);
+		//Xc = R*Xw + T
+		veimRTrue[k] = Eigen::AngleAxisf( 1.5707963f*nSide, Eigen::Vector3f::UnitY() ).toRotationMatrix();
+		veivTTrue[k] = -veimRTrue[k]*eivC;
+	}
+	//odometry with a biased rotation and translation, chained into the initial poses as a tracker would
+	const Eigen::Matrix3f eimRBias = Eigen::AngleAxisf( .01f, Eigen::Vector3f(.2f,1,.1f).normalized() ).toRotationMatrix();
+	const Eigen::Vector3f eivTBias(.01f,-.005f,.008f);
+	btl::geometry::CPoseGraph cGraph;
+	std::vector<Eigen::Matrix3f> veimR(nNodes); std::vector<Eigen::Vector3f> veivT(nNodes);
+	veimR[0] = veimRTrue[0]; veivT[0] = veivTTrue[0];
+	cGraph.addNode(veimR[0],veivT[0]);
+	for (int k=1; k<nNodes; k++){
+		//Xk = R*Xk-1 + T
+		const Eigen::Matrix3f eimR = eimRBias*veimRTrue[k]*veimRTrue[k-1].transpose();
+		const Eigen::Vector3f eivT = veivTTrue[k] - veimRTrue[k]*veimRTrue[k-1].transpose()*veivTTrue[k-1] + eivTBias;
+		veimR[k] = eimR*veimR[k-1]; veivT[k] = eimR*veivT[k-1] + eivT;
+		cGraph.addNode(veimR[k],veivT[k]);
+		cGraph.addEdge(k-1,k,eimR,eivT);
+	}
+	float fDriftBefore = 0.f;
+	for (int k=0; k<nNodes; k++) fDriftBefore = std::max( fDriftBefore, (veimR[k].transpose()*veivT[k] - veimRTrue[k].transpose()*veivTTrue[k]).norm() );
+	//the revisit: node 16 sees node 0 from the same pose
+	cGraph.addEdge(0,nNodes-1,Eigen::Matrix3f::Identity(),Eigen::Vector3f::Zero());
+	const unsigned int uVersion = cGraph.version();
+	cGraph.optimise();
+	BTL_ASSERT( cGraph.version() != uVersion && nNodes == cGraph.nodes(), "testPoseGraphSquareLoop() no solve" );
+	//the drift is spread over the loop: the camera centres close in on the truth and the loop is closed
+	float fDriftAfter = 0.f;
+	for (int k=0; k<nNodes; k++){
+		cGraph.getPose(k,&veimR[k],&veivT[k]);
+		fDriftAfter = std::max( fDriftAfter, (veimR[k].transpose()*veivT[k] - veimRTrue[k].transpose()*veivTTrue[k]).norm() );
+	}
+	const Eigen::AngleAxisf eAALoop( veimR[nNodes-1]*veimR[0].transpose() );
+	PRINT( fDriftBefore ); PRINT( fDriftAfter ); PRINT( eAALoop.angle() ); PRINT( (veivT[nNodes-1]-veivT[0]).norm() );
+	BTL_ASSERT( (veimR[0]-veimRTrue[0]).norm() < 1e-6f && (veivT[0]-veivTTrue[0]).norm() < 1e-6f, "testPoseGraphSquareLoop() the first node must stay fixed" );
+	BTL_ASSERT( fDriftBefore > .2f && fDriftAfter < .4f*fDriftBefore, "testPoseGraphSquareLoop() the drift was not reduced" );
+	BTL_ASSERT( fabs(eAALoop.angle()) < .02f && (veivT[nNodes-1]-veivT[0]).norm() < .05f, "testPoseGraphSquareLoop() the loop is not closed" );
+}
 void testSetSE3(){
 	cv::Mat _cvmX = (cv::Mat_<double>(1,6) << 0,0.1,.03,0,1,0);
 	cv::Mat cvmSE3(4,4,CV_64FC1); cvmSE3= cv::Mat::eye(4, 4, CV_64F);
@@ -217,6 +656,12 @@ void testSetSE3(){
 }
 void test(){
 	testSetSE3();
+	testKeyFrameSnapshot();
+	testRgbdStreamDepthCodec();
+	testCOptimLeastSquares();
+	testSolvePlaneToPlane();
+	testPoseGraphSquareLoop();
+	testVoxelHashGrids();
 	//testCOptim();
 	//testException();
 	//testCVUtil();
@@ -239,6 +684,12 @@ void testCVUtil()
 	testCVUtilOperators();
 	testConvert2DisparityDomain();
 	testDownSampling();
+	testBilateralFilterInDisparity();
+	testRegistrationICPSoA();
+	testIntegrateTsdfVolume();
+	testGuidedMatch();
+	testAbsoluteOrientationBatch();
+	testBrickMesh();
 	cvUtilColor();
 }
 void testException()
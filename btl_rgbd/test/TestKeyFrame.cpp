@@ -0,0 +1,82 @@
+#define INFO
+//gl, only the types GLUtil.h needs for KeyFrame.h
+#include <gl/glew.h>
+#include <cuda_gl_interop.h>
+//boost
+#include <boost/random.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+//stl
+#include <vector>
+#include <list>
+#include <stdexcept>
+#include <cstdio>
+//opencv
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/gpu/gpu.hpp>
+//eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+//self
+#include "../OtherUtil.hpp"
+#include "../Converters.hpp"
+#include "../EigenUtil.hpp"
+#include "../Camera.h"
+#include "../Kinect.h"
+#include "../GLUtil.h"
+#include "../PlaneObj.h"
+#include "../Histogram.h"
+#include "SemiDenseTracker.h"
+#include "SemiDenseTrackerOrb.h"
+#include "../KeyFrame.h"
+#include "TestKeyFrame.h"
+
+void testKeyFrameSnapshot()
+{
+	PRINTSTR("test: CKeyFrame::exportBinary() -> importBinary() round trip");
+	//host only, the snapshot is a host pyramid
+	const btl::kinect::CKeyFrame::tp_backend eBackend = btl::kinect::CKeyFrame::_eBackend;
+	btl::kinect::CKeyFrame::_eBackend = btl::kinect::CKeyFrame::CPU_BACKEND;
+	btl::image::SCamera sRGB("XtionRGB.yml");
+	const ushort uPyrHeight = 3;
+	btl::kinect::CKeyFrame cExport(&sRGB,0,uPyrHeight,Eigen::Vector3f(1.5f,1.5f,-.3f));
+	cv::RNG cRNG(5);
+	for (ushort i = 0; i < uPyrHeight; i++){
+		cRNG.fill( *cExport._acvmShrPtrPyrPts[i], cv::RNG::UNIFORM, -2.f, 2.f );
+		cRNG.fill( *cExport._acvmShrPtrPyrNls[i], cv::RNG::UNIFORM, -1.f, 1.f );
+		cRNG.fill( *cExport._acvmShrPtrPyrRGBs[i], cv::RNG::UNIFORM, 0, 256 );
+		cRNG.fill( *cExport._acvmShrPtrPyrBWs[i], cv::RNG::UNIFORM, 0, 256 );
+		cRNG.fill( *cExport._acvmPyrDepths[i], cv::RNG::UNIFORM, .4f, 4.f );
+	}
+	cExport.setRTw( Eigen::AngleAxisf(.3f,Eigen::Vector3f(.1f,1.f,.2f).normalized()).toRotationMatrix(), Eigen::Vector3f(.2f,-.1f,.5f) );
+	cExport.exportBinary( "./", "TestKeyFrameSnapshot.bin" );
+
+	//a frame of the same shape with another pose and pyramid content
+	btl::kinect::CKeyFrame cImport(&sRGB,0,uPyrHeight,Eigen::Vector3f(0.f,0.f,0.f));
+	cImport.importBinary( "./", "TestKeyFrameSnapshot.bin" );
+	double dMaxDiff = 0.;
+	for (ushort i = 0; i < uPyrHeight; i++){
+		dMaxDiff = std::max( dMaxDiff, cv::norm( *cExport._acvmShrPtrPyrPts[i], *cImport._acvmShrPtrPyrPts[i], cv::NORM_INF ) );
+		dMaxDiff = std::max( dMaxDiff, cv::norm( *cExport._acvmShrPtrPyrNls[i], *cImport._acvmShrPtrPyrNls[i], cv::NORM_INF ) );
+		dMaxDiff = std::max( dMaxDiff, cv::norm( *cExport._acvmShrPtrPyrRGBs[i], *cImport._acvmShrPtrPyrRGBs[i], cv::NORM_INF ) );
+		dMaxDiff = std::max( dMaxDiff, cv::norm( *cExport._acvmShrPtrPyrBWs[i], *cImport._acvmShrPtrPyrBWs[i], cv::NORM_INF ) );
+		dMaxDiff = std::max( dMaxDiff, cv::norm( *cExport._acvmPyrDepths[i], *cImport._acvmPyrDepths[i], cv::NORM_INF ) );
+	}
+	PRINT( dMaxDiff );
+	BTL_ASSERT( 0. == dMaxDiff, "testKeyFrameSnapshot() the imported pyramid differs from the exported one" );
+	BTL_ASSERT( cExport._eimRw == cImport._eimRw && cExport._eivTw == cImport._eivTw, "testKeyFrameSnapshot() the imported pose differs from the exported one" );
+
+	//a frame of another pyramid height must refuse the snapshot and keep its own pyramid
+	btl::kinect::CKeyFrame cOther(&sRGB,0,uPyrHeight-1,Eigen::Vector3f(0.f,0.f,0.f));
+	const cv::Mat* pPts = cOther._acvmShrPtrPyrPts[0].get();
+	bool bThrown = false;
+	try{
+		cOther.importBinary( "./", "TestKeyFrameSnapshot.bin" );
+	}
+	catch ( std::runtime_error& ){
+		bThrown = true;
+	}
+	BTL_ASSERT( bThrown && pPts == cOther._acvmShrPtrPyrPts[0].get(), "testKeyFrameSnapshot() a mismatching snapshot was imported" );
+	std::remove( "./TestKeyFrameSnapshot.bin" );
+	btl::kinect::CKeyFrame::_eBackend = eBackend;
+}
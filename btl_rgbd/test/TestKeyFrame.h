@@ -0,0 +1 @@
+void testKeyFrameSnapshot();
\ No newline at end of file
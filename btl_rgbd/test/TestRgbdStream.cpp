@@ -0,0 +1,49 @@
+#define INFO
+//boost
+#include <boost/shared_ptr.hpp>
+//stl
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+//opencv
+#include <opencv2/core/core.hpp>
+//self
+#include "../OtherUtil.hpp"
+#include "../RgbdStream.h"
+#include "TestRgbdStream.h"
+
+void testRgbdStreamDepthCodec()
+{
+	PRINTSTR("test: SRgbdStream::encodeDepth() -> decodeDepth() round trip");
+	using btl::kinect::SRgbdStream;
+	//holes, flat runs, smooth slopes, sensor noise and the largest jumps a ushort allows
+	cv::Mat cvmDepth(480,640,CV_16UC1);
+	cv::RNG cRNG(9);
+	for (int r = 0; r < cvmDepth.rows; r++){
+		ushort* pDepth = cvmDepth.ptr<ushort>(r);
+		for (int c = 0; c < cvmDepth.cols; c++){
+			if (r < 40)                 pDepth[c] = 0;
+			else if (r < 80)            pDepth[c] = 1500;
+			else if (r < 240)           pDepth[c] = ushort(800 + 2*c + r);
+			else if (r < 400)           pDepth[c] = ushort(cRNG.uniform(0,65536));
+			else                        pDepth[c] = (c & 1) ? 65535 : 0;
+			if (0 == cRNG.uniform(0,50)) pDepth[c] = 0;
+		}
+	}
+	std::vector<uchar> vCode;
+	SRgbdStream::encodeDepth( cvmDepth, &vCode );
+	cv::Mat cvmDecoded(cvmDepth.size(),CV_16UC1,cv::Scalar(7));
+	const bool bDecoded = SRgbdStream::decodeDepth( &vCode[0], vCode.size(), &cvmDecoded );
+	PRINT( vCode.size() );
+	BTL_ASSERT( bDecoded, "testRgbdStreamDepthCodec() a valid code was rejected" );
+	int nDiff = 0;
+	for (int r = 0; r < cvmDepth.rows; r++)
+	for (int c = 0; c < cvmDepth.cols; c++) nDiff += cvmDepth.at<ushort>(r,c) != cvmDecoded.at<ushort>(r,c);
+	BTL_ASSERT( 0 == nDiff, "testRgbdStreamDepthCodec() the decoded depth is not bit exact" );
+	//a truncated code or one with trailing bytes must be rejected
+	const bool bTruncated = SRgbdStream::decodeDepth( &vCode[0], vCode.size()-1, &cvmDecoded );
+	vCode.push_back(1);
+	const bool bTrailing = SRgbdStream::decodeDepth( &vCode[0], vCode.size(), &cvmDecoded );
+	BTL_ASSERT( !bTruncated && !bTrailing, "testRgbdStreamDepthCodec() a corrupted code was accepted" );
+}
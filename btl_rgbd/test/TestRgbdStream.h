@@ -0,0 +1 @@
+void testRgbdStreamDepthCodec();
\ No newline at end of file
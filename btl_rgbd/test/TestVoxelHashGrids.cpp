@@ -0,0 +1,135 @@
+#define INFO
+//gl, only the types GLUtil.h needs for KeyFrame.h
+#include <gl/glew.h>
+#include <cuda_gl_interop.h>
+//boost
+#include <boost/random.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+//stl
+#include <vector>
+#include <list>
+#include <limits>
+#include <algorithm>
+//opencv
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/gpu/gpu.hpp>
+//eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+//self
+#include "../OtherUtil.hpp"
+#include "../Converters.hpp"
+#include "../EigenUtil.hpp"
+#include "../Camera.h"
+#include "../GLUtil.h"
+#include "../PlaneObj.h"
+#include "../Histogram.h"
+#include "SemiDenseTracker.h"
+#include "SemiDenseTrackerOrb.h"
+#include "../KeyFrame.h"
+#include "../CpuLib.h"
+#include "../VoxelHashGrids.h"
+#include "TestVoxelHashGrids.h"
+
+//range along each ray of a sphere in front of a wall, as seen from the origin of the camera
+static void renderSphereAndWall( const float fFx_, const float fFy_, const float u_, const float v_, const float fScale_, cv::Mat* pcvmDepth_ ){
+	const Eigen::Vector3f eivCentre(.1f,-.05f,1.5f);
+	for (int r = 0; r < pcvmDepth_->rows; r++)
+	for (int c = 0; c < pcvmDepth_->cols; c++){
+		const Eigen::Vector3f eivD = Eigen::Vector3f( (c - u_)/fFx_, (r - v_)/fFy_, 1.f ).normalized();
+		const float fB = eivD.dot(eivCentre), fDisc = fB*fB - eivCentre.squaredNorm() + .16f;
+		pcvmDepth_->at<float>(r,c) = fScale_*( fDisc > 0.f ? fB - sqrtf(fDisc) : 2.5f/eivD(2) );
+	}
+}
+
+void testVoxelHashGrids()
+{
+	PRINTSTR("test: CVoxelHashGrids::integrateFrame() and raycast() vs. the dense btl::cpu::integrateTsdfVolume() and raycastTsdfVolume()");
+	const btl::kinect::CKeyFrame::tp_backend eBackend = btl::kinect::CKeyFrame::_eBackend;
+	btl::kinect::CKeyFrame::_eBackend = btl::kinect::CKeyFrame::CPU_BACKEND;
+	btl::image::SCamera sRGB("XtionRGB.yml");
+	const float fFx = sRGB._fFx, fFy = sRGB._fFy, u = sRGB._u, v = sRGB._v;
+	//the dense volume covers the world voxels [0,nRes)^3, which are the voxels of the same index in the hashed one
+	const int nRes = 128, nSide = btl::geometry::CVoxelHashGrids::BLOCK_SIDE;
+	const float fVoxelSize = .02f, fTrunc = 6*fVoxelSize;
+	const Eigen::Matrix3f eimRw = Eigen::AngleAxisf(.3f,Eigen::Vector3f(.2f,1.f,.1f).normalized()).toRotationMatrix();
+	const Eigen::Vector3f eivCw(1.2f,1.6f,.4f);
+	btl::kinect::CKeyFrame cFrame(&sRGB,0,3,eivCw);
+	cFrame.setRTw( eimRw, -eimRw*eivCw );
+	cv::Mat& cvmDepth = *cFrame._acvmPyrDepths[0];
+	btl::geometry::CVoxelHashGrids cHashed(fVoxelSize,fTrunc);
+	cv::Mat cvmDense(nRes*nRes,nRes,CV_16SC2,cv::Scalar::all(0));
+	//fuse twice so that the running average is compared as well
+	for (int i = 0; i < 2; i++){
+		renderSphereAndWall( fFx, fFy, u, v, 1.f + .003f*i, &cvmDepth );
+		cHashed.integrateFrame( cFrame );
+		btl::cpu::integrateTsdfVolume( cvmDepth, 0, fVoxelSize, fTrunc, eimRw.data(), eivCw.data(), fFx, fFy, u, v, &cvmDense );
+	}
+	//the dense voxels within the truncation band must sit in allocated blocks and hold the same (tsdf,weight),
+	//the free space in front of the band is only kept by the dense volume
+	int nBand = 0, nMissing = 0, nDiff = 0;
+	for (int z = 0; z < nRes; z++)
+	for (int y = 0; y < nRes; y++){
+		const short* pD = cvmDense.ptr<short>(z*nRes + y);
+		for (int x = 0; x < nRes; x++, pD += 2){
+			if (0 == pD[1] || abs( pD[0] ) >= 32767) continue;
+			nBand++;
+			const int nBlock = cHashed.findBlock( x/nSide, y/nSide, z/nSide );
+			if (nBlock < 0) { nMissing++; continue; }
+			const short* pH = cHashed.voxels(nBlock) + 2*( ( (z%nSide)*nSide + y%nSide )*nSide + x%nSide );
+			nDiff += abs( pH[0] - pD[0] ) > 1 || pH[1] != pD[1];
+		}
+	}
+	PRINT( cHashed.blocks() );
+	PRINT( nBand );
+	PRINT( nMissing );
+	PRINT( nDiff );
+	BTL_ASSERT( nBand > 0 && 0 == nMissing, "testVoxelHashGrids() a voxel of the truncation band has no block" );
+	BTL_ASSERT( nDiff*10000 <= nBand, "testVoxelHashGrids() the blocks are off the dense volume" );
+
+	//ray cast both from the pose of the frame
+	std::vector<cv::Mat> vcvmPyramid;
+	btl::cpu::buildTsdfMinMaxPyramid( cvmDense, NULL, nSide, &vcvmPyramid );
+	cv::Mat cvmPts(cvmDepth.size(),CV_32FC3), cvmNls(cvmDepth.size(),CV_32FC3);
+	btl::cpu::raycastTsdfVolume( cvmDense, NULL, vcvmPyramid, nSide, fVoxelSize, fTrunc, eimRw.data(), eivCw.data(), fFx, fFy, u, v, 0, &cvmPts, &cvmNls );
+	cHashed.raycast( &cFrame );
+	//both are measured against the surface that was fused, the range of the two frames averaged, on the pixels whose
+	//7x7 neighbourhood has no depth jump beyond the truncation. along the silhouette of the sphere the dense volume
+	//has crossings where the free space seen past the sphere meets the band behind it, the hashed blocks keep no free
+	//space, so the two differ there by design
+	const float fLo = 2*nSide*fVoxelSize, fHi = (nRes - 2*nSide)*fVoxelSize;
+	int nSurface = 0, nLost = 0, anHits[2] = {0,0}, anNear[2] = {0,0};
+	double adErr[2] = {0.,0.};
+	for (int r = 3; r < cvmDepth.rows - 3; r++)
+	for (int c = 3; c < cvmDepth.cols - 3; c++){
+		const float fD = cvmDepth.at<float>(r,c);
+		bool bJump = false;
+		for (int i = -3; i <= 3 && !bJump; i++)
+		for (int j = -3; j <= 3 && !bJump; j++)
+			bJump = fabs( cvmDepth.at<float>(r+i,c+j) - fD ) > fTrunc;
+		if (bJump) continue;
+		const Eigen::Vector3f eivS = eivCw + fD*1.0015f/1.003f*( eimRw.transpose()*Eigen::Vector3f( (c - u)/fFx, (r - v)/fFy, 1.f ).normalized() );
+		if (eivS(0) < fLo || eivS(1) < fLo || eivS(2) < fLo || eivS(0) > fHi || eivS(1) > fHi || eivS(2) > fHi) continue;
+		nSurface++;
+		const float* apPt[2] = { cvmPts.ptr<float>(r) + 3*c, cFrame._acvmShrPtrPyrPts[0]->ptr<float>(r) + 3*c };
+		for (int i = 0; i < 2; i++){
+			if (apPt[i][0] != apPt[i][0]) continue;
+			const float fErr = ( Eigen::Vector3f(apPt[i][0],apPt[i][1],apPt[i][2]) - eivS ).norm();
+			anHits[i]++;
+			anNear[i] += fErr < .5f*fVoxelSize;
+			adErr[i] += fErr;
+		}
+		nLost += apPt[0][0] == apPt[0][0] && apPt[1][0] != apPt[1][0];
+	}
+	const float fMeanDense = float(adErr[0]/std::max(anHits[0],1)), fMeanHashed = float(adErr[1]/std::max(anHits[1],1));
+	PRINT( nSurface );
+	PRINT( nLost );
+	PRINT( anNear[0] );
+	PRINT( anNear[1] );
+	PRINT( fMeanDense );
+	PRINT( fMeanHashed );
+	BTL_ASSERT( nSurface > 0 && nLost*1000 <= nSurface, "testVoxelHashGrids() the hashed ray cast missed the surface" );
+	BTL_ASSERT( anNear[1] >= .99f*anNear[0] && fMeanHashed <= 1.1f*fMeanDense && fMeanHashed < .25f*fVoxelSize, "testVoxelHashGrids() the hashed ray cast is off the surface" );
+	btl::kinect::CKeyFrame::_eBackend = eBackend;
+}
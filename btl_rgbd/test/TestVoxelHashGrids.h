@@ -0,0 +1 @@
+void testVoxelHashGrids();
\ No newline at end of file
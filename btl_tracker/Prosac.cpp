@@ -0,0 +1,376 @@
+/* Written by ZG Tan to implement the prosac algorithm, based on OpenCV
+  */
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/internal.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <Eigen/Dense>
+#include "Prosac.h"
+#include <algorithm>
+#include <vector>
+#include <limits>
+#include <math.h>
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+float FindHomography::ComputeReprojError(const cv::Point2f& point1, const cv::Point2f& point2, const float* homography)
+{
+    float projectionPointZ = homography[6] * point1.x + homography[7] * point1.y + homography[8];
+    float projectionPointX = (homography[0] * point1.x + homography[1] * point1.y + homography[2])/projectionPointZ;
+    float projectionPointY = (homography[3] * point1.x + homography[4] * point1.y + homography[5])/projectionPointZ;
+
+    return (float)(fabs( projectionPointX - point2.x) + fabs(projectionPointY - point2.y));
+};
+
+bool FindHomography::checkSubset( const cv::Point2f* ptr, int count )
+{
+    // check that no selected point lies on a line connecting two others
+    for( int i = 2; i < count; i++ ) {
+        for( int j = 0; j < i; j++ ) {
+            double dx1 = ptr[j].x - ptr[i].x;
+            double dy1 = ptr[j].y - ptr[i].y;
+            for( int k = 0; k < j; k++ ) {
+                double dx2 = ptr[k].x - ptr[i].x;
+                double dy2 = ptr[k].y - ptr[i].y;
+                if( fabs(dx2*dy1 - dy2*dx1) <= FLT_EPSILON*(fabs(dx1) + fabs(dy1) + fabs(dx2) + fabs(dy2)))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+namespace
+{
+enum { SAMPLE = 4, BATCH = 32 };
+//rows of the structure of arrays
+enum { REF_X = 0, REF_Y, SCENE_X, SCENE_Y };
+
+//translate to the centroid and scale the mean distance to sqrt(2), T maps the points to the normalised ones
+void normalise( const cv::Point2f* pPts_, int nCount_, Eigen::Matrix3d* peimT_ ){
+	double dCx = 0, dCy = 0, dD = 0;
+	for (int i = 0; i < nCount_; i++) { dCx += pPts_[i].x; dCy += pPts_[i].y; }
+	dCx /= nCount_; dCy /= nCount_;
+	for (int i = 0; i < nCount_; i++) dD += sqrt( (pPts_[i].x-dCx)*(pPts_[i].x-dCx) + (pPts_[i].y-dCy)*(pPts_[i].y-dCy) );
+	const double dS = dD > 0 ? sqrt(2.) * nCount_ / dD : 1.;
+	*peimT_ << dS, 0, -dS*dCx, 0, dS, -dS*dCy, 0, 0, 1;
+}
+bool denormalise( const Eigen::Matrix3d& eimHn_, const Eigen::Matrix3d& eimTRef_, const Eigen::Matrix3d& eimTScene_, float* pH_ ){
+	Eigen::Matrix3d eimH = eimTScene_.inverse() * eimHn_ * eimTRef_;
+	if ( fabs( eimH(2,2) ) < std::numeric_limits<double>::epsilon() ) return false;
+	eimH /= eimH(2,2);
+	for (int r = 0; r < 3; r++) for (int c = 0; c < 3; c++) pH_[r*3+c] = float( eimH(r,c) );
+	return true;
+}
+//4-point DLT with h33 = 1 on normalised coordinates, H maps reference to scene
+bool solveHomography4( const cv::Point2f* pRef_, const cv::Point2f* pScene_, float* pH_ ){
+	if ( !FindHomography::checkSubset( pRef_, SAMPLE ) || !FindHomography::checkSubset( pScene_, SAMPLE ) ) return false;
+	Eigen::Matrix3d eimTRef, eimTScene;
+	normalise( pRef_, SAMPLE, &eimTRef );
+	normalise( pScene_, SAMPLE, &eimTScene );
+	Eigen::Matrix<double,8,8> eimA;
+	Eigen::Matrix<double,8,1> eivB;
+	for (int i = 0; i < SAMPLE; i++){
+		const double x = eimTRef(0,0)*pRef_[i].x + eimTRef(0,2), y = eimTRef(1,1)*pRef_[i].y + eimTRef(1,2);
+		const double u = eimTScene(0,0)*pScene_[i].x + eimTScene(0,2), v = eimTScene(1,1)*pScene_[i].y + eimTScene(1,2);
+		eimA.row(2*i)   << x, y, 1, 0, 0, 0, -u*x, -u*y; eivB(2*i)   = u;
+		eimA.row(2*i+1) << 0, 0, 0, x, y, 1, -v*x, -v*y; eivB(2*i+1) = v;
+	}
+	Eigen::FullPivLU< Eigen::Matrix<double,8,8> > lu( eimA );
+	if ( !lu.isInvertible() ) return false;
+	const Eigen::Matrix<double,8,1> h = lu.solve( eivB );
+	Eigen::Matrix3d eimHn; eimHn << h(0), h(1), h(2), h(3), h(4), h(5), h(6), h(7), 1;
+	if ( !denormalise( eimHn, eimTRef, eimTScene, pH_ ) ) return false;
+	//the sample must stay on one side of the line at infinity
+	int nPositive = 0;
+	for (int i = 0; i < SAMPLE; i++) nPositive += pH_[6]*pRef_[i].x + pH_[7]*pRef_[i].y + pH_[8] > 0 ? 1 : 0;
+	return nPositive == 0 || nPositive == SAMPLE;
+}
+//least squares DLT over the flagged matches on normalised coordinates, the null vector of A^T A
+bool solveHomographyLS( const std::vector<cv::Point2f>& vRef_, const std::vector<cv::Point2f>& vScene_, float* pH_ ){
+	const int nCount = (int)vRef_.size();
+	if ( nCount < SAMPLE ) return false;
+	Eigen::Matrix3d eimTRef, eimTScene;
+	normalise( &vRef_[0], nCount, &eimTRef );
+	normalise( &vScene_[0], nCount, &eimTScene );
+	Eigen::Matrix<double,9,9> eimAtA; eimAtA.setZero();
+	Eigen::Matrix<double,9,1> r0, r1;
+	for (int i = 0; i < nCount; i++){
+		const double x = eimTRef(0,0)*vRef_[i].x + eimTRef(0,2), y = eimTRef(1,1)*vRef_[i].y + eimTRef(1,2);
+		const double u = eimTScene(0,0)*vScene_[i].x + eimTScene(0,2), v = eimTScene(1,1)*vScene_[i].y + eimTScene(1,2);
+		r0 << x, y, 1, 0, 0, 0, -u*x, -u*y, -u;
+		r1 << 0, 0, 0, x, y, 1, -v*x, -v*y, -v;
+		eimAtA += r0 * r0.transpose() + r1 * r1.transpose();
+	}
+	Eigen::SelfAdjointEigenSolver< Eigen::Matrix<double,9,9> > eig( eimAtA );
+	const Eigen::Matrix<double,9,1> h = eig.eigenvectors().col(0);//ascending eigen values
+	Eigen::Matrix3d eimHn; eimHn << h(0), h(1), h(2), h(3), h(4), h(5), h(6), h(7), h(8);
+	return denormalise( eimHn, eimTRef, eimTScene, pH_ );
+}
+
+//Wald's decision threshold A for the inlier ratio fEps_ and the ratio fDelta_ of points consistent with a bad model,
+//fTM_ is the cost of a hypothesis in point evaluations (Chum & Matas, optimal randomised RANSAC)
+double sprtThreshold( double dEps_, double dDelta_, double dTM_ = 200. ){
+	const double dC = (1-dDelta_)*log( (1-dDelta_)/(1-dEps_) ) + dDelta_*log( dDelta_/dEps_ );
+	const double dK = dTM_*dC + 1;
+	double dA = dK;
+	for (int i = 0; i < 10; i++) dA = dK + log(dA);
+	return dA;
+}
+//samples needed to draw an all-inlier sample that also survives the test with the given confidence
+int sprtUpdateNumIters( double dConfidence_, double dEps_, double dA_, int nMaxIters_ ){
+	const double dNum = log( std::max( 1. - dConfidence_, DBL_MIN ) );
+	const double dP = pow( dEps_, SAMPLE ) * ( 1. - 1./dA_ );
+	if ( dP <= 0. ) return nMaxIters_;
+	const double dDenom = log( std::max( 1. - dP, DBL_MIN ) );
+	return dDenom >= 0 || -dNum >= nMaxIters_*(-dDenom) ? nMaxIters_ : cvRound( dNum/dDenom );
+}
+
+struct SHypothesis{
+	int aIdx[SAMPLE];
+	float aH[9];
+	bool bValid;
+	bool bRejected;
+	int nInliers;
+	int nTested;
+};
+//solves and verifies every hypothesis of a batch, the likelihood ratio is updated 4 matches at a time.
+//samples index the matches in sampling order, the test runs over a shuffled copy because SPRT assumes the matches
+//arrive in random order
+class CSprtVerify : public cv::ParallelLoopBody
+{
+public:
+	CSprtVerify(const cv::Mat& cvmSample_, const cv::Mat& cvmSoA_, int nCount_, float fThreshold_, double dEps_, double dDelta_, double dA_, SHypothesis* pHypo_)
+	:_cvmSample(cvmSample_),_cvmSoA(cvmSoA_),_nCount(nCount_),_fThreshold(fThreshold_),_dA(dA_),_pHypo(pHypo_){
+		_dInlier  = dDelta_/dEps_;
+		_dOutlier = (1-dDelta_)/(1-dEps_);
+	}
+	virtual void operator()(const cv::Range& sHypo_) const{
+		const float* pRx = _cvmSoA.ptr<float>(REF_X);   const float* pRy = _cvmSoA.ptr<float>(REF_Y);
+		const float* pSx = _cvmSoA.ptr<float>(SCENE_X); const float* pSy = _cvmSoA.ptr<float>(SCENE_Y);
+		for (int n = sHypo_.start; n < sHypo_.end; n++){
+			SHypothesis& sH = _pHypo[n];
+			sH.nInliers = sH.nTested = 0; sH.bRejected = false;
+			cv::Point2f aRef[SAMPLE], aScene[SAMPLE];
+			for (int i = 0; i < SAMPLE; i++){
+				aRef[i]   = cv::Point2f( _cvmSample.ptr<float>(REF_X)[sH.aIdx[i]],   _cvmSample.ptr<float>(REF_Y)[sH.aIdx[i]] );
+				aScene[i] = cv::Point2f( _cvmSample.ptr<float>(SCENE_X)[sH.aIdx[i]], _cvmSample.ptr<float>(SCENE_Y)[sH.aIdx[i]] );
+			}
+			sH.bValid = solveHomography4( aRef, aScene, sH.aH );
+			if (!sH.bValid) continue;
+			const float* h = sH.aH;
+			double dLambda = 1.;
+			int nInliers = 0, i = 0;
+			for (; i < _nCount; i += 4){
+				int nMask = 0;
+#if CV_SSE2
+				const __m128 x = _mm_loadu_ps(pRx+i), y = _mm_loadu_ps(pRy+i);
+				const __m128 z = _mm_add_ps( _mm_add_ps( _mm_mul_ps(_mm_set1_ps(h[6]),x), _mm_mul_ps(_mm_set1_ps(h[7]),y) ), _mm_set1_ps(h[8]) );
+				const __m128 u = _mm_add_ps( _mm_add_ps( _mm_mul_ps(_mm_set1_ps(h[0]),x), _mm_mul_ps(_mm_set1_ps(h[1]),y) ), _mm_set1_ps(h[2]) );
+				const __m128 v = _mm_add_ps( _mm_add_ps( _mm_mul_ps(_mm_set1_ps(h[3]),x), _mm_mul_ps(_mm_set1_ps(h[4]),y) ), _mm_set1_ps(h[5]) );
+				const __m128 m128AbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+				const __m128 du = _mm_and_ps( _mm_sub_ps( _mm_div_ps(u,z), _mm_loadu_ps(pSx+i) ), m128AbsMask );
+				const __m128 dv = _mm_and_ps( _mm_sub_ps( _mm_div_ps(v,z), _mm_loadu_ps(pSy+i) ), m128AbsMask );
+				nMask = _mm_movemask_ps( _mm_cmplt_ps( _mm_add_ps(du,dv), _mm_set1_ps(_fThreshold) ) );
+#else
+				for (int l = 0; l < 4; l++){
+					const float z = h[6]*pRx[i+l] + h[7]*pRy[i+l] + h[8];
+					const float du = fabs( (h[0]*pRx[i+l] + h[1]*pRy[i+l] + h[2])/z - pSx[i+l] );
+					const float dv = fabs( (h[3]*pRx[i+l] + h[4]*pRy[i+l] + h[5])/z - pSy[i+l] );
+					if (du + dv < _fThreshold) nMask |= 1<<l;//NaN padding fails the test
+				}
+#endif
+				const int nLanes = std::min( 4, _nCount - i );
+				for (int l = 0; l < nLanes; l++){
+					if ( nMask & (1<<l) ) { nInliers++; dLambda *= _dInlier; }
+					else dLambda *= _dOutlier;
+				}
+				if (dLambda > _dA) { sH.bRejected = true; i += nLanes; break; }
+			}//for each group of 4 matches
+			sH.nInliers = nInliers;
+			sH.nTested = std::min( i, _nCount );
+		}//for each hypothesis
+	}
+private:
+	const cv::Mat& _cvmSample;
+	const cv::Mat& _cvmSoA;
+	int _nCount;
+	float _fThreshold;
+	double _dInlier, _dOutlier, _dA;
+	SHypothesis* _pHypo;
+};
+}//namespace
+
+bool FindPROSACHomography::Calculate()
+{
+    const int64 t0 = cv::getTickCount();
+    inlierCount = 0;
+    std::vector<MatchedPoint> & matchs = *matchedPoints;
+    if (matchs.size() < SAMPLE) return false;
+
+    //remove duplicate matches, the one with the smallest distance survives
+    std::sort(matchs.begin(), matchs.end(), CmpMatch());
+    std::vector<MatchedPoint> refined_matches;
+    refined_matches.reserve(matchs.size());
+    for (size_t i = 0; i < matchs.size(); i++) {
+        if (!refined_matches.empty()) {
+            const MatchedPoint& mp = refined_matches.back();
+            float dist = fabs(mp.pointScene.x-matchs[i].pointScene.x) + fabs(mp.pointScene.y-matchs[i].pointScene.y) +
+                fabs(mp.pointReference.x-matchs[i].pointReference.x) + fabs(mp.pointReference.y-matchs[i].pointReference.y);
+            if (dist <= reprojectionThreshold) {
+                if (matchs[i].distance < mp.distance) refined_matches.back() = matchs[i];
+                continue;
+            }
+        }
+        refined_matches.push_back(matchs[i]);
+    }
+    matchs.swap(refined_matches);
+
+    // sorting to give an increasing order of distances, thus correspondences with small distance would be sampled first.
+    if (method == MY_PROSAC)
+        std::stable_sort(matchs.begin(), matchs.end(), CompareDistanceLess());
+
+    const int count = (int)matchs.size();
+    if (count < SAMPLE) return false;
+
+    //structure of arrays in sampling order and a shuffled copy padded with NaN to a multiple of 4
+    cv::Mat cvmSample( 4, count, CV_32FC1 ), cvmSoA( 4, (count + 3) & ~3, CV_32FC1 );
+    cvmSoA.setTo( std::numeric_limits<float>::quiet_NaN() );
+    std::vector<int> vOrder(count);
+    for (int j = 0; j < count; j++) vOrder[j] = j;
+    for (int j = count-1; j > 0; j--) std::swap( vOrder[j], vOrder[rng.uniform(0,j+1)] );
+    for (int j = 0; j < count; j++) {
+        cvmSample.ptr<float>(REF_X)[j]   = matchs[j].pointReference.x;
+        cvmSample.ptr<float>(REF_Y)[j]   = matchs[j].pointReference.y;
+        cvmSample.ptr<float>(SCENE_X)[j] = matchs[j].pointScene.x;
+        cvmSample.ptr<float>(SCENE_Y)[j] = matchs[j].pointScene.y;
+    }
+    for (int r = 0; r < 4; r++) for (int j = 0; j < count; j++)
+        cvmSoA.ptr<float>(r)[j] = cvmSample.ptr<float>(r)[vOrder[j]];
+
+    //PROSAC growth function, the sampling pool grows from the best SAMPLE matches towards all of them
+    const int m = SAMPLE;
+    int samplingCount = m;
+    double Tn = maxIteration;
+    for (int i = 0; i < m; i++) Tn *= (samplingCount-i)/(double)(count-i);
+    int T_n_prime = 1;
+
+    //SPRT state
+    double dEps = .1, dDelta = .05;
+    double dA = sprtThreshold( dEps, dDelta );
+    int nRejected = 0; double dDeltaSum = 0;
+
+    float bestHomography[9];
+    int bestCount = 0;
+    int maxIter = maxIteration;
+    std::vector<SHypothesis> vHypo(BATCH);
+    for (int i = 1; i < maxIter; ) {
+        //draw the samples of a batch serially, the PROSAC schedule depends on the iteration
+        const int nBatch = std::min( (int)BATCH, maxIter - i );
+        for (int b = 0; b < nBatch; b++, i++) {
+            if (method == MY_PROSAC && samplingCount < count && i > T_n_prime) {
+                double Tn1 = Tn * (double)(samplingCount + 1) / (double)(samplingCount + 1 - m);
+                T_n_prime = T_n_prime + (int)ceil(Tn1 - Tn);
+                Tn = Tn1;
+                samplingCount++;
+            }
+            const int nPool = method == MY_PROSAC ? samplingCount : count;
+            //PROSAC takes the newest match and m-1 from the rest of the pool until the pool has been sampled enough
+            const bool bNewest = method == MY_PROSAC && i <= T_n_prime;
+            int* pIdx = vHypo[b].aIdx;
+            for (int k = 0; k < m; ) {
+                const int nIdx = (bNewest && k == 0) ? nPool - 1 : rng.uniform( 0, bNewest ? nPool - 1 : nPool );
+                bool bRepeat = false;
+                for (int j = 0; j < k; j++) bRepeat = bRepeat || pIdx[j] == nIdx;
+                if (!bRepeat) pIdx[k++] = nIdx;
+            }
+        }
+        CSprtVerify cVerify( cvmSample, cvmSoA, count, reprojectionThreshold, dEps, dDelta, dA, &vHypo[0] );
+        if (multiThread) cv::parallel_for_( cv::Range(0,nBatch), cVerify );
+        else             cVerify( cv::Range(0,nBatch) );
+
+        //update the best model and the test in the order of the samples
+        bool bUpdate = false;
+        for (int b = 0; b < nBatch; b++) {
+            const SHypothesis& sH = vHypo[b];
+            if (!sH.bValid) continue;
+            if (sH.bRejected) {
+                nRejected++; dDeltaSum += sH.nInliers / (double)std::max(sH.nTested,1);
+                continue;
+            }
+            if (sH.nInliers > bestCount) {
+                bestCount = sH.nInliers;
+                std::copy( sH.aH, sH.aH + 9, bestHomography );
+                bUpdate = true;
+            }
+        }
+        if (nRejected > 0) {
+            const double dDeltaNew = std::max( dDeltaSum / nRejected, .01 );
+            if (fabs(dDeltaNew - dDelta)/dDelta > .1) { dDelta = dDeltaNew; bUpdate = true; }
+        }
+        if (bUpdate) {
+            dEps = std::min( std::max( bestCount / (double)count, .1 ), .95 );
+            if (dEps <= dDelta) dDelta = dEps * .5;
+            dA = sprtThreshold( dEps, dDelta );
+            maxIter = std::min( maxIter, sprtUpdateNumIters( confidence, bestCount / (double)count, dA, maxIteration ) );
+        }
+        if (cv::getTickCount() - t0 > timeout) break;
+    }
+
+    if (bestCount < SAMPLE) return false;
+
+    //refine over the inliers of the best model
+    std::vector<cv::Point2f> consensusObject, consensusReference;
+    for (int j = 0; j < count; j++) {
+        matchs[j].isInlier = ComputeReprojError(matchs[j].pointReference, matchs[j].pointScene, bestHomography) < reprojectionThreshold;
+        if (matchs[j].isInlier) {
+            consensusObject.push_back( matchs[j].pointScene );
+            consensusReference.push_back( matchs[j].pointReference );
+        }
+    }
+    std::copy( bestHomography, bestHomography + 9, homography );
+    inlierCount = (int)consensusObject.size();
+    float refinedHomography[9];
+    if (solveHomographyLS( consensusReference, consensusObject, refinedHomography )) {
+        int nRefined = 0;
+        for (int j = 0; j < count; j++)
+            nRefined += ComputeReprojError(matchs[j].pointReference, matchs[j].pointScene, refinedHomography) < reprojectionThreshold ? 1 : 0;
+        if (nRefined >= inlierCount) {
+            std::copy( refinedHomography, refinedHomography + 9, homography );
+            for (int j = 0; j < count; j++)
+                matchs[j].isInlier = ComputeReprojError(matchs[j].pointReference, matchs[j].pointScene, homography) < reprojectionThreshold;
+            inlierCount = nRefined;
+        }
+    }
+    return inlierCount >= SAMPLE;
+}
+
+bool find_homography(const std::vector<cv::Point2f> & src, const std::vector<cv::Point2f> & des, cv::Mat* pcvmH_, int method,
+	const std::vector<float> & feature_distances, float reprojectionThreshold)
+{
+    const int n = (int)src.size();
+    if (n < SAMPLE || des.size() != src.size()) return false;
+
+    switch (method) {
+    case CV_RANSAC:
+    case CV_LMEDS:
+        *pcvmH_ = cv::findHomography( src, des, method, reprojectionThreshold );
+        return !pcvmH_->empty();
+    case MY_PROSAC:
+    case MY_RANSAC:
+        {
+        FindPROSACHomography prosac;
+        std::vector<MatchedPoint> matchedPoints(n);
+        for (int k = 0; k < n; k++)
+            matchedPoints[k] = MatchedPoint( des[k], src[k], feature_distances.empty() ? 0.f : feature_distances[k] );
+        prosac.method = method;
+        prosac.SetReprojectionThreshold( reprojectionThreshold );
+        prosac.AttatchMatchedPoints(&matchedPoints);
+        const bool ret = prosac.Calculate();
+        pcvmH_->create( 3, 3, CV_64FC1 );
+        for (int k = 0; k < 9; k++) pcvmH_->ptr<double>()[k] = (double)prosac.homography[k];
+        return ret;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,149 @@
+/* ========================================================================
+ * ======================================================================== */
+
+#ifndef _FIND_PROSAC_HOMOGRAPY_H_
+#define _FIND_PROSAC_HOMOGRAPY_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#define MY_PROSAC 16
+#define MY_RANSAC 32
+
+typedef struct _MatchedPoint {
+    cv::Point2f pointScene;
+    cv::Point2f pointReference;
+    float distance;
+    bool isInlier;
+
+    _MatchedPoint(const cv::Point2f& pointScene, const cv::Point2f& pointReference, float distance = 0.0) {
+        this->pointScene = pointScene;
+        this->pointReference = pointReference;
+
+        this->distance = distance;
+        isInlier = false;
+    }
+    _MatchedPoint() {
+        this->distance = 10000000;
+        isInlier = false;
+    }
+
+    bool operator==(const _MatchedPoint& oprd) const {
+        return this->distance == oprd.distance;
+    }
+    bool operator<(const _MatchedPoint& oprd) const {
+        return this->distance < oprd.distance;
+    }
+} MatchedPoint;
+
+class FindHomography
+{
+public:
+    float reprojectionThreshold;
+    float homography[9];
+    cv::RNG rng;
+
+    std::vector<MatchedPoint>* matchedPoints;
+public:
+    FindHomography() {
+        reprojectionThreshold = 5.0;
+        matchedPoints = NULL;
+        for(int i=0; i<9; i++)
+            homography[i] = 0.0f;
+    }
+    virtual ~FindHomography() {
+    }
+
+    inline void SetReprojectionThreshold(float reprojectionThreshold=5.0f) {
+        this->reprojectionThreshold = reprojectionThreshold;
+    };
+
+    inline void AttatchMatchedPoints(std::vector<MatchedPoint>* matchedPoints) {
+        this->matchedPoints = matchedPoints;
+    };
+    inline float* GetHomography() {
+        return this->homography;
+    };
+
+    //|x'-u| + |y'-v| where (x',y') is point1 mapped by homography
+    static float ComputeReprojError(const cv::Point2f& point1, const cv::Point2f& point2, const float* homography);
+
+    virtual bool Calculate() = 0;
+
+public:
+    //true if no 3 of the 4 points are collinear
+    static bool checkSubset( const cv::Point2f* ptr, int count );
+};
+
+
+typedef struct _CompareDistanceLess {
+    bool operator()(const struct _MatchedPoint& p, const struct _MatchedPoint& q) const {
+        return p.distance < q.distance;
+    }
+} CompareDistanceLess;
+
+typedef struct _cmpMatch {
+	bool operator()(const struct _MatchedPoint& a, const struct _MatchedPoint& b) const {
+		cv::Point a_s( cvRound(a.pointScene.x), cvRound(a.pointScene.y) );
+		cv::Point a_r( cvRound(a.pointReference.x), cvRound(a.pointReference.y) );
+		cv::Point b_s( cvRound(b.pointScene.x), cvRound(b.pointScene.y) );
+		cv::Point b_r( cvRound(b.pointReference.x), cvRound(b.pointReference.y) );
+
+		if (a_s.x != b_s.x) return a_s.x < b_s.x;
+		if (a_s.y != b_s.y) return a_s.y < b_s.y;
+		if (a_r.x != b_r.x) return a_r.x < b_r.x;
+		if (a_r.y != b_r.y) return a_r.y < b_r.y;
+		return a.distance < b.distance;
+	}
+
+} CmpMatch;
+
+//PROSAC (or plain RANSAC) over 4-point DLT hypotheses. every hypothesis is verified with Wald's sequential
+//probability ratio test on the matches in a structure of arrays, 4 at a time, so a bad model is dropped after a
+//few points. hypotheses are generated and verified in batches, in parallel when multiThread is set; the batches
+//make the result independent of the number of threads. the best model is refined by DLT over its inliers.
+class FindPROSACHomography:public FindHomography
+{
+public:
+    float confidence;
+    int maxIteration;
+    double timeout;
+    int method;
+    bool multiThread;
+    int inlierCount;
+
+public:
+    FindPROSACHomography() {
+        this->confidence = 0.99f; // constant
+        SetTimeout(5.0);
+
+        this->maxIteration = 2000;
+        this->reprojectionThreshold = 5.0f;
+
+        this->matchedPoints = NULL;
+        method = MY_PROSAC;
+        multiThread = true;
+        inlierCount = 0;
+    }
+    ~FindPROSACHomography() {
+
+    }
+
+    inline void SetMaxIteration(int iteration=1000) {
+        this->maxIteration = iteration;
+    };
+    inline void SetTimeout(double ms) {
+        this->timeout = ms * 1e-3 * cv::getTickFrequency();
+    };
+
+public:
+    bool Calculate();
+};
+
+//pcvmH_ receives the 3x3 CV_64F homography mapping src to des. MY_PROSAC samples the matches in increasing
+//feature_distances, CV_RANSAC and CV_LMEDS go to cv::findHomography()
+bool find_homography(const std::vector<cv::Point2f> & src, const std::vector<cv::Point2f> & des, cv::Mat* pcvmH_, int method = MY_PROSAC,
+	const std::vector<float> & feature_distances = std::vector<float>(), float reprojectionThreshold = 5.f);
+
+
+#endif
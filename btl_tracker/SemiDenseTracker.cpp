@@ -6,6 +6,7 @@
 #include <boost/scoped_ptr.hpp>
 
 #include "SemiDenseTracker.h"
+#include "Prosac.h"
 
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -270,13 +271,15 @@ void btl::image::semidense::CSemiDenseTracker::displayCandidates( cv::Mat& cvmCo
 cv::Mat btl::image::semidense::CSemiDenseTracker::calcHomography(const cv::Mat& cvmMaskCurr_, const cv::Mat& cvmMaskPrev_) {
 	std::vector<short2> vKPCurr;
 	std::vector<short2> vKPPrev;
+	std::vector<float> vDistance;
 	int nTotal = std::max( int(_uPyrHeight-2),1);
 	for( int n = 0; n< nTotal; n++ ){
 		short t = 1<<n;
 		//get keypoints
-		cv::Mat cvmKeyPointLocation, cvmKeyPointVelocity;
+		cv::Mat cvmKeyPointLocation, cvmKeyPointVelocity, cvmKeyPointResponse;
 		_cvgmMatchedKeyPointLocation[n].download(cvmKeyPointLocation);
 		_cvgmParticleVelocityCurr[n].download(cvmKeyPointVelocity);
+		_cvgmMatchedKeyPointResponse[n].download(cvmKeyPointResponse);
 
 		for (unsigned int i=0;i<_uMatchedPoints[n]; i+=1){
 			short2 s2KPCurr = cvmKeyPointLocation.ptr<short2>()[i];
@@ -288,6 +291,7 @@ cv::Mat btl::image::semidense::CSemiDenseTracker::calcHomography(const cv::Mat&
 				cvmMaskCurr_.ptr(s2KPCurr.y)[s2KPCurr.x] == 255 && cvmMaskPrev_.ptr(s2KPPrev.y)[s2KPPrev.x] ==255 ){
 					vKPPrev.push_back(s2KPPrev);
 					vKPCurr.push_back(s2KPCurr);
+					vDistance.push_back(-cvmKeyPointResponse.ptr<float>()[i]);//PROSAC samples the strongest responses first
 			}
 		}
 	}
@@ -297,16 +301,18 @@ cv::Mat btl::image::semidense::CSemiDenseTracker::calcHomography(const cv::Mat&
 		std::cout << "Not KeyPoint detected";
 		return cv::Mat();
 	}
-	cv::Mat cvmKeyPointPrev; cvmKeyPointPrev.create( 1, (int)vKPCurr.size(), CV_32FC2 );
-	cv::Mat cvmKeyPointCurr; cvmKeyPointCurr.create( 1, (int)vKPCurr.size(), CV_32FC2 );
+	std::vector<cv::Point2f> vKeyPointPrev( vKPCurr.size() );
+	std::vector<cv::Point2f> vKeyPointCurr( vKPCurr.size() );
 	std::vector<short2>::iterator itC = vKPCurr.begin();
 	std::vector<short2>::iterator itP = vKPPrev.begin();
-	for (int i=0;i<cvmKeyPointCurr.cols; i++,itC++,itP++){
-		cvmKeyPointCurr.ptr<float2>()[i] = convert2f2(*itC);
-		cvmKeyPointPrev.ptr<float2>()[i] = convert2f2(*itP);
+	for (size_t i=0;i<vKeyPointCurr.size(); i++,itC++,itP++){
+		vKeyPointCurr[i] = cv::Point2f( itC->x, itC->y );
+		vKeyPointPrev[i] = cv::Point2f( itP->x, itP->y );
 	}
-	//calc Homography
-	return cv::findHomography(cvmKeyPointPrev,cvmKeyPointCurr,CV_RANSAC,1);
+	//calc Homography, the L1 threshold of 1.5 pixel is about the 1 pixel Euclidean one of cv::findHomography()
+	cv::Mat cvmHomography;
+	if( !find_homography(vKeyPointPrev,vKeyPointCurr,&cvmHomography,MY_PROSAC,vDistance,1.5f) ) return cv::Mat();
+	return cvmHomography;
 }
 
 void btl::image::semidense::CSemiDenseTracker::display(cv::Mat& cvmColorFrame_) {
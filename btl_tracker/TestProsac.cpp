@@ -0,0 +1,60 @@
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "Prosac.h"
+#include "TestProsac.h"
+
+//a known homography, 30% of the matches replaced by outliers and the rest within half a pixel of it.
+//PROSAC and RANSAC must flag every true inlier and map the inliers within the noise
+void testProsacHomography()
+{
+	const float afH[9] = { 1.05f, -.08f, 12.f, .06f, .97f, -9.f, 6e-5f, -4e-5f, 1.f };
+	const int nMatches = 400;
+	const float fNoise = .5f, fThreshold = 5.f;
+	const int anMethod[2] = { MY_PROSAC, MY_RANSAC };
+	for (int m = 0; m < 2; m++)
+	for (int t = 0; t < 2; t++){
+		cv::RNG cRNG( 7 + m );
+		std::vector<MatchedPoint> vMatches(nMatches);
+		for (int i = 0; i < nMatches; i++){
+			const cv::Point2f pRef( cRNG.uniform(0.f,640.f), cRNG.uniform(0.f,480.f) );
+			const float fZ = afH[6]*pRef.x + afH[7]*pRef.y + afH[8];
+			cv::Point2f pScene( (afH[0]*pRef.x + afH[1]*pRef.y + afH[2])/fZ, (afH[3]*pRef.x + afH[4]*pRef.y + afH[5])/fZ );
+			if (cRNG.uniform(0,10) >= 3) pScene += cv::Point2f( cRNG.uniform(-fNoise,fNoise), cRNG.uniform(-fNoise,fNoise) );
+			else                         pScene  = cv::Point2f( cRNG.uniform(0.f,640.f), cRNG.uniform(0.f,480.f) );
+			//an outlier that lands on the model is an inlier. the feature distances loosely favour the inliers,
+			//as the descriptor distances of a real matcher
+			const bool bInlier = FindHomography::ComputeReprojError( pRef, pScene, afH ) < fThreshold - 2*fNoise;
+			vMatches[i] = MatchedPoint( pScene, pRef, cRNG.uniform(0.f,1.f) + (bInlier ? 0.f : .5f) );
+		}
+		FindPROSACHomography cProsac;
+		cProsac.method = anMethod[m];
+		cProsac.multiThread = t == 1;
+		cProsac.SetReprojectionThreshold( fThreshold );
+		cProsac.SetTimeout( 1000. );
+		cProsac.AttatchMatchedPoints( &vMatches );
+		CV_Assert( cProsac.Calculate() );
+		//every true inlier is found, an accepted outlier must be consistent with the model.
+		//Calculate() sorts the matches and merges the near duplicates
+		float fMaxErr = 0.f;
+		int nFound = 0, nInliers = 0;
+		for (size_t i = 0; i < vMatches.size(); i++){
+			const float fErr = FindHomography::ComputeReprojError( vMatches[i].pointReference, vMatches[i].pointScene, cProsac.homography );
+			const bool bTrue = FindHomography::ComputeReprojError( vMatches[i].pointReference, vMatches[i].pointScene, afH ) < fThreshold - 2*fNoise;
+			CV_Assert( !bTrue || vMatches[i].isInlier );
+			CV_Assert( vMatches[i].isInlier == (fErr < fThreshold) );
+			if (bTrue) { fMaxErr = std::max( fMaxErr, fErr ); nInliers++; }
+			nFound += vMatches[i].isInlier ? 1 : 0;
+		}
+		CV_Assert( cProsac.inlierCount == nFound && nFound >= nInliers && nFound < nInliers + nMatches/20 && nInliers > nMatches/2 );
+		CV_Assert( fMaxErr < 4*fNoise );
+		//the model itself within a pixel over the image
+		for (float y = 0.f; y <= 480.f; y += 80.f)
+		for (float x = 0.f; x <= 640.f; x += 80.f){
+			const float fZ = afH[6]*x + afH[7]*y + afH[8];
+			const cv::Point2f pTrue( (afH[0]*x + afH[1]*y + afH[2])/fZ, (afH[3]*x + afH[4]*y + afH[5])/fZ );
+			CV_Assert( FindHomography::ComputeReprojError( cv::Point2f(x,y), pTrue, cProsac.homography ) < 1.f );
+		}
+	}
+}
@@ -0,0 +1 @@
+void testProsacHomography();
\ No newline at end of file